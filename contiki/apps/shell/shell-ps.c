@@ -50,6 +50,13 @@ SHELL_COMMAND(ps_command,
 	      "ps",
 	      "ps: list all running processes",
 	      &shell_ps_process);
+#if PROCESS_CONF_PROFILE
+PROCESS(shell_pstat_process, "pstat");
+SHELL_COMMAND(pstat_command,
+	      "pstat",
+	      "pstat [reset]: show (or clear) run times and event latencies of the processes",
+	      &shell_pstat_process);
+#endif /* PROCESS_CONF_PROFILE */
 /*---------------------------------------------------------------------------*/
 PROCESS_THREAD(shell_ps_process, ev, data)
 {
@@ -66,9 +73,43 @@ PROCESS_THREAD(shell_ps_process, ev, data)
   PROCESS_END();
 }
 /*---------------------------------------------------------------------------*/
+#if PROCESS_CONF_PROFILE
+PROCESS_THREAD(shell_pstat_process, ev, data)
+{
+  struct process *p;
+  const struct process_profile *pr;
+  char buf[80];
+  PROCESS_BEGIN();
+
+  if(data != NULL && strncmp(data, "reset", 5) == 0) {
+    process_profile_reset();
+    PROCESS_EXIT();
+  }
+
+  snprintf(buf, sizeof(buf), "%lu ticks/s", (unsigned long)RTIMER_SECOND);
+  shell_output_str(&pstat_command, "Run time and event latency in rtimer ticks, ", buf);
+  shell_output_str(&pstat_command,
+                   "runs total max (event) avg | events avg-latency max-latency: name", "");
+  for(p = PROCESS_LIST(); p != NULL; p = p->next) {
+    pr = &p->profile;
+    snprintf(buf, sizeof(buf), "%lu %lu %u (%u) %lu | %lu %lu %u: ",
+             pr->runs, pr->time, (unsigned)pr->max_time,
+             (unsigned)pr->max_event, pr->runs ? pr->time / pr->runs : 0,
+             pr->events, pr->events ? pr->latency / pr->events : 0,
+             (unsigned)pr->max_latency);
+    shell_output_str(&pstat_command, buf, PROCESS_NAME_STRING(p));
+  }
+
+  PROCESS_END();
+}
+#endif /* PROCESS_CONF_PROFILE */
+/*---------------------------------------------------------------------------*/
 void
 shell_ps_init(void)
 {
   shell_register_command(&ps_command);
+#if PROCESS_CONF_PROFILE
+  shell_register_command(&pstat_command);
+#endif /* PROCESS_CONF_PROFILE */
 }
 /*---------------------------------------------------------------------------*/
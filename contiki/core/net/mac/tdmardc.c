@@ -0,0 +1,442 @@
+/*
+ * Copyright (c) 2012, TU Dortmund University.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following
+ *    disclaimer in the documentation and/or other materials provided
+ *    with the distribution.
+ * 3. The name of the author may not be used to endorse or promote
+ *    products derived from this software without specific prior
+ *    written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS
+ * OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+ * GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ *
+ */
+
+/**
+ * \file
+ *         A TDMA RDC driver driven by a schedule table
+ *
+ *         An rtimer fires at every slot boundary and, in TX and shared
+ *         slots, once more when the guard time is over. The timer only
+ *         keeps track of the slot; tdmardc_process switches the radio
+ *         and sends the queued frames, so any radio driver can be used.
+ */
+
+#include "contiki.h"
+#include "net/mac/tdmardc.h"
+#include "net/packetbuf.h"
+#include "net/queuebuf.h"
+#include "net/netstack.h"
+#include "lib/list.h"
+#include "lib/memb.h"
+#include <string.h>
+
+#define DEBUG 0
+#if DEBUG
+#include <stdio.h>
+#define PRINTF(...) printf(__VA_ARGS__)
+#else
+#define PRINTF(...)
+#endif
+
+#ifdef TDMARDC_CONF_QUEUE_SIZE
+#define TDMARDC_QUEUE_SIZE TDMARDC_CONF_QUEUE_SIZE
+#else
+#define TDMARDC_QUEUE_SIZE 8
+#endif /* TDMARDC_CONF_QUEUE_SIZE */
+
+/* Schedule used until tdmardc_set_schedule() is called: one shared slot */
+#ifdef TDMARDC_CONF_SLOT_LENGTH
+#define TDMARDC_SLOT_LENGTH TDMARDC_CONF_SLOT_LENGTH
+#else
+#define TDMARDC_SLOT_LENGTH (RTIMER_SECOND / 50)
+#endif /* TDMARDC_CONF_SLOT_LENGTH */
+
+#ifdef TDMARDC_CONF_GUARD_TIME
+#define TDMARDC_GUARD_TIME TDMARDC_CONF_GUARD_TIME
+#else
+#define TDMARDC_GUARD_TIME (TDMARDC_SLOT_LENGTH / 10)
+#endif /* TDMARDC_CONF_GUARD_TIME */
+
+/* The radio API has no channel setter, a platform maps this to its radio
+   (e.g. cc2420_set_channel). Without it the slot channels are ignored. */
+#ifdef TDMARDC_CONF_SET_CHANNEL
+#define TDMARDC_SET_CHANNEL(c) TDMARDC_CONF_SET_CHANNEL(c)
+#else
+#define TDMARDC_SET_CHANNEL(c)
+#endif /* TDMARDC_CONF_SET_CHANNEL */
+
+#ifdef TDMARDC_CONF_ADDRESS_FILTER
+#define TDMARDC_ADDRESS_FILTER TDMARDC_CONF_ADDRESS_FILTER
+#else
+#define TDMARDC_ADDRESS_FILTER 1
+#endif /* TDMARDC_CONF_ADDRESS_FILTER */
+
+struct tdmardc_packet {
+  struct tdmardc_packet *next;
+  struct queuebuf *buf;
+  mac_callback_t sent;
+  void *ptr;
+};
+
+MEMB(packet_memb, struct tdmardc_packet, TDMARDC_QUEUE_SIZE);
+LIST(packet_list);
+
+static const struct tdmardc_slot default_slots[] = {
+  { TDMARDC_SLOT_SHARED, 0 }
+};
+static const struct tdmardc_schedule default_schedule = {
+  TDMARDC_SLOT_LENGTH, TDMARDC_GUARD_TIME, 1, default_slots
+};
+
+/* written by the thread, taken by the slot timer */
+static const struct tdmardc_schedule *volatile new_schedule;
+static volatile uint8_t resync;
+static rtimer_clock_t sync_start;
+
+/* written by the slot timer */
+static const struct tdmardc_schedule *volatile schedule = &default_schedule;
+static volatile uint8_t slot;
+static volatile rtimer_clock_t slot_start;
+static volatile uint8_t slot_seq;       /* counts the slot boundaries */
+static volatile uint8_t tx_window;      /* guard time of a TX/shared slot over */
+static uint8_t tx_point;                /* timer set to the end of the guard time */
+static volatile uint8_t timer_on;
+
+static struct rtimer rt;
+static volatile uint8_t running;
+static uint8_t radio_is_on;
+
+PROCESS(tdmardc_process, "TDMA RDC");
+
+/*---------------------------------------------------------------------------*/
+static uint8_t
+may_transmit(uint8_t type)
+{
+  return type == TDMARDC_SLOT_TX || type == TDMARDC_SLOT_SHARED;
+}
+/*---------------------------------------------------------------------------*/
+static void
+next_slot(rtimer_clock_t boundary)
+{
+  rtimer_clock_t now = RTIMER_NOW();
+  rtimer_clock_t elapsed;
+
+  if(new_schedule != NULL) {
+    schedule = new_schedule;
+    new_schedule = NULL;
+    if(!resync) {
+      sync_start = boundary;
+      resync = 1;
+    }
+  }
+
+  if(resync) {
+    resync = 0;
+    while(RTIMER_CLOCK_LT(now, sync_start)) {
+      sync_start -= schedule->slot_length * schedule->num_slots;
+    }
+    elapsed = now - sync_start;
+    slot = (elapsed / schedule->slot_length) % schedule->num_slots;
+    slot_start = now - elapsed % schedule->slot_length;
+  } else {
+    slot_start = boundary;
+    slot = (slot + 1) % schedule->num_slots;
+    /* skip the slots that are already over */
+    while(!RTIMER_CLOCK_LT(now, slot_start + schedule->slot_length)) {
+      slot_start += schedule->slot_length;
+      slot = (slot + 1) % schedule->num_slots;
+    }
+  }
+  slot_seq++;
+  tx_window = 0;
+}
+/*---------------------------------------------------------------------------*/
+static void
+slot_timer(struct rtimer *t, void *ptr)
+{
+  rtimer_clock_t guard_end;
+
+  if(!running) {
+    timer_on = 0;
+    return;
+  }
+
+  if(tx_point) {
+    tx_point = 0;
+    tx_window = 1;
+  } else {
+    next_slot(RTIMER_TIME(t));
+    if(may_transmit(schedule->slots[slot].type)) {
+      guard_end = slot_start + schedule->guard_time;
+      if(RTIMER_CLOCK_LT(RTIMER_NOW(), guard_end)) {
+        tx_point = 1;
+        process_poll(&tdmardc_process);
+        rtimer_set(t, guard_end, 1, slot_timer, NULL);
+        return;
+      }
+      tx_window = 1;
+    }
+  }
+  process_poll(&tdmardc_process);
+  rtimer_set(t, slot_start + schedule->slot_length, 1, slot_timer, NULL);
+}
+/*---------------------------------------------------------------------------*/
+static void
+configure_radio(const struct tdmardc_slot *s)
+{
+  if(s->channel != 0) {
+    TDMARDC_SET_CHANNEL(s->channel);
+  }
+  if(s->type == TDMARDC_SLOT_OFF) {
+    if(radio_is_on) {
+      NETSTACK_RADIO.off();
+      radio_is_on = 0;
+    }
+  } else if(!radio_is_on) {
+    NETSTACK_RADIO.on();
+    radio_is_on = 1;
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+transmit(uint8_t type)
+{
+  struct tdmardc_packet *p;
+  mac_callback_t sent;
+  void *ptr;
+  int ret;
+
+  while(tx_window && (p = list_head(packet_list)) != NULL) {
+    /* the frame has to start before the guard time at the end */
+    if(!RTIMER_CLOCK_LT(RTIMER_NOW(), slot_start + schedule->slot_length -
+                        schedule->guard_time)) {
+      break;
+    }
+    if(type == TDMARDC_SLOT_SHARED && NETSTACK_RADIO.channel_clear() == 0) {
+      PRINTF("tdmardc: shared slot %u busy\n", slot);
+      break;
+    }
+
+    queuebuf_to_packetbuf(p->buf);
+    switch(NETSTACK_RADIO.send(packetbuf_hdrptr(), packetbuf_totlen())) {
+    case RADIO_TX_OK:
+      ret = MAC_TX_OK;
+      break;
+    case RADIO_TX_COLLISION:
+      ret = MAC_TX_COLLISION;
+      break;
+    case RADIO_TX_NOACK:
+      ret = MAC_TX_NOACK;
+      break;
+    default:
+      ret = MAC_TX_ERR;
+      break;
+    }
+
+    /* the callback may queue the next frame */
+    sent = p->sent;
+    ptr = p->ptr;
+    list_remove(packet_list, p);
+    queuebuf_free(p->buf);
+    memb_free(&packet_memb, p);
+    mac_call_sent_callback(sent, ptr, ret, 1);
+
+    if(type == TDMARDC_SLOT_SHARED) {
+      /* one frame per node and shared slot */
+      break;
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(tdmardc_process, ev, data)
+{
+  static uint8_t configured_seq;
+  const struct tdmardc_slot *s;
+
+  PROCESS_BEGIN();
+
+  configured_seq = slot_seq - 1;
+
+  while(1) {
+    PROCESS_YIELD_UNTIL(ev == PROCESS_EVENT_POLL);
+    if(!running) {
+      continue;
+    }
+
+    s = &schedule->slots[slot];
+    if(configured_seq != slot_seq) {
+      configured_seq = slot_seq;
+      configure_radio(s);
+    }
+    if(tx_window) {
+      transmit(s->type);
+    }
+  }
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
+static void
+send_packet(mac_callback_t sent, void *ptr)
+{
+  struct tdmardc_packet *p;
+
+  packetbuf_set_addr(PACKETBUF_ADDR_SENDER, &rimeaddr_node_addr);
+
+  if(NETSTACK_FRAMER.create() < 0) {
+    PRINTF("tdmardc: send failed, too large header\n");
+    mac_call_sent_callback(sent, ptr, MAC_TX_ERR_FATAL, 1);
+    return;
+  }
+
+  p = memb_alloc(&packet_memb);
+  if(p == NULL) {
+    PRINTF("tdmardc: queue full\n");
+    mac_call_sent_callback(sent, ptr, MAC_TX_ERR, 1);
+    return;
+  }
+  p->buf = queuebuf_new_from_packetbuf();
+  if(p->buf == NULL) {
+    PRINTF("tdmardc: no queuebuf\n");
+    memb_free(&packet_memb, p);
+    mac_call_sent_callback(sent, ptr, MAC_TX_ERR, 1);
+    return;
+  }
+  p->sent = sent;
+  p->ptr = ptr;
+  list_add(packet_list, p);
+
+  /* still time left in the current slot */
+  process_poll(&tdmardc_process);
+}
+/*---------------------------------------------------------------------------*/
+static void
+send_list(mac_callback_t sent, void *ptr, struct rdc_buf_list *buf_list)
+{
+  if(buf_list != NULL) {
+    queuebuf_to_packetbuf(buf_list->buf);
+    send_packet(sent, ptr);
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+packet_input(void)
+{
+  if(NETSTACK_FRAMER.parse() < 0) {
+    PRINTF("tdmardc: failed to parse %u\n", packetbuf_datalen());
+#if TDMARDC_ADDRESS_FILTER
+  } else if(!rimeaddr_cmp(packetbuf_addr(PACKETBUF_ADDR_RECEIVER),
+                          &rimeaddr_node_addr) &&
+            !rimeaddr_cmp(packetbuf_addr(PACKETBUF_ADDR_RECEIVER),
+                          &rimeaddr_null)) {
+    PRINTF("tdmardc: not for us\n");
+#endif /* TDMARDC_ADDRESS_FILTER */
+  } else {
+    NETSTACK_MAC.input();
+  }
+}
+/*---------------------------------------------------------------------------*/
+static int
+on(void)
+{
+  if(!running) {
+    if(!resync) {
+      /* start with slot 0 */
+      sync_start = RTIMER_NOW() + 1;
+      resync = 1;
+    }
+    running = 1;
+    if(!timer_on) {
+      timer_on = 1;
+      tx_point = 0;
+      rtimer_set(&rt, RTIMER_NOW() + 1, 1, slot_timer, NULL);
+    }
+  }
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+static int
+off(int keep_radio_on)
+{
+  running = 0;
+  tx_window = 0;
+  if(keep_radio_on) {
+    radio_is_on = 1;
+    return NETSTACK_RADIO.on();
+  } else {
+    radio_is_on = 0;
+    return NETSTACK_RADIO.off();
+  }
+}
+/*---------------------------------------------------------------------------*/
+static unsigned short
+channel_check_interval(void)
+{
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+static void
+init(void)
+{
+  memb_init(&packet_memb);
+  list_init(packet_list);
+  process_set_prio(&tdmardc_process, PROCESS_PRIO_HIGH);
+  process_start(&tdmardc_process, NULL);
+  on();
+}
+/*---------------------------------------------------------------------------*/
+int
+tdmardc_set_schedule(const struct tdmardc_schedule *s)
+{
+  if(s == NULL || s->num_slots == 0 || s->slots == NULL ||
+     s->slot_length == 0 || 2 * s->guard_time >= s->slot_length) {
+    return -1;
+  }
+  new_schedule = s;
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+void
+tdmardc_sync(rtimer_clock_t frame_start)
+{
+  sync_start = frame_start;
+  resync = 1;
+}
+/*---------------------------------------------------------------------------*/
+int
+tdmardc_current_slot(void)
+{
+  return running ? slot : -1;
+}
+/*---------------------------------------------------------------------------*/
+const struct rdc_driver tdmardc_driver = {
+  "tdmardc",
+  init,
+  send_packet,
+  send_list,
+  packet_input,
+  on,
+  off,
+  channel_check_interval,
+};
+/*---------------------------------------------------------------------------*/
@@ -0,0 +1,92 @@
+/*
+ * Copyright (c) 2012, TU Dortmund University.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following
+ *    disclaimer in the documentation and/or other materials provided
+ *    with the distribution.
+ * 3. The name of the author may not be used to endorse or promote
+ *    products derived from this software without specific prior
+ *    written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS
+ * OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+ * GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ *
+ */
+
+/**
+ * \file
+ *         A TDMA RDC driver driven by a schedule table
+ *
+ *         Time is divided into frames of num_slots slots. Each node loads
+ *         its own view of the schedule: per slot whether it transmits,
+ *         listens, shares the slot with other nodes or keeps the radio
+ *         off, and on which channel. Frames from the upper layers are
+ *         queued until the next slot they may go out in.
+ */
+
+#ifndef __TDMARDC_H__
+#define __TDMARDC_H__
+
+#include "net/mac/rdc.h"
+#include "sys/rtimer.h"
+
+#define TDMARDC_SLOT_OFF      0 /**< radio off */
+#define TDMARDC_SLOT_RX       1 /**< listen */
+#define TDMARDC_SLOT_TX       2 /**< this node owns the slot and sends all
+                                     queued frames that fit */
+#define TDMARDC_SLOT_SHARED   3 /**< listen, every node may send one frame
+                                     after a clear channel assessment, e.g.
+                                     for broadcasts */
+
+struct tdmardc_slot {
+  uint8_t type;         /**< TDMARDC_SLOT_* */
+  uint8_t channel;      /**< channel of the slot, 0 keeps the channel */
+};
+
+struct tdmardc_schedule {
+  rtimer_clock_t slot_length;
+  rtimer_clock_t guard_time;  /**< no transmission within guard_time of
+                                   the slot boundaries */
+  uint8_t num_slots;
+  const struct tdmardc_slot *slots;
+};
+
+extern const struct rdc_driver tdmardc_driver;
+
+/**
+ * Load a schedule. It takes effect at the next slot boundary, which starts
+ * slot 0 unless tdmardc_sync() aligns the frame. The table is not copied.
+ * \return 0, or -1 if the schedule is invalid
+ */
+int tdmardc_set_schedule(const struct tdmardc_schedule *schedule);
+
+/**
+ * Align the frames, slot 0 of a frame started (or starts) at frame_start.
+ * Applied at the next slot boundary.
+ */
+void tdmardc_sync(rtimer_clock_t frame_start);
+
+/**
+ * \return the current slot, or -1 while the driver is off
+ */
+int tdmardc_current_slot(void);
+
+#endif /* __TDMARDC_H__ */
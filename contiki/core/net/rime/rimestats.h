@@ -51,7 +51,8 @@ struct rimestats {
   unsigned long toolong, tooshort, badsynch, badcrc;
 
   unsigned long contentiondrop, /* Packet dropped due to contention */
-    sendingdrop; /* Packet dropped when we were sending a packet */
+    sendingdrop, /* Packet dropped when we were sending a packet */
+    overrun; /* Packet dropped because the radio driver had no free receive buffer */
 
   unsigned long lltx, llrx;
 };
@@ -98,7 +98,7 @@ rpl_remove_routes_by_nexthop(uip_ipaddr_t *nexthop, rpl_dag_t *dag)
     if(locroute->isused
         && uip_ipaddr_cmp(&locroute->nexthop, nexthop)
         && locroute->state.dag == dag) {
-      locroute->isused = 0;
+      uip_ds6_route_rm(locroute);
     }
   }
   ANNOTATE("#L %u 0\n",nexthop->u8[sizeof(uip_ipaddr_t) - 1]);
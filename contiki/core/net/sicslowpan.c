@@ -218,40 +218,71 @@ static uint8_t uncomp_hdr_len;
 static int last_tx_status;
 /** @} */
 
+#if UIP_STATISTICS == 1
+struct sicslowpan_stats sicslowpan_stats;
+#endif /* UIP_STATISTICS == 1 */
+
 #if SICSLOWPAN_CONF_FRAG
 /** \name Fragmentation related variables
  *  @{
  */
 
-static uint16_t sicslowpan_len;
+/** Datagram tag to be put in the fragments I send. */
+static uint16_t my_tag;
 
 /**
- * The buffer used for the 6lowpan reassembly.
- * This buffer contains only the IPv6 packet (no MAC header, 6lowpan, etc).
- * It has a fix size as we do not use dynamic memory allocation.
+ * A datagram being reassembled. The buffer contains only the IPv6 packet
+ * (no MAC header, 6lowpan, etc). There is a fix number of contexts as we
+ * do not use dynamic memory allocation.
  */
-static uip_buf_t sicslowpan_aligned_buf;
-#define sicslowpan_buf (sicslowpan_aligned_buf.u8)
+struct reass_context {
+  uip_buf_t buf;
+  /** The source address, the tag and the size in the fragments being
+      merged, the size is 0 while the context is free. A context that
+      has all blocks keeps them until it is taken for another packet or
+      times out, so late duplicates are not taken for a new packet. */
+  rimeaddr_t sender;
+  uint16_t tag;
+  uint16_t size;
+  /** One bit per 8 byte block of the IPv6 packet received so far. */
+  uint8_t received[((UIP_BUFSIZE + 7) / 8 + 7) / 8];
+  uint16_t blocks;
+  /** Reassembly %process %timer. */
+  struct timer timer;
+};
 
-/** The total length of the IPv6 packet in the sicslowpan_buf. */
+static struct reass_context reass_contexts[SICSLOWPAN_REASS_CONTEXTS];
 
+#if SICSLOWPAN_FRAG_FORWARD
+#if !UIP_CONF_ROUTER
+#error SICSLOWPAN_CONF_FRAG_FORWARD needs UIP_CONF_ROUTER
+#endif /* !UIP_CONF_ROUTER */
 /**
- * length of the ip packet already sent / received.
- * It includes IP and transport headers.
+ * A packet forwarded fragment by fragment. The first fragment maps the
+ * source address, the tag and the size of the received fragments to the
+ * next hop and the tag of the fragments sent.
  */
-static uint16_t processed_ip_in_len;
-
-/** Datagram tag to be put in the fragments I send. */
-static uint16_t my_tag;
-
-/** When reassembling, the tag in the fragments being merged. */
-static uint16_t reass_tag;
+struct frag_forward {
+  /** Same as in struct reass_context, the size is 0 while free. */
+  rimeaddr_t sender;
+  uint16_t tag;
+  uint16_t size;
+  rimeaddr_t nexthop;
+  uint16_t nexthop_tag;
+  /** The bytes of the IPv6 packet forwarded so far. */
+  uint16_t forwarded;
+  struct timer timer;
+};
 
-/** When reassembling, the source address of the fragments being merged */
-rimeaddr_t frag_sender;
+static struct frag_forward frag_forwards[SICSLOWPAN_FRAG_FORWARD];
+#endif /* SICSLOWPAN_FRAG_FORWARD */
 
-/** Reassembly %process %timer. */
-static struct timer reass_timer;
+/**
+ * The buffer a received packet is uncompressed into: uip_buf if it is
+ * not fragmented, the buffer of its reassembly context otherwise.
+ */
+static uint8_t *sicslowpan_buf;
+#define sicslowpan_len uip_len
 
 /** @} */
 #else /* SICSLOWPAN_CONF_FRAG */
@@ -1344,6 +1375,25 @@ send_packet(rimeaddr_t *dest)
   watchdog_periodic();
 }
 /*--------------------------------------------------------------------*/
+/**
+ * \brief Compress the header of the IP packet in uip_buf with the
+ * configured compression scheme
+ * \param dest the link layer destination address of the packet
+ */
+static void
+compress_hdr(rimeaddr_t *dest)
+{
+#if SICSLOWPAN_COMPRESSION == SICSLOWPAN_COMPRESSION_HC1
+  compress_hdr_hc1(dest);
+#endif /* SICSLOWPAN_COMPRESSION == SICSLOWPAN_COMPRESSION_HC1 */
+#if SICSLOWPAN_COMPRESSION == SICSLOWPAN_COMPRESSION_IPV6
+  compress_hdr_ipv6(dest);
+#endif /* SICSLOWPAN_COMPRESSION == SICSLOWPAN_COMPRESSION_IPV6 */
+#if SICSLOWPAN_COMPRESSION == SICSLOWPAN_COMPRESSION_HC06
+  compress_hdr_hc06(dest);
+#endif /* SICSLOWPAN_COMPRESSION == SICSLOWPAN_COMPRESSION_HC06 */
+}
+/*--------------------------------------------------------------------*/
 /** \brief Take an IP packet and format it to be sent on an 802.15.4
  *  network using 6lowpan.
  *  \param localdest The MAC address of the destination
@@ -1409,15 +1459,7 @@ output(uip_lladdr_t *localdest)
 
   if(uip_len >= COMPRESSION_THRESHOLD) {
     /* Try to compress the headers */
-#if SICSLOWPAN_COMPRESSION == SICSLOWPAN_COMPRESSION_HC1
-    compress_hdr_hc1(&dest);
-#endif /* SICSLOWPAN_COMPRESSION == SICSLOWPAN_COMPRESSION_HC1 */
-#if SICSLOWPAN_COMPRESSION == SICSLOWPAN_COMPRESSION_IPV6
-    compress_hdr_ipv6(&dest);
-#endif /* SICSLOWPAN_COMPRESSION == SICSLOWPAN_COMPRESSION_IPV6 */
-#if SICSLOWPAN_COMPRESSION == SICSLOWPAN_COMPRESSION_HC06
-    compress_hdr_hc06(&dest);
-#endif /* SICSLOWPAN_COMPRESSION == SICSLOWPAN_COMPRESSION_HC06 */
+    compress_hdr(&dest);
   } else {
     compress_hdr_ipv6(&dest);
   }
@@ -1543,15 +1585,329 @@ output(uip_lladdr_t *localdest)
   return 1;
 }
 
+#if SICSLOWPAN_CONF_FRAG
+/*--------------------------------------------------------------------*/
+/**
+ * \brief Find the reassembly context of a fragment or take a free one.
+ * \param tag The datagram tag of the fragment
+ * \param size The datagram size of the fragment
+ * \return The context, NULL if all contexts are busy or the packet has
+ * been reassembled already
+ *
+ * A context belongs to the source address, the tag and the size in the
+ * fragment headers. Contexts whose timer expired are freed on the way, a
+ * free context is taken before one of a reassembled packet. A packet
+ * that lost a fragment would keep its context busy until it times out,
+ * so when all contexts are busy an unfinished packet is given up for a
+ * new one: one of the same sender, which has gone on to another packet,
+ * else the oldest one if it is half way to its timeout. The oldest
+ * packet is not given up sooner, or packets would take the contexts
+ * from each other when there are more senders than contexts.
+ */
+static struct reass_context *
+reass_context(uint16_t tag, uint16_t size)
+{
+  struct reass_context *c, *unused = NULL, *stale = NULL, *oldest = NULL;
+  const rimeaddr_t *sender = packetbuf_addr(PACKETBUF_ADDR_SENDER);
+
+  for(c = reass_contexts; c < &reass_contexts[SICSLOWPAN_REASS_CONTEXTS]; c++) {
+    if(c->size > 0 && timer_expired(&c->timer)) {
+      if(c->blocks < (c->size + 7) >> 3) {
+        /* reassembly timed out, cancel it */
+        PRINTFI("sicslowpan input: reassembly timed out (len %d, tag %d)\n",
+                c->size, c->tag);
+        UIP_STAT(++sicslowpan_stats.reass_timeout);
+      }
+      c->size = 0;
+    }
+    if(c->size == 0) {
+      if(unused == NULL || unused->size > 0) {
+        unused = c;
+      }
+    } else if(c->size == size && c->tag == tag &&
+              rimeaddr_cmp(&c->sender, sender)) {
+      if(c->blocks == (size + 7) >> 3) {
+        PRINTFI("sicslowpan input: Dropping fragment of a reassembled packet\n");
+        UIP_STAT(++sicslowpan_stats.reass_duplicate);
+        return NULL;
+      }
+      return c;
+    } else if(c->blocks == (c->size + 7) >> 3) {
+      if(unused == NULL) {
+        unused = c;
+      }
+    } else if(rimeaddr_cmp(&c->sender, sender)) {
+      stale = c;
+    } else if(oldest == NULL || timer_remaining(&c->timer) <
+                                timer_remaining(&oldest->timer)) {
+      oldest = c;
+    }
+  }
+
+  if(unused == NULL) {
+    if(stale != NULL) {
+      unused = stale;
+    } else if(oldest != NULL && timer_remaining(&oldest->timer) <
+              SICSLOWPAN_REASS_MAXAGE * CLOCK_SECOND / 2) {
+      unused = oldest;
+    }
+    if(unused != NULL) {
+      PRINTFI("sicslowpan input: reassembly given up (len %d, tag %d)\n",
+              unused->size, unused->tag);
+      UIP_STAT(++sicslowpan_stats.reass_timeout);
+    }
+  }
+  if(unused == NULL) {
+    PRINTFI("sicslowpan input: Dropping fragment, all reassembly contexts are busy\n");
+    UIP_STAT(++sicslowpan_stats.reass_nocontext);
+    return NULL;
+  }
+  unused->size = size;
+  unused->tag = tag;
+  rimeaddr_copy(&unused->sender, sender);
+  memset(unused->received, 0, sizeof(unused->received));
+  unused->blocks = 0;
+  timer_set(&unused->timer, SICSLOWPAN_REASS_MAXAGE * CLOCK_SECOND);
+  PRINTFI("sicslowpan input: INIT FRAGMENTATION (len %d, tag %d)\n",
+          size, tag);
+  UIP_STAT(++sicslowpan_stats.reass_started);
+  return unused;
+}
+#if SICSLOWPAN_FRAG_FORWARD
+/*--------------------------------------------------------------------*/
+/**
+ * \brief Check whether a fragment belongs to a packet being reassembled.
+ * \param tag The datagram tag of the fragment
+ * \param size The datagram size of the fragment
+ * \return 1 if the packet has a reassembly context, 0 if not
+ *
+ * A subsequent fragment that came in before the first one opened a
+ * context, the first fragment must go there instead of being forwarded.
+ */
+static uint8_t
+reass_pending(uint16_t tag, uint16_t size)
+{
+  struct reass_context *c;
+  const rimeaddr_t *sender = packetbuf_addr(PACKETBUF_ADDR_SENDER);
+
+  for(c = reass_contexts; c < &reass_contexts[SICSLOWPAN_REASS_CONTEXTS]; c++) {
+    if(c->size == size && c->tag == tag && !timer_expired(&c->timer) &&
+       rimeaddr_cmp(&c->sender, sender)) {
+      return 1;
+    }
+  }
+  return 0;
+}
+/*--------------------------------------------------------------------*/
+/**
+ * \brief Find the forwarding entry of a fragment, or take a free one.
+ * \param tag The datagram tag of the fragment
+ * \param size The datagram size of the fragment
+ * \param take Whether to take a free entry if there is none yet
+ * \return The entry, NULL if there is none
+ *
+ * Like the reassembly contexts, an entry that forwarded the whole packet
+ * is kept until it is taken for another packet or times out.
+ */
+static struct frag_forward *
+forward_entry(uint16_t tag, uint16_t size, uint8_t take)
+{
+  struct frag_forward *f, *unused = NULL;
+  const rimeaddr_t *sender = packetbuf_addr(PACKETBUF_ADDR_SENDER);
+
+  for(f = frag_forwards; f < &frag_forwards[SICSLOWPAN_FRAG_FORWARD]; f++) {
+    if(f->size > 0 && timer_expired(&f->timer)) {
+      f->size = 0;
+    }
+    if(f->size == 0) {
+      if(unused == NULL || unused->size > 0) {
+        unused = f;
+      }
+    } else if(f->size == size && f->tag == tag &&
+              rimeaddr_cmp(&f->sender, sender)) {
+      return f;
+    } else if(unused == NULL && f->forwarded >= f->size) {
+      unused = f;
+    }
+  }
+
+  if(!take || unused == NULL) {
+    return NULL;
+  }
+  unused->size = size;
+  unused->tag = tag;
+  rimeaddr_copy(&unused->sender, sender);
+  unused->nexthop_tag = my_tag++;
+  unused->forwarded = 0;
+  timer_set(&unused->timer, SICSLOWPAN_REASS_MAXAGE * CLOCK_SECOND);
+  return unused;
+}
+/*--------------------------------------------------------------------*/
+/**
+ * \brief Send a fragment to the next hop of its packet.
+ * \param frame The fragment, not in packetbuf
+ * \param len The length of the fragment
+ * \param f The forwarding entry of the packet
+ */
+static void
+forward_send(uint8_t *frame, uint16_t len, struct frag_forward *f)
+{
+  packetbuf_clear();
+  packetbuf_copyfrom(frame, len);
+  packetbuf_set_attr(PACKETBUF_ATTR_MAX_MAC_TRANSMISSIONS,
+                     SICSLOWPAN_MAX_MAC_TRANSMISSIONS);
+  UIP_STAT(++sicslowpan_stats.frag_forwarded);
+  send_packet(&f->nexthop);
+}
+/*--------------------------------------------------------------------*/
+/**
+ * \brief Forward a first fragment if the packet is for another node.
+ * \param tag The datagram tag of the fragment
+ * \param size The datagram size of the fragment
+ * \return 1 if the fragment was forwarded or is a duplicate, 0 if the
+ * packet is to be reassembled
+ *
+ * The IP header of the fragment has been uncompressed into uip_buf. The
+ * header is compressed again for the next hop with the hop limit
+ * decremented, the payload of the fragment stays the same, so the offsets
+ * in the following fragments are still valid. Packets with a hop-by-hop
+ * option, packets whose hop limit expires and packets without a known
+ * next hop are reassembled and left to the IP layer. uip_buf is used as
+ * scratch space, it is not in use while a packet is received.
+ */
+static uint8_t
+forward_first_fragment(uint16_t tag, uint16_t size)
+{
+  uip_ipaddr_t *nexthop;
+  uip_ds6_route_t *route;
+  uip_ds6_nbr_t *nbr;
+  struct frag_forward *f;
+  uint8_t *frame;
+  uint8_t in_rime_hdr_len, in_uncomp_hdr_len;
+  uint16_t end;
+
+  if(UIP_IP_BUF->proto == UIP_PROTO_HBHO || UIP_IP_BUF->ttl <= 1 ||
+     uip_is_addr_mcast(&UIP_IP_BUF->destipaddr) ||
+     uip_is_addr_link_local(&UIP_IP_BUF->destipaddr) ||
+     uip_is_addr_link_local(&UIP_IP_BUF->srcipaddr) ||
+     uip_ds6_is_my_addr(&UIP_IP_BUF->destipaddr)) {
+    return 0;
+  }
+
+  /* Same next hop as tcpip_ipv6_output() */
+  if(uip_ds6_is_addr_onlink(&UIP_IP_BUF->destipaddr)) {
+    nexthop = &UIP_IP_BUF->destipaddr;
+  } else {
+    route = uip_ds6_route_lookup(&UIP_IP_BUF->destipaddr);
+    if(route != NULL) {
+      nexthop = &route->nexthop;
+    } else if((nexthop = uip_ds6_defrt_choose()) == NULL) {
+      return 0;
+    }
+  }
+  nbr = uip_ds6_nbr_lookup(nexthop);
+  if(nbr == NULL || nbr->state == NBR_INCOMPLETE) {
+    return 0;
+  }
+
+  /* The packet up to the end of the fragment goes to uip_buf, the
+     fragment for the next hop is put together behind it. */
+  if(packetbuf_datalen() < rime_hdr_len) {
+    return 0;
+  }
+  end = uncomp_hdr_len + packetbuf_datalen() - rime_hdr_len;
+  if(end >= size || UIP_LLH_LEN + end + PACKETBUF_SIZE > UIP_BUFSIZE) {
+    return 0;
+  }
+  f = forward_entry(tag, size, 1);
+  if(f == NULL) {
+    return 0;
+  }
+  if(f->forwarded > 0) {
+    /* the entry was taken by this fragment before */
+    PRINTFI("sicslowpan input: Dropping duplicate first fragment\n");
+    UIP_STAT(++sicslowpan_stats.reass_duplicate);
+    return 1;
+  }
+  memcpy((uint8_t *)UIP_IP_BUF + uncomp_hdr_len, rime_ptr + rime_hdr_len,
+         end - uncomp_hdr_len);
+  UIP_IP_BUF->ttl--;
+
+  in_rime_hdr_len = rime_hdr_len;
+  in_uncomp_hdr_len = uncomp_hdr_len;
+  frame = (uint8_t *)UIP_IP_BUF + end;
+  rime_ptr = frame;
+  rime_hdr_len = 0;
+  uncomp_hdr_len = 0;
+  compress_hdr((rimeaddr_t *)&nbr->lladdr);
+  if(end < uncomp_hdr_len ||
+     SICSLOWPAN_FRAG1_HDR_LEN + rime_hdr_len + end - uncomp_hdr_len >
+     MAC_MAX_PAYLOAD) {
+    PRINTFI("sicslowpan input: first fragment too large to forward\n");
+    UIP_IP_BUF->ttl++;
+    rime_ptr = packetbuf_dataptr();
+    rime_hdr_len = in_rime_hdr_len;
+    uncomp_hdr_len = in_uncomp_hdr_len;
+    f->size = 0;
+    return 0;
+  }
+
+  memmove(rime_ptr + SICSLOWPAN_FRAG1_HDR_LEN, rime_ptr, rime_hdr_len);
+  SET16(RIME_FRAG_PTR, RIME_FRAG_DISPATCH_SIZE,
+        ((SICSLOWPAN_DISPATCH_FRAG1 << 8) | size));
+  SET16(RIME_FRAG_PTR, RIME_FRAG_TAG, f->nexthop_tag);
+  rime_hdr_len += SICSLOWPAN_FRAG1_HDR_LEN;
+  memcpy(rime_ptr + rime_hdr_len, (uint8_t *)UIP_IP_BUF + uncomp_hdr_len,
+         end - uncomp_hdr_len);
+  rimeaddr_copy(&f->nexthop, (rimeaddr_t *)&nbr->lladdr);
+  f->forwarded += end;
+  PRINTFI("sicslowpan input: forwarding first fragment (size %d, tag %d -> %d)\n",
+          size, tag, f->nexthop_tag);
+  forward_send(frame, rime_hdr_len + end - uncomp_hdr_len, f);
+  return 1;
+}
+/*--------------------------------------------------------------------*/
+/**
+ * \brief Forward a subsequent fragment if its first fragment was
+ * forwarded.
+ * \param tag The datagram tag of the fragment
+ * \param size The datagram size of the fragment
+ * \return 1 if the fragment was forwarded, 0 if not
+ *
+ * Only the tag is changed, the fragment is copied to uip_buf to be sent.
+ */
+static uint8_t
+forward_fragment(uint16_t tag, uint16_t size)
+{
+  struct frag_forward *f;
+  uint16_t len = packetbuf_datalen();
+
+  f = forward_entry(tag, size, 0);
+  if(f == NULL || len < SICSLOWPAN_FRAGN_HDR_LEN) {
+    return 0;
+  }
+  memcpy(uip_buf, packetbuf_dataptr(), len);
+  SET16(uip_buf, RIME_FRAG_TAG, f->nexthop_tag);
+  f->forwarded += len - SICSLOWPAN_FRAGN_HDR_LEN;
+  PRINTFI("sicslowpan input: forwarding fragment (size %d, tag %d -> %d)\n",
+          size, tag, f->nexthop_tag);
+  forward_send(uip_buf, len, f);
+  return 1;
+}
+#endif /* SICSLOWPAN_FRAG_FORWARD */
+#endif /* SICSLOWPAN_CONF_FRAG */
 /*--------------------------------------------------------------------*/
 /** \brief Process a received 6lowpan packet.
  *  \param r The MAC layer
  *
  *  The 6lowpan packet is put in packetbuf by the MAC. If its a frag1 or
- *  a non-fragmented packet we first uncompress the IP header. The
- *  6lowpan payload and possibly the uncompressed IP header are then
- *  copied in siclowpan_buf. If the IP packet is complete it is copied
- *  to uip_buf and the IP layer is called.
+ *  a non-fragmented packet we first uncompress the IP header. A
+ *  non-fragmented packet is uncompressed into uip_buf and the IP layer
+ *  is called. The 6lowpan payload and possibly the uncompressed IP
+ *  header of a fragment are copied to the buffer of its reassembly
+ *  context, fragments of several packets may interleave and arrive in
+ *  any order. If the IP packet is complete it is copied to uip_buf and
+ *  the IP layer is called.
  *
  * \note We do not check for overlapping sicslowpan fragments
  * (it is a SHALL in the RFC 4944 and should never happen)
@@ -1566,7 +1922,11 @@ input(void)
 #if SICSLOWPAN_CONF_FRAG
   /* tag of the fragment */
   uint16_t frag_tag = 0;
-  uint8_t first_fragment = 0, last_fragment = 0;
+  /* the bytes of the IP packet in the fragment */
+  uint16_t frag_start, frag_end;
+  uint16_t block;
+  uint8_t is_duplicate;
+  struct reass_context *reass = NULL;
 #endif /*SICSLOWPAN_CONF_FRAG*/
 
   /* init */
@@ -1577,11 +1937,7 @@ input(void)
   rime_ptr = packetbuf_dataptr();
 
 #if SICSLOWPAN_CONF_FRAG
-  /* if reassembly timed out, cancel it */
-  if(timer_expired(&reass_timer)) {
-    sicslowpan_len = 0;
-    processed_ip_in_len = 0;
-  }
+  sicslowpan_buf = uip_buf;
   /*
    * Since we don't support the mesh and broadcast header, the first header
    * we look for is the fragmentation header
@@ -1597,8 +1953,6 @@ input(void)
       PRINTFI("size %d, tag %d, offset %d)\n",
              frag_size, frag_tag, frag_offset);
       rime_hdr_len += SICSLOWPAN_FRAG1_HDR_LEN;
-      /*      printf("frag1 %d %d\n", reass_tag, frag_tag);*/
-      first_fragment = 1;
       break;
     case SICSLOWPAN_DISPATCH_FRAGN:
       /*
@@ -1612,47 +1966,32 @@ input(void)
       PRINTFI("size %d, tag %d, offset %d)\n",
              frag_size, frag_tag, frag_offset);
       rime_hdr_len += SICSLOWPAN_FRAGN_HDR_LEN;
-
-      /* If this is the last fragment, we may shave off any extrenous
-         bytes at the end. We must be liberal in what we accept. */
-      PRINTFI("last_fragment?: processed_ip_in_len %d rime_payload_len %d frag_size %d\n",
-              processed_ip_in_len, packetbuf_datalen() - rime_hdr_len, frag_size);
-
-      if(processed_ip_in_len + packetbuf_datalen() - rime_hdr_len >= frag_size) {
-        last_fragment = 1;
-      }
       break;
     default:
       break;
   }
 
-  if(processed_ip_in_len > 0) {
-    /* reassembly is ongoing */
-    /*    printf("frag %d %d\n", reass_tag, frag_tag);*/
-    if((frag_size > 0 &&
-        (frag_size != sicslowpan_len ||
-         reass_tag  != frag_tag ||
-         !rimeaddr_cmp(&frag_sender, packetbuf_addr(PACKETBUF_ADDR_SENDER))))  ||
-       frag_size == 0) {
-      /*
-       * the packet is a fragment that does not belong to the packet
-       * being reassembled or the packet is not a fragment.
-       */
-      PRINTFI("sicslowpan input: Dropping 6lowpan packet that is not a fragment of the packet currently being reassembled\n");
+  if(frag_size > 0) {
+    if(frag_size > UIP_BUFSIZE - UIP_LLH_LEN) {
+      PRINTFI("sicslowpan input: Dropping fragment of a packet larger than the reassembly buffer\n");
+      UIP_STAT(++sicslowpan_stats.reass_dropped);
       return;
     }
-  } else {
-    /*
-     * reassembly is off
-     * start it if we received a fragment
-     */
-    if((frag_size > 0) && (frag_size <= UIP_BUFSIZE)) {
-      sicslowpan_len = frag_size;
-      reass_tag = frag_tag;
-      timer_set(&reass_timer, SICSLOWPAN_REASS_MAXAGE*CLOCK_SECOND);
-      PRINTFI("sicslowpan input: INIT FRAGMENTATION (len %d, tag %d)\n",
-             sicslowpan_len, reass_tag);
-      rimeaddr_copy(&frag_sender, packetbuf_addr(PACKETBUF_ADDR_SENDER));
+#if SICSLOWPAN_FRAG_FORWARD
+    if(rime_hdr_len == SICSLOWPAN_FRAGN_HDR_LEN &&
+       forward_fragment(frag_tag, frag_size)) {
+      return;
+    }
+    /* The header of a first fragment is uncompressed into uip_buf, the
+       packet gets a context if it is not forwarded. */
+    if(rime_hdr_len == SICSLOWPAN_FRAGN_HDR_LEN)
+#endif /* SICSLOWPAN_FRAG_FORWARD */
+    {
+      reass = reass_context(frag_tag, frag_size);
+      if(reass == NULL) {
+        return;
+      }
+      sicslowpan_buf = reass->buf.u8;
     }
   }
 
@@ -1693,6 +2032,21 @@ input(void)
              RIME_HC1_PTR[RIME_HC1_DISPATCH]);
       return;
   }
+
+#if SICSLOWPAN_FRAG_FORWARD
+  if(frag_size > 0) {
+    if(!reass_pending(frag_tag, frag_size) &&
+       forward_first_fragment(frag_tag, frag_size)) {
+      return;
+    }
+    reass = reass_context(frag_tag, frag_size);
+    if(reass == NULL) {
+      return;
+    }
+    sicslowpan_buf = reass->buf.u8;
+    memcpy(SICSLOWPAN_IP_BUF, UIP_IP_BUF, uncomp_hdr_len);
+  }
+#endif /* SICSLOWPAN_FRAG_FORWARD */
    
     
 #if SICSLOWPAN_CONF_FRAG
@@ -1710,72 +2064,80 @@ input(void)
     return;
   }
   rime_payload_len = packetbuf_datalen() - rime_hdr_len;
-  memcpy((uint8_t *)SICSLOWPAN_IP_BUF + uncomp_hdr_len + (uint16_t)(frag_offset << 3), rime_ptr + rime_hdr_len, rime_payload_len);
-  
-  /* update processed_ip_in_len if fragment, sicslowpan_len otherwise */
 
 #if SICSLOWPAN_CONF_FRAG
-  if(frag_size > 0) {
-    /* Add the size of the header only for the first fragment. */
-    if(first_fragment != 0) {
-      processed_ip_in_len += uncomp_hdr_len;
-    }
+  if(reass != NULL) {
     /* For the last fragment, we are OK if there is extrenous bytes at
        the end of the packet. */
-    if(last_fragment != 0) {
-      processed_ip_in_len = frag_size;
-    } else {
-      processed_ip_in_len += rime_payload_len;
+    frag_start = (uint16_t)(frag_offset << 3);
+    frag_end = frag_start + uncomp_hdr_len + rime_payload_len;
+    if(frag_end > frag_size) {
+      frag_end = frag_size;
+    }
+    if(frag_end < frag_start + uncomp_hdr_len) {
+      PRINTFI("sicslowpan input: Dropping fragment beyond the end of the packet\n");
+      UIP_STAT(++sicslowpan_stats.reass_dropped);
+      return;
+    }
+    memcpy((uint8_t *)SICSLOWPAN_IP_BUF + frag_start + uncomp_hdr_len,
+           rime_ptr + rime_hdr_len, frag_end - frag_start - uncomp_hdr_len);
+
+    is_duplicate = 1;
+    for(block = frag_start >> 3; block < (frag_end + 7) >> 3; block++) {
+      if((reass->received[block >> 3] & (1 << (block & 7))) == 0) {
+        reass->received[block >> 3] |= 1 << (block & 7);
+        reass->blocks++;
+        is_duplicate = 0;
+      }
+    }
+    if(is_duplicate) {
+      UIP_STAT(++sicslowpan_stats.reass_duplicate);
+    }
+    PRINTF("sicslowpan input: %d of %d blocks (tag %d)\n",
+           reass->blocks, (frag_size + 7) >> 3, frag_tag);
+    if(reass->blocks < (frag_size + 7) >> 3) {
+      return;
     }
-    PRINTF("processed_ip_in_len %d, rime_payload_len %d\n", processed_ip_in_len, rime_payload_len);
 
-  } else {
+    /*
+     * We have a full IP packet in the reassembly context, deliver it to
+     * the IP stack
+     */
+    PRINTFI("sicslowpan input: IP packet ready (length %d)\n", frag_size);
+    memcpy((uint8_t *)UIP_IP_BUF, (uint8_t *)SICSLOWPAN_IP_BUF, frag_size);
+    uip_len = frag_size;
+    UIP_STAT(++sicslowpan_stats.reass_done);
+  } else
 #endif /* SICSLOWPAN_CONF_FRAG */
+  {
+    memcpy((uint8_t *)SICSLOWPAN_IP_BUF + uncomp_hdr_len,
+           rime_ptr + rime_hdr_len, rime_payload_len);
     sicslowpan_len = rime_payload_len + uncomp_hdr_len;
-#if SICSLOWPAN_CONF_FRAG
   }
 
-  /*
-   * If we have a full IP packet in sicslowpan_buf, deliver it to
-   * the IP stack
-   */
-  PRINTF("sicslowpan_init processed_ip_in_len %d, sicslowpan_len %d\n",
-         processed_ip_in_len, sicslowpan_len);
-  if(processed_ip_in_len == 0 || (processed_ip_in_len == sicslowpan_len)) {
-    PRINTFI("sicslowpan input: IP packet ready (length %d)\n",
-           sicslowpan_len);
-    memcpy((uint8_t *)UIP_IP_BUF, (uint8_t *)SICSLOWPAN_IP_BUF, sicslowpan_len);
-    uip_len = sicslowpan_len;
-    sicslowpan_len = 0;
-    processed_ip_in_len = 0;
-#endif /* SICSLOWPAN_CONF_FRAG */
-
 #if DEBUG
-    {
-      uint16_t ndx;
-      PRINTF("after decompression %u:", SICSLOWPAN_IP_BUF->len[1]);
-      for (ndx = 0; ndx < SICSLOWPAN_IP_BUF->len[1] + 40; ndx++) {
-        uint8_t data = ((uint8_t *) (SICSLOWPAN_IP_BUF))[ndx];
-        PRINTF("%02x", data);
-      }
-      PRINTF("\n");
+  {
+    uint16_t ndx;
+    PRINTF("after decompression %u:", SICSLOWPAN_IP_BUF->len[1]);
+    for (ndx = 0; ndx < SICSLOWPAN_IP_BUF->len[1] + 40; ndx++) {
+      uint8_t data = ((uint8_t *) (SICSLOWPAN_IP_BUF))[ndx];
+      PRINTF("%02x", data);
     }
+    PRINTF("\n");
+  }
 #endif
 
 #if SICSLOWPAN_CONF_NEIGHBOR_INFO
-    neighbor_info_packet_received();
+  neighbor_info_packet_received();
 #endif /* SICSLOWPAN_CONF_NEIGHBOR_INFO */
 
-    /* if callback is set then set attributes and call */
-    if(callback) {
-      set_packet_attrs();
-      callback->input_callback();
-    }
-
-    tcpip_input();
-#if SICSLOWPAN_CONF_FRAG
+  /* if callback is set then set attributes and call */
+  if(callback) {
+    set_packet_attrs();
+    callback->input_callback();
   }
-#endif /* SICSLOWPAN_CONF_FRAG */
+
+  tcpip_input();
 }
 /** @} */
 
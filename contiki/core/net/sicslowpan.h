@@ -319,6 +319,28 @@ struct sicslowpan_nh_compressor {
 };
 
 
+#if UIP_STATISTICS == 1
+/**
+ * The 6lowpan reassembly statistics, kept if UIP_STATISTICS is set.
+ */
+struct sicslowpan_stats {
+  unsigned long reass_started;    /**< Reassembly contexts taken. */
+  unsigned long reass_done;       /**< Packets reassembled. */
+  unsigned long reass_timeout;    /**< Packets discarded incomplete,
+                                       timed out or given up for
+                                       another packet. */
+  unsigned long reass_nocontext;  /**< Fragments dropped because all
+                                       reassembly contexts were busy. */
+  unsigned long reass_dropped;    /**< Fragments dropped because of their
+                                       size or offset. */
+  unsigned long reass_duplicate;  /**< Fragments received before. */
+  unsigned long frag_forwarded;   /**< Fragments forwarded without
+                                       reassembly. */
+};
+
+extern struct sicslowpan_stats sicslowpan_stats;
+#endif /* UIP_STATISTICS == 1 */
+
 extern const struct network_driver sicslowpan_driver;
 
 #endif /* __SICSLOWPAN_H__ */
@@ -98,6 +98,46 @@ static uip_ds6_nbr_t *locnbr;
 static uip_ds6_defrt_t *locdefrt;
 static uip_ds6_route_t *locroute;
 
+#if UIP_DS6_ROUTE_HASH
+/* Routes are referred to by their index in uip_ds6_routing_table */
+#if UIP_DS6_ROUTE_NB < 0xff
+typedef uint8_t route_index_t;
+#define ROUTE_NONE 0xff
+#else
+typedef uint16_t route_index_t;
+#define ROUTE_NONE 0xffff
+#endif
+
+#define ROUTE_UNINDEXED 0
+#define ROUTE_HASHED    1
+#define ROUTE_PREFIX    2
+
+static route_index_t route_hash[UIP_DS6_ROUTE_HASH_SIZE];       /** \brief first /128 route per bucket */
+static route_index_t route_next[UIP_DS6_ROUTE_NB];              /** \brief next /128 route in the bucket */
+static route_index_t route_prefixes[UIP_DS6_ROUTE_NB];          /** \brief shorter routes, longest first */
+static route_index_t route_nprefixes;
+static uint8_t route_indexed[UIP_DS6_ROUTE_NB];                 /** \brief ROUTE_HASHED, ROUTE_PREFIX or ROUTE_UNINDEXED */
+#endif /* UIP_DS6_ROUTE_HASH */
+
+#if UIP_DS6_NBR_HASH
+#if UIP_DS6_NBR_HASH_SIZE <= UIP_DS6_NBR_NB
+#error UIP_DS6_NBR_HASH_SIZE must be larger than UIP_DS6_NBR_NB
+#endif
+/* Neighbors are referred to by their index in uip_ds6_nbr_cache */
+#if UIP_DS6_NBR_NB < 0xff
+typedef uint8_t nbr_index_t;
+#define NBR_NONE 0xff
+#else
+typedef uint16_t nbr_index_t;
+#define NBR_NONE 0xffff
+#endif
+
+#define NBR_KEY_LEN(ll) ((ll) ? UIP_LLADDR_LEN : sizeof(uip_ipaddr_t))
+
+static nbr_index_t nbr_ip_hash[UIP_DS6_NBR_HASH_SIZE];          /** \brief neighbors by IPv6 address */
+static nbr_index_t nbr_ll_hash[UIP_DS6_NBR_HASH_SIZE];          /** \brief neighbors by link-layer address */
+#endif /* UIP_DS6_NBR_HASH */
+
 /*---------------------------------------------------------------------------*/
 void
 uip_ds6_init(void)
@@ -111,6 +151,15 @@ uip_ds6_init(void)
   memset(uip_ds6_prefix_list, 0, sizeof(uip_ds6_prefix_list));
   memset(&uip_ds6_if, 0, sizeof(uip_ds6_if));
   memset(uip_ds6_routing_table, 0, sizeof(uip_ds6_routing_table));
+#if UIP_DS6_NBR_HASH
+  memset(nbr_ip_hash, 0xff, sizeof(nbr_ip_hash));
+  memset(nbr_ll_hash, 0xff, sizeof(nbr_ll_hash));
+#endif /* UIP_DS6_NBR_HASH */
+#if UIP_DS6_ROUTE_HASH
+  memset(route_hash, 0xff, sizeof(route_hash));
+  memset(route_indexed, ROUTE_UNINDEXED, sizeof(route_indexed));
+  route_nprefixes = 0;
+#endif /* UIP_DS6_ROUTE_HASH */
   uip_ds6_addr_size = sizeof(struct uip_ds6_addr);
   uip_ds6_netif_addr_list_offset = offsetof(struct uip_ds6_netif, addr_list);
 
@@ -285,6 +334,110 @@ uip_ds6_list_loop(uip_ds6_element_t *list, uint8_t size,
   return *out_element != NULL ? FREESPACE : NOSPACE;
 }
 
+#if UIP_DS6_NBR_HASH
+/*---------------------------------------------------------------------------*/
+/*
+ * Both tables use linear probing and hold every used neighbor. A lookup
+ * stops at the first free slot, so removing a neighbor moves the following
+ * entries of its run up instead of leaving a tombstone. The keys stay in
+ * uip_ds6_nbr_cache, the link-layer address may only change through
+ * uip_ds6_nbr_set_lladdr().
+ */
+static uint16_t
+nbr_hash(const uint8_t *key, uint8_t len)
+{
+  uint16_t h = 0;
+
+  while(len-- > 0) {
+    h = (h << 5) + h + *key++;
+  }
+  /* addresses handed out in sequence would otherwise fill neighboring
+     slots and build long probe runs */
+  h *= 0x9e37;
+  h ^= h >> 8;
+  return h % UIP_DS6_NBR_HASH_SIZE;
+}
+/*---------------------------------------------------------------------------*/
+static const uint8_t *
+nbr_key(nbr_index_t i, uint8_t ll)
+{
+  return ll ? (const uint8_t *)&uip_ds6_nbr_cache[i].lladdr :
+    uip_ds6_nbr_cache[i].ipaddr.u8;
+}
+/*---------------------------------------------------------------------------*/
+static void
+nbr_hash_add(nbr_index_t *table, uint8_t ll, nbr_index_t i)
+{
+  uint16_t j;
+
+  /* there are more slots than neighbors */
+  for(j = nbr_hash(nbr_key(i, ll), NBR_KEY_LEN(ll)); table[j] != NBR_NONE;) {
+    if(++j == UIP_DS6_NBR_HASH_SIZE) {
+      j = 0;
+    }
+  }
+  table[j] = i;
+}
+/*---------------------------------------------------------------------------*/
+static void
+nbr_hash_rm(nbr_index_t *table, uint8_t ll, nbr_index_t i)
+{
+  uint16_t j, k, home;
+
+  for(j = nbr_hash(nbr_key(i, ll), NBR_KEY_LEN(ll)); table[j] != i;) {
+    if(table[j] == NBR_NONE) {
+      return;
+    }
+    if(++j == UIP_DS6_NBR_HASH_SIZE) {
+      j = 0;
+    }
+  }
+  /* an entry further down the run moves into the gap at j unless its home
+     slot lies (cyclically) in between */
+  for(k = j;;) {
+    if(++k == UIP_DS6_NBR_HASH_SIZE) {
+      k = 0;
+    }
+    if(table[k] == NBR_NONE) {
+      break;
+    }
+    home = nbr_hash(nbr_key(table[k], ll), NBR_KEY_LEN(ll));
+    if(j <= k ? (home <= j || home > k) : (home <= j && home > k)) {
+      table[j] = table[k];
+      j = k;
+    }
+  }
+  table[j] = NBR_NONE;
+}
+/*---------------------------------------------------------------------------*/
+/* Same return values as uip_ds6_list_loop() for a /128 */
+static uint8_t
+nbr_find(uip_ipaddr_t *ipaddr)
+{
+  nbr_index_t i;
+  uint16_t j;
+
+  for(j = nbr_hash(ipaddr->u8, sizeof(uip_ipaddr_t));
+      (i = nbr_ip_hash[j]) != NBR_NONE;) {
+    locnbr = &uip_ds6_nbr_cache[i];
+    if(locnbr->isused && uip_ipaddr_cmp(&locnbr->ipaddr, ipaddr)) {
+      return FOUND;
+    }
+    if(++j == UIP_DS6_NBR_HASH_SIZE) {
+      j = 0;
+    }
+  }
+
+  for(locnbr = uip_ds6_nbr_cache;
+      locnbr < uip_ds6_nbr_cache + UIP_DS6_NBR_NB; locnbr++) {
+    if(!locnbr->isused) {
+      return FREESPACE;
+    }
+  }
+  locnbr = NULL;
+  return NOSPACE;
+}
+#endif /* UIP_DS6_NBR_HASH */
 /*---------------------------------------------------------------------------*/
 uip_ds6_nbr_t *
 uip_ds6_nbr_add(uip_ipaddr_t *ipaddr, uip_lladdr_t *lladdr,
@@ -292,10 +445,14 @@ uip_ds6_nbr_add(uip_ipaddr_t *ipaddr, uip_lladdr_t *lladdr,
 {
   int r;
 
+#if UIP_DS6_NBR_HASH
+  r = nbr_find(ipaddr);
+#else
   r = uip_ds6_list_loop
      ((uip_ds6_element_t *)uip_ds6_nbr_cache, UIP_DS6_NBR_NB,
       sizeof(uip_ds6_nbr_t), ipaddr, 128,
       (uip_ds6_element_t **)&locnbr);
+#endif
 
   if(r == FREESPACE) {
     locnbr->isused = 1;
@@ -305,6 +462,10 @@ uip_ds6_nbr_add(uip_ipaddr_t *ipaddr, uip_lladdr_t *lladdr,
     } else {
       memset(&locnbr->lladdr, 0, UIP_LLADDR_LEN);
     }
+#if UIP_DS6_NBR_HASH
+    nbr_hash_add(nbr_ip_hash, 0, locnbr - uip_ds6_nbr_cache);
+    nbr_hash_add(nbr_ll_hash, 1, locnbr - uip_ds6_nbr_cache);
+#endif
     locnbr->isrouter = isrouter;
     locnbr->state = state;
 #if UIP_CONF_IPV6_QUEUE_PKT
@@ -356,6 +517,12 @@ void
 uip_ds6_nbr_rm(uip_ds6_nbr_t *nbr)
 {
   if(nbr != NULL) {
+#if UIP_DS6_NBR_HASH
+    if(nbr->isused) {
+      nbr_hash_rm(nbr_ip_hash, 0, nbr - uip_ds6_nbr_cache);
+      nbr_hash_rm(nbr_ll_hash, 1, nbr - uip_ds6_nbr_cache);
+    }
+#endif
     nbr->isused = 0;
 #if UIP_CONF_IPV6_QUEUE_PKT
     uip_packetqueue_free(&nbr->packethandle);
@@ -369,10 +536,14 @@ uip_ds6_nbr_rm(uip_ds6_nbr_t *nbr)
 uip_ds6_nbr_t *
 uip_ds6_nbr_lookup(uip_ipaddr_t *ipaddr)
 {
+#if UIP_DS6_NBR_HASH
+  if(nbr_find(ipaddr) == FOUND) {
+#else
   if(uip_ds6_list_loop
      ((uip_ds6_element_t *)uip_ds6_nbr_cache, UIP_DS6_NBR_NB,
       sizeof(uip_ds6_nbr_t), ipaddr, 128,
       (uip_ds6_element_t **)&locnbr) == FOUND) {
+#endif
     locnbr->last_lookup = clock_time();
     return locnbr;
   }
@@ -383,6 +554,25 @@ uip_ds6_nbr_lookup(uip_ipaddr_t *ipaddr)
 uip_ds6_nbr_t *
 uip_ds6_nbr_ll_lookup(uip_lladdr_t *lladdr)
 {
+#if UIP_DS6_NBR_HASH
+  nbr_index_t i, found;
+  uint16_t j;
+
+  /* several neighbors may share the link-layer address, return the first
+     in the cache like the linear scan */
+  found = NBR_NONE;
+  for(j = nbr_hash((uint8_t *)lladdr, UIP_LLADDR_LEN);
+      (i = nbr_ll_hash[j]) != NBR_NONE;) {
+    if(i < found && uip_ds6_nbr_cache[i].isused &&
+       !memcmp(lladdr, &uip_ds6_nbr_cache[i].lladdr, UIP_LLADDR_LEN)) {
+      found = i;
+    }
+    if(++j == UIP_DS6_NBR_HASH_SIZE) {
+      j = 0;
+    }
+  }
+  return found != NBR_NONE ? &uip_ds6_nbr_cache[found] : NULL;
+#else /* UIP_DS6_NBR_HASH */
   uip_ds6_nbr_t *fin;
 
   for(locnbr = uip_ds6_nbr_cache, fin = locnbr + UIP_DS6_NBR_NB;
@@ -395,6 +585,24 @@ uip_ds6_nbr_ll_lookup(uip_lladdr_t *lladdr)
     }
   }
   return NULL;
+#endif /* UIP_DS6_NBR_HASH */
+}
+
+/*---------------------------------------------------------------------------*/
+void
+uip_ds6_nbr_set_lladdr(uip_ds6_nbr_t *nbr, uip_lladdr_t *lladdr)
+{
+#if UIP_DS6_NBR_HASH
+  if(nbr->isused) {
+    nbr_hash_rm(nbr_ll_hash, 1, nbr - uip_ds6_nbr_cache);
+  }
+#endif
+  memcpy(&nbr->lladdr, lladdr, UIP_LLADDR_LEN);
+#if UIP_DS6_NBR_HASH
+  if(nbr->isused) {
+    nbr_hash_add(nbr_ll_hash, 1, nbr - uip_ds6_nbr_cache);
+  }
+#endif
 }
 
 /*---------------------------------------------------------------------------*/
@@ -744,17 +952,144 @@ uip_ds6_aaddr_lookup(uip_ipaddr_t *ipaddr)
   return NULL;
 }
 
+#if UIP_DS6_ROUTE_HASH
+/*---------------------------------------------------------------------------*/
+/*
+ * The routing table itself stays the same, the index only tells where to
+ * look. Entries whose isused flag got cleared outside of uip_ds6_route_rm()
+ * remain indexed until their slot gets reused, so every hit is checked
+ * against the table.
+ */
+static uint16_t
+route_bucket(uip_ipaddr_t *ipaddr)
+{
+  /* the host routes of a network share the prefix, hash the interface id */
+  uint16_t h;
+
+  h = ipaddr->u16[4] ^ ipaddr->u16[5] ^ ipaddr->u16[6] ^ ipaddr->u16[7];
+  return (h ^ (h >> 8)) & (UIP_DS6_ROUTE_HASH_SIZE - 1);
+}
+/*---------------------------------------------------------------------------*/
+static void
+route_index_add(route_index_t i)
+{
+  uip_ds6_route_t *r = &uip_ds6_routing_table[i];
+  route_index_t pos;
+  uint16_t h;
+
+  if(r->length == 128) {
+    h = route_bucket(&r->ipaddr);
+    route_next[i] = route_hash[h];
+    route_hash[h] = i;
+    route_indexed[i] = ROUTE_HASHED;
+  } else {
+    for(pos = route_nprefixes;
+        pos > 0 && uip_ds6_routing_table[route_prefixes[pos - 1]].length < r->length;
+        pos--) {
+      route_prefixes[pos] = route_prefixes[pos - 1];
+    }
+    route_prefixes[pos] = i;
+    route_nprefixes++;
+    route_indexed[i] = ROUTE_PREFIX;
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+route_index_rm(route_index_t i)
+{
+  route_index_t *p;
+  route_index_t pos;
+
+  if(route_indexed[i] == ROUTE_HASHED) {
+    for(p = &route_hash[route_bucket(&uip_ds6_routing_table[i].ipaddr)];
+        *p != ROUTE_NONE; p = &route_next[*p]) {
+      if(*p == i) {
+        *p = route_next[i];
+        break;
+      }
+    }
+  } else if(route_indexed[i] == ROUTE_PREFIX) {
+    for(pos = 0; pos < route_nprefixes && route_prefixes[pos] != i; pos++);
+    for(route_nprefixes--; pos < route_nprefixes; pos++) {
+      route_prefixes[pos] = route_prefixes[pos + 1];
+    }
+  }
+  route_indexed[i] = ROUTE_UNINDEXED;
+}
+/*---------------------------------------------------------------------------*/
+/* Same return values as uip_ds6_list_loop(), but FOUND only for a route to
+   the same prefix with the same length. A free slot is taken out of the
+   index. */
+static uint8_t
+route_find(uip_ipaddr_t *ipaddr, uint8_t length)
+{
+  route_index_t i;
+
+  if(length == 128) {
+    for(i = route_hash[route_bucket(ipaddr)]; i != ROUTE_NONE;
+        i = route_next[i]) {
+      locroute = &uip_ds6_routing_table[i];
+      if(locroute->isused && locroute->length == 128 &&
+         uip_ipaddr_cmp(&locroute->ipaddr, ipaddr)) {
+        return FOUND;
+      }
+    }
+  } else {
+    for(i = 0; i < route_nprefixes; i++) {
+      locroute = &uip_ds6_routing_table[route_prefixes[i]];
+      if(locroute->isused && locroute->length == length &&
+         uip_ipaddr_prefixcmp(&locroute->ipaddr, ipaddr, length)) {
+        return FOUND;
+      }
+    }
+  }
+
+  for(i = 0; i < UIP_DS6_ROUTE_NB; i++) {
+    if(!uip_ds6_routing_table[i].isused) {
+      route_index_rm(i);
+      locroute = &uip_ds6_routing_table[i];
+      return FREESPACE;
+    }
+  }
+  locroute = NULL;
+  return NOSPACE;
+}
+#endif /* UIP_DS6_ROUTE_HASH */
 /*---------------------------------------------------------------------------*/
 uip_ds6_route_t *
 uip_ds6_route_lookup(uip_ipaddr_t *destipaddr)
 {
   uip_ds6_route_t *locrt = NULL;
+#if UIP_DS6_ROUTE_HASH
+  route_index_t i;
+#else
   uint8_t longestmatch = 0;
+#endif
 
   PRINTF("DS6: Looking up route for ");
   PRINT6ADDR(destipaddr);
   PRINTF("\n");
 
+#if UIP_DS6_ROUTE_HASH
+  /* a host route is the longest match there is, then the prefixes longest
+     first */
+  for(i = route_hash[route_bucket(destipaddr)]; i != ROUTE_NONE;
+      i = route_next[i]) {
+    locroute = &uip_ds6_routing_table[i];
+    if(locroute->isused && locroute->length == 128 &&
+       uip_ipaddr_cmp(destipaddr, &locroute->ipaddr)) {
+      locrt = locroute;
+      break;
+    }
+  }
+  for(i = 0; locrt == NULL && i < route_nprefixes; i++) {
+    locroute = &uip_ds6_routing_table[route_prefixes[i]];
+    if(locroute->isused &&
+       uip_ipaddr_prefixcmp(destipaddr, &locroute->ipaddr, locroute->length)) {
+      locrt = locroute;
+    }
+  }
+#else /* UIP_DS6_ROUTE_HASH */
   for(locroute = uip_ds6_routing_table;
       locroute < uip_ds6_routing_table + UIP_DS6_ROUTE_NB; locroute++) {
     if((locroute->isused) && (locroute->length >= longestmatch)
@@ -765,6 +1100,7 @@ uip_ds6_route_lookup(uip_ipaddr_t *destipaddr)
       locrt = locroute;
     }
   }
+#endif /* UIP_DS6_ROUTE_HASH */
 
   if(locrt != NULL) {
     PRINTF("DS6: Found route:");
@@ -784,10 +1120,14 @@ uip_ds6_route_t *
 uip_ds6_route_add(uip_ipaddr_t *ipaddr, uint8_t length, uip_ipaddr_t *nexthop,
                   uint8_t metric)
 {
+#if UIP_DS6_ROUTE_HASH
+  if(route_find(ipaddr, length) == FREESPACE) {
+#else
   if(uip_ds6_list_loop
      ((uip_ds6_element_t *)uip_ds6_routing_table, UIP_DS6_ROUTE_NB,
       sizeof(uip_ds6_route_t), ipaddr, length,
       (uip_ds6_element_t **)&locroute) == FREESPACE) {
+#endif
     locroute->isused = 1;
     uip_ipaddr_copy(&(locroute->ipaddr), ipaddr);
     locroute->length = length;
@@ -797,6 +1137,9 @@ uip_ds6_route_add(uip_ipaddr_t *ipaddr, uint8_t length, uip_ipaddr_t *nexthop,
 #ifdef UIP_DS6_ROUTE_STATE_TYPE
     memset(&locroute->state, 0, sizeof(UIP_DS6_ROUTE_STATE_TYPE));
 #endif
+#if UIP_DS6_ROUTE_HASH
+    route_index_add(locroute - uip_ds6_routing_table);
+#endif
 
     PRINTF("DS6: adding route: ");
     PRINT6ADDR(ipaddr);
@@ -814,6 +1157,9 @@ void
 uip_ds6_route_rm(uip_ds6_route_t *route)
 {
   route->isused = 0;
+#if UIP_DS6_ROUTE_HASH
+  route_index_rm(route - uip_ds6_routing_table);
+#endif
 #if (DEBUG & DEBUG_ANNOTATE) == DEBUG_ANNOTATE
   /* we need to check if this was the last route towards "nexthop" */
   /* if so - remove that link (annotation) */
@@ -837,6 +1183,9 @@ uip_ds6_route_rm_by_nexthop(uip_ipaddr_t *nexthop)
       locroute++) {
     if(locroute->isused && uip_ipaddr_cmp(&locroute->nexthop, nexthop)) {
       locroute->isused = 0;
+#if UIP_DS6_ROUTE_HASH
+      route_index_rm(locroute - uip_ds6_routing_table);
+#endif
     }
   }
   ANNOTATE("#L %u 0\n",nexthop->u8[sizeof(uip_ipaddr_t) - 1]);
@@ -64,6 +64,20 @@
 #endif
 #define UIP_DS6_NBR_NB UIP_DS6_NBR_NBS + UIP_DS6_NBR_NBU
 
+/* Open-addressed hash tables on the IPv6 and on the link-layer address of
+ * the neighbors, instead of a linear scan per lookup */
+#ifdef UIP_CONF_DS6_NBR_HASH
+#define UIP_DS6_NBR_HASH UIP_CONF_DS6_NBR_HASH
+#else
+#define UIP_DS6_NBR_HASH 0
+#endif
+/* Slots per table, more than UIP_DS6_NBR_NB */
+#ifdef UIP_CONF_DS6_NBR_HASH_SIZE
+#define UIP_DS6_NBR_HASH_SIZE UIP_CONF_DS6_NBR_HASH_SIZE
+#else
+#define UIP_DS6_NBR_HASH_SIZE (2 * (UIP_DS6_NBR_NB))
+#endif
+
 /* Default router list */
 #define UIP_DS6_DEFRT_NBS 0
 #ifndef UIP_CONF_DS6_DEFRT_NBU
@@ -91,6 +105,24 @@
 #endif
 #define UIP_DS6_ROUTE_NB UIP_DS6_ROUTE_NBS + UIP_DS6_ROUTE_NBU
 
+/* Index of the routing table: host routes (/128) in a hash table, shorter
+ * prefixes in a list sorted by length, instead of a linear scan per lookup */
+#ifdef UIP_CONF_DS6_ROUTE_HASH
+#define UIP_DS6_ROUTE_HASH UIP_CONF_DS6_ROUTE_HASH
+#else
+#define UIP_DS6_ROUTE_HASH 0
+#endif
+/* Number of hash buckets, a power of 2 */
+#ifdef UIP_CONF_DS6_ROUTE_HASH_SIZE
+#define UIP_DS6_ROUTE_HASH_SIZE UIP_CONF_DS6_ROUTE_HASH_SIZE
+#else
+#define UIP_DS6_ROUTE_HASH_SIZE 16
+#endif
+#if (UIP_DS6_ROUTE_HASH_SIZE & (UIP_DS6_ROUTE_HASH_SIZE - 1)) != 0
+#error UIP_DS6_ROUTE_HASH_SIZE must be a power of two (i.e., 1, 2, 4, 8, 16, 32, 64, ...).
+#error Change UIP_CONF_DS6_ROUTE_HASH_SIZE in contiki-conf.h, project-conf.h or in your Makefile.
+#endif
+
 /* Unicast address list*/
 #define UIP_DS6_ADDR_NBS 1
 #ifndef UIP_CONF_DS6_ADDR_NBU
@@ -322,6 +354,7 @@ uip_ds6_nbr_t *uip_ds6_nbr_add(uip_ipaddr_t *ipaddr, uip_lladdr_t *lladdr,
 void uip_ds6_nbr_rm(uip_ds6_nbr_t *nbr);
 uip_ds6_nbr_t *uip_ds6_nbr_lookup(uip_ipaddr_t *ipaddr);
 uip_ds6_nbr_t *uip_ds6_nbr_ll_lookup(uip_lladdr_t *lladdr);
+void uip_ds6_nbr_set_lladdr(uip_ds6_nbr_t *nbr, uip_lladdr_t *lladdr);
 
 /** @} */
 
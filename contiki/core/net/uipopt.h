@@ -474,6 +474,27 @@
 #define SICSLOWPAN_REASS_MAXAGE 20
 #endif
 
+/**
+ * Number of packets the 6lowpan layer reassembles at the same time, each
+ * takes a buffer of UIP_BUFSIZE
+ */
+#ifdef SICSLOWPAN_CONF_REASS_CONTEXTS
+#define SICSLOWPAN_REASS_CONTEXTS (SICSLOWPAN_CONF_REASS_CONTEXTS)
+#else
+#define SICSLOWPAN_REASS_CONTEXTS 1
+#endif
+
+/**
+ * Number of fragmented packets a router forwards at the same time
+ * fragment by fragment, without reassembling them (default: 0, every
+ * packet is reassembled)
+ */
+#ifdef SICSLOWPAN_CONF_FRAG_FORWARD
+#define SICSLOWPAN_FRAG_FORWARD (SICSLOWPAN_CONF_FRAG_FORWARD)
+#else
+#define SICSLOWPAN_FRAG_FORWARD 0
+#endif
+
 /**
  * Do we compress the IP header or not (default: no)
  */
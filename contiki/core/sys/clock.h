@@ -131,6 +131,15 @@ void clock_wait(clock_time_t t);
  */
 void clock_delay_usec(uint16_t dt);
 
+/**
+ * Sleep until the next interrupt, unless events are pending.
+ *
+ * Called from the main loop of platforms that implement it. With
+ * CLOCK_CONF_TICKLESS the tick interrupt is suspended until the next
+ * etimer expires, and the clock advanced by the ticks slept on wakeup.
+ */
+void clock_idle(void);
+
 /**
  * Deprecated platform-specific routines.
  *
@@ -50,37 +50,73 @@
 #include "sys/etimer.h"
 #include "sys/process.h"
 
+/* Pending timers, sorted by expiration time. A timer only gets inserted
+   while it is pending, in front of the first pending timer that expires
+   later, so the expired timers are always at the head of the list. */
 static struct etimer *timerlist;
 static clock_time_t next_expiration;
 
 PROCESS(etimer_process, "Event timer");
 /*---------------------------------------------------------------------------*/
+static int
+expired_at(struct etimer *t, clock_time_t now)
+{
+  return (clock_time_t)(now - t->timer.start) >= t->timer.interval;
+}
+/*---------------------------------------------------------------------------*/
 static void
 update_time(void)
 {
-  clock_time_t tdist;
-  clock_time_t now;
-  struct etimer *t;
-
   if (timerlist == NULL) {
     next_expiration = 0;
   } else {
-    now = clock_time();
-    t = timerlist;
-    /* Must calculate distance to next time into account due to wraps */
-    tdist = t->timer.start + t->timer.interval - now;
-    for(t = t->next; t != NULL; t = t->next) {
-      if(t->timer.start + t->timer.interval - now < tdist) {
-	tdist = t->timer.start + t->timer.interval - now;
-      }
+    next_expiration = timerlist->timer.start + timerlist->timer.interval;
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+insert_timer(struct etimer *timer)
+{
+  struct etimer **p;
+  clock_time_t now;
+  clock_time_t left;
+
+  p = &timerlist;
+  now = clock_time();
+  if(!expired_at(timer, now)) {
+    /* Compare the time left, not the expiration times, due to wraps */
+    left = timer->timer.start + timer->timer.interval - now;
+    while(*p != NULL &&
+	  (expired_at(*p, now) ||
+	   (clock_time_t)((*p)->timer.start + (*p)->timer.interval - now) <= left)) {
+      p = &(*p)->next;
     }
-    next_expiration = now + tdist;
   }
+  timer->next = *p;
+  *p = timer;
+
+  update_time();
+}
+/*---------------------------------------------------------------------------*/
+static int
+remove_timer(struct etimer *timer)
+{
+  struct etimer **p;
+
+  for(p = &timerlist; *p != NULL; p = &(*p)->next) {
+    if(*p == timer) {
+      *p = timer->next;
+      timer->next = NULL;
+      update_time();
+      return 1;
+    }
+  }
+  return 0;
 }
 /*---------------------------------------------------------------------------*/
 PROCESS_THREAD(etimer_process, ev, data)
 {
-  struct etimer *t, *u;
+  struct etimer *t, **u;
 	
   PROCESS_BEGIN();
 
@@ -92,51 +128,37 @@ PROCESS_THREAD(etimer_process, ev, data)
     if(ev == PROCESS_EVENT_EXITED) {
       struct process *p = data;
 
-      while(timerlist != NULL && timerlist->p == p) {
-	timerlist = timerlist->next;
-      }
-
-      if(timerlist != NULL) {
-	t = timerlist;
-	while(t->next != NULL) {
-	  if(t->next->p == p) {
-	    t->next = t->next->next;
-	  } else
-	    t = t->next;
+      u = &timerlist;
+      while(*u != NULL) {
+	if((*u)->p == p) {
+	  *u = (*u)->next;
+	} else {
+	  u = &(*u)->next;
 	}
       }
+      update_time();
       continue;
     } else if(ev != PROCESS_EVENT_POLL) {
       continue;
     }
 
-  again:
-    
-    u = NULL;
-    
-    for(t = timerlist; t != NULL; t = t->next) {
-      if(timer_expired(&t->timer)) {
-	if(process_post(t->p, PROCESS_EVENT_TIMER, t) == PROCESS_ERR_OK) {
+    /* Only the head of the list can have expired */
+    while(timerlist != NULL && timer_expired(&timerlist->timer)) {
+      t = timerlist;
+      if(process_post(t->p, PROCESS_EVENT_TIMER, t) == PROCESS_ERR_OK) {
 	  
-	  /* Reset the process ID of the event timer, to signal that the
-	     etimer has expired. This is later checked in the
-	     etimer_expired() function. */
-	  t->p = PROCESS_NONE;
-	  if(u != NULL) {
-	    u->next = t->next;
-	  } else {
-	    timerlist = t->next;
-	  }
-	  t->next = NULL;
-	  update_time();
-	  goto again;
-	} else {
-	  etimer_request_poll();
-	}
+	/* Reset the process ID of the event timer, to signal that the
+	   etimer has expired. This is later checked in the
+	   etimer_expired() function. */
+	t->p = PROCESS_NONE;
+	timerlist = t->next;
+	t->next = NULL;
+      } else {
+	etimer_request_poll();
+	break;
       }
-      u = t;
     }
-    
+    update_time();
   }
   
   PROCESS_END();
@@ -151,27 +173,14 @@ etimer_request_poll(void)
 static void
 add_timer(struct etimer *timer)
 {
-  struct etimer *t;
-
   etimer_request_poll();
 
-  if(timer->p != PROCESS_NONE) {
-    /* Timer not on list. */
-    
-    for(t = timerlist; t != NULL; t = t->next) {
-      if(t == timer) {
-	/* Timer already on list, bail out. */
-	update_time();
-	return;
-      }
-    }
+  /* A timer that is not pending has no process. A pending one keeps its
+     process and gets sorted in again, its time has changed. */
+  if(timer->p == PROCESS_NONE || !remove_timer(timer)) {
+    timer->p = PROCESS_CURRENT();
   }
-
-  timer->p = PROCESS_CURRENT();
-  timer->next = timerlist;
-  timerlist = timer;
-
-  update_time();
+  insert_timer(timer);
 }
 /*---------------------------------------------------------------------------*/
 void
@@ -199,7 +208,9 @@ void
 etimer_adjust(struct etimer *et, int timediff)
 {
   et->timer.start += timediff;
-  update_time();
+  if(et->p != PROCESS_NONE && remove_timer(et)) {
+    insert_timer(et);
+  }
 }
 /*---------------------------------------------------------------------------*/
 int
@@ -235,29 +246,8 @@ etimer_next_expiration_time(void)
 void
 etimer_stop(struct etimer *et)
 {
-  struct etimer *t;
-
-  /* First check if et is the first event timer on the list. */
-  if(et == timerlist) {
-    timerlist = timerlist->next;
-    update_time();
-  } else {
-    /* Else walk through the list and try to find the item before the
-       et timer. */
-    for(t = timerlist; t != NULL && t->next != et; t = t->next);
-
-    if(t != NULL) {
-      /* We've found the item before the event timer that we are about
-	 to remove. We point the items next pointer to the event after
-	 the removed item. */
-      t->next = et->next;
-
-      update_time();
-    }
-  }
+  remove_timer(et);
 
-  /* Remove the next pointer from the item to be removed. */
-  et->next = NULL;
   /* Set the timer as expired */
   et->p = PROCESS_NONE;
 }
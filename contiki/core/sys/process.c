@@ -45,10 +45,14 @@
  */
 
 #include <stdio.h>
+#include <string.h>
 
 #include "sys/process.h"
 #include "sys/arg.h"
 
+/* Events carry the time they were posted */
+#define PROCESS_TIMESTAMPS (PROCESS_CONF_STATS || PROCESS_CONF_PROFILE)
+
 /*
  * Pointer to the currently running process structure.
  */
@@ -64,16 +68,57 @@ struct event_data {
   process_event_t ev;
   process_data_t data;
   struct process *p;
+#if PROCESS_TIMESTAMPS
+  rtimer_clock_t posted;
+#endif /* PROCESS_TIMESTAMPS */
+};
+
+/*
+ * One ring of events per priority.
+ */
+struct event_queue {
+  struct event_data *events;
+  process_num_events_t size, nevents, fevent;
 };
 
-static process_num_events_t nevents, fevent;
 static struct event_data events[PROCESS_CONF_NUMEVENTS];
+static struct event_data events_high[PROCESS_CONF_NUMEVENTS_HIGH];
+
+static struct event_queue queues[PROCESS_PRIO_LEVELS] = {
+  { events, PROCESS_CONF_NUMEVENTS },
+  { events_high, PROCESS_CONF_NUMEVENTS_HIGH },
+};
 
 #if PROCESS_CONF_STATS
 process_num_events_t process_maxevents;
+struct process_stats process_stats[PROCESS_PRIO_LEVELS];
 #endif
 
-static volatile unsigned char poll_requested;
+/*
+ * One flag per priority, so that process_poll() sets them with a
+ * single store from interrupt handlers.
+ */
+static volatile unsigned char poll_requested[PROCESS_PRIO_LEVELS];
+
+/*
+ * Queues of the interrupt handlers, and a flag set with a single store
+ * when there is something to move from them into the event queues.
+ */
+static struct process_isr_queue *isr_queues;
+static volatile unsigned char isr_pending;
+
+/*
+ * Keeps the compiler from moving memory accesses across it. The queues
+ * of the interrupt handlers need it to publish an event only after it is
+ * complete, and to free it only after it was read.
+ */
+#ifdef PROCESS_CONF_BARRIER
+#define PROCESS_BARRIER() PROCESS_CONF_BARRIER()
+#elif defined(__GNUC__)
+#define PROCESS_BARRIER() __asm__ __volatile__("" ::: "memory")
+#else
+#define PROCESS_BARRIER()
+#endif
 
 #define PROCESS_STATE_NONE        0
 #define PROCESS_STATE_RUNNING     1
@@ -172,10 +217,53 @@ exit_process(struct process *p, struct process *fromprocess)
   process_current = old_current;
 }
 /*---------------------------------------------------------------------------*/
+#if PROCESS_CONF_PROFILE
+static void
+profile_run(struct process *p, process_event_t ev, rtimer_clock_t start)
+{
+  rtimer_clock_t time = RTIMER_NOW() - start;
+
+  p->profile.runs++;
+  p->profile.time += time;
+  if(time > p->profile.max_time) {
+    p->profile.max_time = time;
+    p->profile.max_event = ev;
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+profile_event(struct process *p, rtimer_clock_t posted)
+{
+  rtimer_clock_t latency;
+
+  if((p->state & PROCESS_STATE_RUNNING) && p->thread != NULL) {
+    latency = RTIMER_NOW() - posted;
+    p->profile.events++;
+    p->profile.latency += latency;
+    if(latency > p->profile.max_latency) {
+      p->profile.max_latency = latency;
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
+void
+process_profile_reset(void)
+{
+  struct process *p;
+
+  for(p = process_list; p != NULL; p = p->next) {
+    memset(&p->profile, 0, sizeof(p->profile));
+  }
+}
+#endif /* PROCESS_CONF_PROFILE */
+/*---------------------------------------------------------------------------*/
 static void
 call_process(struct process *p, process_event_t ev, process_data_t data)
 {
   int ret;
+#if PROCESS_CONF_PROFILE
+  rtimer_clock_t start;
+#endif /* PROCESS_CONF_PROFILE */
 
 #if DEBUG
   if(p->state == PROCESS_STATE_CALLED) {
@@ -188,7 +276,13 @@ call_process(struct process *p, process_event_t ev, process_data_t data)
     PRINTF("process: calling process '%s' with event %d\n", PROCESS_NAME_STRING(p), ev);
     process_current = p;
     p->state = PROCESS_STATE_CALLED;
+#if PROCESS_CONF_PROFILE
+    start = RTIMER_NOW();
+#endif /* PROCESS_CONF_PROFILE */
     ret = p->thread(&p->pt, ev, data);
+#if PROCESS_CONF_PROFILE
+    profile_run(p, ev, start);
+#endif /* PROCESS_CONF_PROFILE */
     if(ret == PT_EXITED ||
        ret == PT_ENDED ||
        ev == PROCESS_EVENT_EXIT) {
@@ -208,29 +302,43 @@ process_exit(struct process *p)
 void
 process_init(void)
 {
+  unsigned char i;
+
   lastevent = PROCESS_EVENT_MAX;
 
-  nevents = fevent = 0;
+  for(i = 0; i < PROCESS_PRIO_LEVELS; i++) {
+    queues[i].nevents = queues[i].fevent = 0;
+    poll_requested[i] = 0;
+#if PROCESS_CONF_STATS
+    process_stats[i].maxevents = 0;
+    process_stats[i].full = 0;
+    process_stats[i].events = 0;
+    process_stats[i].latency = 0;
+    process_stats[i].max_latency = 0;
+#endif /* PROCESS_CONF_STATS */
+  }
 #if PROCESS_CONF_STATS
   process_maxevents = 0;
 #endif /* PROCESS_CONF_STATS */
+  isr_queues = NULL;
+  isr_pending = 0;
 
   process_current = process_list = NULL;
 }
 /*---------------------------------------------------------------------------*/
 /*
- * Call each process' poll handler.
+ * Call the poll handler of each process of the given priority.
  */
 /*---------------------------------------------------------------------------*/
 static void
-do_poll(void)
+do_poll(unsigned char prio)
 {
   struct process *p;
 
-  poll_requested = 0;
+  poll_requested[prio] = 0;
   /* Call the processes that needs to be polled. */
   for(p = process_list; p != NULL; p = p->next) {
-    if(p->needspoll) {
+    if(p->needspoll && p->prio == prio) {
       p->state = PROCESS_STATE_RUNNING;
       p->needspoll = 0;
       call_process(p, PROCESS_EVENT_POLL, NULL);
@@ -239,18 +347,63 @@ do_poll(void)
 }
 /*---------------------------------------------------------------------------*/
 /*
- * Process the next event in the event queue and deliver it to
- * listening processes.
+ * Check for poll requests or events of the given or a higher priority.
+ */
+/*---------------------------------------------------------------------------*/
+static int
+pending(unsigned char prio)
+{
+  for(; prio < PROCESS_PRIO_LEVELS; prio++) {
+    if(poll_requested[prio] || queues[prio].nevents > 0) {
+      return 1;
+    }
+  }
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+static void do_event(unsigned char prio);
+
+/*
+ * Starting with the highest priority down to prio, call the poll
+ * handlers and deliver the first event of the first non-empty queue.
  */
 /*---------------------------------------------------------------------------*/
 static void
-do_event(void)
+run_once(unsigned char prio)
 {
-  static process_event_t ev;
-  static process_data_t data;
-  static struct process *receiver;
-  static struct process *p;
-  
+  unsigned char i = PROCESS_PRIO_LEVELS;
+
+  while(i-- > prio) {
+    if(poll_requested[i]) {
+      do_poll(i);
+    }
+    if(queues[i].nevents > 0) {
+      do_event(i);
+      return;
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
+/*
+ * Process the next event in the event queue of the given priority and
+ * deliver it to listening processes.
+ */
+/*---------------------------------------------------------------------------*/
+static void
+do_event(unsigned char prio)
+{
+  struct event_queue *q = &queues[prio];
+  process_event_t ev;
+  process_data_t data;
+  struct process *receiver;
+  struct process *p;
+#if PROCESS_TIMESTAMPS
+  rtimer_clock_t posted;
+#endif /* PROCESS_TIMESTAMPS */
+#if PROCESS_CONF_STATS
+  rtimer_clock_t latency;
+#endif /* PROCESS_CONF_STATS */
+
   /*
    * If there are any events in the queue, take the first one and walk
    * through the list of processes to see if the event should be
@@ -259,29 +412,48 @@ do_event(void)
    * call the poll handlers inbetween.
    */
 
-  if(nevents > 0) {
+  if(q->nevents > 0) {
     
     /* There are events that we should deliver. */
-    ev = events[fevent].ev;
+    ev = q->events[q->fevent].ev;
     
-    data = events[fevent].data;
-    receiver = events[fevent].p;
+    data = q->events[q->fevent].data;
+    receiver = q->events[q->fevent].p;
+
+#if PROCESS_TIMESTAMPS
+    posted = q->events[q->fevent].posted;
+#endif /* PROCESS_TIMESTAMPS */
+#if PROCESS_CONF_STATS
+    latency = RTIMER_NOW() - posted;
+    process_stats[prio].events++;
+    process_stats[prio].latency += latency;
+    if(latency > process_stats[prio].max_latency) {
+      process_stats[prio].max_latency = latency;
+    }
+#endif /* PROCESS_CONF_STATS */
 
     /* Since we have seen the new event, we move pointer upwards
        and decrese the number of events. */
-    fevent = (fevent + 1) % PROCESS_CONF_NUMEVENTS;
-    --nevents;
+    q->fevent = (q->fevent + 1) % q->size;
+    --q->nevents;
 
     /* If this is a broadcast event, we deliver it to all events, in
        order of their priority. */
     if(receiver == PROCESS_BROADCAST) {
       for(p = process_list; p != NULL; p = p->next) {
 
-	/* If we have been requested to poll a process, we do this in
-	   between processing the broadcast event. */
-	if(poll_requested) {
-	  do_poll();
+	/* Polls and events of a higher priority may not wait for the
+	   broadcast to finish, we handle them in between. The polls of
+	   this priority are handled in between too. */
+	while(pending(prio + 1)) {
+	  run_once(prio + 1);
 	}
+	if(poll_requested[prio]) {
+	  do_poll(prio);
+	}
+#if PROCESS_CONF_PROFILE
+	profile_event(p, posted);
+#endif /* PROCESS_CONF_PROFILE */
 	call_process(p, ev, data);
       }
     } else {
@@ -294,46 +466,104 @@ do_event(void)
       }
 
       /* Make sure that the process actually is running. */
+#if PROCESS_CONF_PROFILE
+      profile_event(receiver, posted);
+#endif /* PROCESS_CONF_PROFILE */
       call_process(receiver, ev, data);
     }
   }
 }
 /*---------------------------------------------------------------------------*/
+/*
+ * Move the events posted by interrupt handlers into the event queues.
+ */
+/*---------------------------------------------------------------------------*/
+static void
+merge_isr_queues(void)
+{
+  struct process_isr_queue *q;
+  struct process_isr_event *e;
+  process_num_events_t tail;
+
+  isr_pending = 0;
+  for(q = isr_queues; q != NULL; q = q->next) {
+    tail = q->tail;
+    while(tail != q->head) {
+      PROCESS_BARRIER();
+      e = &q->events[tail & (q->size - 1)];
+      if(process_post_prio(e->p, e->ev, e->data, q->prio) != PROCESS_ERR_OK) {
+	/* Keep the rest until the event queue has room again */
+	isr_pending = 1;
+	break;
+      }
+      PROCESS_BARRIER();
+      q->tail = ++tail;
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
 int
 process_run(void)
 {
-  /* Process poll events. */
-  if(poll_requested) {
-    do_poll();
+  if(isr_pending) {
+    merge_isr_queues();
   }
 
-  /* Process one event from the queue */
-  do_event();
+  /* Process poll events and one event from the queues, the high
+     priority ones first. */
+  run_once(PROCESS_PRIO_NORMAL);
 
-  return nevents + poll_requested;
+  return process_nevents();
 }
 /*---------------------------------------------------------------------------*/
 int
 process_nevents(void)
 {
-  return nevents + poll_requested;
+  unsigned char i;
+  int n = 0;
+
+  for(i = 0; i < PROCESS_PRIO_LEVELS; i++) {
+    n += queues[i].nevents + poll_requested[i];
+  }
+  return n + isr_pending;
 }
 /*---------------------------------------------------------------------------*/
 int
 process_post(struct process *p, process_event_t ev, process_data_t data)
+{
+  return process_post_prio(p, ev, data, PROCESS_PRIO_NORMAL);
+}
+/*---------------------------------------------------------------------------*/
+int
+process_post_prio(struct process *p, process_event_t ev, process_data_t data,
+		  unsigned char prio)
 {
   static process_num_events_t snum;
+  struct event_queue *q;
+#if PROCESS_CONF_STATS
+  process_num_events_t total;
+  unsigned char i;
+#endif /* PROCESS_CONF_STATS */
+
+  if(prio >= PROCESS_PRIO_LEVELS) {
+    prio = PROCESS_PRIO_LEVELS - 1;
+  }
+  q = &queues[prio];
 
   if(PROCESS_CURRENT() == NULL) {
-    PRINTF("process_post: NULL process posts event %d to process '%s', nevents %d\n",
-	   ev,PROCESS_NAME_STRING(p), nevents);
+    PRINTF("process_post: NULL process posts event %d to process '%s', prio %d, nevents %d\n",
+	   ev,PROCESS_NAME_STRING(p), prio, q->nevents);
   } else {
-    PRINTF("process_post: Process '%s' posts event %d to process '%s', nevents %d\n",
+    PRINTF("process_post: Process '%s' posts event %d to process '%s', prio %d, nevents %d\n",
 	   PROCESS_NAME_STRING(PROCESS_CURRENT()), ev,
-	   p == PROCESS_BROADCAST? "<broadcast>": PROCESS_NAME_STRING(p), nevents);
+	   p == PROCESS_BROADCAST? "<broadcast>": PROCESS_NAME_STRING(p),
+	   prio, q->nevents);
   }
   
-  if(nevents == PROCESS_CONF_NUMEVENTS) {
+  if(q->nevents == q->size) {
+#if PROCESS_CONF_STATS
+    process_stats[prio].full++;
+#endif /* PROCESS_CONF_STATS */
 #if DEBUG
     if(p == PROCESS_BROADCAST) {
       printf("soft panic: event queue is full when broadcast event %d was posted from %s\n", ev, PROCESS_NAME_STRING(process_current));
@@ -344,15 +574,25 @@ process_post(struct process *p, process_event_t ev, process_data_t data)
     return PROCESS_ERR_FULL;
   }
   
-  snum = (process_num_events_t)(fevent + nevents) % PROCESS_CONF_NUMEVENTS;
-  events[snum].ev = ev;
-  events[snum].data = data;
-  events[snum].p = p;
-  ++nevents;
+  snum = (process_num_events_t)(q->fevent + q->nevents) % q->size;
+  q->events[snum].ev = ev;
+  q->events[snum].data = data;
+  q->events[snum].p = p;
+#if PROCESS_TIMESTAMPS
+  q->events[snum].posted = RTIMER_NOW();
+#endif /* PROCESS_TIMESTAMPS */
+  ++q->nevents;
 
 #if PROCESS_CONF_STATS
-  if(nevents > process_maxevents) {
-    process_maxevents = nevents;
+  if(q->nevents > process_stats[prio].maxevents) {
+    process_stats[prio].maxevents = q->nevents;
+  }
+  total = 0;
+  for(i = 0; i < PROCESS_PRIO_LEVELS; i++) {
+    total += queues[i].nevents;
+  }
+  if(total > process_maxevents) {
+    process_maxevents = total;
   }
 #endif /* PROCESS_CONF_STATS */
   
@@ -360,6 +600,43 @@ process_post(struct process *p, process_event_t ev, process_data_t data)
 }
 /*---------------------------------------------------------------------------*/
 void
+process_isr_queue_register(struct process_isr_queue *q)
+{
+  struct process_isr_queue *r;
+
+  for(r = isr_queues; r != NULL; r = r->next) {
+    if(r == q) {
+      return;
+    }
+  }
+  q->tail = q->head;
+  q->next = isr_queues;
+  isr_queues = q;
+}
+/*---------------------------------------------------------------------------*/
+int
+process_post_isr(struct process_isr_queue *q, struct process *p,
+		 process_event_t ev, process_data_t data)
+{
+  process_num_events_t head = q->head;
+  struct process_isr_event *e;
+
+  if((process_num_events_t)(head - q->tail) == q->size) {
+    q->full++;
+    return PROCESS_ERR_FULL;
+  }
+  e = &q->events[head & (q->size - 1)];
+  e->p = p;
+  e->ev = ev;
+  e->data = data;
+  /* The event must be complete before process_run() sees it */
+  PROCESS_BARRIER();
+  q->head = head + 1;
+  isr_pending = 1;
+  return PROCESS_ERR_OK;
+}
+/*---------------------------------------------------------------------------*/
+void
 process_post_synch(struct process *p, process_event_t ev, process_data_t data)
 {
   struct process *caller = process_current;
@@ -375,11 +652,23 @@ process_poll(struct process *p)
     if(p->state == PROCESS_STATE_RUNNING ||
        p->state == PROCESS_STATE_CALLED) {
       p->needspoll = 1;
-      poll_requested = 1;
+      poll_requested[p->prio] = 1;
     }
   }
 }
 /*---------------------------------------------------------------------------*/
+void
+process_set_prio(struct process *p, unsigned char prio)
+{
+  if(prio >= PROCESS_PRIO_LEVELS) {
+    prio = PROCESS_PRIO_LEVELS - 1;
+  }
+  p->prio = prio;
+  if(p->needspoll) {
+    poll_requested[prio] = 1;
+  }
+}
+/*---------------------------------------------------------------------------*/
 int
 process_is_running(struct process *p)
 {
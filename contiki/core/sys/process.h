@@ -56,6 +56,9 @@
 
 #include "sys/pt.h"
 #include "sys/cc.h"
+#if PROCESS_CONF_STATS || PROCESS_CONF_PROFILE
+#include "sys/rtimer.h"
+#endif /* PROCESS_CONF_STATS || PROCESS_CONF_PROFILE */
 
 typedef unsigned char process_event_t;
 typedef void *        process_data_t;
@@ -89,6 +92,25 @@ typedef unsigned char process_num_events_t;
 #define PROCESS_CONF_NUMEVENTS 32
 #endif /* PROCESS_CONF_NUMEVENTS */
 
+/* Size of the queue of high priority events */
+#ifndef PROCESS_CONF_NUMEVENTS_HIGH
+#define PROCESS_CONF_NUMEVENTS_HIGH 4
+#endif /* PROCESS_CONF_NUMEVENTS_HIGH */
+
+/**
+ * \name Priorities
+ *
+ * Events and polls of a higher priority are delivered before all
+ * events and polls of a lower priority, also in between the
+ * deliveries of a lower priority broadcast event. Within a priority
+ * events are delivered in the order they were posted.
+ * @{
+ */
+#define PROCESS_PRIO_NORMAL   0
+#define PROCESS_PRIO_HIGH     1
+#define PROCESS_PRIO_LEVELS   2
+/* @} */
+
 #define PROCESS_EVENT_NONE            0x80
 #define PROCESS_EVENT_INIT            0x81
 #define PROCESS_EVENT_POLL            0x82
@@ -313,6 +335,25 @@ static PT_THREAD(process_thread_##name(struct pt *process_pt,	\
 
 /** @} */
 
+#if PROCESS_CONF_PROFILE
+/**
+ * Run time and event latency of a process, collected when
+ * PROCESS_CONF_PROFILE is set. Times are in rtimer ticks. The run
+ * time of a call includes the processes it called synchronously.
+ */
+struct process_profile {
+  unsigned long runs;             /**< calls of the process thread */
+  unsigned long time;             /**< sum of the run times */
+  rtimer_clock_t max_time;        /**< longest run */
+  process_event_t max_event;      /**< event of the longest run */
+  unsigned long events;           /**< asynchronous events delivered */
+  unsigned long latency;          /**< sum of the time from posting to
+                                       delivery */
+  rtimer_clock_t max_latency;     /**< longest time from posting to
+                                       delivery */
+};
+#endif /* PROCESS_CONF_PROFILE */
+
 struct process {
   struct process *next;
 #if PROCESS_CONF_NO_PROCESS_NAMES
@@ -323,7 +364,10 @@ struct process {
 #endif
   PT_THREAD((* thread)(struct pt *, process_event_t, process_data_t));
   struct pt pt;
-  unsigned char state, needspoll;
+  unsigned char state, needspoll, prio;
+#if PROCESS_CONF_PROFILE
+  struct process_profile profile;
+#endif /* PROCESS_CONF_PROFILE */
 };
 
 /**
@@ -365,6 +409,22 @@ CCIF void process_start(struct process *p, const char *arg);
  */
 CCIF int process_post(struct process *p, process_event_t ev, void* data);
 
+/**
+ * Post an asynchronous event with a priority.
+ *
+ * Same as process_post(), but the event goes into the queue of the
+ * given priority. process_post() posts with PROCESS_PRIO_NORMAL.
+ *
+ * \param prio PROCESS_PRIO_NORMAL or PROCESS_PRIO_HIGH
+ *
+ * \retval PROCESS_ERR_OK The event could be posted.
+ *
+ * \retval PROCESS_ERR_FULL The queue of the priority was full and
+ * the event could not be posted.
+ */
+CCIF int process_post_prio(struct process *p, process_event_t ev,
+			   void* data, unsigned char prio);
+
 /**
  * Post a synchronous event to a process.
  *
@@ -470,6 +530,88 @@ CCIF process_event_t process_alloc_event(void);
  */
 CCIF void process_poll(struct process *p);
 
+/**
+ * Set the priority of the polls of a process.
+ *
+ * Processes start with PROCESS_PRIO_NORMAL. Typically radio and MAC
+ * drivers set PROCESS_PRIO_HIGH, so that their poll handlers do not
+ * wait for the events of the applications.
+ *
+ * \param p A pointer to the process' process structure.
+ * \param prio PROCESS_PRIO_NORMAL or PROCESS_PRIO_HIGH
+ */
+CCIF void process_set_prio(struct process *p, unsigned char prio);
+
+/**
+ * An event posted from an interrupt handler.
+ */
+struct process_isr_event {
+  struct process *p;
+  process_event_t ev;
+  process_data_t data;
+};
+
+/**
+ * Queue of the events posted by one interrupt handler.
+ *
+ * process_post() must not be called from interrupt handlers, it is not
+ * reentrant. Instead, each interrupt source posts into a queue of its
+ * own with process_post_isr(), without disabling interrupts: only the
+ * handler writes head, only process_run() writes tail. process_run()
+ * moves the events into the event queue of the given priority, in the
+ * order they were posted. process_poll() is safe from interrupt
+ * handlers as it is.
+ *
+ * Declare the queue with PROCESS_ISR_QUEUE() and register it with
+ * process_isr_queue_register() before enabling the interrupt.
+ */
+struct process_isr_queue {
+  struct process_isr_queue *next;
+  struct process_isr_event *events;
+  process_num_events_t size;             /**< a power of two */
+  unsigned char prio;                    /**< PROCESS_PRIO_* of the events */
+  volatile process_num_events_t head;    /**< written by the handler */
+  volatile process_num_events_t tail;    /**< written by process_run() */
+  unsigned short full;                   /**< posts failed, the queue was
+                                              full */
+};
+
+/**
+ * Declare a queue for process_post_isr().
+ *
+ * \param name The variable name of the queue.
+ * \param size Number of events, a power of two up to 128.
+ * \param prio Priority of the events, PROCESS_PRIO_*.
+ *
+ * \hideinitializer
+ */
+#define PROCESS_ISR_QUEUE(name, size, prio)                     \
+  static struct process_isr_event name##_events[size];          \
+  static struct process_isr_queue name = { NULL, name##_events, \
+                                           size, prio }
+
+/**
+ * Register a queue declared with PROCESS_ISR_QUEUE(). Registering a
+ * queue twice has no effect.
+ */
+CCIF void process_isr_queue_register(struct process_isr_queue *q);
+
+/**
+ * Post an asynchronous event from an interrupt handler.
+ *
+ * Only the interrupt handler the queue belongs to may call this for the
+ * queue, it must not be interrupted by another call for the same queue.
+ *
+ * \param q The queue of the interrupt handler.
+ *
+ * \retval PROCESS_ERR_OK The event could be posted.
+ *
+ * \retval PROCESS_ERR_FULL The queue was full and the event could not
+ * be posted.
+ */
+CCIF int process_post_isr(struct process_isr_queue *q, struct process *p,
+			  process_event_t ev, void* data);
+
 /** @} */
 
 /**
@@ -526,6 +668,33 @@ CCIF extern struct process *process_list;
 
 #define PROCESS_LIST() process_list
 
+#if PROCESS_CONF_PROFILE
+/**
+ * Clear the profiles of all processes.
+ */
+void process_profile_reset(void);
+#endif /* PROCESS_CONF_PROFILE */
+
+#if PROCESS_CONF_STATS
+/**
+ * Statistics of the event queue of one priority.
+ */
+struct process_stats {
+  process_num_events_t maxevents; /**< most events ever queued */
+  unsigned long full;             /**< posts failed, the queue was full */
+  unsigned long events;           /**< events delivered */
+  unsigned long latency;          /**< sum of the time the delivered
+                                       events were queued, in rtimer
+                                       ticks */
+  rtimer_clock_t max_latency;     /**< longest time an event was queued */
+};
+
+/** Most events ever queued over all priorities */
+extern process_num_events_t process_maxevents;
+/** Statistics per priority, indexed by PROCESS_PRIO_* */
+extern struct process_stats process_stats[PROCESS_PRIO_LEVELS];
+#endif /* PROCESS_CONF_STATS */
+
 #endif /* __PROCESS_H__ */
 
 /** @} */
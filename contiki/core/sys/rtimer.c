@@ -56,7 +56,10 @@
 #define PRINTF(...)
 #endif
 
-static struct rtimer *next_rtimer;
+/* pending tasks, sorted by time, tasks with the same time in the order
+   they were posted */
+static struct rtimer *rtimer_queue;
+static uint8_t dispatching;
 
 /*---------------------------------------------------------------------------*/
 void
@@ -65,28 +68,50 @@ rtimer_init(void)
   rtimer_arch_init();
 }
 /*---------------------------------------------------------------------------*/
+static void
+remove_task(struct rtimer *rtimer)
+{
+  struct rtimer **p;
+
+  for(p = &rtimer_queue; *p != NULL; p = &(*p)->next) {
+    if(*p == rtimer) {
+      *p = rtimer->next;
+      return;
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
 int
 rtimer_set(struct rtimer *rtimer, rtimer_clock_t time,
 	   rtimer_clock_t duration,
 	   rtimer_callback_t func, void *ptr)
 {
-  int first = 0;
+  struct rtimer **p, *first;
 
   PRINTF("rtimer_set time %d\n", time);
 
-  if(next_rtimer == NULL) {
-    first = 1;
-  }
+  RTIMER_ARCH_LOCK();
+  first = rtimer_queue;
+  remove_task(rtimer);
 
   rtimer->func = func;
   rtimer->ptr = ptr;
-
   rtimer->time = time;
-  next_rtimer = rtimer;
 
-  if(first == 1) {
-    rtimer_arch_schedule(time);
+  for(p = &rtimer_queue;
+      *p != NULL && !RTIMER_CLOCK_LT(time, (*p)->time);
+      p = &(*p)->next);
+  rtimer->next = *p;
+  *p = rtimer;
+
+  /* the timer is set for the first task: reprogram it when another task
+     became the first one or the first one moved, including a first task
+     posted again for a later time, unless rtimer_run_next() does that
+     when the callbacks are done */
+  if((rtimer_queue != first || rtimer_queue == rtimer) && !dispatching) {
+    rtimer_arch_schedule(rtimer_queue->time);
   }
+  RTIMER_ARCH_UNLOCK();
   return RTIMER_OK;
 }
 /*---------------------------------------------------------------------------*/
@@ -94,15 +119,38 @@ void
 rtimer_run_next(void)
 {
   struct rtimer *t;
-  if(next_rtimer == NULL) {
-    return;
+
+  RTIMER_ARCH_LOCK();
+  dispatching = 1;
+  /* run the tasks that are due by now, the timer may also fire for a
+     time the first task no longer has */
+  t = rtimer_queue;
+  while(t != NULL && !RTIMER_CLOCK_LT(RTIMER_NOW(), t->time)) {
+    rtimer_queue = t->next;
+    t->next = NULL;
+    RTIMER_ARCH_UNLOCK();
+    t->func(t, t->ptr);
+    RTIMER_ARCH_LOCK();
+    t = rtimer_queue;
+  }
+  dispatching = 0;
+  if(rtimer_queue != NULL) {
+    rtimer_arch_schedule(rtimer_queue->time);
   }
-  t = next_rtimer;
-  next_rtimer = NULL;
-  t->func(t, t->ptr);
-  if(next_rtimer != NULL) {
-    rtimer_arch_schedule(next_rtimer->time);
+  RTIMER_ARCH_UNLOCK();
+}
+/*---------------------------------------------------------------------------*/
+int
+rtimer_next_expiration_time(rtimer_clock_t *time)
+{
+  int pending;
+
+  RTIMER_ARCH_LOCK();
+  pending = rtimer_queue != NULL;
+  if(pending) {
+    *time = rtimer_queue->time;
   }
-  return;
+  RTIMER_ARCH_UNLOCK();
+  return pending;
 }
 /*---------------------------------------------------------------------------*/
@@ -62,6 +62,13 @@ typedef unsigned short rtimer_clock_t;
 
 #include "rtimer-arch.h"
 
+/* Protect the timer queue against rtimer_run_next(), for architectures
+   that run it from an interrupt while tasks are posted from the thread */
+#ifndef RTIMER_ARCH_LOCK
+#define RTIMER_ARCH_LOCK()
+#define RTIMER_ARCH_UNLOCK()
+#endif /* RTIMER_ARCH_LOCK */
+
 /**
  * \brief      Initialize the real-time scheduler.
  *
@@ -82,6 +89,7 @@ typedef void (* rtimer_callback_t)(struct rtimer *t, void *ptr);
  *             support module for the real-time module.
  */
 struct rtimer {
+  struct rtimer *next;
   rtimer_clock_t time;
   rtimer_callback_t func;
   void *ptr;
@@ -105,7 +113,9 @@ enum {
  *             (false) if the task could not be scheduled.
  *
  *             This function schedules a real-time task at a specified
- *             time in the future.
+ *             time in the future. Tasks are kept in a queue sorted by
+ *             time, so several tasks may be pending at once. Posting a
+ *             task that is already pending moves it to the new time.
  *
  */
 int rtimer_set(struct rtimer *task, rtimer_clock_t time,
@@ -116,10 +126,25 @@ int rtimer_set(struct rtimer *task, rtimer_clock_t time,
  *
  *             This function is called by the architecture dependent
  *             code to execute and schedule the next real-time task.
+ *             All tasks that are due by then get executed in the order
+ *             of their time.
  *
  */
 void rtimer_run_next(void);
 
+/**
+ * \brief      Get the time of the next real-time task
+ * \param time Set to the time of the first pending task
+ * \return     Non-zero (true) if a task is pending, zero (false)
+ *             otherwise
+ *
+ *             Tickless platforms use this together with
+ *             etimer_next_expiration_time() to find out when to wake up
+ *             next.
+ *
+ */
+int rtimer_next_expiration_time(rtimer_clock_t *time);
+
 /**
  * \brief      Get the current clock time
  * \return     The current time
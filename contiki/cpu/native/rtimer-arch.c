@@ -63,6 +63,35 @@ interrupt(int sig)
   rtimer_run_next();
 }
 /*---------------------------------------------------------------------------*/
+#ifndef _WIN32
+static int lock_depth;
+static sigset_t lock_mask;
+#endif /* !_WIN32 */
+
+void
+rtimer_arch_lock(void)
+{
+#ifndef _WIN32
+  sigset_t alarm;
+
+  if(lock_depth++ == 0) {
+    sigemptyset(&alarm);
+    sigaddset(&alarm, SIGALRM);
+    sigprocmask(SIG_BLOCK, &alarm, &lock_mask);
+  }
+#endif /* !_WIN32 */
+}
+/*---------------------------------------------------------------------------*/
+void
+rtimer_arch_unlock(void)
+{
+#ifndef _WIN32
+  if(--lock_depth == 0) {
+    sigprocmask(SIG_SETMASK, &lock_mask, NULL);
+  }
+#endif /* !_WIN32 */
+}
+/*---------------------------------------------------------------------------*/
 void
 rtimer_arch_init(void)
 {
@@ -79,6 +108,10 @@ rtimer_arch_schedule(rtimer_clock_t t)
   rtimer_clock_t c;
 
   c = t - (unsigned short)clock_time();
+  if((signed short)c <= 0) {
+    /* due or past: a zero timer value would disarm the timer */
+    c = 1;
+  }
   
   val.it_value.tv_sec = c / 1000;
   val.it_value.tv_usec = (c % 1000) * 1000;
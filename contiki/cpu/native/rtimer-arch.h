@@ -42,9 +42,17 @@
 #define __RTIMER_ARCH_H__
 
 #include "contiki-conf.h"
+#include "sys/clock.h"
 
 #define RTIMER_ARCH_SECOND CLOCK_CONF_SECOND
 
 #define rtimer_arch_now() clock_time()
 
+/* rtimer_run_next() runs from the SIGALRM handler */
+#define RTIMER_ARCH_LOCK()   rtimer_arch_lock()
+#define RTIMER_ARCH_UNLOCK() rtimer_arch_unlock()
+
+void rtimer_arch_lock(void);
+void rtimer_arch_unlock(void);
+
 #endif /* __RTIMER_ARCH_H__ */
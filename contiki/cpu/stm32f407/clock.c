@@ -51,22 +51,29 @@ static volatile clock_time_t count;
 static volatile unsigned long current_seconds = 0;
 static unsigned int second_countdown = CLOCK_SECOND;
 
+/*---------------------------------------------------------------------------*/
+static void advance(clock_time_t ticks) {
+  count += ticks;
+
+  while(ticks >= second_countdown) {
+    ticks -= second_countdown;
+    current_seconds++;
+    second_countdown = CLOCK_SECOND;
+  }
+  second_countdown -= ticks;
+}
+
 /*----------------------------------------------------------------------------
   Systick Interrupt Handler
-  SysTick interrupt happens every 1 ms
+  SysTick interrupt happens every 1 ms. With CLOCK_CONF_TICKLESS it may be
+  stretched in clock_idle() up to the next etimer expiration
  *----------------------------------------------------------------------------*/
 void SysTick_Handler(void) {
-  count++;
+  advance(1);
 
   if(etimer_pending()) {
     etimer_request_poll();
   }
-  
-  if (--second_countdown == 0) {
-    current_seconds++;
-    second_countdown = CLOCK_SECOND;
-  }
-  
 }
 
 /*---------------------------------------------------------------------------*/
@@ -114,3 +121,88 @@ void clock_wait(clock_time_t i) {
 unsigned long clock_seconds(void) {
   return current_seconds;
 }
+
+/*---------------------------------------------------------------------------*/
+#if CLOCK_CONF_TICKLESS
+/**
+ * Sleep (WFI) until the next interrupt. If the next etimer expires more
+ * than a tick ahead, SysTick is reloaded to fire only then, at most
+ * 0xffffff cycles (~99 ms at 168 MHz) later. On wakeup the clock gets
+ * advanced by the ticks slept, and SysTick continues with 1 ms.
+ *
+ * The head of the rtimer queue does not bound the sleep: rtimers run on
+ * TIM1, whose compare and overflow interrupts end the WFI by themselves,
+ * and a wakeup before the stretched SysTick only counts the ticks that
+ * passed.
+ */
+void clock_idle(void) {
+  uint32_t cycles = SystemCoreClock / CLOCK_SECOND;
+  uint32_t load, val;
+  clock_time_t ticks, left;
+
+  __disable_irq();
+  if(process_nevents() > 0) {
+    __enable_irq();
+    return;
+  }
+
+  /* room for the rest of the current tick */
+  ticks = (SysTick_LOAD_RELOAD_Msk - cycles) / cycles;
+  if(etimer_pending()) {
+    left = etimer_next_expiration_time() - count;
+    if((int)left < (int)ticks) {
+      ticks = (int)left < 0 ? 0 : left;
+    }
+  }
+
+  if(ticks < 2 || (SCB->ICSR & SCB_ICSR_PENDSTSET_Msk)) {
+    /* the next tick is due anyway */
+    __DSB();
+    __WFI();
+    __enable_irq();
+    return;
+  }
+
+  /* Stop SysTick. The current tick ends after VAL cycles, ticks - 1
+     more follow. Writing VAL clears COUNTFLAG. */
+  SysTick->CTRL = SysTick_CTRL_CLKSOURCE_Msk | SysTick_CTRL_TICKINT_Msk;
+  load = SysTick->VAL + (ticks - 1) * cycles;
+  SysTick->LOAD = load;
+  SysTick->VAL = 0;
+  SysTick->CTRL = SysTick_CTRL_CLKSOURCE_Msk | SysTick_CTRL_TICKINT_Msk |
+    SysTick_CTRL_ENABLE_Msk;
+
+  __DSB();
+  __WFI();
+  __ISB();
+
+  SysTick->CTRL = SysTick_CTRL_CLKSOURCE_Msk | SysTick_CTRL_TICKINT_Msk;
+  if(SysTick->CTRL & SysTick_CTRL_COUNTFLAG_Msk) {
+    /* Slept until the end, the pending SysTick interrupt counts the
+       last tick */
+    advance(ticks - 1);
+    load = cycles;
+  } else {
+    /* Another interrupt woke us up. Count the ticks completed, the next
+       SysTick interrupt ends the current one. */
+    val = SysTick->VAL;
+    advance(ticks - 1 - val / cycles);
+    load = val % cycles;
+    if(load == 0) {
+      load = cycles;
+    }
+  }
+
+  /* Continue with the rest of the tick, then reload 1 ms periods */
+  SysTick->LOAD = load - 1;
+  SysTick->VAL = 0;
+  SysTick->CTRL = SysTick_CTRL_CLKSOURCE_Msk | SysTick_CTRL_TICKINT_Msk |
+    SysTick_CTRL_ENABLE_Msk;
+  SysTick->LOAD = cycles - 1;
+
+  if(etimer_pending()) {
+    etimer_request_poll();
+  }
+  __enable_irq();
+}
+#endif /* CLOCK_CONF_TICKLESS */
@@ -62,6 +62,10 @@ static rtimer_clock_t next_rtimer_time = 0;
 
 static uint16_t saved_TIM1_DIER;
 
+/* PRIMASK before the outermost rtimer_arch_lock() */
+static uint32_t lock_primask;
+static uint8_t lock_depth;
+
 /*---------------------------------------------------------------------------*/
 void TIM1_UP_TIM10_IRQHandler(void) {
 	rtimer_clock_t now, clock_to_wait;
@@ -146,6 +150,28 @@ void rtimer_arch_enable_irq(void)
   TIM1->DIER = saved_TIM1_DIER;
 }
 /*---------------------------------------------------------------------------*/
+/* Masks all interrupts while the rtimer queue is changed, in thread mode
+   and in interrupt handlers. Nested calls keep them masked, the outermost
+   unlock restores the PRIMASK it found. */
+void
+rtimer_arch_lock(void)
+{
+  uint32_t primask = __get_PRIMASK();
+
+  __disable_irq();
+  if(lock_depth++ == 0) {
+    lock_primask = primask;
+  }
+}
+/*---------------------------------------------------------------------------*/
+void
+rtimer_arch_unlock(void)
+{
+  if(--lock_depth == 0) {
+    __set_PRIMASK(lock_primask);
+  }
+}
+/*---------------------------------------------------------------------------*/
 rtimer_clock_t rtimer_arch_now(void)
 {
   return ((rtimer_clock_t)time_msb << 16)|TIM1->CNT;
@@ -84,4 +84,11 @@ rtimer_clock_t rtimer_arch_now(void);
 void rtimer_arch_disable_irq(void);
 void rtimer_arch_enable_irq(void);
 
+/* rtimer_run_next() runs from TIM1_CC_IRQHandler */
+#define RTIMER_ARCH_LOCK()   rtimer_arch_lock()
+#define RTIMER_ARCH_UNLOCK() rtimer_arch_unlock()
+
+void rtimer_arch_lock(void);
+void rtimer_arch_unlock(void);
+
 #endif /* __RTIMER_ARCH_H__ */
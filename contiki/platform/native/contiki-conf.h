@@ -66,7 +66,9 @@ typedef unsigned short uip_stats_t;
 #define UIP_CONF_UDP             1
 #define UIP_CONF_MAX_CONNECTIONS 40
 #define UIP_CONF_MAX_LISTENPORTS 40
+#ifndef UIP_CONF_BUFFER_SIZE
 #define UIP_CONF_BUFFER_SIZE     420
+#endif /* UIP_CONF_BUFFER_SIZE */
 #define UIP_CONF_BYTE_ORDER      UIP_LITTLE_ENDIAN
 #define UIP_CONF_TCP       1
 #define UIP_CONF_TCP_SPLIT       0
@@ -170,6 +172,12 @@ typedef unsigned long clock_time_t;
 
 #define CLOCK_CONF_SECOND 1000
 
+/* Sleep in select() until the next etimer or rtimer expires, instead of
+   waking up every ms */
+#ifndef CLOCK_CONF_TICKLESS
+#define CLOCK_CONF_TICKLESS 0
+#endif /* CLOCK_CONF_TICKLESS */
+
 #define LOG_CONF_ENABLED 1
 
 /* Not part of C99 but actually present */
@@ -35,6 +35,10 @@
 #include <string.h>
 #include <unistd.h>
 #include <sys/select.h>
+#include <errno.h>
+#if CLOCK_CONF_TICKLESS
+#include <signal.h>
+#endif /* CLOCK_CONF_TICKLESS */
 
 #ifdef __CYGWIN__
 #include "net/wpcap-drv.h"
@@ -113,9 +117,15 @@ static void
 stdin_handle_fd(fd_set *rset, fd_set *wset)
 {
   char c;
+  int ret;
   if(FD_ISSET(STDIN_FILENO, rset)) {
-    if(read(STDIN_FILENO, &c, 1) > 0) {
+    ret = read(STDIN_FILENO, &c, 1);
+    if(ret > 0) {
       serial_line_input_byte(c);
+    } else if(ret == 0) {
+      /* end of file, e.g. /dev/null: stdin would stay readable and keep
+         the main loop from sleeping */
+      select_set_callback(STDIN_FILENO, NULL);
     }
   }
 }
@@ -150,7 +160,49 @@ set_rime_addr(void)
   printf("%d\n", addr.u8[i]);
 }
 
-
+/*---------------------------------------------------------------------------*/
+#if CLOCK_CONF_TICKLESS
+/*
+ * Time until the next etimer or rtimer expires, NULL if none is pending.
+ */
+static struct timespec *
+next_wakeup(struct timespec *ts)
+{
+  rtimer_clock_t rt;
+  int pending = 0;
+  long ms = 0;
+  long r;
+
+  if(etimer_pending()) {
+    ms = (long)(etimer_next_expiration_time() - clock_time());
+    ms = ms * 1000 / CLOCK_SECOND;
+    pending = 1;
+  }
+  if(rtimer_next_expiration_time(&rt)) {
+    /* SIGALRM ends the wait when the task is due. It may come up to a
+       tick after RTIMER_NOW() reached the time of the task, so wait a
+       tick longer instead of polling until then. */
+    r = (signed short)(rt - RTIMER_NOW());
+    if(r < 0) {
+      r = 0;
+    }
+    r = (r + 1) * 1000 / RTIMER_SECOND;
+    if(!pending || r < ms) {
+      ms = r;
+    }
+    pending = 1;
+  }
+  if(!pending) {
+    return NULL;
+  }
+  if(ms < 0) {
+    ms = 0;
+  }
+  ts->tv_sec = ms / 1000;
+  ts->tv_nsec = (ms % 1000) * 1000000;
+  return ts;
+}
+#endif /* CLOCK_CONF_TICKLESS */
 /*---------------------------------------------------------------------------*/
 int contiki_argc = 0;
 char **contiki_argv;
@@ -187,6 +239,7 @@ main(int argc, char **argv)
   process_init();
   process_start(&etimer_process, NULL);
   ctimer_init();
+  rtimer_init();
 
   set_rime_addr();
 
@@ -234,12 +287,31 @@ main(int argc, char **argv)
     int maxfd;
     int i;
     int retval;
+#if CLOCK_CONF_TICKLESS
+    struct timespec ts, *timeout;
+    sigset_t alarm, mask;
+#else
     struct timeval tv;
+#endif /* CLOCK_CONF_TICKLESS */
 
     retval = process_run();
 
+#if CLOCK_CONF_TICKLESS
+    /* Block SIGALRM until pselect() waits, so that an rtimer callback
+       that polls a process after the check cannot go unnoticed */
+    sigemptyset(&alarm);
+    sigaddset(&alarm, SIGALRM);
+    sigprocmask(SIG_BLOCK, &alarm, &mask);
+    if(process_nevents() > 0) {
+      ts.tv_sec = ts.tv_nsec = 0;
+      timeout = &ts;
+    } else {
+      timeout = next_wakeup(&ts);
+    }
+#else
     tv.tv_sec = 0;
     tv.tv_usec = retval ? 1 : 1000;
+#endif /* CLOCK_CONF_TICKLESS */
 
     FD_ZERO(&fdr);
     FD_ZERO(&fdw);
@@ -250,9 +322,17 @@ main(int argc, char **argv)
       }
     }
 
+#if CLOCK_CONF_TICKLESS
+    retval = pselect(maxfd + 1, &fdr, &fdw, NULL, timeout, &mask);
+    sigprocmask(SIG_SETMASK, &mask, NULL);
+#else
     retval = select(maxfd + 1, &fdr, &fdw, NULL, &tv);
+#endif /* CLOCK_CONF_TICKLESS */
     if(retval < 0) {
-      perror("select");
+      /* an rtimer (SIGALRM) interrupts the select */
+      if(errno != EINTR) {
+        perror("select");
+      }
     } else if(retval > 0) {
       /* timeout => retval == 0 */
       for(i = 0; i <= maxfd; i++) {
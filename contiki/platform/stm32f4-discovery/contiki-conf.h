@@ -24,6 +24,13 @@
 
 #define CLOCK_CONF_SECOND 1000
 
+/* Sleep in the main loop, without SysTick interrupts until the next
+   etimer expires. Off until the SysTick stretching in clock_idle() has
+   been checked on the board. */
+#ifndef CLOCK_CONF_TICKLESS
+#define CLOCK_CONF_TICKLESS 0
+#endif /* CLOCK_CONF_TICKLESS */
+
 
 //#define SLIP_PORT RS232_PORT_1
 
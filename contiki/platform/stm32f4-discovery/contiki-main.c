@@ -234,5 +234,10 @@ int main (void) {                       /* Main Program                       */
     //watchdog_periodic();
     process_run();
 
+#if CLOCK_CONF_TICKLESS
+    /* sleep until the next interrupt or etimer expiration */
+    clock_idle();
+#endif /* CLOCK_CONF_TICKLESS */
+
   }
 }
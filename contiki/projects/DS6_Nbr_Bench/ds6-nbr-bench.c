@@ -0,0 +1,287 @@
+/*
+ * Copyright (c) 2012, TU Dortmund University.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following
+ *    disclaimer in the documentation and/or other materials provided
+ *    with the distribution.
+ * 3. The name of the author may not be used to endorse or promote
+ *    products derived from this software without specific prior
+ *    written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS
+ * OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+ * GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * This file is part of the Contiki OS
+ *
+ */
+/*---------------------------------------------------------------------------*/
+/*---------------------------------------------------------------------------*/
+/**
+ * \file    Micro-benchmark of the neighbor cache. For cache sizes doubling
+ *          up to UIP_DS6_NBR_NB the cache gets filled with the link-local
+ *          and the global address of half as many nodes, so each
+ *          link-layer address belongs to two neighbors. Measured are
+ *          - adding all neighbors,
+ *          - lookups by IPv6 address, every fourth one for an address
+ *            that is not in the cache,
+ *          - lookups by link-layer address, as neighbor-info does for
+ *            every frame sent,
+ *          - removing all neighbors.
+ *          Then the full cache churns: neighbors get removed, added and
+ *          change their link-layer address at random, and after each
+ *          step every lookup is checked against a scan of the cache.
+ *          Build with NBR_HASH=0 for the linear scan.
+ *
+ *          usage: ds6-nbr-bench.native [lookups [churn steps]]
+ */
+/*---------------------------------------------------------------------------*/
+#include "contiki.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "net/uip.h"
+#include "net/uip-ds6.h"
+
+#define DS6_NBR_BENCH_LOOKUPS   1000000
+#define DS6_NBR_BENCH_CHURN     20000
+
+#define NBRS                    (UIP_DS6_NBR_NB)
+
+extern int contiki_argc;
+extern char **contiki_argv;
+extern uip_ds6_nbr_t uip_ds6_nbr_cache[];
+
+PROCESS(ds6_nbr_bench_process, "ds6 neighbor benchmark");
+AUTOSTART_PROCESSES(&ds6_nbr_bench_process);
+
+static uip_ds6_nbr_t *nbrs[NBRS];
+static int n, wrong;
+static clock_t cpu;
+
+/*---------------------------------------------------------------------------*/
+static long
+arg(int i, long def)
+{
+  return contiki_argc > i ? strtol(contiki_argv[i], NULL, 0) : def;
+}
+/*---------------------------------------------------------------------------*/
+static void
+start(void)
+{
+  cpu = clock();
+}
+/*---------------------------------------------------------------------------*/
+static void
+report(const char *phase, long ops)
+{
+  double us = (clock() - cpu) * 1000000.0 / CLOCKS_PER_SEC;
+
+  printf("%-9s %4d neighbors: %10.1f us cpu, %8.3f us each, %10.0f per s\n",
+         phase, n, us, us / ops, us > 0 ? ops * 1000000.0 / us : 0);
+}
+/*---------------------------------------------------------------------------*/
+/* neighbor i is node i / 2, link-local for even i, global for odd i */
+static void
+ip(uip_ipaddr_t *ipaddr, int i)
+{
+  uip_ip6addr(ipaddr, i & 1 ? 0xaaaa : 0xfe80, 0, 0, 0,
+              0x0212, 0x7400, (i >> 1) >> 8, (i >> 1) & 0xff);
+}
+/*---------------------------------------------------------------------------*/
+static void
+ll(uip_lladdr_t *lladdr, int node)
+{
+  memset(lladdr, 0, sizeof(*lladdr));
+  lladdr->addr[0] = 0x02;
+  lladdr->addr[1] = 0x12;
+  lladdr->addr[2] = 0x74;
+  lladdr->addr[UIP_LLADDR_LEN - 2] = node >> 8;
+  lladdr->addr[UIP_LLADDR_LEN - 1] = node & 0xff;
+}
+/*---------------------------------------------------------------------------*/
+static uip_ds6_nbr_t *
+add(int i, int node)
+{
+  uip_ipaddr_t ipaddr;
+  uip_lladdr_t lladdr;
+
+  ip(&ipaddr, i);
+  ll(&lladdr, node);
+  return uip_ds6_nbr_add(&ipaddr, &lladdr, 0, NBR_REACHABLE);
+}
+/*---------------------------------------------------------------------------*/
+static void
+ip_lookups(long count)
+{
+  uip_ipaddr_t ipaddr;
+  long i;
+  int k;
+
+  for(i = 0; i < count; i++) {
+    k = (i * 7919L) % n;
+    ip(&ipaddr, (i & 3) == 3 ? n + k : k);
+    if(uip_ds6_nbr_lookup(&ipaddr) != ((i & 3) == 3 ? NULL : nbrs[k])) {
+      wrong++;
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+ll_lookups(long count)
+{
+  uip_ds6_nbr_t *first;
+  uip_lladdr_t lladdr;
+  long i;
+  int k;
+
+  for(i = 0; i < count; i++) {
+    k = (i * 7919L) % ((n + 1) / 2);
+    ll(&lladdr, k);
+    /* the node's neighbor that comes first in the cache */
+    first = nbrs[2 * k];
+    if(2 * k + 1 < n && nbrs[2 * k + 1] < first) {
+      first = nbrs[2 * k + 1];
+    }
+    if(uip_ds6_nbr_ll_lookup(&lladdr) != first) {
+      wrong++;
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
+/* every used neighbor must be found by both lookups like a scan of the
+   cache finds it, some unused addresses must not be found */
+static void
+check(void)
+{
+  uip_ds6_nbr_t *nbr, *first;
+  uip_ipaddr_t ipaddr;
+  int i;
+
+  for(nbr = uip_ds6_nbr_cache; nbr < uip_ds6_nbr_cache + NBRS; nbr++) {
+    if(!nbr->isused) {
+      continue;
+    }
+    if(uip_ds6_nbr_lookup(&nbr->ipaddr) != nbr) {
+      wrong++;
+    }
+    for(first = uip_ds6_nbr_cache;
+        !first->isused || memcmp(&first->lladdr, &nbr->lladdr, UIP_LLADDR_LEN);
+        first++);
+    if(uip_ds6_nbr_ll_lookup(&nbr->lladdr) != first) {
+      wrong++;
+    }
+  }
+  for(i = 0; i < 8; i++) {
+    ip(&ipaddr, 4 * NBRS + i);
+    if(uip_ds6_nbr_lookup(&ipaddr) != NULL) {
+      wrong++;
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+churn(long steps)
+{
+  uip_ds6_nbr_t *nbr;
+  uip_lladdr_t lladdr;
+  long s;
+  int i, next;
+
+  n = NBRS;
+  for(i = 0; i < n; i++) {
+    nbrs[i] = add(i, i / 2);
+  }
+  next = n;
+  srand(1);
+  for(s = 0; s < steps; s++) {
+    nbr = &uip_ds6_nbr_cache[rand() % NBRS];
+    switch(rand() % 3) {
+    case 0:
+      uip_ds6_nbr_rm(nbr);
+      break;
+    case 1:
+      /* takes a free slot, or replaces the least recently looked up */
+      add(next, rand() % (NBRS / 2 + 1));
+      next = next + 1 < 4 * NBRS ? next + 1 : NBRS;
+      break;
+    default:
+      if(nbr->isused) {
+        ll(&lladdr, rand() % (NBRS / 2 + 1));
+        uip_ds6_nbr_set_lladdr(nbr, &lladdr);
+      }
+      break;
+    }
+    check();
+  }
+  for(nbr = uip_ds6_nbr_cache; nbr < uip_ds6_nbr_cache + NBRS; nbr++) {
+    uip_ds6_nbr_rm(nbr);
+  }
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(ds6_nbr_bench_process, ev, data)
+{
+  static long count;
+  int i;
+
+  PROCESS_BEGIN();
+
+  count = arg(1, DS6_NBR_BENCH_LOOKUPS);
+  printf("ds6 neighbor benchmark: %s, %ld lookups\n",
+         UIP_DS6_NBR_HASH ? "hashed" : "linear scan", count);
+
+  /* doubling, the last one is the full cache */
+  for(n = 4; n <= NBRS;
+      n = n < NBRS && n * 2 > NBRS ?
+        NBRS : n * 2) {
+    start();
+    for(i = 0; i < n; i++) {
+      nbrs[i] = add(i, i / 2);
+    }
+    report("add", n);
+    for(i = 0; i < n; i++) {
+      if(nbrs[i] == NULL) {
+        wrong++;
+      }
+    }
+    start();
+    ip_lookups(count);
+    report("lookup", count);
+    start();
+    ll_lookups(count);
+    report("ll lookup", count);
+    start();
+    for(i = 0; i < n; i++) {
+      uip_ds6_nbr_rm(nbrs[i]);
+    }
+    report("remove", n);
+  }
+
+  start();
+  churn(arg(2, DS6_NBR_BENCH_CHURN));
+  report("churn", arg(2, DS6_NBR_BENCH_CHURN));
+  printf("%d wrong results\n", wrong);
+
+  exit(wrong == 0 ? 0 : 1);
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
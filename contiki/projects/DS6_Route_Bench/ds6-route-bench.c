@@ -0,0 +1,199 @@
+/*
+ * Copyright (c) 2012, TU Dortmund University.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following
+ *    disclaimer in the documentation and/or other materials provided
+ *    with the distribution.
+ * 3. The name of the author may not be used to endorse or promote
+ *    products derived from this software without specific prior
+ *    written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS
+ * OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+ * GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * This file is part of the Contiki OS
+ *
+ */
+/*---------------------------------------------------------------------------*/
+/*---------------------------------------------------------------------------*/
+/**
+ * \file    Micro-benchmark of the routing table. For table sizes doubling
+ *          up to UIP_DS6_ROUTE_NB the table gets filled with two prefix
+ *          routes (/48 and /64) and host routes (/128) below them, as a
+ *          RPL root collects them from the DAOs. Measured are
+ *          - adding all routes,
+ *          - lookups of the host routes, every fourth one for an address
+ *            without a host route that falls back to the /64,
+ *          - removing all routes.
+ *          Every lookup result gets checked. Build with ROUTE_HASH=0 for
+ *          the linear scan.
+ *
+ *          usage: ds6-route-bench.native [lookups]
+ */
+/*---------------------------------------------------------------------------*/
+#include "contiki.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "net/uip.h"
+#include "net/uip-ds6.h"
+
+#define DS6_ROUTE_BENCH_LOOKUPS   1000000
+
+extern int contiki_argc;
+extern char **contiki_argv;
+
+PROCESS(ds6_route_bench_process, "ds6 route benchmark");
+AUTOSTART_PROCESSES(&ds6_route_bench_process);
+
+static uip_ds6_route_t *routes[UIP_DS6_ROUTE_NB];
+static uip_ds6_route_t *prefix48, *prefix64;
+static uip_ipaddr_t nexthop;
+static int n, wrong;
+static clock_t cpu;
+
+/*---------------------------------------------------------------------------*/
+static long
+arg(int i, long def)
+{
+  return contiki_argc > i ? strtol(contiki_argv[i], NULL, 0) : def;
+}
+/*---------------------------------------------------------------------------*/
+static void
+start(void)
+{
+  cpu = clock();
+}
+/*---------------------------------------------------------------------------*/
+static void
+report(const char *phase, long ops)
+{
+  double us = (clock() - cpu) * 1000000.0 / CLOCKS_PER_SEC;
+
+  printf("%-7s %4d routes: %10.1f us cpu, %8.3f us each, %10.0f per s\n",
+         phase, n, us, us / ops, us > 0 ? ops * 1000000.0 / us : 0);
+}
+/*---------------------------------------------------------------------------*/
+/* host i below aaaa::/64, i < 0x10000 */
+static void
+host(uip_ipaddr_t *ipaddr, int i)
+{
+  uip_ip6addr(ipaddr, 0xaaaa, 0, 0, 0, 0x0212, 0x7400, i >> 8, i & 0xff);
+}
+/*---------------------------------------------------------------------------*/
+static void
+fill(void)
+{
+  uip_ipaddr_t ipaddr;
+  int i;
+
+  uip_ip6addr(&ipaddr, 0xaaaa, 0, 0, 0, 0, 0, 0, 0);
+  prefix48 = uip_ds6_route_add(&ipaddr, 48, &nexthop, 0);
+  prefix64 = uip_ds6_route_add(&ipaddr, 64, &nexthop, 0);
+  for(i = 0; i < n - 2; i++) {
+    host(&ipaddr, i);
+    routes[i] = uip_ds6_route_add(&ipaddr, 128, &nexthop, 0);
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+empty(void)
+{
+  int i;
+
+  for(i = 0; i < n - 2; i++) {
+    if(routes[i] != NULL) {
+      uip_ds6_route_rm(routes[i]);
+    }
+  }
+  if(prefix64 != NULL) {
+    uip_ds6_route_rm(prefix64);
+  }
+  if(prefix48 != NULL) {
+    uip_ds6_route_rm(prefix48);
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+lookups(long count)
+{
+  uip_ipaddr_t ipaddr;
+  uip_ds6_route_t *expected;
+  long i;
+  int h;
+
+  for(i = 0; i < count; i++) {
+    h = (i * 7919L) % (n - 1);
+    if((i & 3) == 3 || h == n - 2) {
+      /* no host route */
+      host(&ipaddr, 0x8000 + h);
+      expected = prefix64;
+    } else {
+      host(&ipaddr, h);
+      expected = routes[h];
+    }
+    if(uip_ds6_route_lookup(&ipaddr) != expected) {
+      wrong++;
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(ds6_route_bench_process, ev, data)
+{
+  static long count;
+  int i;
+
+  PROCESS_BEGIN();
+
+  count = arg(1, DS6_ROUTE_BENCH_LOOKUPS);
+  uip_ip6addr(&nexthop, 0xfe80, 0, 0, 0, 0x0212, 0x7400, 0, 1);
+  printf("ds6 route benchmark: %s, %ld lookups\n",
+         UIP_DS6_ROUTE_HASH ? "hashed" : "linear scan", count);
+
+  /* doubling, the last one is the full table */
+  for(n = 4; n <= UIP_DS6_ROUTE_NB;
+      n = n < UIP_DS6_ROUTE_NB && n * 2 > UIP_DS6_ROUTE_NB ?
+        UIP_DS6_ROUTE_NB : n * 2) {
+    start();
+    fill();
+    report("add", n);
+    for(i = 0; i < n - 2; i++) {
+      if(routes[i] == NULL) {
+        wrong++;
+      }
+    }
+    if(prefix48 == NULL || prefix64 == NULL) {
+      wrong++;
+    }
+    start();
+    lookups(count);
+    report("lookup", count);
+    start();
+    empty();
+    report("remove", n);
+  }
+  printf("%d wrong results\n", wrong);
+
+  exit(wrong == 0 ? 0 : 1);
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
@@ -0,0 +1,200 @@
+/*
+ * Copyright (c) 2012, TU Dortmund University.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following
+ *    disclaimer in the documentation and/or other materials provided
+ *    with the distribution.
+ * 3. The name of the author may not be used to endorse or promote
+ *    products derived from this software without specific prior
+ *    written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS
+ * OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+ * GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * This file is part of the Contiki OS
+ *
+ */
+/*---------------------------------------------------------------------------*/
+/**
+ * \file    Micro-benchmark of the event timers. A sink process owns all
+ *          timers and counts their events. The benchmark drives
+ *          etimer_process itself with etimer_request_poll() and
+ *          process_run(), so the CPU time (clock()) does not depend on
+ *          the main loop of the native platform. Measured are
+ *          - setting the timers, expiration times spread over a second,
+ *          - restarting all of them while they are pending,
+ *          - a poll of etimer_process while none of them has expired,
+ *            as it happens on each pass of an idle main loop,
+ *          - a burst: all timers expired at once, until the sink got
+ *            every event.
+ *          Finally the timers expire in real time, spread over a fifth
+ *          of a second, to check that no event comes early or out of
+ *          order.
+ *
+ *          usage: etimer-bench.native [timers [polls]]
+ */
+/*---------------------------------------------------------------------------*/
+#include "contiki.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define ETIMER_BENCH_TIMERS   500
+#define ETIMER_BENCH_POLLS    10000
+#define ETIMER_BENCH_MAX      4000
+
+extern int contiki_argc;
+extern char **contiki_argv;
+
+PROCESS(etimer_bench_process, "etimer benchmark");
+PROCESS(etimer_sink_process, "etimer sink");
+AUTOSTART_PROCESSES(&etimer_bench_process);
+
+static struct etimer timers[ETIMER_BENCH_MAX];
+static int n, fired, early, misordered;
+static clock_time_t last_expiration;
+static clock_t cpu;
+
+/*---------------------------------------------------------------------------*/
+static long
+arg(int i, long def)
+{
+  return contiki_argc > i ? strtol(contiki_argv[i], NULL, 0) : def;
+}
+/*---------------------------------------------------------------------------*/
+static void
+start(void)
+{
+  fired = early = misordered = 0;
+  cpu = clock();
+}
+/*---------------------------------------------------------------------------*/
+static void
+report(const char *phase, long ops)
+{
+  double us = (clock() - cpu) * 1000000.0 / CLOCKS_PER_SEC;
+
+  printf("%-8s %5d timers: %10.1f us cpu, %8.3f us each\n",
+         phase, n, us, us / ops);
+}
+/*---------------------------------------------------------------------------*/
+/* runs etimer_process and the sink from within the benchmark process,
+   process_run() leaves process_current set to the process it ran last */
+static void
+run_etimers(void)
+{
+  struct process *self = PROCESS_CURRENT();
+
+  etimer_request_poll();
+  while(process_run() > 0);
+  process_current = self;
+}
+/*---------------------------------------------------------------------------*/
+/* all timers, spread over interval, in no particular order */
+static void
+set_all(clock_time_t base, clock_time_t interval)
+{
+  int i;
+
+  PROCESS_CONTEXT_BEGIN(&etimer_sink_process);
+  for(i = 0; i < n; i++) {
+    etimer_set(&timers[i], base + (interval ? (i * 7919L) % interval : 0));
+  }
+  PROCESS_CONTEXT_END(&etimer_sink_process);
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(etimer_sink_process, ev, data)
+{
+  struct etimer *et;
+  clock_time_t expiration;
+
+  PROCESS_BEGIN();
+
+  while(1) {
+    PROCESS_WAIT_EVENT_UNTIL(ev == PROCESS_EVENT_TIMER);
+    et = data;
+    expiration = etimer_expiration_time(et);
+    if(!timer_expired(&et->timer)) {
+      early++;
+    }
+    if(fired > 0 && (long)(expiration - last_expiration) < 0) {
+      misordered++;
+    }
+    last_expiration = expiration;
+    fired++;
+  }
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(etimer_bench_process, ev, data)
+{
+  static struct etimer wait;
+  long polls, i;
+
+  PROCESS_BEGIN();
+
+  n = arg(1, ETIMER_BENCH_TIMERS);
+  polls = arg(2, ETIMER_BENCH_POLLS);
+  if(n < 1 || n > ETIMER_BENCH_MAX) {
+    printf("etimer benchmark: 1 to %d timers\n", ETIMER_BENCH_MAX);
+    exit(1);
+  }
+  process_start(&etimer_sink_process, NULL);
+
+  start();
+  set_all(10 * CLOCK_SECOND, CLOCK_SECOND);
+  report("set", n);
+
+  start();
+  PROCESS_CONTEXT_BEGIN(&etimer_sink_process);
+  for(i = 0; i < n; i++) {
+    etimer_restart(&timers[i]);
+  }
+  PROCESS_CONTEXT_END(&etimer_sink_process);
+  report("restart", n);
+
+  start();
+  for(i = 0; i < polls; i++) {
+    run_etimers();
+  }
+  report("poll", polls);
+
+  /* all expired at once, the event queue limits how many get posted per
+     poll */
+  set_all(0, 0);
+  start();
+  while(fired < n) {
+    run_etimers();
+  }
+  report("burst", n);
+
+  start();
+  set_all(1, CLOCK_SECOND / 5);
+  etimer_set(&wait, CLOCK_SECOND / 5 + 2);
+  PROCESS_WAIT_EVENT_UNTIL(etimer_expired(&wait));
+  printf("expire   %5d timers: %d fired, %d early, %d out of order\n",
+         n, fired, early, misordered);
+
+  exit(fired == n && early == 0 && misordered == 0 ? 0 : 1);
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
@@ -0,0 +1,222 @@
+/*
+ * Copyright (c) 2012, TU Dortmund University.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following
+ *    disclaimer in the documentation and/or other materials provided
+ *    with the distribution.
+ * 3. The name of the author may not be used to endorse or promote
+ *    products derived from this software without specific prior
+ *    written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS
+ * OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+ * GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * This file is part of the Contiki OS
+ *
+ */
+/*---------------------------------------------------------------------------*/
+/*---------------------------------------------------------------------------*/
+/**
+ * \file    Shows the event priorities of the process scheduler. Bulk
+ *          events keep the normal priority queue busy, every delivery
+ *          costs some CPU time. Then the radio process gets an event,
+ *          once with normal and once with high priority:
+ *          - unicast: the normal queue has been filled with bulk events
+ *            before, up to the last free slot,
+ *          - broadcast: the first receiver of a bulk broadcast posts it,
+ *            while the broadcast still has to reach the other
+ *            listeners.
+ *          For each case the number of bulk deliveries ahead of the radio
+ *          event is printed, then the queue statistics.
+ *
+ *          usage: process-prio.native [rounds [busy]]
+ *          busy: CPU time per bulk delivery in rtimer ticks
+ */
+/*---------------------------------------------------------------------------*/
+#include "contiki.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#define PROCESS_PRIO_ROUNDS   100
+#define PROCESS_PRIO_BUSY     1
+
+extern int contiki_argc;
+extern char **contiki_argv;
+
+PROCESS(process_prio_process, "priority demo");
+PROCESS(radio_process, "radio");
+PROCESS(listener1_process, "listener 1");
+PROCESS(listener2_process, "listener 2");
+PROCESS(listener3_process, "listener 3");
+PROCESS(listener4_process, "listener 4");
+AUTOSTART_PROCESSES(&process_prio_process);
+
+static process_event_t bulk_event, radio_event;
+static rtimer_clock_t busy;
+static unsigned char trigger, trigger_prio;
+/* bulk deliveries, and their number when the radio event was posted */
+static unsigned long delivered, posted_at;
+static unsigned long radio_events, ahead, ahead_max;
+
+/*---------------------------------------------------------------------------*/
+static long
+arg(int n, long def)
+{
+  return contiki_argc > n ? strtol(contiki_argv[n], NULL, 0) : def;
+}
+/*---------------------------------------------------------------------------*/
+static void
+post_radio_event(void)
+{
+  posted_at = delivered;
+  if(process_post_prio(&radio_process, radio_event, NULL,
+                       trigger_prio) != PROCESS_ERR_OK) {
+    printf("radio event lost\n");
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+bulk_input(void)
+{
+  rtimer_clock_t start = RTIMER_NOW();
+
+  delivered++;
+  if(trigger) {
+    trigger = 0;
+    post_radio_event();
+  }
+  while(RTIMER_CLOCK_LT(RTIMER_NOW(), start + busy));
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(radio_process, ev, data)
+{
+  PROCESS_BEGIN();
+
+  while(1) {
+    PROCESS_WAIT_EVENT_UNTIL(ev == radio_event);
+    radio_events++;
+    ahead += delivered - posted_at;
+    if(delivered - posted_at > ahead_max) {
+      ahead_max = delivered - posted_at;
+    }
+  }
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
+#define LISTENER_THREAD(name)                   \
+PROCESS_THREAD(name, ev, data)                  \
+{                                               \
+  PROCESS_BEGIN();                              \
+  while(1) {                                    \
+    PROCESS_WAIT_EVENT_UNTIL(ev == bulk_event); \
+    bulk_input();                               \
+  }                                             \
+  PROCESS_END();                                \
+}
+
+LISTENER_THREAD(listener1_process)
+LISTENER_THREAD(listener2_process)
+LISTENER_THREAD(listener3_process)
+LISTENER_THREAD(listener4_process)
+/*---------------------------------------------------------------------------*/
+/* Delivers the queued events, called by the demo process itself. */
+static void
+run_events(void)
+{
+  struct process *self = process_current;
+
+  while(process_run() > 0);
+  process_current = self;
+}
+/*---------------------------------------------------------------------------*/
+static void
+run(const char *name, int broadcast, unsigned char prio, long rounds)
+{
+  long i;
+  int n;
+
+  radio_events = ahead = ahead_max = 0;
+  trigger_prio = prio;
+  for(i = 0; i < rounds; i++) {
+    run_events();
+    if(broadcast) {
+      trigger = 1;
+      process_post(PROCESS_BROADCAST, bulk_event, NULL);
+    } else {
+      /* leave room for the radio event in the normal queue */
+      for(n = 0; n < PROCESS_CONF_NUMEVENTS - 1; n++) {
+        process_post(&listener1_process, bulk_event, NULL);
+      }
+      post_radio_event();
+    }
+    run_events();
+  }
+  printf("%-9s %-6s %lu radio events, bulk deliveries ahead: avg %lu.%02lu, max %lu\n",
+         name, prio == PROCESS_PRIO_HIGH ? "high" : "normal", radio_events,
+         radio_events ? ahead / radio_events : 0,
+         radio_events ? ahead * 100 / radio_events % 100 : 0, ahead_max);
+}
+/*---------------------------------------------------------------------------*/
+static void
+print_stats(void)
+{
+  const struct process_stats *s;
+  unsigned char prio;
+
+  printf("most events queued %u\n", process_maxevents);
+  for(prio = 0; prio < PROCESS_PRIO_LEVELS; prio++) {
+    s = &process_stats[prio];
+    printf("prio %u: %lu events, max %u queued, %lu posts failed, latency avg %lu max %u ticks (%lu ticks/s)\n",
+           prio, s->events, s->maxevents, s->full,
+           s->events ? s->latency / s->events : 0, (unsigned)s->max_latency,
+           (unsigned long)RTIMER_SECOND);
+  }
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(process_prio_process, ev, data)
+{
+  static long rounds;
+
+  PROCESS_BEGIN();
+
+  rounds = arg(1, PROCESS_PRIO_ROUNDS);
+  busy = arg(2, PROCESS_PRIO_BUSY);
+  bulk_event = process_alloc_event();
+  radio_event = process_alloc_event();
+  process_start(&radio_process, NULL);
+  process_start(&listener1_process, NULL);
+  process_start(&listener2_process, NULL);
+  process_start(&listener3_process, NULL);
+  process_start(&listener4_process, NULL);
+
+  printf("%ld rounds, %u events in the normal queue, %u in the high one, busy %u ticks\n",
+         rounds, PROCESS_CONF_NUMEVENTS, PROCESS_CONF_NUMEVENTS_HIGH,
+         (unsigned)busy);
+  run("unicast", 0, PROCESS_PRIO_NORMAL, rounds);
+  run("unicast", 0, PROCESS_PRIO_HIGH, rounds);
+  run("broadcast", 1, PROCESS_PRIO_NORMAL, rounds);
+  run("broadcast", 1, PROCESS_PRIO_HIGH, rounds);
+  print_stats();
+  exit(0);
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
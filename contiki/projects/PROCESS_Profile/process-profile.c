@@ -0,0 +1,205 @@
+/*
+ * Copyright (c) 2012, TU Dortmund University.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following
+ *    disclaimer in the documentation and/or other materials provided
+ *    with the distribution.
+ * 3. The name of the author may not be used to endorse or promote
+ *    products derived from this software without specific prior
+ *    written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS
+ * OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+ * GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * This file is part of the Contiki OS
+ *
+ */
+/*---------------------------------------------------------------------------*/
+/**
+ * \file    Checks the process profiles. A number of events is posted
+ *          at once, alternating to a process that busy waits for a
+ *          while per event and to one that returns right away. Then the
+ *          profiles of both have to show
+ *          - one run per event,
+ *          - the busy waits as the run times of the busy process, the
+ *            longest one for the event it was posted, and no time for
+ *            the other one,
+ *          - one delivery per event, the last event of each process
+ *            waited for all the busy runs before it.
+ *          The same again after process_profile_reset().
+ *
+ *          usage: process-profile.native [events [busy]]
+ *          busy: CPU time per event in rtimer ticks
+ */
+/*---------------------------------------------------------------------------*/
+#include "contiki.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#define PROCESS_PROFILE_EVENTS  10
+#define PROCESS_PROFILE_BUSY    5
+/* rtimer ticks a measurement may be off, e.g. by a tick that started
+   while a run was being timed */
+#define PROCESS_PROFILE_SLACK   2
+
+extern int contiki_argc;
+extern char **contiki_argv;
+
+PROCESS(process_profile_process, "profile check");
+PROCESS(busy_process, "busy");
+PROCESS(idle_process, "idle");
+AUTOSTART_PROCESSES(&process_profile_process);
+
+static process_event_t work_event, done_event;
+static int events;
+static rtimer_clock_t busy;
+/* the busy waits as the busy process measured them itself, on a loaded
+   host they may take longer than busy */
+static unsigned long busy_sum;
+static rtimer_clock_t busy_max, busy_last;
+
+/*---------------------------------------------------------------------------*/
+static long
+arg(int n, long def)
+{
+  return contiki_argc > n ? strtol(contiki_argv[n], NULL, 0) : def;
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(busy_process, ev, data)
+{
+  rtimer_clock_t start;
+
+  PROCESS_BEGIN();
+
+  while(1) {
+    PROCESS_WAIT_EVENT_UNTIL(ev == work_event);
+    start = RTIMER_NOW();
+    while(RTIMER_CLOCK_LT(RTIMER_NOW(), start + busy));
+    busy_last = RTIMER_NOW() - start;
+    busy_sum += busy_last;
+    if(busy_last > busy_max) {
+      busy_max = busy_last;
+    }
+  }
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(idle_process, ev, data)
+{
+  static int received;
+
+  PROCESS_BEGIN();
+
+  while(1) {
+    PROCESS_WAIT_EVENT_UNTIL(ev == work_event);
+    if(++received == events) {
+      received = 0;
+      process_post(&process_profile_process, done_event, NULL);
+    }
+  }
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
+static int
+check_range(const char *what, unsigned long value, unsigned long min,
+            unsigned long max)
+{
+  if(value < min || value > max) {
+    printf("  %s %lu, expected %lu to %lu\n", what, value, min, max);
+    return 1;
+  }
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+static int
+check(void)
+{
+  const struct process_profile *b = &busy_process.profile;
+  const struct process_profile *i = &idle_process.profile;
+  int failed = 0;
+
+  printf("busy: %lu runs, %lu ticks, max %u for event %u, %lu events, latency max %u\n",
+         b->runs, b->time, (unsigned)b->max_time, (unsigned)b->max_event,
+         b->events, (unsigned)b->max_latency);
+  printf("idle: %lu runs, %lu ticks, max %u for event %u, %lu events, latency max %u\n",
+         i->runs, i->time, (unsigned)i->max_time, (unsigned)i->max_event,
+         i->events, (unsigned)i->max_latency);
+
+  failed += check_range("busy runs", b->runs, events, events);
+  failed += check_range("busy events", b->events, events, events);
+  failed += check_range("busy max run", b->max_time, busy_max,
+                        busy_max + PROCESS_PROFILE_SLACK);
+  failed += check_range("busy run time", b->time, busy_sum,
+                        busy_sum + events * PROCESS_PROFILE_SLACK);
+  failed += check_range("busy max event", b->max_event, work_event,
+                        work_event);
+  failed += check_range("busy max latency", b->max_latency,
+                        busy_sum - busy_last,
+                        busy_sum + events * PROCESS_PROFILE_SLACK);
+  failed += check_range("idle runs", i->runs, events, events);
+  failed += check_range("idle events", i->events, events, events);
+  failed += check_range("idle max run", i->max_time, 0,
+                        PROCESS_PROFILE_SLACK);
+  failed += check_range("idle max latency", i->max_latency, busy_sum,
+                        busy_sum + events * PROCESS_PROFILE_SLACK);
+  return failed;
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(process_profile_process, ev, data)
+{
+  static int round, failed;
+  int n;
+
+  PROCESS_BEGIN();
+
+  events = arg(1, PROCESS_PROFILE_EVENTS);
+  busy = arg(2, PROCESS_PROFILE_BUSY);
+  if(events < 1 || 2 * events > PROCESS_CONF_NUMEVENTS - 2) {
+    printf("process profile: 1 to %d events\n", (PROCESS_CONF_NUMEVENTS - 2) / 2);
+    exit(1);
+  }
+  work_event = process_alloc_event();
+  done_event = process_alloc_event();
+  process_start(&busy_process, NULL);
+  process_start(&idle_process, NULL);
+  /* let both reach their wait */
+  PROCESS_PAUSE();
+
+  for(round = 0; round < 2; round++) {
+    process_profile_reset();
+    busy_sum = busy_max = 0;
+    for(n = 0; n < events; n++) {
+      process_post(&busy_process, work_event, NULL);
+      process_post(&idle_process, work_event, NULL);
+    }
+    PROCESS_WAIT_EVENT_UNTIL(ev == done_event);
+    printf("round %d, %d events of %u ticks, busy waits took %lu ticks, max %u\n",
+           round, events, (unsigned)busy, busy_sum, (unsigned)busy_max);
+    failed += check();
+  }
+
+  printf("process profile %s\n", failed ? "FAILED" : "passed");
+  exit(failed ? 1 : 0);
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
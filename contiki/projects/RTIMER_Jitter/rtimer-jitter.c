@@ -0,0 +1,213 @@
+/*
+ * Copyright (c) 2012, TU Dortmund University.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following
+ *    disclaimer in the documentation and/or other materials provided
+ *    with the distribution.
+ * 3. The name of the author may not be used to endorse or promote
+ *    products derived from this software without specific prior
+ *    written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS
+ * OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+ * GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * This file is part of the Contiki OS
+ *
+ */
+/*---------------------------------------------------------------------------*/
+/**
+ * \file    Runs a number of periodic rtimers with different periods at
+ *          once. Each callback posts its task again, drift free, one
+ *          period after its last time. The dispatch jitter is the time
+ *          from the tick a task was due to the callback, measured with
+ *          gettimeofday() as the native rtimer counts milliseconds.
+ *
+ *          Finally the first of two pending tasks is posted again for a
+ *          later time, neither task may run before it is due.
+ *
+ *          usage: rtimer-jitter.native [timers [seconds [period]]]
+ *          timer i runs with a period of period + i ticks
+ */
+/*---------------------------------------------------------------------------*/
+#include "contiki.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/time.h>
+
+#define RTIMER_JITTER_TIMERS  16
+#define RTIMER_JITTER_SECONDS 3
+#define RTIMER_JITTER_PERIOD  5
+#define RTIMER_JITTER_MAX     64
+#define RTIMER_JITTER_WRAP    (65536LL * 1000000 / RTIMER_SECOND)
+
+extern int contiki_argc;
+extern char **contiki_argv;
+
+PROCESS(rtimer_jitter_process, "rtimer jitter");
+AUTOSTART_PROCESSES(&rtimer_jitter_process);
+
+struct periodic {
+  struct rtimer task;
+  rtimer_clock_t period;
+  uint32_t fired;
+};
+
+static struct periodic timers[RTIMER_JITTER_MAX];
+static struct periodic reposted[2];
+static volatile uint8_t stop;
+static rtimer_clock_t last_due;
+static uint32_t dispatched, misordered, early, repost_early;
+static long long jitter_sum, jitter_max, jitter_min;
+
+/*---------------------------------------------------------------------------*/
+static long
+arg(int n, long def)
+{
+  return contiki_argc > n ? strtol(contiki_argv[n], NULL, 0) : def;
+}
+/*---------------------------------------------------------------------------*/
+/* time since the tick due became current, in us */
+static long long
+jitter(rtimer_clock_t due)
+{
+  struct timeval tv;
+  long long d;
+
+  gettimeofday(&tv, NULL);
+  d = ((long long)tv.tv_sec * 1000000 + tv.tv_usec -
+       (long long)due * (1000000 / RTIMER_SECOND)) % RTIMER_JITTER_WRAP;
+  if(d < 0) {
+    d += RTIMER_JITTER_WRAP;
+  }
+  if(d >= RTIMER_JITTER_WRAP / 2) {
+    d -= RTIMER_JITTER_WRAP;
+  }
+  return d;
+}
+/*---------------------------------------------------------------------------*/
+static void
+periodic_callback(struct rtimer *t, void *ptr)
+{
+  struct periodic *p = ptr;
+  long long j = jitter(RTIMER_TIME(t));
+
+  if(RTIMER_CLOCK_LT(RTIMER_NOW(), RTIMER_TIME(t))) {
+    early++;
+  }
+  if(dispatched > 0 && RTIMER_CLOCK_LT(RTIMER_TIME(t), last_due)) {
+    misordered++;
+  }
+  last_due = RTIMER_TIME(t);
+  dispatched++;
+  p->fired++;
+  jitter_sum += j;
+  if(j > jitter_max) {
+    jitter_max = j;
+  }
+  if(j < jitter_min) {
+    jitter_min = j;
+  }
+
+  if(!stop) {
+    rtimer_set(t, RTIMER_TIME(t) + p->period, 1, periodic_callback, p);
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+repost_callback(struct rtimer *t, void *ptr)
+{
+  struct periodic *p = ptr;
+
+  if(RTIMER_CLOCK_LT(RTIMER_NOW(), RTIMER_TIME(t))) {
+    repost_early++;
+  }
+  p->fired++;
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(rtimer_jitter_process, ev, data)
+{
+  static struct etimer et;
+  static int n, seconds;
+  static rtimer_clock_t start, end;
+  static uint32_t starved;
+  uint32_t expected;
+  rtimer_clock_t period;
+  int i;
+
+  PROCESS_BEGIN();
+
+  n = arg(1, RTIMER_JITTER_TIMERS);
+  seconds = arg(2, RTIMER_JITTER_SECONDS);
+  period = arg(3, RTIMER_JITTER_PERIOD);
+  if(n < 1 || n > RTIMER_JITTER_MAX) {
+    printf("rtimer jitter: 1 to %d timers\n", RTIMER_JITTER_MAX);
+    exit(1);
+  }
+  printf("rtimer jitter: %d timers, periods %u to %u ticks, %d s, %u ticks/s\n",
+         n, period, period + n - 1, seconds, RTIMER_SECOND);
+
+  jitter_min = RTIMER_JITTER_WRAP;
+  start = RTIMER_NOW() + 10;
+  for(i = 0; i < n; i++) {
+    timers[i].period = period + i;
+    rtimer_set(&timers[i].task, start, 1, periodic_callback, &timers[i]);
+  }
+
+  etimer_set(&et, seconds * CLOCK_SECOND);
+  PROCESS_WAIT_EVENT_UNTIL(etimer_expired(&et));
+  stop = 1;
+  end = RTIMER_NOW();
+  etimer_set(&et, CLOCK_SECOND / 10);
+  PROCESS_WAIT_EVENT_UNTIL(etimer_expired(&et));
+
+  /* compare with the periods that started before the stop */
+  starved = 0;
+  for(i = 0; i < n; i++) {
+    expected = (rtimer_clock_t)(end - start) / timers[i].period;
+    if(timers[i].fired + 2 < expected) {
+      printf("timer %d: %lu of about %lu callbacks\n", i,
+             (unsigned long)timers[i].fired, (unsigned long)expected);
+      starved++;
+    }
+  }
+  printf("%lu callbacks, %lu timers starved, %lu out of order, %lu early\n",
+         (unsigned long)dispatched, (unsigned long)starved,
+         (unsigned long)misordered, (unsigned long)early);
+  printf("jitter: min %lld us, avg %lld us, max %lld us\n",
+         jitter_min, dispatched ? jitter_sum / dispatched : 0, jitter_max);
+
+  /* the second task becomes the first one while the timer is still set
+     for the time the first task had */
+  start = RTIMER_NOW();
+  rtimer_set(&reposted[0].task, start + 20, 1, repost_callback, &reposted[0]);
+  rtimer_set(&reposted[1].task, start + 40, 1, repost_callback, &reposted[1]);
+  rtimer_set(&reposted[0].task, start + 60, 1, repost_callback, &reposted[0]);
+  etimer_set(&et, CLOCK_SECOND / 10);
+  PROCESS_WAIT_EVENT_UNTIL(etimer_expired(&et));
+  printf("repost: %lu and %lu callbacks, %lu early\n",
+         (unsigned long)reposted[0].fired, (unsigned long)reposted[1].fired,
+         (unsigned long)repost_early);
+
+  exit(starved == 0 && misordered == 0 && early == 0 && repost_early == 0 &&
+       reposted[0].fired == 1 && reposted[1].fired == 1 ? 0 : 1);
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
@@ -0,0 +1,425 @@
+/*
+ * Copyright (c) 2012, TU Dortmund University.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following
+ *    disclaimer in the documentation and/or other materials provided
+ *    with the distribution.
+ * 3. The name of the author may not be used to endorse or promote
+ *    products derived from this software without specific prior
+ *    written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS
+ * OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+ * GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * This file is part of the Contiki OS
+ *
+ */
+/*---------------------------------------------------------------------------*/
+/*---------------------------------------------------------------------------*/
+/**
+ * \file    Forwarding of fragmented datagrams by a 6lowpan router. A MAC
+ *          driver captures the fragments sicslowpan makes of UDP
+ *          datagrams of DATAGRAM_LEN bytes to fd00::100, these are fed
+ *          back into sicslowpan as if 1 to MAX_SENDERS senders were
+ *          sending at the same time, one fragment of each sender per
+ *          round:
+ *          - in order,
+ *          - swapped, the second fragment of each datagram before the
+ *            first, these datagrams are reassembled,
+ *          - twice, every fragment is duplicated.
+ *          The route to fd00::100 leads to a neighbor, so the
+ *          datagrams are forwarded: fragment by fragment, or reassembled
+ *          and fragmented again by the IP layer if the fragment
+ *          forwarding is off (FORWARD=0). Printed are the number of
+ *          fragments sent, how many fragments came in on average between
+ *          the first fragment of a datagram coming in and going out, the
+ *          CPU time per fragment and the sicslowpan statistics.
+ *          The fragments sent are then fed back with fd00::100 as own
+ *          address and the reassembled datagrams are checked, including
+ *          the decremented hop limit. Exits with 1 if a datagram is
+ *          missing or wrong, or a first fragment was sent twice.
+ *
+ *          usage: sicslowpan-forward.native [datagrams per sender]
+ */
+/*---------------------------------------------------------------------------*/
+#include "contiki.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "net/netstack.h"
+#include "net/packetbuf.h"
+#include "net/rime.h"
+#include "net/sicslowpan.h"
+#include "net/tcpip.h"
+#include "net/uip.h"
+#include "net/uip-ds6.h"
+
+#define DATAGRAM_LEN    600
+#define MAX_DATAGRAMS   50
+#define MAX_SENDERS     4
+#define MAX_FRAGMENTS   12
+#define HOP_LIMIT       64
+
+#define MODE_IN_ORDER   0
+#define MODE_SWAPPED    1
+#define MODE_TWICE      2
+
+#define UIP_IP_BUF      ((struct uip_ip_hdr *)&uip_buf[UIP_LLH_LEN])
+#define UIP_UDP_BUF     ((struct uip_udp_hdr *)&uip_buf[UIP_LLIPH_LEN])
+#define PAYLOAD         (&uip_buf[UIP_LLIPH_LEN + UIP_UDPH_LEN])
+#define PAYLOAD_LEN     (DATAGRAM_LEN - UIP_IPUDPH_LEN)
+
+extern int contiki_argc;
+extern char **contiki_argv;
+
+PROCESS(sicslowpan_forward_process, "sicslowpan forwarding");
+AUTOSTART_PROCESSES(&sicslowpan_forward_process);
+
+struct frame {
+  uint8_t len;
+  uint8_t data[PACKETBUF_SIZE];
+};
+
+/* the fragments of the datagrams of each sender */
+static struct frame frames[MAX_SENDERS][MAX_DATAGRAMS][MAX_FRAGMENTS];
+/* the fragments sent by the router, twice as many in the twice mode */
+static struct frame sent[2 * MAX_SENDERS * MAX_DATAGRAMS * MAX_FRAGMENTS];
+static struct frame *capture;
+static unsigned int captured, capture_max;
+static uint8_t nfragments;
+static int datagrams;
+
+/* fragments fed in total, and when the current datagram of each sender
+ * started */
+static unsigned long fed, first_in[MAX_SENDERS];
+static int feeding;
+static unsigned long delay, delays, firsts;
+
+static uint8_t verifying;
+static uint8_t delivered[MAX_SENDERS][MAX_DATAGRAMS];
+static unsigned long ndelivered, wrong;
+static clock_t started;
+
+/*---------------------------------------------------------------------------*/
+static long
+arg(int n, long def)
+{
+  return contiki_argc > n ? strtol(contiki_argv[n], NULL, 0) : def;
+}
+/*---------------------------------------------------------------------------*/
+static void
+start(void)
+{
+  started = clock();
+  memset(&sicslowpan_stats, 0, sizeof(sicslowpan_stats));
+}
+/*---------------------------------------------------------------------------*/
+static unsigned long
+elapsed_ns(void)
+{
+  return (unsigned long)((clock() - started) * (1000000000.0 / CLOCKS_PER_SEC));
+}
+/*---------------------------------------------------------------------------*/
+/* MAC layer of the test: stores the fragments sicslowpan sends */
+static void
+mac_send(mac_callback_t sent_callback, void *ptr)
+{
+  uint8_t *d = packetbuf_dataptr();
+
+  if(capture != NULL && captured < capture_max) {
+    capture[captured].len = packetbuf_totlen();
+    packetbuf_copyto(capture[captured].data);
+    captured++;
+  }
+  if((d[0] & 0xf8) == SICSLOWPAN_DISPATCH_FRAG1) {
+    firsts++;
+    if(feeding >= 0) {
+      /* the current datagram of the sender being fed goes out */
+      delay += fed - first_in[feeding];
+      delays++;
+    }
+  }
+  mac_call_sent_callback(sent_callback, ptr, MAC_TX_OK, 1);
+}
+/*---------------------------------------------------------------------------*/
+static void
+mac_input(void)
+{
+  NETSTACK_NETWORK.input();
+}
+/*---------------------------------------------------------------------------*/
+static int
+mac_on(void)
+{
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+static int
+mac_off(int keep_radio_on)
+{
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+static unsigned short
+mac_channel_check_interval(void)
+{
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+static void
+mac_init(void)
+{
+}
+/*---------------------------------------------------------------------------*/
+const struct mac_driver forward_mac_driver = {
+  "forward-mac",
+  mac_init,
+  mac_send,
+  mac_input,
+  mac_on,
+  mac_off,
+  mac_channel_check_interval,
+};
+/*---------------------------------------------------------------------------*/
+/* called by sicslowpan for each datagram it passes to the IP layer: while
+ * verifying, checks the datagram and drops it */
+static void
+sniffer_input(void)
+{
+  uint8_t *p = PAYLOAD;
+  uint16_t i;
+  uint8_t sender = p[0], seq = p[1];
+
+  if(!verifying) {
+    return;
+  }
+  if(uip_len != DATAGRAM_LEN || UIP_IP_BUF->proto != UIP_PROTO_UDP ||
+     UIP_IP_BUF->ttl != HOP_LIMIT - 1 ||
+     sender >= MAX_SENDERS || seq >= datagrams ||
+     UIP_IP_BUF->srcipaddr.u8[15] != sender + 1 ||
+     delivered[sender][seq]) {
+    wrong++;
+  } else {
+    for(i = 2; i < PAYLOAD_LEN; i++) {
+      if(p[i] != (uint8_t)(sender + seq + i)) {
+        break;
+      }
+    }
+    if(i < PAYLOAD_LEN) {
+      wrong++;
+    } else {
+      delivered[sender][seq] = 1;
+      ndelivered++;
+    }
+  }
+  uip_len = 0;
+}
+/*---------------------------------------------------------------------------*/
+static void
+sniffer_output(int mac_status)
+{
+}
+/*---------------------------------------------------------------------------*/
+RIME_SNIFFER(sniffer, sniffer_input, sniffer_output);
+/*---------------------------------------------------------------------------*/
+/* fragments datagram seq of sender through sicslowpan, all senders use
+ * the tag seq */
+static void
+make_datagram(int sender, int seq)
+{
+  uint8_t *p = PAYLOAD;
+  int i;
+
+  memset(UIP_IP_BUF, 0, UIP_IPUDPH_LEN);
+  UIP_IP_BUF->vtc = 0x60;
+  UIP_IP_BUF->len[0] = (DATAGRAM_LEN - UIP_IPH_LEN) >> 8;
+  UIP_IP_BUF->len[1] = (DATAGRAM_LEN - UIP_IPH_LEN) & 0xff;
+  UIP_IP_BUF->proto = UIP_PROTO_UDP;
+  UIP_IP_BUF->ttl = HOP_LIMIT;
+  uip_ip6addr(&UIP_IP_BUF->srcipaddr, 0xfd00, 0, 0, 0, 0, 0, 0, sender + 1);
+  uip_ip6addr(&UIP_IP_BUF->destipaddr, 0xfd00, 0, 0, 0, 0, 0, 0, 0x100);
+  UIP_UDP_BUF->srcport = UIP_HTONS(1000);
+  UIP_UDP_BUF->destport = UIP_HTONS(2000);
+  UIP_UDP_BUF->udplen = UIP_HTONS(DATAGRAM_LEN - UIP_IPH_LEN);
+  p[0] = sender;
+  p[1] = seq;
+  for(i = 2; i < PAYLOAD_LEN; i++) {
+    p[i] = sender + seq + i;
+  }
+  uip_len = DATAGRAM_LEN;
+
+  capture = frames[sender][seq];
+  captured = 0;
+  capture_max = MAX_FRAGMENTS;
+  tcpip_output((uip_lladdr_t *)&rimeaddr_node_addr);
+  capture = NULL;
+  if(nfragments == 0) {
+    nfragments = captured;
+  } else if(captured != nfragments) {
+    printf("sicslowpan forwarding: %u fragments instead of %u\n",
+           captured, nfragments);
+    exit(1);
+  }
+  for(i = 0; i < captured; i++) {
+    frames[sender][seq][i].data[2] = 0;
+    frames[sender][seq][i].data[3] = seq;
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+feed(int sender, struct frame *f)
+{
+  rimeaddr_t addr;
+
+  memset(&addr, 0, sizeof(addr));
+  addr.u8[0] = 0x02;
+  addr.u8[sizeof(addr) - 1] = sender + 1;
+  packetbuf_clear();
+  packetbuf_copyfrom(f->data, f->len);
+  packetbuf_set_addr(PACKETBUF_ADDR_SENDER, &addr);
+  packetbuf_set_addr(PACKETBUF_ADDR_RECEIVER, &rimeaddr_node_addr);
+  NETSTACK_NETWORK.input();
+}
+/*---------------------------------------------------------------------------*/
+/* the senders send their datagrams one after the other, one fragment of
+ * each sender per round */
+static void
+forward(int mode, int senders)
+{
+  int seq, round, sender, i;
+
+  captured = 0;
+  capture = sent;
+  capture_max = sizeof(sent) / sizeof(sent[0]);
+  fed = delay = delays = firsts = 0;
+  for(seq = 0; seq < datagrams; seq++) {
+    for(round = 0; round < nfragments; round++) {
+      i = round;
+      if(mode == MODE_SWAPPED && round < 2) {
+        i = 1 - round;
+      }
+      for(sender = 0; sender < senders; sender++) {
+        if(round == 0) {
+          first_in[sender] = fed;
+        }
+        fed++;
+        feeding = sender;
+        feed(sender, &frames[sender][seq][i]);
+        if(mode == MODE_TWICE) {
+          fed++;
+          feed(sender, &frames[sender][seq][i]);
+        }
+        feeding = -1;
+      }
+    }
+  }
+  capture = NULL;
+}
+/*---------------------------------------------------------------------------*/
+/* reassembles the fragments sent by the router */
+static void
+verify(void)
+{
+  unsigned int i;
+
+  memset(delivered, 0, sizeof(delivered));
+  ndelivered = wrong = 0;
+  verifying = 1;
+  for(i = 0; i < captured; i++) {
+    feed(0, &sent[i]);
+  }
+  verifying = 0;
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(sicslowpan_forward_process, ev, data)
+{
+  static const char *modes[] = { "in order", "swapped", "twice" };
+  static struct etimer et;
+  static int mode, senders;
+  static uip_ipaddr_t dest, nexthop;
+  static uip_lladdr_t nexthop_lladdr = {{ 0x02, 0, 0, 0, 0, 0, 0, 0x64 }};
+  static uip_ds6_addr_t *addr;
+  unsigned long ns;
+  int sender, seq;
+
+  PROCESS_BEGIN();
+
+  feeding = -1;
+  datagrams = arg(1, MAX_DATAGRAMS);
+  if(datagrams < 1 || datagrams > MAX_DATAGRAMS) {
+    printf("sicslowpan forwarding: 1 to %d datagrams per sender\n",
+           MAX_DATAGRAMS);
+    exit(1);
+  }
+  for(sender = 0; sender < MAX_SENDERS; sender++) {
+    for(seq = 0; seq < datagrams; seq++) {
+      make_datagram(sender, seq);
+    }
+  }
+
+  uip_ip6addr(&dest, 0xfd00, 0, 0, 0, 0, 0, 0, 0x100);
+  uip_ip6addr(&nexthop, 0xfe80, 0, 0, 0, 0, 0, 0, 0x64);
+  uip_ds6_nbr_add(&nexthop, &nexthop_lladdr, 0, NBR_REACHABLE);
+  uip_ds6_route_add(&dest, 128, &nexthop, 0);
+  rime_sniffer_add(&sniffer);
+  printf("sicslowpan forwarding: %d datagrams of %d bytes per sender, %u fragments each, fragment forwarding %s\n",
+         datagrams, DATAGRAM_LEN, nfragments,
+         SICSLOWPAN_FRAG_FORWARD ? "on" : "off");
+
+  for(mode = MODE_IN_ORDER; mode <= MODE_TWICE; mode++) {
+    for(senders = 1; senders <= MAX_SENDERS; senders *= 2) {
+      start();
+      forward(mode, senders);
+      ns = elapsed_ns();
+      printf("%-9s %d senders: %4u fragments sent, %lu.%lu fragments in until the first goes out, %lu ns per fragment\n",
+             modes[mode], senders, captured, delays ? delay / delays : 0,
+             delays ? delay * 10 / delays % 10 : 0, fed ? ns / fed : 0);
+      printf("                     forwarded %lu, reassemblies %lu, no context %lu, duplicate %lu\n",
+             sicslowpan_stats.frag_forwarded, sicslowpan_stats.reass_done,
+             sicslowpan_stats.reass_nocontext,
+             sicslowpan_stats.reass_duplicate);
+      if(firsts != senders * datagrams) {
+        printf("sicslowpan forwarding: %lu first fragments sent for %d datagrams\n",
+               firsts, senders * datagrams);
+        exit(1);
+      }
+
+      /* let the contexts time out, then check what was sent */
+      etimer_set(&et, SICSLOWPAN_REASS_MAXAGE * CLOCK_SECOND + 1);
+      PROCESS_WAIT_EVENT_UNTIL(etimer_expired(&et));
+      addr = uip_ds6_addr_add(&dest, 0, ADDR_MANUAL);
+      verify();
+      uip_ds6_addr_rm(addr);
+      printf("                     %lu of %d datagrams reassembled from them, %lu wrong\n",
+             ndelivered, senders * datagrams, wrong);
+      if(ndelivered != senders * datagrams || wrong > 0) {
+        exit(1);
+      }
+      etimer_set(&et, SICSLOWPAN_REASS_MAXAGE * CLOCK_SECOND + 1);
+      PROCESS_WAIT_EVENT_UNTIL(etimer_expired(&et));
+    }
+  }
+  exit(0);
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
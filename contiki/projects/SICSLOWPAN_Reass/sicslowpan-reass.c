@@ -0,0 +1,341 @@
+/*
+ * Copyright (c) 2012, TU Dortmund University.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following
+ *    disclaimer in the documentation and/or other materials provided
+ *    with the distribution.
+ * 3. The name of the author may not be used to endorse or promote
+ *    products derived from this software without specific prior
+ *    written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS
+ * OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+ * GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * This file is part of the Contiki OS
+ *
+ */
+/*---------------------------------------------------------------------------*/
+/*---------------------------------------------------------------------------*/
+/**
+ * \file    Reassembly of interleaved 6lowpan fragments. A MAC driver
+ *          captures the fragments sicslowpan makes of UDP datagrams of
+ *          DATAGRAM_LEN bytes, these are fed back into sicslowpan as if
+ *          several senders were sending at the same time, all of them
+ *          using the same datagram tags. Each round delivers one fragment
+ *          of each sender:
+ *          - in order,
+ *          - reverse, the fragments of each datagram last to first,
+ *          - twice, every fragment is duplicated.
+ *          The reassembled datagrams are checked, then the number of
+ *          datagrams delivered, the CPU time per fragment and the
+ *          sicslowpan statistics are printed for 1 to MAX_SENDERS senders.
+ *          The timeouts of a run are the reassemblies the previous run
+ *          left unfinished.
+ *
+ *          usage: sicslowpan-reass.native [datagrams per sender]
+ */
+/*---------------------------------------------------------------------------*/
+#include "contiki.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "net/netstack.h"
+#include "net/packetbuf.h"
+#include "net/rime.h"
+#include "net/sicslowpan.h"
+#include "net/tcpip.h"
+#include "net/uip.h"
+
+#define DATAGRAM_LEN    600
+#define MAX_DATAGRAMS   50
+#define MAX_SENDERS     8
+#define MAX_FRAGMENTS   12
+
+#define UIP_IP_BUF      ((struct uip_ip_hdr *)&uip_buf[UIP_LLH_LEN])
+#define UIP_UDP_BUF     ((struct uip_udp_hdr *)&uip_buf[UIP_LLIPH_LEN])
+#define PAYLOAD         (&uip_buf[UIP_LLIPH_LEN + UIP_UDPH_LEN])
+#define PAYLOAD_LEN     (DATAGRAM_LEN - UIP_IPUDPH_LEN)
+
+#define MODE_IN_ORDER   0
+#define MODE_REVERSE    1
+#define MODE_TWICE      2
+
+extern int contiki_argc;
+extern char **contiki_argv;
+
+PROCESS(sicslowpan_reass_process, "sicslowpan reassembly");
+AUTOSTART_PROCESSES(&sicslowpan_reass_process);
+
+struct frame {
+  uint8_t len;
+  uint8_t data[PACKETBUF_SIZE];
+};
+
+/* the fragments of the datagrams of each sender */
+static struct frame frames[MAX_SENDERS][MAX_DATAGRAMS][MAX_FRAGMENTS];
+static struct frame *capture;
+static uint8_t captured, nfragments;
+static int datagrams;
+static uint8_t delivered[MAX_SENDERS][MAX_DATAGRAMS];
+static unsigned long ndelivered, wrong;
+static clock_t started;
+
+/*---------------------------------------------------------------------------*/
+static long
+arg(int n, long def)
+{
+  return contiki_argc > n ? strtol(contiki_argv[n], NULL, 0) : def;
+}
+/*---------------------------------------------------------------------------*/
+static void
+start(void)
+{
+  started = clock();
+}
+/*---------------------------------------------------------------------------*/
+static void
+report(const char *mode, int senders, unsigned long fragments)
+{
+  unsigned long ns = (unsigned long)((clock() - started) *
+                                     (1000000000.0 / CLOCKS_PER_SEC));
+
+  printf("%-9s %d senders: %3lu of %3d datagrams, %lu wrong, %lu ns per fragment\n",
+         mode, senders, ndelivered, senders * datagrams, wrong,
+         fragments ? ns / fragments : 0);
+  printf("          started %lu, done %lu, timeout %lu, no context %lu, dropped %lu, duplicate %lu\n",
+         sicslowpan_stats.reass_started, sicslowpan_stats.reass_done,
+         sicslowpan_stats.reass_timeout, sicslowpan_stats.reass_nocontext,
+         sicslowpan_stats.reass_dropped, sicslowpan_stats.reass_duplicate);
+}
+/*---------------------------------------------------------------------------*/
+/* MAC layer of the test: stores the fragments sicslowpan sends */
+static void
+mac_send(mac_callback_t sent, void *ptr)
+{
+  if(capture != NULL && captured < MAX_FRAGMENTS) {
+    capture[captured].len = packetbuf_totlen();
+    packetbuf_copyto(capture[captured].data);
+    captured++;
+  }
+  mac_call_sent_callback(sent, ptr, MAC_TX_OK, 1);
+}
+/*---------------------------------------------------------------------------*/
+static void
+mac_input(void)
+{
+  NETSTACK_NETWORK.input();
+}
+/*---------------------------------------------------------------------------*/
+static int
+mac_on(void)
+{
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+static int
+mac_off(int keep_radio_on)
+{
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+static unsigned short
+mac_channel_check_interval(void)
+{
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+static void
+mac_init(void)
+{
+}
+/*---------------------------------------------------------------------------*/
+const struct mac_driver reass_mac_driver = {
+  "reass-mac",
+  mac_init,
+  mac_send,
+  mac_input,
+  mac_on,
+  mac_off,
+  mac_channel_check_interval,
+};
+/*---------------------------------------------------------------------------*/
+/* called by sicslowpan for each datagram it passes to the IP layer: checks
+ * the datagram and drops it */
+static void
+sniffer_input(void)
+{
+  uint8_t *p = PAYLOAD;
+  uint16_t i;
+  uint8_t sender = p[0], seq = p[1];
+
+  if(uip_len != DATAGRAM_LEN || UIP_IP_BUF->proto != UIP_PROTO_UDP ||
+     sender >= MAX_SENDERS || seq >= datagrams ||
+     UIP_IP_BUF->srcipaddr.u8[15] != sender + 1 ||
+     delivered[sender][seq]) {
+    wrong++;
+  } else {
+    for(i = 2; i < PAYLOAD_LEN; i++) {
+      if(p[i] != (uint8_t)(sender + seq + i)) {
+        break;
+      }
+    }
+    if(i < PAYLOAD_LEN) {
+      wrong++;
+    } else {
+      delivered[sender][seq] = 1;
+      ndelivered++;
+    }
+  }
+  uip_len = 0;
+}
+/*---------------------------------------------------------------------------*/
+RIME_SNIFFER(sniffer, sniffer_input, NULL);
+/*---------------------------------------------------------------------------*/
+/* fragments datagram seq of sender through sicslowpan, all senders use
+ * the tag seq */
+static void
+make_datagram(int sender, int seq)
+{
+  static uip_lladdr_t dest = {{ 0x02, 0, 0, 0, 0, 0, 0, 0x01 }};
+  uint8_t *p = PAYLOAD;
+  int i;
+
+  memset(UIP_IP_BUF, 0, UIP_IPUDPH_LEN);
+  UIP_IP_BUF->vtc = 0x60;
+  UIP_IP_BUF->len[0] = (DATAGRAM_LEN - UIP_IPH_LEN) >> 8;
+  UIP_IP_BUF->len[1] = (DATAGRAM_LEN - UIP_IPH_LEN) & 0xff;
+  UIP_IP_BUF->proto = UIP_PROTO_UDP;
+  UIP_IP_BUF->ttl = 64;
+  uip_ip6addr(&UIP_IP_BUF->srcipaddr, 0xfd00, 0, 0, 0, 0, 0, 0, sender + 1);
+  uip_ip6addr(&UIP_IP_BUF->destipaddr, 0xfd00, 0, 0, 0, 0, 0, 0, 0x100);
+  UIP_UDP_BUF->srcport = UIP_HTONS(1000);
+  UIP_UDP_BUF->destport = UIP_HTONS(2000);
+  UIP_UDP_BUF->udplen = UIP_HTONS(DATAGRAM_LEN - UIP_IPH_LEN);
+  p[0] = sender;
+  p[1] = seq;
+  for(i = 2; i < PAYLOAD_LEN; i++) {
+    p[i] = sender + seq + i;
+  }
+  uip_len = DATAGRAM_LEN;
+
+  capture = frames[sender][seq];
+  captured = 0;
+  tcpip_output(&dest);
+  capture = NULL;
+  if(nfragments == 0) {
+    nfragments = captured;
+  } else if(captured != nfragments) {
+    printf("sicslowpan reassembly: %u fragments instead of %u\n",
+           captured, nfragments);
+    exit(1);
+  }
+  for(i = 0; i < captured; i++) {
+    frames[sender][seq][i].data[2] = 0;
+    frames[sender][seq][i].data[3] = seq;
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+feed(int sender, struct frame *f)
+{
+  rimeaddr_t addr;
+
+  memset(&addr, 0, sizeof(addr));
+  addr.u8[0] = 0x02;
+  addr.u8[sizeof(addr) - 1] = sender + 1;
+  packetbuf_clear();
+  packetbuf_copyfrom(f->data, f->len);
+  packetbuf_set_addr(PACKETBUF_ADDR_SENDER, &addr);
+  packetbuf_set_addr(PACKETBUF_ADDR_RECEIVER, &rimeaddr_node_addr);
+  NETSTACK_NETWORK.input();
+}
+/*---------------------------------------------------------------------------*/
+/* the senders send their datagrams one after the other, one fragment of
+ * each sender per round */
+static unsigned long
+run(int mode, int senders)
+{
+  unsigned long fragments = 0;
+  int seq, round, sender;
+  struct frame *f;
+
+  memset(delivered, 0, sizeof(delivered));
+  ndelivered = wrong = 0;
+  memset(&sicslowpan_stats, 0, sizeof(sicslowpan_stats));
+  for(seq = 0; seq < datagrams; seq++) {
+    for(round = 0; round < nfragments; round++) {
+      for(sender = 0; sender < senders; sender++) {
+        f = &frames[sender][seq][mode == MODE_REVERSE ?
+                                 nfragments - 1 - round : round];
+        feed(sender, f);
+        fragments++;
+        if(mode == MODE_TWICE) {
+          feed(sender, f);
+          fragments++;
+        }
+      }
+    }
+  }
+  return fragments;
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(sicslowpan_reass_process, ev, data)
+{
+  static const char *modes[] = { "in order", "reverse", "twice" };
+  static struct etimer et;
+  static int mode, senders;
+  unsigned long fragments;
+  int sender, seq;
+
+  PROCESS_BEGIN();
+
+  datagrams = arg(1, MAX_DATAGRAMS);
+  if(datagrams < 1 || datagrams > MAX_DATAGRAMS) {
+    printf("sicslowpan reassembly: 1 to %d datagrams per sender\n",
+           MAX_DATAGRAMS);
+    exit(1);
+  }
+  for(sender = 0; sender < MAX_SENDERS; sender++) {
+    for(seq = 0; seq < datagrams; seq++) {
+      make_datagram(sender, seq);
+    }
+  }
+  rime_sniffer_add(&sniffer);
+  printf("sicslowpan reassembly: %d datagrams of %d bytes per sender, %u fragments each, %u contexts\n",
+         datagrams, DATAGRAM_LEN, nfragments, SICSLOWPAN_REASS_CONTEXTS);
+
+  for(mode = MODE_IN_ORDER; mode <= MODE_TWICE; mode++) {
+    for(senders = 1; senders <= MAX_SENDERS; senders *= 2) {
+      start();
+      fragments = run(mode, senders);
+      report(modes[mode], senders, fragments);
+      /* let the contexts time out, the next run counts the unfinished
+       * reassemblies as timeouts */
+      etimer_set(&et, SICSLOWPAN_REASS_MAXAGE * CLOCK_SECOND + 1);
+      PROCESS_WAIT_EVENT_UNTIL(etimer_expired(&et));
+    }
+  }
+  exit(0);
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
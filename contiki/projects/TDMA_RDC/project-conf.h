@@ -0,0 +1,13 @@
+#ifndef __PROJECT_TDMA_RDC_CONF_H__
+#define __PROJECT_TDMA_RDC_CONF_H__
+
+
+#define NETSTACK_CONF_MAC   nullmac_driver
+#define NETSTACK_CONF_RDC   tdmardc_driver
+#define NETSTACK_CONF_RADIO tdma_rdc_radio_driver
+
+/* the test radio records the channel of each transmission */
+#define TDMARDC_CONF_SET_CHANNEL(c) tdma_rdc_set_channel(c)
+void tdma_rdc_set_channel(int channel);
+
+#endif /* __PROJECT_TDMA_RDC_CONF_H__ */
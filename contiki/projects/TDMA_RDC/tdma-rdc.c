@@ -0,0 +1,266 @@
+/*
+ * Copyright (c) 2012, TU Dortmund University.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following
+ *    disclaimer in the documentation and/or other materials provided
+ *    with the distribution.
+ * 3. The name of the author may not be used to endorse or promote
+ *    products derived from this software without specific prior
+ *    written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS
+ * OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+ * GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * This file is part of the Contiki OS
+ *
+ */
+/*---------------------------------------------------------------------------*/
+/**
+ * \file    Runs the TDMA RDC with a schedule of five slots on the native
+ *          platform. Bursts of unicast and broadcast frames are sent
+ *          through the MAC layer, the radio below the RDC checks that
+ *          each frame starts in a TX or shared slot of this node, outside
+ *          the guard times and on the channel of the slot.
+ *
+ *          usage: tdma-rdc.native [bursts [frames per burst]]
+ */
+/*---------------------------------------------------------------------------*/
+#include "contiki.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "net/netstack.h"
+#include "net/packetbuf.h"
+#include "net/mac/tdmardc.h"
+#include "dev/nullradio.h"
+
+#define TDMA_RDC_BURSTS       10
+#define TDMA_RDC_FRAMES       4
+#define TDMA_RDC_SLOT_LENGTH  (RTIMER_SECOND / 20)
+#define TDMA_RDC_GUARD_TIME   (RTIMER_SECOND / 200)
+
+extern int contiki_argc;
+extern char **contiki_argv;
+
+PROCESS(tdma_rdc_process, "TDMA RDC test");
+AUTOSTART_PROCESSES(&tdma_rdc_process);
+
+static const struct tdmardc_slot slots[] = {
+  { TDMARDC_SLOT_TX,     11 },
+  { TDMARDC_SLOT_RX,     12 },
+  { TDMARDC_SLOT_SHARED, 26 },
+  { TDMARDC_SLOT_OFF,     0 },
+  { TDMARDC_SLOT_TX,     15 },
+};
+static const struct tdmardc_schedule schedule = {
+  TDMA_RDC_SLOT_LENGTH, TDMA_RDC_GUARD_TIME,
+  sizeof(slots) / sizeof(slots[0]), slots
+};
+
+static rtimer_clock_t frame_start;
+static int channel;
+static uint32_t transmitted, wrong_slot, wrong_time, wrong_channel;
+static uint32_t sent, acked, failed, latency_max;
+static uint32_t per_slot[sizeof(slots) / sizeof(slots[0])];
+static rtimer_clock_t queued[256];
+
+/*---------------------------------------------------------------------------*/
+static long
+arg(int n, long def)
+{
+  return contiki_argc > n ? strtol(contiki_argv[n], NULL, 0) : def;
+}
+/*---------------------------------------------------------------------------*/
+void
+tdma_rdc_set_channel(int c)
+{
+  channel = c;
+}
+/*---------------------------------------------------------------------------*/
+/* Radio driver of the test: nullradio, with checks of each transmission */
+static int
+radio_send(const void *payload, unsigned short payload_len)
+{
+  rtimer_clock_t offset = (rtimer_clock_t)(RTIMER_NOW() - frame_start) %
+    (schedule.slot_length * schedule.num_slots);
+  int slot = offset / schedule.slot_length;
+
+  transmitted++;
+  offset %= schedule.slot_length;
+  if(slot != tdmardc_current_slot() ||
+     (slots[slot].type != TDMARDC_SLOT_TX &&
+      slots[slot].type != TDMARDC_SLOT_SHARED)) {
+    wrong_slot++;
+  } else {
+    per_slot[slot]++;
+  }
+  if(offset < schedule.guard_time ||
+     offset >= schedule.slot_length - schedule.guard_time) {
+    wrong_time++;
+  }
+  if(slot < schedule.num_slots && slots[slot].channel != channel) {
+    wrong_channel++;
+  }
+  return nullradio_driver.send(payload, payload_len);
+}
+/*---------------------------------------------------------------------------*/
+static int
+radio_init(void)
+{
+  return nullradio_driver.init();
+}
+/*---------------------------------------------------------------------------*/
+static int
+radio_prepare(const void *payload, unsigned short payload_len)
+{
+  return nullradio_driver.prepare(payload, payload_len);
+}
+/*---------------------------------------------------------------------------*/
+static int
+radio_transmit(unsigned short transmit_len)
+{
+  return nullradio_driver.transmit(transmit_len);
+}
+/*---------------------------------------------------------------------------*/
+static int
+radio_read(void *buf, unsigned short buf_len)
+{
+  return nullradio_driver.read(buf, buf_len);
+}
+/*---------------------------------------------------------------------------*/
+static int
+radio_channel_clear(void)
+{
+  return nullradio_driver.channel_clear();
+}
+/*---------------------------------------------------------------------------*/
+static int
+radio_receiving_packet(void)
+{
+  return nullradio_driver.receiving_packet();
+}
+/*---------------------------------------------------------------------------*/
+static int
+radio_pending_packet(void)
+{
+  return nullradio_driver.pending_packet();
+}
+/*---------------------------------------------------------------------------*/
+static int
+radio_on(void)
+{
+  return nullradio_driver.on();
+}
+/*---------------------------------------------------------------------------*/
+static int
+radio_off(void)
+{
+  return nullradio_driver.off();
+}
+/*---------------------------------------------------------------------------*/
+const struct radio_driver tdma_rdc_radio_driver = {
+  radio_init,
+  radio_prepare,
+  radio_transmit,
+  radio_send,
+  radio_read,
+  radio_channel_clear,
+  radio_receiving_packet,
+  radio_pending_packet,
+  radio_on,
+  radio_off,
+};
+/*---------------------------------------------------------------------------*/
+static void
+packet_sent(void *ptr, int status, int num_tx)
+{
+  rtimer_clock_t latency = RTIMER_NOW() - queued[(uintptr_t)ptr & 0xff];
+
+  if(status == MAC_TX_OK) {
+    acked++;
+  } else {
+    failed++;
+  }
+  if(latency > latency_max) {
+    latency_max = latency;
+  }
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(tdma_rdc_process, ev, data)
+{
+  static struct etimer et;
+  static uint32_t bursts, frames, i;
+  rimeaddr_t to;
+
+  PROCESS_BEGIN();
+
+  bursts = arg(1, TDMA_RDC_BURSTS);
+  frames = arg(2, TDMA_RDC_FRAMES);
+
+  /* slot 0 starts one slot from now */
+  frame_start = RTIMER_NOW() + schedule.slot_length;
+  if(tdmardc_set_schedule(&schedule) != 0) {
+    printf("TDMA RDC: invalid schedule\n");
+    exit(1);
+  }
+  tdmardc_sync(frame_start);
+
+  printf("TDMA RDC: %lu bursts of %lu frames, %u slots of %u ticks, guard %u ticks\n",
+         (unsigned long)bursts, (unsigned long)frames, schedule.num_slots,
+         schedule.slot_length, schedule.guard_time);
+
+  while(sent < bursts * frames) {
+    etimer_set(&et, CLOCK_SECOND / 3);
+    PROCESS_WAIT_EVENT_UNTIL(etimer_expired(&et));
+
+    for(i = 0; i < frames; i++) {
+      packetbuf_clear();
+      packetbuf_copyfrom("tdma", 4);
+      /* every other frame is a broadcast */
+      rimeaddr_copy(&to, &rimeaddr_null);
+      if(i & 1) {
+        to.u8[0] = 1;
+      }
+      packetbuf_set_addr(PACKETBUF_ADDR_RECEIVER, &to);
+      queued[sent & 0xff] = RTIMER_NOW();
+      NETSTACK_MAC.send(packet_sent, (void *)(uintptr_t)(sent & 0xff));
+      sent++;
+    }
+  }
+
+  /* two frames for the last frames to go out */
+  etimer_set(&et, 2 * schedule.num_slots * schedule.slot_length *
+             CLOCK_SECOND / RTIMER_SECOND);
+  PROCESS_WAIT_EVENT_UNTIL(etimer_expired(&et));
+
+  printf("%lu queued, %lu sent, %lu failed, %lu pending, max latency %lu ticks\n",
+         (unsigned long)sent, (unsigned long)acked, (unsigned long)failed,
+         (unsigned long)(sent - acked - failed), (unsigned long)latency_max);
+  printf("%lu transmissions: %lu in a wrong slot, %lu in a guard time, %lu on a wrong channel\n",
+         (unsigned long)transmitted, (unsigned long)wrong_slot,
+         (unsigned long)wrong_time, (unsigned long)wrong_channel);
+  for(i = 0; i < schedule.num_slots; i++) {
+    printf("slot %lu: %lu frames\n", (unsigned long)i, (unsigned long)per_slot[i]);
+  }
+  exit(sent == acked && wrong_slot + wrong_time + wrong_channel == 0 ? 0 : 1);
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
@@ -0,0 +1,7 @@
+#ifndef __PROJECT_TDMA_SIM_CONF_H__
+#define __PROJECT_TDMA_SIM_CONF_H__
+
+
+#define NETSTACK_CONF_RADIO rf231_slotted_driver
+
+#endif /* __PROJECT_TDMA_SIM_CONF_H__ */
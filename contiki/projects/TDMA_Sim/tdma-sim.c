@@ -0,0 +1,168 @@
+/*
+ * Copyright (c) 2012, TU Dortmund University.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following
+ *    disclaimer in the documentation and/or other materials provided
+ *    with the distribution.
+ * 3. The name of the author may not be used to endorse or promote
+ *    products derived from this software without specific prior
+ *    written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS
+ * OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+ * GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * This file is part of the Contiki OS
+ *
+ */
+/*---------------------------------------------------------------------------*/
+/**
+ * \file    Runs the rf231 slotted TDMA state machine against the native
+ *          discrete event simulation and prints timing and slot statistics.
+ *
+ *          usage: tdma-sim.native [cycles [peers [loss [drift [jitter [seed [dma]]]]]]]
+ *          loss in 1/65536, drift in ppm, jitter and SPI DMA latency in ns
+ */
+/*---------------------------------------------------------------------------*/
+#include "contiki.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/time.h>
+
+#include "net/netstack.h"
+#include "net/packetbuf.h"
+#include "net/rime/rimestats.h"
+#include "rf231_slotted.h"
+#include "rf231_slotted_hal.h"
+#include "rf231_slotted_sim.h"
+
+#define TDMA_SIM_CYCLES       10000
+#define TDMA_SIM_CHUNK        1000
+
+extern int contiki_argc;
+extern char **contiki_argv;
+
+PROCESS(tdma_sim_process, "TDMA Simulation");
+AUTOSTART_PROCESSES(&tdma_sim_process);
+
+/*---------------------------------------------------------------------------*/
+static long
+arg(int n, long def)
+{
+  return contiki_argc > n ? strtol(contiki_argv[n], NULL, 0) : def;
+}
+/*---------------------------------------------------------------------------*/
+static void
+print_stats(const rf231_sim_stats_t *s, double seconds)
+{
+  const tdma_hop_t *hop = rf231_slotted_get_hopping();
+#ifndef SLOTTED_KOORDINATOR
+  const tdma_pll_t *pll;
+#endif /* SLOTTED_KOORDINATOR */
+
+  printf("cycles          %lu (%lu events, %.0f cycles/s)\n",
+         (unsigned long)s->cycles, (unsigned long)s->events,
+         seconds > 0 ? s->cycles / seconds : 0.0);
+  printf("beacons missed  %lu\n", (unsigned long)s->beaconsMissed);
+  printf("slots used      %lu of %lu (%lu.%lu %%)\n",
+         (unsigned long)s->slotsUsed, (unsigned long)s->slotsTotal,
+         s->slotsTotal ? (unsigned long)(s->slotsUsed * 100ULL / s->slotsTotal) : 0,
+         s->slotsTotal ? (unsigned long)(s->slotsUsed * 1000ULL / s->slotsTotal % 10) : 0);
+  printf("joins           %lu\n", (unsigned long)s->joins);
+  printf("collisions      %lu\n", (unsigned long)s->collisions);
+  printf("underruns       %lu\n", (unsigned long)s->underruns);
+  printf("data frames     %lu sent, %lu received\n",
+         rimestats.lltx, rimestats.llrx);
+  printf("retransmissions %lu, %lu not acknowledged\n",
+         rimestats.rexmit, rimestats.noacktx);
+  if(s->periodSamples) {
+    printf("period error    avg %lu ns, max %lu ns\n",
+           (unsigned long)(s->periodErrSum / s->periodSamples),
+           (unsigned long)s->periodErrMax);
+  }
+  if(s->slotSamples) {
+    printf("slot error      avg %lu ns, max %lu ns\n",
+           (unsigned long)(s->slotErrSum / s->slotSamples),
+           (unsigned long)s->slotErrMax);
+  }
+  printf("hopping         %u channels, %lu hops, on channel %u\n",
+         TDMA_HOP_LENGTH, (unsigned long)hop->hops, hop->channel);
+#ifndef SLOTTED_KOORDINATOR
+  pll = rf231_slotted_get_pll();
+  printf("beacon pll      rate %+ld ppm, phase error max %lu ns, %lu unlocks\n",
+         (long)(((int64_t)pll->rate - (int64_t)PLL_ONE) * 1000000 / (int64_t)PLL_ONE),
+         (unsigned long)pll->phaseErrorMax * TIM_RESOLUTION_NS,
+         (unsigned long)pll->unlocks);
+  printf("coasting        %lu beacons, %lu sync losses\n",
+         (unsigned long)pll->beaconsCoasted, (unsigned long)pll->syncLosses);
+#endif /* SLOTTED_KOORDINATOR */
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(tdma_sim_process, ev, data)
+{
+  static rf231_sim_conf_t conf;
+  static uint32_t cycles, done;
+  static struct timeval start;
+  struct timeval end;
+
+  PROCESS_BEGIN();
+
+  cycles = arg(1, TDMA_SIM_CYCLES);
+  conf.numPeers = arg(2, RF231_SIM_PEERS);
+  conf.lossRate = arg(3, 0);
+  conf.driftPpm = arg(4, 0);
+  conf.jitterNs = arg(5, 0);
+  conf.seed = arg(6, 1);
+  conf.dmaLatencyNs = arg(7, 0);
+  rf231_sim_configure(&conf);
+
+#ifdef SLOTTED_KOORDINATOR
+  /* one slot per simulated client */
+  if(!rf231_slotted_set_superframe(conf.numPeers, PAYLOAD_PER_CLIENT)) {
+    printf("TDMA simulation: at most %u clients\n", MAX_CLIENTS);
+    exit(1);
+  }
+  printf("TDMA simulation: koordinator, %u clients\n", conf.numPeers);
+#else
+  printf("TDMA simulation: client 0x%02x, %u peers\n", RF231_SIM_NODE_ID, conf.numPeers);
+#endif /* SLOTTED_KOORDINATOR */
+  printf("default period %lu ns, slot %lu ns, loss %u/65536, drift %ld ppm, jitter %lu ns, dma %lu ns\n",
+         (unsigned long)TDMA_PERIOD_NS, (unsigned long)TDMA_SLOTTIME_NS,
+         conf.lossRate, (long)conf.driftPpm, (unsigned long)conf.jitterNs,
+         (unsigned long)conf.dmaLatencyNs);
+
+  gettimeofday(&start, NULL);
+  done = 0;
+  while(done < cycles) {
+    /* one frame per chunk through the transmit queue of the driver */
+    packetbuf_copyfrom("TDMA", 4);
+    NETSTACK_RADIO.send(packetbuf_hdrptr(), packetbuf_totlen());
+    done += rf231_sim_run(cycles - done < TDMA_SIM_CHUNK ? cycles - done : TDMA_SIM_CHUNK);
+    /* let the rest of the system run between the chunks */
+    PROCESS_PAUSE();
+  }
+  gettimeofday(&end, NULL);
+
+  print_stats(rf231_sim_get_stats(),
+              (end.tv_sec - start.tv_sec) + (end.tv_usec - start.tv_usec) / 1e6);
+  exit(0);
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
@@ -0,0 +1,207 @@
+/*
+ * Copyright (c) 2012, TU Dortmund University.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following
+ *    disclaimer in the documentation and/or other materials provided
+ *    with the distribution.
+ * 3. The name of the author may not be used to endorse or promote
+ *    products derived from this software without specific prior
+ *    written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS
+ * OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+ * GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * This file is part of the Contiki OS
+ *
+ */
+/*---------------------------------------------------------------------------*/
+/**
+ * \file    Checks the idle mode of the native main loop. For a few
+ *          seconds a process waits for a periodic etimer, and a periodic
+ *          rtimer polls another process from its callback. The select()
+ *          and pselect() calls of the main loop are counted, each one is
+ *          a wakeup, as is the lateness of the etimer events and of the
+ *          polls behind their rtimer times.
+ *          With CLOCK_CONF_TICKLESS the main loop has to sleep until the
+ *          next timer, so there may be only a few wakeups per timer,
+ *          otherwise it wakes up every tick. Either way no timer may be
+ *          late by more than TICKLESS_IDLE_LATE ticks.
+ *
+ *          usage: tickless-idle.native [seconds [etimer [rtimer]]]
+ *          etimer in clock ticks, rtimer in rtimer ticks
+ */
+/*---------------------------------------------------------------------------*/
+#include "contiki.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/select.h>
+
+#define TICKLESS_IDLE_SECONDS   2
+#define TICKLESS_IDLE_ETIMER    (CLOCK_SECOND / 10)
+#define TICKLESS_IDLE_RTIMER    (RTIMER_SECOND * 37 / 1000)
+/* wakeups allowed per timer event with CLOCK_CONF_TICKLESS */
+#define TICKLESS_IDLE_WAKEUPS   3
+/* in clock and rtimer ticks. The host may deschedule us for a few ms,
+   a wakeup that got lost costs up to a timer period. */
+#define TICKLESS_IDLE_LATE      20
+
+extern int contiki_argc;
+extern char **contiki_argv;
+
+PROCESS(tickless_idle_process, "tickless idle check");
+PROCESS(etimer_user_process, "etimer user");
+PROCESS(rtimer_user_process, "rtimer user");
+AUTOSTART_PROCESSES(&tickless_idle_process);
+
+static clock_time_t etimer_period;
+static rtimer_clock_t rtimer_period;
+static struct rtimer task;
+static volatile rtimer_clock_t due;
+static volatile uint8_t stop;
+static unsigned long wakeups, etimer_events, rtimer_polls;
+static unsigned long etimer_late, rtimer_late;
+
+/*---------------------------------------------------------------------------*/
+/* the main loop of the native platform, linked with --wrap */
+int __real_select(int n, fd_set *r, fd_set *w, fd_set *e, struct timeval *t);
+int __real_pselect(int n, fd_set *r, fd_set *w, fd_set *e,
+                   const struct timespec *t, const sigset_t *mask);
+
+int
+__wrap_select(int n, fd_set *r, fd_set *w, fd_set *e, struct timeval *t)
+{
+  wakeups++;
+  return __real_select(n, r, w, e, t);
+}
+
+int
+__wrap_pselect(int n, fd_set *r, fd_set *w, fd_set *e,
+               const struct timespec *t, const sigset_t *mask)
+{
+  wakeups++;
+  return __real_pselect(n, r, w, e, t, mask);
+}
+/*---------------------------------------------------------------------------*/
+static long
+arg(int n, long def)
+{
+  return contiki_argc > n ? strtol(contiki_argv[n], NULL, 0) : def;
+}
+/*---------------------------------------------------------------------------*/
+static void
+rtimer_callback(struct rtimer *t, void *ptr)
+{
+  due = RTIMER_TIME(t);
+  process_poll(&rtimer_user_process);
+  if(!stop) {
+    rtimer_set(t, RTIMER_TIME(t) + rtimer_period, 1, rtimer_callback, NULL);
+  }
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(rtimer_user_process, ev, data)
+{
+  rtimer_clock_t late;
+
+  PROCESS_BEGIN();
+
+  while(1) {
+    PROCESS_YIELD_UNTIL(ev == PROCESS_EVENT_POLL);
+    late = RTIMER_NOW() - due;
+    if(late > rtimer_late) {
+      rtimer_late = late;
+    }
+    rtimer_polls++;
+  }
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(etimer_user_process, ev, data)
+{
+  static struct etimer et;
+  clock_time_t late;
+
+  PROCESS_BEGIN();
+
+  etimer_set(&et, etimer_period);
+  while(1) {
+    PROCESS_WAIT_EVENT_UNTIL(etimer_expired(&et));
+    late = clock_time() - etimer_expiration_time(&et);
+    if(late > etimer_late) {
+      etimer_late = late;
+    }
+    etimer_events++;
+    etimer_reset(&et);
+  }
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(tickless_idle_process, ev, data)
+{
+  static struct etimer et;
+  static int seconds;
+  static unsigned long start_wakeups;
+  static clock_time_t start;
+  unsigned long events, allowed;
+  int failed;
+
+  PROCESS_BEGIN();
+
+  seconds = arg(1, TICKLESS_IDLE_SECONDS);
+  etimer_period = arg(2, TICKLESS_IDLE_ETIMER);
+  rtimer_period = arg(3, TICKLESS_IDLE_RTIMER);
+  if(etimer_period < 1 || rtimer_period < 1) {
+    printf("tickless idle: periods of at least one tick\n");
+    exit(1);
+  }
+  printf("tickless idle %s: %d s, etimer every %lu ticks, rtimer every %u ticks\n",
+         CLOCK_CONF_TICKLESS ? "on" : "off", seconds,
+         (unsigned long)etimer_period, (unsigned)rtimer_period);
+
+  process_start(&etimer_user_process, NULL);
+  process_start(&rtimer_user_process, NULL);
+  rtimer_set(&task, RTIMER_NOW() + rtimer_period, 1, rtimer_callback, NULL);
+
+  start = clock_time();
+  start_wakeups = wakeups;
+  etimer_set(&et, seconds * CLOCK_SECOND);
+  PROCESS_WAIT_EVENT_UNTIL(etimer_expired(&et));
+  stop = 1;
+  wakeups -= start_wakeups;
+
+  events = etimer_events + rtimer_polls + 1;
+  allowed = CLOCK_CONF_TICKLESS ? events * TICKLESS_IDLE_WAKEUPS :
+    (unsigned long)(clock_time() - start) + events;
+  printf("%lu wakeups (%lu allowed) for %lu etimer events and %lu rtimer polls\n",
+         wakeups, allowed, etimer_events, rtimer_polls);
+  printf("late: etimers %lu ticks, rtimer polls %lu ticks\n",
+         etimer_late, rtimer_late);
+
+  failed = wakeups > allowed ||
+    etimer_events + 1 < seconds * CLOCK_SECOND / etimer_period ||
+    rtimer_polls + 1 < seconds * RTIMER_SECOND / rtimer_period ||
+    etimer_late > TICKLESS_IDLE_LATE || rtimer_late > TICKLESS_IDLE_LATE;
+  printf("tickless idle %s\n", failed ? "FAILED" : "passed");
+  exit(failed ? 1 : 0);
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
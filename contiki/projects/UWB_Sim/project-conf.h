@@ -0,0 +1,11 @@
+#ifndef __PROJECT_UWB_SIM_CONF_H__
+#define __PROJECT_UWB_SIM_CONF_H__
+
+
+#define NETSTACK_CONF_RADIO uwb_driver
+#define NETSTACK_CONF_RDC   uwb_sim_rdc_driver
+
+/* no RS232 output from the driver, it would dominate the run time */
+#define UWB_CONF_DEBUG 0
+
+#endif /* __PROJECT_UWB_SIM_CONF_H__ */
@@ -0,0 +1,299 @@
+/*
+ * Copyright (c) 2012, TU Dortmund University.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following
+ *    disclaimer in the documentation and/or other materials provided
+ *    with the distribution.
+ * 3. The name of the author may not be used to endorse or promote
+ *    products derived from this software without specific prior
+ *    written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS
+ * OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+ * GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * This file is part of the Contiki OS
+ *
+ */
+/*---------------------------------------------------------------------------*/
+/**
+ * \file    Runs the UWB driver against the native simulation of the PHY and
+ *          compares the frame rate and the CPU time spent busy waiting of
+ *          blocking (NETSTACK_RADIO.send) and interrupt-driven
+ *          (uwb_transmit_async) transmissions. Then a peer sends the
+ *          same number of frames with a fixed gap, the upper layers keep
+ *          the CPU busy for a while per frame on average, the receive
+ *          timestamps get checked against the period of the peer.
+ *
+ *          usage: uwb-sim.native [frames [length [dma [gap [busy]]]]]
+ *          SPI DMA latency, gap between the received frames and upper
+ *          layer time per received frame in ns
+ */
+/*---------------------------------------------------------------------------*/
+#include "contiki.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "net/netstack.h"
+#include "net/packetbuf.h"
+#include "net/rime/rimestats.h"
+#include "uwb.h"
+#include "uwb_sim.h"
+
+#define UWB_SIM_FRAMES        10000
+#define UWB_SIM_LENGTH        100
+#define UWB_SIM_CHUNK_NS      100000000ULL
+#define UWB_SIM_GAP_NS        100000
+#define UWB_SIM_BUSY_NS       500000
+
+extern int contiki_argc;
+extern char **contiki_argv;
+
+extern int run_tests(void);
+
+PROCESS(uwb_sim_process, "UWB Simulation");
+AUTOSTART_PROCESSES(&uwb_sim_process);
+
+static uint8_t frame[126];
+static uint32_t frames, sent, errors;
+static unsigned short length;
+static uint32_t rx_busy, delivered, corrupt, reordered;
+static uint16_t rx_next;
+static uint32_t rx_period, ts_intervals, ts_error;
+static uint32_t ts_last;
+
+/*---------------------------------------------------------------------------*/
+static long
+arg(int n, long def)
+{
+  return contiki_argc > n ? strtol(contiki_argv[n], NULL, 0) : def;
+}
+/*---------------------------------------------------------------------------*/
+static void
+print_stats(const char *mode, uint64_t ns)
+{
+  const uwb_sim_stats_t *s = uwb_sim_get_stats();
+
+  printf("%-9s %lu frames, %lu errors, %lu.%lu frames/s, air %lu.%lu %%, cpu busy %lu.%lu %%\n",
+         mode, (unsigned long)sent, (unsigned long)errors,
+         ns ? (unsigned long)(sent * 1000000000ULL / ns) : 0,
+         ns ? (unsigned long)(sent * 10000000000ULL / ns % 10) : 0,
+         ns ? (unsigned long)(s->airtimeNs * 100 / ns) : 0,
+         ns ? (unsigned long)(s->airtimeNs * 1000 / ns % 10) : 0,
+         ns ? (unsigned long)(s->cpuBusyNs * 100 / ns) : 0,
+         ns ? (unsigned long)(s->cpuBusyNs * 1000 / ns % 10) : 0);
+  printf("          %lu sent by the PHY, %lu aborted, %lu DMA transfers (%lu bytes), %lu events\n",
+         (unsigned long)s->framesSent, (unsigned long)s->framesAborted,
+         (unsigned long)s->dmaTransfers, (unsigned long)s->dmaBytes,
+         (unsigned long)s->events);
+}
+/*---------------------------------------------------------------------------*/
+static void
+tx_done(void *ptr, int status)
+{
+  sent++;
+  if(status != RADIO_TX_OK) {
+    errors++;
+  }
+  /* start the next frame right from the completion */
+  while(sent < frames &&
+        uwb_transmit_async(frame, length, tx_done, NULL) != RADIO_TX_OK) {
+    sent++;
+    errors++;
+  }
+}
+/*---------------------------------------------------------------------------*/
+/* RDC layer of the simulation: checks the received frames, then keeps the
+ * CPU busy like the upper layers would - in bursts, every fourth frame
+ * completes a datagram and takes four times the average. The peer sends
+ * periodically, so the timestamps of two frames must differ by the number
+ * of periods in between. */
+static void
+rdc_init(void)
+{
+}
+/*---------------------------------------------------------------------------*/
+static void
+rdc_send(mac_callback_t sent, void *ptr)
+{
+}
+/*---------------------------------------------------------------------------*/
+static void
+rdc_send_list(mac_callback_t sent, void *ptr, struct rdc_buf_list *list)
+{
+}
+/*---------------------------------------------------------------------------*/
+static void
+rdc_input(void)
+{
+  const uint8_t *d = packetbuf_dataptr();
+  uint16_t i, seq = d[0] | (d[1] << 8);
+  uint32_t ts = uwb_rx_timestamp();
+  int64_t err;
+
+  if(delivered > 0 && (int16_t)(seq - rx_next) >= 0) {
+    err = (int64_t)(uint32_t)(ts - ts_last) * 1000000 / (HAL_TIME_SECOND / 1000) -
+      (int64_t)(uint16_t)(seq - rx_next + 1) * rx_period;
+    if(err < 0) {
+      err = -err;
+    }
+    if(err > ts_error) {
+      ts_error = err;
+    }
+    ts_intervals++;
+  }
+  if(packetbuf_attr(PACKETBUF_ATTR_TIMESTAMP) != (uint16_t)ts) {
+    corrupt++;
+  }
+  ts_last = ts;
+  delivered++;
+  if(packetbuf_datalen() != length) {
+    corrupt++;
+  } else {
+    for(i = 2; i < length; i++) {
+      if(d[i] != (uint8_t)(seq + i)) {
+        corrupt++;
+        break;
+      }
+    }
+  }
+  if((int16_t)(seq - rx_next) < 0) {
+    reordered++;
+  }
+  rx_next = seq + 1;
+  uwb_sim_busy((seq & 3) == 3 ? 4 * rx_busy : 0);
+}
+/*---------------------------------------------------------------------------*/
+static int
+rdc_on(void)
+{
+  return NETSTACK_RADIO.on();
+}
+/*---------------------------------------------------------------------------*/
+static int
+rdc_off(int keep_radio_on)
+{
+  return keep_radio_on ? NETSTACK_RADIO.on() : NETSTACK_RADIO.off();
+}
+/*---------------------------------------------------------------------------*/
+static unsigned short
+rdc_channel_check_interval(void)
+{
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+const struct rdc_driver uwb_sim_rdc_driver = {
+  "uwb-sim",
+  rdc_init,
+  rdc_send,
+  rdc_send_list,
+  rdc_input,
+  rdc_on,
+  rdc_off,
+  rdc_channel_check_interval,
+};
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(uwb_sim_process, ev, data)
+{
+  static uwb_sim_conf_t conf;
+  static uint64_t start;
+  static uint32_t gap;
+  uint32_t last;
+  int i;
+
+  PROCESS_BEGIN();
+
+  frames = arg(1, UWB_SIM_FRAMES);
+  length = arg(2, UWB_SIM_LENGTH);
+  conf.dmaLatencyNs = arg(3, 0);
+  conf.irqLatencyNs = 1000;
+  gap = arg(4, UWB_SIM_GAP_NS);
+  rx_busy = arg(5, UWB_SIM_BUSY_NS);
+  uwb_sim_configure(&conf);
+  if(length > sizeof(frame)) {
+    printf("UWB simulation: at most %u bytes per frame\n", (unsigned)sizeof(frame));
+    exit(1);
+  }
+  for(i = 0; i < length; i++) {
+    frame[i] = i;
+  }
+
+  printf("UWB simulation: %lu frames of %u bytes, dma %lu ns\n",
+         (unsigned long)frames, length, (unsigned long)conf.dmaLatencyNs);
+  /* the self test expects no DMA underway */
+  uwb_sim_run(UWB_SIM_CHUNK_NS);
+  printf("self test %s\n", run_tests() == 0 ? "passed" : "FAILED");
+  NETSTACK_RADIO.on();
+  uwb_sim_run(UWB_SIM_CHUNK_NS);
+
+  /* blocking: the CPU waits for the uploads and polls for the tx-int */
+  uwb_sim_clear_stats();
+  start = uwb_sim_now();
+  sent = errors = 0;
+  while(sent < frames) {
+    if(NETSTACK_RADIO.send(frame, length) != RADIO_TX_OK) {
+      errors++;
+    }
+    sent++;
+  }
+  print_stats("blocking", uwb_sim_now() - start);
+  uwb_sim_run(UWB_SIM_CHUNK_NS);
+
+  /* interrupt-driven: uploads chained by the dma-int, completion by the
+   * tx-int */
+  uwb_sim_clear_stats();
+  start = uwb_sim_now();
+  sent = errors = 0;
+  if(frames > 0 && uwb_transmit_async(frame, length, tx_done, NULL) != RADIO_TX_OK) {
+    printf("uwb_transmit_async failed\n");
+    exit(1);
+  }
+  do {
+    last = sent;
+    uwb_sim_run(UWB_SIM_CHUNK_NS);
+  } while(sent < frames && sent != last);
+  print_stats("async", uwb_sim_now() - start);
+
+  /* reception: frames of the peer go through the RX ring */
+  uwb_sim_run(UWB_SIM_CHUNK_NS);
+  uwb_sim_clear_stats();
+  rimestats.llrx = rimestats.overrun = 0;
+  rx_period = UWB_SIM_PREAMBLE_NS + length * UWB_SIM_BYTE_NS + gap;
+  printf("rx        gap %lu ns, upper layers %lu ns per frame (avg), %u descriptors\n",
+         (unsigned long)gap, (unsigned long)rx_busy, UWB_RX_BUFFERS);
+  uwb_sim_inject(frames, length, gap);
+  do {
+    last = uwb_sim_get_stats()->events;
+    uwb_sim_run(UWB_SIM_CHUNK_NS);
+  } while(uwb_sim_get_stats()->events != last);
+  printf("          %lu sent by the peer, %lu received by the PHY, %lu missed, %lu overruns\n",
+         (unsigned long)uwb_sim_get_stats()->rxInjected,
+         (unsigned long)uwb_sim_get_stats()->rxReceived,
+         (unsigned long)uwb_sim_get_stats()->rxMissed, rimestats.overrun);
+  printf("          %lu downloaded, %lu delivered (%lu corrupt, %lu reordered)\n",
+         rimestats.llrx, (unsigned long)delivered,
+         (unsigned long)corrupt, (unsigned long)reordered);
+  printf("          timestamps: max error %lu ns over %lu intervals (%lu ns per tick)\n",
+         (unsigned long)ts_error, (unsigned long)ts_intervals,
+         (unsigned long)(1000000000UL / HAL_TIME_SECOND));
+  exit(0);
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
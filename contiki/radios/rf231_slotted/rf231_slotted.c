@@ -43,13 +43,14 @@
 #include <stdio.h>
 #include <string.h>
 #include "contiki.h"
+#ifndef CONTIKI_TARGET_NATIVE
 #include <stm32f4xx.h> /* STM32F4xx Definitions */
-#include <clock.h>
-#define delay_us( us )   ( clock_delay_usec( us ) )
+#endif /* CONTIKI_TARGET_NATIVE */
 #include "dev/leds.h"
 #include "dev/spi.h"
 #include "rf231_slotted.h"
 #include "net/packetbuf.h"
+#include "net/queuebuf.h"
 #include "net/rime/rimestats.h"
 #include "net/netstack.h"
 #include "sys/timetable.h"
@@ -80,23 +81,64 @@ PROCESS(rf231_slotted_process, "Slotted TDMA Driver");
 static uint8_t txBuffer[BEACON_LENGTH]; /**< Koordinator dummy Paket */
 #else
 static uint8_t txBuffer[RESPONSE_LENGTH]; /**< Client dummy Paket */
+static uint8_t txCompact[RESPONSE_COMPACT_PAYLOAD_OFFSET]; /**< header of a
+						    compact response */
 #endif
+static uint8_t *txHeader = txBuffer;        /**< header of the next upload */
 
-/* Received frames are buffered to rxframe in the interrupt routine in
-   hal.c */
+/* Received frames are read to rxframe[rxframe_tail] by the slotted
+   process. Frames carrying data stay in the ring until rf231_read() passes
+   them to the upper layers, rxframe_head is the next frame to read.
+   rxparsed[] holds the parsed view of each frame, its payload is narrowed
+   to the data of the upper layers. */
 uint8_t rxframe_head,rxframe_tail;
-hal_rx_frame_t rxframe[MAX_CLIENTS];
-
-static ring_buffer_t PeriodBuffer;          /**< A ring buffer to store the last
-					         measured periods */
+hal_rx_frame_t rxframe[RF230_CONF_RX_BUFFERS];
+static parsed_frame_t rxparsed[RF230_CONF_RX_BUFFERS];
+
+/* Frames of the upper layers waiting for the slot of this node */
+static struct queuebuf *txqueue[TDMA_TX_QUEUE];
+static uint8_t txqueue_head, txqueue_count;
+static struct queuebuf *txframe;            /**< queued frame sent with the
+					         next upload */
+static bool txframeUploading;               /**< head of txqueue is being
+					         uploaded */
+
+static tdma_pll_t pll;                      /**< beacon tracking of the
+					         client */
+static tdma_hop_t hop;                      /**< channel hopping */
 uint32_t lastBeaconTime;                    /**< time of the last beacon */
 extern uint32_t slotTime;                   /**< Offsett of the timeslot of this
 					         client */
 static proto_conf_t rf231_slotted_config;   /**< contorl struct for the mac
 			   		         driver */
-static volatile counter; 
+static volatile uint16_t counter;
 uint8_t sqn;                                /**< Sequence Number - only needed if
 				                 the framer isn't used */
+#ifdef SLOTTED_KOORDINATOR
+static uint8_t pendingClients = TDMA_CLIENTS;       /**< max. clients admitted
+						       with the next beacon */
+static uint8_t pendingPayload = PAYLOAD_PER_CLIENT;
+static tdma_slot_t slots[MAX_CLIENTS];              /**< client slots */
+static uint16_t grantAddr = TDMA_NO_ADDR;           /**< pending slot grant */
+static uint8_t grantSlot = TDMA_NO_SLOT;
+static uint8_t grantRepeat;                         /**< beacons left to
+						       repeat the grant */
+#else /* SLOTTED_KOORDINATOR */
+static uint16_t ownAddr;                            /**< short address */
+static bool joining;                                /**< join if no slot */
+static bool leaving;                                /**< release the slot */
+static bool rxReading;                              /**< frame read pending */
+static uint8_t txSqn;                               /**< sqn of the queued
+						       frame in the slot */
+static uint8_t txRetries;                           /**< unacknowledged sends
+						       of the queued frame */
+static bool txframeSent;                            /**< queued frame sent,
+						       awaiting the ACK */
+static uint8_t ackSlot;                             /**< slot of the sent
+						       frame */
+static bool beaconCheck;                            /**< beacon missed unless
+						       the frame read is one */
+#endif /* SLOTTED_KOORDINATOR */
 
 uint8_t  volatile state = RF231_STATE_UNINIT;
 
@@ -125,13 +167,31 @@ typedef enum{
  int rf231_on(void);
  int rf231_off(void);
  void rf231_warm_reset(void);
- void rf231_reset_state_machine(void);
- void rf231_wait_idle(void);
+static void rf231_reset_state_machine(void);
+static void rf231_wait_idle(void);
  bool rf231_is_ready_to_sendy(void);
  uint8_t rf231_get_trx_state(void);
  radio_status_t rf231_set_trx_state(uint8_t new_state);
  void rf231_upload_packet(unsigned short payload_len);
-int create_packet(void);
+static struct queuebuf *txqueue_peek(uint8_t max_length);
+static void txqueue_remove(void);
+static uint8_t rx_frame_data(parsed_frame_t *pf);
+static void hop_tune(uint8_t channel);
+#ifdef SLOTTED_KOORDINATOR
+static uint8_t beacon_update(void);
+static bool slots_response(uint16_t addr, uint8_t flags, uint8_t seq);
+#else
+static uint8_t superframe_update(hal_rx_frame_t *frame);
+static uint8_t response_update(uint8_t beacon_length);
+static void txqueue_acked(bool acked);
+static void response_send(uint8_t frame_length);
+static void beacon_watch(void);
+static void beacon_listen(void);
+static void beacon_missed(void);
+static void pll_update(uint32_t capture, uint32_t cycle);
+static void pll_coast(uint32_t cycle);
+static uint32_t pll_ticks(uint32_t ticks);
+#endif /* SLOTTED_KOORDINATOR */
 
 static int rf231_read(void *buf, unsigned short bufsize);
 static int rf231_prepare(const void *data, unsigned short len);
@@ -259,31 +319,49 @@ rf231_init(void)
 {
   uint8_t i;
   uint8_t tvers, tmanu;
+#ifndef SLOTTED_KOORDINATOR
   uint8_t address_0;
+#endif
   /* Initialise the Config Structure */
-  PeriodBuffer.PutPos = 0;
-  PeriodBuffer.Count = 0;
-  rf231_slotted_config.clientProcessing = 0;
-  rf231_slotted_config.guardInterval = 0;
+  memset(&pll, 0, sizeof(pll));
+  pll.rate = PLL_ONE;
+  memset(&hop, 0, sizeof(hop));
+  for(i = 0; i < TDMA_HOP_LENGTH; i++) {
+    hop.sequence[i] = TDMA_HOP_CHANNEL(TDMA_CELL, i);
+  }
+  /* the first beacon goes out on the first channel */
+  hop.index = TDMA_HOP_LENGTH - 1;
+  rf231_slotted_config.clientProcessing = CLIENT_PROCESSING_TIME_TICKS;
+  rf231_slotted_config.guardInterval = TDMA_GUARD_TIME_NS / 1000;
   rf231_slotted_config.Period = 0;
   rf231_slotted_config.numClients = 0;
-  rf231_slotted_config.clientSlotLength = 0;
+  rf231_slotted_config.payloadPerClient = PAYLOAD_PER_CLIENT;
+  rf231_slotted_config.clientSlotLength = TDMA_SLOT_TICKS;
+  rf231_slotted_config.cycleTime = TDMA_PERIOD_TICKS;
   rf231_slotted_config.beaconCount = 0;
 
-  /* set the correct slot for a client. Use the last byte of the client number
-   * and set a hardcoded offset. */
-#ifndef SLOTTED_KOORDINATOR
-  address_0 = *((uint8_t*)0x1FFF7A10+0);          /* read the last byte of node
-						   * Number */
-  if(address_0 == 0x3c){
-    rf231_slotted_config.slotOffsett = TDMA_BEACON_TICKS + CLIENT_PROCESSING_TIME_TICKS;
-  } else if(address_0 == 0x2a){
-    rf231_slotted_config.slotOffsett = TDMA_BEACON_TICKS + CLIENT_PROCESSING_TIME_TICKS + TDMA_SLOT_TICKS;
-  } else if(address_0 == 0x2b){
-    rf231_slotted_config.slotOffsett = TDMA_BEACON_TICKS + CLIENT_PROCESSING_TIME_TICKS + 2 * TDMA_SLOT_TICKS;
-  } else {
-    rf231_slotted_config.slotOffsett = TDMA_BEACON_TICKS + CLIENT_PROCESSING_TIME_TICKS + 2 * TDMA_SLOT_TICKS;
+  /* a client starts without a slot and joins through the join slot. The
+   * slot offset is calculated from the received beacons */
+#ifdef SLOTTED_KOORDINATOR
+  for(i = 0; i < MAX_CLIENTS; i++) {
+    slots[i].addr = TDMA_NO_ADDR;
+    slots[i].missed = 0;
+    slots[i].seen = false;
   }
+  grantAddr = TDMA_NO_ADDR;
+#else /* SLOTTED_KOORDINATOR */
+  address_0 = hal_get_uid_byte(0);                /* read the last byte of node
+						   * Number */
+  ownAddr = ((uint16_t)hal_get_uid_byte(2) << 8) | address_0;
+  rf231_slotted_config.slotNumber = TDMA_NO_SLOT;
+  rf231_slotted_config.slotOffsett = 0;
+  joining = true;
+  leaving = false;
+  rxReading = false;
+  beaconCheck = false;
+  txSqn = 0;
+  txRetries = 0;
+  txframeSent = false;
 #endif /* SLOTTED_KOORDINATOR */
 
   state = RF231_STATE_INACTIVE;
@@ -300,47 +378,27 @@ rf231_init(void)
   /* hardopded dummy packet. Its better to use the framer! see packet_create
      function below */
 #ifdef SLOTTED_KOORDINATOR
-  txBuffer[0]=0xa0;            /* fcf*/
-  txBuffer[1]=0x06;
+  txBuffer[0]=BEACON_FCF_0;    /* fcf*/
+  txBuffer[1]=BEACON_FCF_1;
   txBuffer[2]=0x00;            /* sqn */
   txBuffer[3]=TDMA_PAN_ID_1;   /* src PAN ID */
   txBuffer[4]=TDMA_PAN_ID_0;
-  txBuffer[5]=(*((uint8_t*)0x1FFF7A10+2));       /* src address */
-  txBuffer[6]=(*((uint8_t*)0x1FFF7A10+0));
-  txBuffer[7]=0x03;                              /* cycle time */
-  txBuffer[8]=0xe8;
-  txBuffer[9]=0x03;                              /* clients */
-  txBuffer[10]=0x11;          /* Payload start */
-  txBuffer[11]=0x11;
-  txBuffer[12]=0x11;
-  txBuffer[13]=0x11;
-  txBuffer[14]=0x22;         /* PL 2*/
-  txBuffer[15]=0x22;
-  txBuffer[16]=0x22;
-  txBuffer[17]=0x22;
-  txBuffer[18]=0x33;        /* pl 3 */
-  txBuffer[19]=0x33;
-  txBuffer[20]=0x33;
-  txBuffer[21]=0x33;
-  txBuffer[22]=0x00;        /* FCS */
-  txBuffer[23]=0x00;
+  txBuffer[5]=hal_get_uid_byte(2);               /* src address */
+  txBuffer[6]=hal_get_uid_byte(0);
+  /* txBuffer[7] - end: superframe, slot bitmap and payload, see
+     beacon_update() */
 #else
-  txBuffer[0]=0xa2;            /* fcf*/
-  txBuffer[1]=0x26;
+  txBuffer[0]=RESPONSE_FCF_0;  /* fcf*/
+  txBuffer[1]=RESPONSE_FCF_1;
   txBuffer[2]=0x00;            /* sqn */
   txBuffer[3]=TDMA_PAN_ID_1;   /* dst PAN ID */
   txBuffer[4]=TDMA_PAN_ID_0;
-  txBuffer[5]=0x2e;            /* dst address of koord */
-  txBuffer[6]=0x1b;
-  txBuffer[7]=(*((uint8_t*)0x1FFF7A10+2));       /* dst address */
-  txBuffer[8]=(*((uint8_t*)0x1FFF7A10+0));
-  txBuffer[9]=0x04;                              /* payload length */
-  txBuffer[10]=0x00;          /* Payload start */
-  txBuffer[11]=0x22;
-  txBuffer[12]=0x33;
-  txBuffer[13]=0x44;
-  txBuffer[14]=0x00;         /* PL 2*/
-  txBuffer[15]=0x00;
+  txBuffer[5]=0xff;            /* dst address of koord, taken from the */
+  txBuffer[6]=0xff;            /* beacons */
+  txBuffer[7]=hal_get_uid_byte(2);               /* dst address */
+  txBuffer[8]=hal_get_uid_byte(0);
+  txBuffer[9]=0;               /* payload length, the payload is taken */
+			       /* from the transmit queue */
 #endif
 
   /* Wait in case VCC just applied */
@@ -351,6 +409,10 @@ rf231_init(void)
   /* Set receive txBuffers empty and point to the first */
   for (i=0;i<RF230_CONF_RX_BUFFERS;i++) rxframe[i].length=0;
   rxframe_head=0;rxframe_tail=0;
+  txqueue_head = 0;
+  txqueue_count = 0;
+  txframe = NULL;
+  txframeUploading = false;
   
   /* Do full rf230 Reset */
   hal_set_rst_low();
@@ -385,15 +447,17 @@ rf231_init(void)
   
   rf231_warm_reset();
 
+  process_set_prio(&rf231_slotted_process, PROCESS_PRIO_HIGH);
   process_start(&rf231_slotted_process, NULL);
 
   on();
+  hop_tune(hop.sequence[0]);
   
   /* bring the radio to send or receive state and upload a packet and reset the
      timer module */
 #ifdef SLOTTED_KOORDINATOR
   rf231_set_trx_state(PLL_ON);
-  rf231_upload_packet(24);
+  rf231_upload_packet(beacon_update());
 #else
   rf231_set_trx_state(RX_AACK_ON);
 #endif
@@ -401,7 +465,7 @@ rf231_init(void)
   hal_register_write(RG_IRQ_MASK, RF230_SUPPORTED_INTERRUPT_MASK);
 
 #ifdef SLOTTED_KOORDINATOR
-  hal_set_TX_Timer(TDMA_PERIOD_TICKS);
+  hal_set_TX_Timer(rf231_slotted_config.cycleTime);
 #endif
   hal_reset_counter();
 
@@ -423,7 +487,6 @@ rf231_warm_reset(void) {
 
   /* Configure the interrupts */
   hal_register_write(RG_IRQ_MASK, RF230_SUPPORTED_INTERRUPT_MASK);
-  uint8_t status = hal_register_read(RG_IRQ_MASK);
 
   /* Set up number of automatic retries 0-15 (0 implies PLL_ON sends
    * instead of the extended TX_ARET mode */
@@ -434,15 +497,15 @@ rf231_warm_reset(void) {
   hal_subregister_write(SR_MAX_CSMA_RETRIES, 0 );
 
   /* set the short address and panID */
-  hal_subregister_write(SR_SHORT_ADDR_0, (*((uint8_t*)0x1FFF7A10+0)));  
-  hal_subregister_write(SR_SHORT_ADDR_1, (*((uint8_t*)0x1FFF7A10+2)));  
+  hal_subregister_write(SR_SHORT_ADDR_0, hal_get_uid_byte(0));
+  hal_subregister_write(SR_SHORT_ADDR_1, hal_get_uid_byte(2));
   hal_subregister_write(SR_PAN_ID_0, TDMA_PAN_ID_0);
   hal_subregister_write(SR_PAN_ID_1, TDMA_PAN_ID_1); 
 
   /* set IEEE address */
-  hal_subregister_write(SR_IEEE_ADDR_0, (*((uint8_t*)0x1FFF7A10+0)));
-  hal_subregister_write(SR_IEEE_ADDR_1, (*((uint8_t*)0x1FFF7A10+2)));
-  hal_subregister_write(SR_IEEE_ADDR_2, (*((uint8_t*)0x1FFF7A10+4)));
+  hal_subregister_write(SR_IEEE_ADDR_0, hal_get_uid_byte(0));
+  hal_subregister_write(SR_IEEE_ADDR_1, hal_get_uid_byte(2));
+  hal_subregister_write(SR_IEEE_ADDR_2, hal_get_uid_byte(4));
   hal_subregister_write(SR_IEEE_ADDR_3, 0xfe);
   hal_subregister_write(SR_IEEE_ADDR_4, 0xff);
   hal_subregister_write(SR_IEEE_ADDR_5, 0x00);
@@ -720,160 +783,791 @@ rf231_is_ready_to_sendy() {
 	return true;
 }
 
+
+
 /*---------------------------------------------------------------------------*/
-static void
-flushrx(void)
+/**
+ * \brief  rf231_upload_packet - download the next frame to the transceiver
+ * \param  payload_len  length of the frame including the FCS
+ *
+ * The frame is txHeader, followed by txframe if a queued frame was chosen
+ * for this cycle. The queued frame is written from the queuebuf directly.
+ * The koordinator releases it when the upload is complete
+ * (FRAME_UPLOADED_EVENT), a client when it is acknowledged.
+ */
+void
+rf231_upload_packet(unsigned short payload_len)
 {
-  rxframe[rxframe_head].length=0;
+  uint8_t data_len;
+
+  if(txframe == NULL) {
+    hal_frame_write_async(txHeader, payload_len - 2, NULL, 0);
+    return;
+  }
+  data_len = queuebuf_datalen(txframe);
+  txframeUploading = true;
+  hal_frame_write_async(txHeader, payload_len - data_len - 2,
+			queuebuf_dataptr(txframe), data_len);
+  RIMESTATS_ADD(lltx);
+  txframe = NULL;
 }
 
+/*---------------------------------------------------------------------------*/
+/**
+ * \brief  txqueue_peek - the next queued frame that fits into a slot
+ * \param  max_length  payload available in the slot
+ * \return struct queuebuf * - the frame or NULL if the queue is empty
+ *
+ * Frames longer than the slot, e.g. after the koordinator reduced the
+ * payload per client, are dropped.
+ */
+static struct queuebuf *
+txqueue_peek(uint8_t max_length)
+{
+  struct queuebuf *q;
+
+  while(txqueue_count > 0) {
+    q = txqueue[txqueue_head];
+    if(queuebuf_datalen(q) <= max_length) {
+      return q;
+    }
+    PRINTF("rf231: %u byte frame does not fit into the slot\n", queuebuf_datalen(q));
+    txqueue_remove();
+  }
+  return NULL;
+}
 
-static int create_packet(void)
+/*---------------------------------------------------------------------------*/
+static void
+txqueue_remove(void)
 {
-  /* create structure to store result. */
-  frame_create_params_t params;
-  frame_result_t result;
+  if(txqueue_count > 0) {
+    queuebuf_free(txqueue[txqueue_head]);
+    txqueue_head = (txqueue_head + 1) % TDMA_TX_QUEUE;
+    --txqueue_count;
+  }
+#ifndef SLOTTED_KOORDINATOR
+  /* the next frame is new data */
+  txRetries = 0;
+  ++txSqn;
+#endif /* SLOTTED_KOORDINATOR */
+}
 
-  /* Build the FCF. */
+/*---------------------------------------------------------------------------*/
+/**
+ * \brief  rx_frame_data - narrow a parsed frame to the data of the upper layers
+ * \param  pf  received beacon (client) or response (koordinator), the
+ *             payload is set to the data of the upper layers
+ * \return uint8_t - length of the data, 0 if the frame carries none
+ */
+static uint8_t
+rx_frame_data(parsed_frame_t *pf)
+{
 #ifdef SLOTTED_KOORDINATOR
-  params.fcf.frameType = BEACON_FRAME_TYPE;
-  params.fcf.panIdCompression = false;
-  params.fcf.destAddrMode = 0;
-  params.dest_pid = 0;
-  params.payload_len = BEACON_PAYLOAD_LENGTH;
-#else
-  params.fcf.frameType = RESPONSE_FRAME_TYPE;
-  params.fcf.panIdCompression = true;
-  params.fcf.destAddrMode = SHORTADDRMODE;
-  params.dest_pid = TDMA_PAN_ID;
-  params.dest_addr.addr16 = 0x2e1b;      /* adress of the
-					 coordinator. better to read
-					 from the received beacons */
-  params.payload_len = MAX_RESPONSE_PAYLOAD;
-#endif
+  response_t response;
 
-/* parameter that are the same for client and coord */
-  params.fcf.securityEnabled = false;
-  params.fcf.framePending = false;
-  params.fcf.ackRequired = false;
-  params.fcf.frameVersion = TDMA_FRAME_VERSION;
-  /* Increment and set the data sequence number. */
-  params.seq = sqn++;
-  /* Complete the addressing fields. */
-  params.fcf.srcAddrMode = SHORTADDRMODE;
-  params.src_pid = TDMA_PAN_ID;
-  //  params.src_addr.addr16 = ;
-
-  /* Copy the payload data. */
-params.payload =  txBuffer;
+  if(!frame_response_parse(pf, &response)) {
+    return 0;
+  }
+  pf->payload = response.payload;
+  pf->payload_length = response.payload_length;
+#else /* SLOTTED_KOORDINATOR */
+  uint8_t *header = pf->payload - BEACON_CYCLE_TIME_OFFSET;
+  uint8_t offset;
+
+  if(pf->fcf.frameType != BEACON_FRAME_TYPE
+     || pf->payload_length < BEACON_HEADER_LENGTH - BEACON_CYCLE_TIME_OFFSET - 2) {
+    return 0;
+  }
+  /* downlink data follows the client payload */
+  offset = TDMA_BEACON_LENGTH(header[BEACON_CLIENTS_OFFSET],
+			      header[BEACON_PAYLOAD_PER_CLIENT_OFFSET])
+    - BEACON_CYCLE_TIME_OFFSET - 2;
+  if(pf->payload_length <= offset) {
+    return 0;
+  }
+  pf->payload += offset;
+  pf->payload_length -= offset;
+#endif /* SLOTTED_KOORDINATOR */
+  return pf->payload_length;
+}
 
+/*---------------------------------------------------------------------------*/
+/**
+ * \brief  rf231_slotted_set_superframe - change the TDMA superframe
+ * \param  clients             max. number of clients admitted
+ * \param  payload_per_client  response payload of a client in bytes
+ * \return int - 1 if the superframe was accepted, 0 otherwise
+ *
+ * The koordinator advertises the new superframe with the next beacon and
+ * switches to the new period at the same time. Clients in slots above the
+ * new limit lose their slot. Clients follow the beacons, on a client this
+ * function has no effect.
+ */
+int
+rf231_slotted_set_superframe(uint8_t clients, uint8_t payload_per_client)
+{
 #ifdef SLOTTED_KOORDINATOR
-params.bhdr.cycleTime = 1000;
-params.bhdr.maxClients = MAX_CLIENTS;
-#endif
+  if(clients > MAX_CLIENTS || payload_per_client > PAYLOAD_PER_CLIENT) {
+    return 0;
+  }
+  pendingClients = clients;
+  pendingPayload = payload_per_client;
+  return 1;
+#else /* SLOTTED_KOORDINATOR */
+  return 0;
+#endif /* SLOTTED_KOORDINATOR */
+}
 
-/* HACK:
- * FCF field ist not set correctly. set it hardcoded.
+/*---------------------------------------------------------------------------*/
+/**
+ * \brief  rf231_slotted_set_hopping - change the channel hop sequence
+ * \param  sequence  TDMA_HOP_LENGTH channels between TDMA_CHANNEL_MIN and
+ *                   TDMA_CHANNEL_MAX
+ * \return int - 1 if the sequence was accepted, 0 otherwise
  *
- * TODO: correct FCF settings
+ * The koordinator hops on the new sequence from the next beacon on. Give
+ * co-located koordinators disjoint sequences. A client listens on the
+ * first channel of the sequence while it has no beacon, afterwards it
+ * follows the sequence of the beacons.
  */
+int
+rf231_slotted_set_hopping(const uint8_t *sequence)
+{
+  uint8_t i;
+
+  for(i = 0; i < TDMA_HOP_LENGTH; i++) {
+    if(sequence[i] < TDMA_CHANNEL_MIN || sequence[i] > TDMA_CHANNEL_MAX) {
+      return 0;
+    }
+  }
+  memcpy(hop.sequence, sequence, TDMA_HOP_LENGTH);
+#ifndef SLOTTED_KOORDINATOR
+  if(pll.captures == 0) {
+    hop_tune(hop.sequence[0]);
+  }
+#endif /* SLOTTED_KOORDINATOR */
+  return 1;
+}
+
+/*---------------------------------------------------------------------------*/
+/**
+ * \brief  rf231_slotted_get_hopping - state of the channel hopping
+ * \return const tdma_hop_t* - the hop sequence and the current channel
+ */
+const tdma_hop_t *
+rf231_slotted_get_hopping(void)
+{
+  return &hop;
+}
+
+/*---------------------------------------------------------------------------*/
+/**
+ * \brief  hop_tune - tune the radio to a channel
+ * \param  channel  channel of the next superframe
+ *
+ * The PLL settles within 11 us, well inside the processing time before a
+ * beacon is sent or expected.
+ */
+static void
+hop_tune(uint8_t channel)
+{
+  if(channel == hop.channel) {
+    return;
+  }
+  hal_subregister_write(SR_CHANNEL, channel);
+  hop.channel = channel;
+  ++hop.hops;
+}
+
+/*---------------------------------------------------------------------------*/
+/**
+ * \brief  rf231_slotted_join - request a slot through the join slot
+ *
+ * Clients join after initialisation. No effect on the koordinator.
+ */
+void
+rf231_slotted_join(void)
+{
+#ifndef SLOTTED_KOORDINATOR
+  joining = true;
+  leaving = false;
+#endif /* SLOTTED_KOORDINATOR */
+}
+
+/*---------------------------------------------------------------------------*/
+/**
+ * \brief  rf231_slotted_leave - release the slot of this client
+ *
+ * The koordinator is told with the next response, the slot is given to
+ * another client afterwards. No effect on the koordinator.
+ */
+void
+rf231_slotted_leave(void)
+{
+#ifndef SLOTTED_KOORDINATOR
+  joining = false;
+  leaving = rf231_slotted_config.slotNumber != TDMA_NO_SLOT;
+#endif /* SLOTTED_KOORDINATOR */
+}
+
 #ifdef SLOTTED_KOORDINATOR
- params.fcf.word_val = 0xa006;
-#else
- params.fcf.word_val = 0xa226;
-#endif
+/*---------------------------------------------------------------------------*/
+/**
+ * \brief  slots_grant - announce a slot in the next beacons
+ * \param  addr  client address
+ * \param  slot  the granted slot, TDMA_NO_SLOT to revoke
+ */
+static void
+slots_grant(uint16_t addr, uint8_t slot)
+{
+  grantAddr = addr;
+  grantSlot = slot;
+  grantRepeat = (slot == TDMA_NO_SLOT) ? 1 : TDMA_MAX_MISSED;
+}
 
- result.frame = buffer;
+/*---------------------------------------------------------------------------*/
+/**
+ * \brief  slots_response - account a response received by the koordinator
+ * \param  addr   source address of the response
+ * \param  flags  the length field of the response
+ * \param  seq    sequence number of the response
+ * \return bool - true if the response carries new data for the upper layers
+ *
+ * A client repeats its data until the ACK bitmap confirms it, data with the
+ * sqn of the last data received in the slot is a repetition.
+ */
+static bool
+slots_response(uint16_t addr, uint8_t flags, uint8_t seq)
+{
+  uint8_t i, slot = TDMA_NO_SLOT, free = TDMA_NO_SLOT;
 
-  /* Create transmission frame. */
-  frame_tx_create(&params, &result);
+  if(addr == TDMA_NO_ADDR) {
+    return false;
+  }
 
-  hal_frame_write(result.frame, result.length);
+  for(i = 0; i < MAX_CLIENTS; i++) {
+    if(slots[i].addr == addr) {
+      slot = i;
+    } else if(slots[i].addr == TDMA_NO_ADDR && free == TDMA_NO_SLOT && i < pendingClients) {
+      free = i;
+    }
+  }
 
+  if(flags & RESPONSE_JOIN) {
+    /* one grant at a time, other clients retry in the next join slots */
+    if(grantAddr != TDMA_NO_ADDR && grantAddr != addr) {
+      return false;
+    }
+    /* a client that lost its grant gets the same slot again */
+    if(slot == TDMA_NO_SLOT && free != TDMA_NO_SLOT) {
+      slot = free;
+      slots[slot].addr = addr;
+      slots[slot].missed = 0;
+      slots[slot].seen = false;
+      slots[slot].sqn = seq - 1;
+    }
+    if(slot != TDMA_NO_SLOT) {
+      slots_grant(addr, slot);
+    }
+  } else if(slot == TDMA_NO_SLOT) {
+    /* response from a client without a slot, make sure it stops */
+    if(grantAddr == TDMA_NO_ADDR && !(flags & RESPONSE_LEAVE)) {
+      slots_grant(addr, TDMA_NO_SLOT);
+    }
+  } else if(flags & RESPONSE_LEAVE) {
+    slots[slot].addr = TDMA_NO_ADDR;
+  } else {
+    slots[slot].seen = true;
+    if(grantAddr == addr) {
+      /* the client uses its new slot */
+      grantAddr = TDMA_NO_ADDR;
+    }
+    if((flags & RESPONSE_LENGTH_MASK) == 0 || seq == slots[slot].sqn) {
+      return false;
+    }
+    slots[slot].sqn = seq;
+    return true;
+  }
+  return false;
 }
 
 /*---------------------------------------------------------------------------*/
-static void 
-ringbuffer_add(ring_buffer_t *buffer, uint32_t value)
+/**
+ * \brief  slots_update - reclaim and compact the client slots
+ * \return uint8_t - number of slots of the next superframe
+ *
+ * Slots of clients that missed TDMA_MAX_MISSED responses are released. A
+ * gap is closed by moving the client of the last slot into it, so the
+ * superframe only spans the clients actually joined.
+ */
+static uint8_t
+slots_update(void)
 {
-  buffer->Buff[buffer->PutPos] = value;
-  buffer->PutPos = ((buffer->PutPos + 1) & PERIOD_BUFFER_MASK);
-  ++(buffer->PutPos);
-  ++(buffer->Count);
-  if(buffer->Count > PERIOD_BUFFER_LENGTH) {
-    buffer->Count=PERIOD_BUFFER_LENGTH;
+  uint8_t i, clients = 0, free = TDMA_NO_SLOT;
+
+  for(i = 0; i < MAX_CLIENTS; i++) {
+    if(slots[i].addr == TDMA_NO_ADDR) {
+      continue;
+    }
+    if(slots[i].seen) {
+      slots[i].missed = 0;
+    } else if(++slots[i].missed >= TDMA_MAX_MISSED || i >= pendingClients) {
+      if(grantAddr == slots[i].addr) {
+	grantAddr = TDMA_NO_ADDR;
+      }
+      slots[i].addr = TDMA_NO_ADDR;
+      continue;
+    }
+    slots[i].seen = false;
   }
+
+  for(i = 0; i < MAX_CLIENTS; i++) {
+    if(slots[i].addr != TDMA_NO_ADDR) {
+      clients = i + 1;
+    } else if(free == TDMA_NO_SLOT) {
+      free = i;
+    }
+  }
+
+  /* move one client per beacon, the last slot is freed when it answers */
+  if(free < clients && grantAddr == TDMA_NO_ADDR) {
+    slots[free] = slots[clients - 1];
+    slots[free].missed = 0;
+    slots[clients - 1].addr = TDMA_NO_ADDR;
+    slots_grant(slots[free].addr, free);
+    while(clients > 0 && slots[clients - 1].addr == TDMA_NO_ADDR) {
+      clients--;
+    }
+  }
+  return clients;
 }
 
-void
-rf231_upload_packet(unsigned short payload_len)
+/*---------------------------------------------------------------------------*/
+/**
+ * \brief  beacon_update - write the superframe into the next beacon
+ * \return uint8_t - length of the beacon
+ *
+ * Called right before the beacon is uploaded. The period of the output
+ * compare timer is changed together with the advertised cycle time. The
+ * next queued frame is sent as downlink data if it fits into the beacon,
+ * the cycle grows by its air time. The ACK bitmap confirms the responses
+ * of the last cycle, it is taken before slots_update() moves a client.
+ */
+static uint8_t
+beacon_update(void)
 {
-    hal_frame_write(txBuffer, payload_len);
+  uint8_t i, clients, payload, data_len = 0;
+  uint8_t acks[TDMA_BITMAP_LENGTH(MAX_CLIENTS)];
+  uint16_t cycle_us, slot_us;
+  uint32_t cycle_ns;
+
+  memset(acks, 0, sizeof(acks));
+  for(i = 0; i < MAX_CLIENTS; i++) {
+    if(slots[i].addr != TDMA_NO_ADDR && slots[i].seen) {
+      acks[i / 8] |= 1 << (i % 8);
+    }
+  }
+  clients = slots_update();
+  payload = TDMA_BEACON_PAYLOAD_OFFSET(clients);
+
+  txframe = txqueue_peek(127 - TDMA_BEACON_LENGTH(clients, pendingPayload));
+  if(txframe != NULL) {
+    data_len = queuebuf_datalen(txframe);
+  }
+  cycle_ns = TDMA_CYCLE_NS(clients, pendingPayload) + (uint32_t)data_len * PHY_TIME_PER_BYTE_NS;
+
+  rf231_slotted_config.numClients = clients;
+  rf231_slotted_config.payloadPerClient = pendingPayload;
+  rf231_slotted_config.clientSlotLength = TDMA_SLOT_NS(pendingPayload) / TIM_RESOLUTION_NS;
+  rf231_slotted_config.cycleTime = cycle_ns / TIM_RESOLUTION_NS;
+
+  cycle_us = cycle_ns / 1000;
+  slot_us = TDMA_SLOT_NS(pendingPayload) / 1000;
+  txBuffer[BEACON_CYCLE_TIME_OFFSET] = cycle_us & 0xff;
+  txBuffer[BEACON_CYCLE_TIME_OFFSET + 1] = cycle_us >> 8;
+  txBuffer[BEACON_CLIENTS_OFFSET] = clients;
+  txBuffer[BEACON_SLOT_TIME_OFFSET] = slot_us & 0xff;
+  txBuffer[BEACON_SLOT_TIME_OFFSET + 1] = slot_us >> 8;
+  txBuffer[BEACON_PAYLOAD_PER_CLIENT_OFFSET] = pendingPayload;
+
+  /* the superframe of this beacon runs on the next channel */
+  hop.index = (hop.index + 1) % TDMA_HOP_LENGTH;
+  hop_tune(hop.sequence[hop.index]);
+  txBuffer[BEACON_HOP_INDEX_OFFSET] = hop.index;
+  memcpy(&txBuffer[BEACON_HOP_SEQUENCE_OFFSET], hop.sequence, TDMA_HOP_LENGTH);
+
+  /* slot grant */
+  if(grantAddr != TDMA_NO_ADDR && grantRepeat > 0) {
+    --grantRepeat;
+    txBuffer[BEACON_GRANT_ADDR_OFFSET] = grantAddr >> 8;
+    txBuffer[BEACON_GRANT_ADDR_OFFSET + 1] = grantAddr & 0xff;
+    txBuffer[BEACON_GRANT_SLOT_OFFSET] = grantSlot;
+  } else {
+    grantAddr = TDMA_NO_ADDR;
+    txBuffer[BEACON_GRANT_ADDR_OFFSET] = TDMA_NO_ADDR >> 8;
+    txBuffer[BEACON_GRANT_ADDR_OFFSET + 1] = TDMA_NO_ADDR & 0xff;
+    txBuffer[BEACON_GRANT_SLOT_OFFSET] = TDMA_NO_SLOT;
+  }
+
+  /* slot bitmap and payload, 0x11 for client 1, 0x22 for client 2 ... */
+  memset(&txBuffer[BEACON_BITMAP_OFFSET], 0, TDMA_BITMAP_LENGTH(clients));
+  for(i = 0; i < clients; i++) {
+    if(slots[i].addr != TDMA_NO_ADDR) {
+      txBuffer[BEACON_BITMAP_OFFSET + i / 8] |= 1 << (i % 8);
+    }
+    memset(&txBuffer[payload + i * pendingPayload], (i + 1) * 0x11, pendingPayload);
+  }
+  memcpy(&txBuffer[BEACON_ACK_BITMAP_OFFSET(clients)], acks, TDMA_BITMAP_LENGTH(clients));
+
+  hal_set_period(rf231_slotted_config.cycleTime);
+
+  return TDMA_BEACON_LENGTH(clients, pendingPayload) + data_len;
+}
+#else /* SLOTTED_KOORDINATOR */
+/*---------------------------------------------------------------------------*/
+/**
+ * \brief  superframe_update - take the superframe from a received beacon
+ * \param  frame  the received beacon
+ * \return uint8_t - length of the frame to send in this cycle, 0 if none
+ *
+ * Applies the slot grant and the slot bitmap of the beacon. A client
+ * without a slot sends a join request in the join slot with a probability
+ * of 1/2, a client with a slot the next queued frame that fits. The slot offset is relative to the input capture, which is taken
+ * at RX_START after the synchronisation header of the beacon.
+ */
+static uint8_t
+superframe_update(hal_rx_frame_t *frame)
+{
+  uint32_t cycle_us, slot_us;
+  uint16_t grant_addr;
+  uint8_t grant_slot, slot, clients;
+
+  txframe = NULL;
+  if(frame->length < BEACON_HEADER_LENGTH) {
+    return 0;
+  }
+  cycle_us = frame->data[BEACON_CYCLE_TIME_OFFSET]
+    | ((uint16_t)frame->data[BEACON_CYCLE_TIME_OFFSET + 1] << 8);
+  slot_us = frame->data[BEACON_SLOT_TIME_OFFSET]
+    | ((uint16_t)frame->data[BEACON_SLOT_TIME_OFFSET + 1] << 8);
+  clients = frame->data[BEACON_CLIENTS_OFFSET];
+  if(frame->length < TDMA_BEACON_PAYLOAD_OFFSET(clients) + 2
+     || frame->data[BEACON_HOP_INDEX_OFFSET] >= TDMA_HOP_LENGTH) {
+    return 0;
+  }
+  for(slot = 0; slot < TDMA_HOP_LENGTH; slot++) {
+    if(frame->data[BEACON_HOP_SEQUENCE_OFFSET + slot] < TDMA_CHANNEL_MIN
+       || frame->data[BEACON_HOP_SEQUENCE_OFFSET + slot] > TDMA_CHANNEL_MAX) {
+      return 0;
+    }
+  }
+
+  rf231_slotted_config.numClients = clients;
+  rf231_slotted_config.payloadPerClient = frame->data[BEACON_PAYLOAD_PER_CLIENT_OFFSET];
+  if(rf231_slotted_config.payloadPerClient > MAX_RESPONSE_PAYLOAD) {
+    rf231_slotted_config.payloadPerClient = MAX_RESPONSE_PAYLOAD;
+  }
+  rf231_slotted_config.cycleTime = cycle_us * 1000 / TIM_RESOLUTION_NS;
+  rf231_slotted_config.clientSlotLength = slot_us * 1000 / TIM_RESOLUTION_NS;
+  pll_update(lastBeaconTime, rf231_slotted_config.cycleTime);
+  beacon_watch();
+
+  /* follow the hop sequence of the koordinator */
+  hop.index = frame->data[BEACON_HOP_INDEX_OFFSET];
+  memcpy(hop.sequence, &frame->data[BEACON_HOP_SEQUENCE_OFFSET], TDMA_HOP_LENGTH);
+  beacon_listen();
+
+  /* the beacon acknowledges the responses of the last cycle */
+  if(txframeSent) {
+    txframeSent = false;
+    txqueue_acked(ackSlot < clients
+		  && (frame->data[BEACON_ACK_BITMAP_OFFSET(clients) + ackSlot / 8] & (1 << (ackSlot % 8))));
+  }
+
+  /* the response goes to the koordinator that sent the beacon */
+  txBuffer[5] = frame->data[5];
+  txBuffer[6] = frame->data[6];
+
+  /* slot grant: ours, or our slot given to another client */
+  slot = rf231_slotted_config.slotNumber;
+  grant_addr = ((uint16_t)frame->data[BEACON_GRANT_ADDR_OFFSET] << 8)
+    | frame->data[BEACON_GRANT_ADDR_OFFSET + 1];
+  grant_slot = frame->data[BEACON_GRANT_SLOT_OFFSET];
+  if(grant_addr == ownAddr) {
+    slot = leaving ? TDMA_NO_SLOT : grant_slot;
+  } else if(grant_addr != TDMA_NO_ADDR && grant_slot == slot) {
+    slot = TDMA_NO_SLOT;
+  }
+  if(slot != TDMA_NO_SLOT && (slot >= clients
+     || !(frame->data[BEACON_BITMAP_OFFSET + slot / 8] & (1 << (slot % 8))))) {
+    slot = TDMA_NO_SLOT;
+  }
+  rf231_slotted_config.slotNumber = slot;
+
+  if(slot == TDMA_NO_SLOT) {
+    if(!joining || (random_rand() & 1)) {
+      return 0;
+    }
+    /* join request in the join slot after the client slots */
+    rf231_slotted_config.slotOffsett = (frame->length * PHY_TIME_PER_BYTE_NS / TIM_RESOLUTION_NS)
+      + CLIENT_PROCESSING_TIME_TICKS + clients * rf231_slotted_config.clientSlotLength;
+    txBuffer[2] = txSqn;
+    txBuffer[RESPONSE_PAYLOAD_LENGTH_OFFSET] = RESPONSE_JOIN;
+    txHeader = txBuffer;
+    return TDMA_JOIN_LENGTH;
+  }
+
+  return response_update(frame->length);
 }
 
 /*---------------------------------------------------------------------------*/
-static uint32_t
-ringbuffer_get_last(ring_buffer_t *buffer)
+/**
+ * \brief  response_update - prepare the response in the slot of this client
+ * \param  beacon_length  length of the beacon the slot follows
+ * \return uint8_t - length of the response
+ */
+static uint8_t
+response_update(uint8_t beacon_length)
 {
-  return buffer->Buff[buffer->PutPos];
+  uint8_t flags, data_len = 0;
+
+  rf231_slotted_config.slotOffsett = (beacon_length * PHY_TIME_PER_BYTE_NS / TIM_RESOLUTION_NS)
+    + CLIENT_PROCESSING_TIME_TICKS
+    + rf231_slotted_config.slotNumber * rf231_slotted_config.clientSlotLength;
+  txframe = leaving ? NULL : txqueue_peek(rf231_slotted_config.payloadPerClient);
+  if(txframe != NULL) {
+    data_len = queuebuf_datalen(txframe);
+    ackSlot = rf231_slotted_config.slotNumber;
+  }
+  flags = data_len;
+  if(leaving) {
+    /* tell the koordinator and give up the slot */
+    flags |= RESPONSE_LEAVE;
+  }
+#if TDMA_COMPACT_RESPONSE
+  frame_compact_response_create(txCompact, txSqn, rf231_slotted_config.slotNumber, flags);
+  txHeader = txCompact;
+#else
+  txBuffer[2] = txSqn;
+  txBuffer[RESPONSE_PAYLOAD_LENGTH_OFFSET] = flags;
+  txHeader = txBuffer;
+#endif /* TDMA_COMPACT_RESPONSE */
+  if(leaving) {
+    rf231_slotted_config.slotNumber = TDMA_NO_SLOT;
+    leaving = false;
+  }
+  return TDMA_RESPONSE_LENGTH(data_len);
 }
 
 /*---------------------------------------------------------------------------*/
-static uint32_t
-ringbuffer_clear(ring_buffer_t *buffer)
+/**
+ * \brief  txqueue_acked - account the ACK of the frame sent in the last cycle
+ * \param  acked  true if the ACK bitmap of the beacon confirms the frame
+ *
+ * The frame is released when it is acknowledged or was sent
+ * TDMA_MAX_RETRIES times without an ACK. Otherwise it goes out again with
+ * the same sqn, the koordinator drops the copy if the ACK got lost.
+ */
+static void
+txqueue_acked(bool acked)
+{
+  if(!acked && txRetries < TDMA_MAX_RETRIES) {
+    ++txRetries;
+    RIMESTATS_ADD(rexmit);
+    return;
+  }
+  if(!acked) {
+    RIMESTATS_ADD(noacktx);
+  }
+  txqueue_remove();
+}
+
+/*---------------------------------------------------------------------------*/
+/**
+ * \brief  response_send - send the prepared response in this cycle
+ * \param  frame_length  length of the response
+ *
+ * The slot offset is relative to the capture of the last beacon, real or
+ * expected. The radio returns to receive mode when the TX_MODE timer set
+ * by beacon_listen() expires.
+ */
+static void
+response_send(uint8_t frame_length)
+{
+  /* set the next send time */
+  hal_set_oc(pll.lastCapture + pll_ticks(rf231_slotted_config.slotOffsett) - HARDWARE_DELAY_TICKS);
+  /* change the radio to send mode and upload the package */
+  state = RF231_STATE_SEND;
+  rf231_set_trx_state(PLL_ON);
+  rf231_upload_packet(frame_length);
+}
+
+/*---------------------------------------------------------------------------*/
+/**
+ * \brief  beacon_listen - receive the next beacon on its channel
+ *
+ * The TX_MODE timer expires before the synchronisation header of the next
+ * beacon, earlier the more beacons were missed. The radio then hops to
+ * the channel of the next superframe and returns to receive mode. The
+ * beacon missed timer fires when the next beacon is not over at the end
+ * of the window.
+ */
+static void
+beacon_listen(void)
 {
-  buffer->Count = 0;
-  buffer->PutPos = 0;
+  uint32_t window = TDMA_RX_WINDOW_TICKS(pll.coasted);
+
+  hal_set_TX_Mode_Timer(pll.nextBeacon - (PHY_SYNCH_HEADER_NS / TIM_RESOLUTION_NS) - window);
 }
 
+/*---------------------------------------------------------------------------*/
+/**
+ * \brief  beacon_watch - arm the beacon missed timer for the next beacon
+ *
+ * A beacon without downlink data is over at the end of the window.
+ */
+static void
+beacon_watch(void)
+{
+  uint8_t length = TDMA_BEACON_LENGTH(rf231_slotted_config.numClients,
+				      rf231_slotted_config.payloadPerClient);
 
+  hal_set_Beacon_Missed_Timer(pll.nextBeacon + TDMA_RX_WINDOW_TICKS(pll.coasted)
+			      + length * PHY_TIME_PER_BYTE_NS / TIM_RESOLUTION_NS);
+}
 
 /*---------------------------------------------------------------------------*/
+/**
+ * \brief  beacon_missed - the expected beacon did not arrive
+ *
+ * Up to TDMA_COAST_PERIODS beacons are replaced by their expected capture.
+ * The cycle and the slot are assumed without downlink data, a client with
+ * a slot keeps sending in it. Afterwards the client stays in receive mode
+ * until it gets a beacon again.
+ */
+static void
+beacon_missed(void)
+{
+  uint8_t frame_length;
+
+  if(pll.captures == 0) {
+    return;
+  }
+  if(pll.coasted >= TDMA_COAST_PERIODS) {
+    ++pll.syncLosses;
+    pll.captures = 0;
+    pll.coasted = 0;
+    return;
+  }
+  pll_coast(TDMA_CYCLE_NS(rf231_slotted_config.numClients,
+			  rf231_slotted_config.payloadPerClient) / TIM_RESOLUTION_NS);
+  beacon_watch();
+  beacon_listen();
+  txframe = NULL;
+  if(rf231_slotted_config.slotNumber == TDMA_NO_SLOT || state != RF231_STATE_IDLE) {
+    return;
+  }
+  frame_length = response_update(TDMA_BEACON_LENGTH(rf231_slotted_config.numClients,
+						    rf231_slotted_config.payloadPerClient));
+  response_send(frame_length);
+}
+#endif /* SLOTTED_KOORDINATOR */
+
+
+
+/*---------------------------------------------------------------------------*/
+/**
+ * \brief  rf231_prepare - queue a frame for the next slot of this node
+ * \param  payload      the frame, usually the packetbuf
+ * \param  payload_len  length of the frame without FCS
+ * \return int - 0 if the frame was queued, 1 otherwise
+ *
+ * The frame is stored in a queuebuf and sent by the slotted process, a
+ * client in its response, the koordinator as downlink data of a beacon.
+ */
 static int
 rf231_prepare(const void *payload, unsigned short payload_len)
 {
-  /* leave as empty function.  
-   *
-   * preparations are made by the slotted process.  
-   *
-   * TODO Implement a meachanism to store the packets taht shall be
-   * transmitted in the packet queue. At the Moment we are sending
-   * empty packages only for testing */
+  struct queuebuf *q;
 
-  return 1;
+#ifdef SLOTTED_KOORDINATOR
+  if(payload_len > MAX_DOWNLINK_PAYLOAD) {
+#else
+  if(payload_len > MAX_RESPONSE_PAYLOAD) {
+#endif /* SLOTTED_KOORDINATOR */
+    PRINTF("rf231: %u byte frame too long for a slot\n", payload_len);
+    return 1;
+  }
+  if(txqueue_count >= TDMA_TX_QUEUE) {
+    return 1;
+  }
+  /* the MAC layers send from the packetbuf, other buffers are copied to
+     it first */
+  if(payload != packetbuf_hdrptr() || payload_len != packetbuf_totlen()) {
+    packetbuf_copyfrom(payload, payload_len);
+  }
+  q = queuebuf_new_from_packetbuf();
+  if(q == NULL) {
+    return 1;
+  }
+  txqueue[(txqueue_head + txqueue_count) % TDMA_TX_QUEUE] = q;
+  ++txqueue_count;
+
+  return 0;
 }
 
 /*---------------------------------------------------------------------------*/
 static int 
 rf231_transmit(unsigned short payload_len)
 {
-
-  /* leave as empty function. transmission is timed by the slotted process */
-
-
-  return 1; 
+  /* transmission is timed by the slotted process, the prepared frame
+     goes out in the next slot of this node */
+  return RADIO_TX_OK;
 }
 
 /*---------------------------------------------------------------------------*/
 static int
 rf231_send(const void *payload, unsigned short payload_len)
 {
-  /* leave as empty function.  
-   *
-   * sending is made by the slotted process.
-   *
-   * TODO Implement a meachanism to store the packets taht shall be
-   * transmitted in the packet queue. At the Moment we are sending
-   * empty packages only for testing */
-
-  return 1;
+  if(rf231_prepare(payload, payload_len)) {
+    return RADIO_TX_ERR;
+  }
+  return rf231_transmit(payload_len);
 }
 
 /*---------------------------------------------------------------------------*/
+/**
+ * \brief  rf231_read - pass the next received data to the upper layers
+ * \param  buf      destination, usually the packetbuf
+ * \param  bufsize  size of buf
+ * \return int - length of the data, 0 if nothing was received
+ */
 static int
 rf231_read(void *buf, unsigned short bufsize)
 {
-  return 1;
+  parsed_frame_t *pf;
+  uint8_t len;
+
+  if(rxframe_head == rxframe_tail) {
+    return 0;
+  }
+  /* the frame was parsed when it was read, copy its data only */
+  pf = &rxparsed[rxframe_head];
+  len = pf->payload_length;
+  if(len > bufsize) {
+    RIMESTATS_ADD(toolong);
+    len = 0;
+  } else if(len > 0) {
+    memcpy(buf, pf->payload, len);
+    packetbuf_set_attr(PACKETBUF_ATTR_LINK_QUALITY, pf->lqi);
+    RIMESTATS_ADD(llrx);
+  }
+  pf->in_use = false;
+  rxframe[rxframe_head].length = 0;
+  rxframe_head = (rxframe_head + 1) % RF230_CONF_RX_BUFFERS;
+
+  return len;
 }
 
 /*---------------------------------------------------------------------------*/
@@ -894,7 +1588,7 @@ rf231_receiving_packet(void)
 static int
 rf231_pending_packet(void)
 {
-  return 0;
+  return rxframe_head != rxframe_tail;
 }
 
 /*---------------------------------------------------------------------------*/
@@ -931,33 +1625,114 @@ rf231_on(void)
 void 
 rf231_slotted_IC_irqh(uint32_t capture)
 {
-  /* write IC value into the IC buffer and generate a IC event to process the new value*/
-  /* store the new value into our ringbuffer */
-  ringbuffer_add(&PeriodBuffer, capture);
+  /* the capture of a beacon is taken over by the process, see pll_update() */
   lastBeaconTime = capture;
 }
 
+#ifndef SLOTTED_KOORDINATOR
 /*----------------------------------------------------------------------------*/
 /**
- * \brief  calculate_period - estimate the length of the last pariod
- * \return void 
- * 
- * This function estimates the period length of the beacon frame arrivals
+ * \brief  pll_ticks - convert koordinator ticks to local ticks
+ * \param  ticks  a time span advertised by the koordinator
+ * \return uint32_t - the time span measured by the local timer
  */
- static void 
-calculate_period()
+static uint32_t
+pll_ticks(uint32_t ticks)
 {
-  int i;
-  uint32_t AvgPeriod;
+  int64_t error = (int64_t)ticks * ((int32_t)pll.rate - (int32_t)PLL_ONE);
+
+  return ticks + (int32_t)((error + (1 << (PLL_RATE_BASE - 1))) >> PLL_RATE_BASE);
+}
 
-  if (state == RF231_STATE_ACTIVE_PLL) {
-    /* substract last stored value with the first sotred and divide by number of periods */
-    rf231_slotted_config.Period = (PeriodBuffer.Buff[(PeriodBuffer.PutPos) - 1] 
-				   - PeriodBuffer.Buff[PeriodBuffer.PutPos])  >> NUM_PERIODS_BASE;
+/*----------------------------------------------------------------------------*/
+/**
+ * \brief  pll_update - track the beacons of the koordinator
+ * \param  capture  RX_START capture of the received beacon
+ * \param  cycle    cycle advertised in the beacon, koordinator ticks
+ *
+ * The phase follows the capture of every beacon, so the slots stay
+ * relative to the beacon the koordinator actually sent. The difference
+ * between the capture and the expected capture is the phase error of the
+ * last cycle. It corrects the rate of the local timer, which scales the
+ * slot offset and the next cycle. The first two beacons (and a beacon far
+ * off the expected time) restart the loop with a measured rate. After
+ * coasting (see pll_coast()) the error spans several cycles, the phase is
+ * taken over but the rate is kept.
+ */
+static void
+pll_update(uint32_t capture, uint32_t cycle)
+{
+  int32_t error, limit;
+  uint32_t measured;
+
+  measured = capture - pll.lastCapture;
+  error = (int32_t)(capture - pll.nextBeacon);
+  limit = (pll.coasted + 1) * (PLL_MAX_PHASE_ERROR_NS / TIM_RESOLUTION_NS);
+  if(pll.captures >= 2 && error <= limit && error >= -limit) {
+    if(pll.coasted == 0) {
+      /* locked: the rate follows the phase error */
+      pll.rate += (int32_t)(((int64_t)error << PLL_RATE_BASE) / (int32_t)pll.cycle) >> PLL_FREQ_SHIFT;
+      pll.phaseError = error;
+      if((uint32_t)(error < 0 ? -error : error) > pll.phaseErrorMax) {
+	pll.phaseErrorMax = error < 0 ? -error : error;
+      }
+      ++pll.samples;
+    }
   } else {
-    /* calculate using FIR filtering */
-    rf231_slotted_config.Period = (0.95 * rf231_slotted_config.Period) 
-      + (0.05 * (PeriodBuffer.Buff[(PeriodBuffer.PutPos) - 1]  - PeriodBuffer.Buff[PeriodBuffer.PutPos]));
+    if(pll.captures >= 2) {
+      ++pll.unlocks;
+    }
+    if(pll.captures >= 1 && pll.coasted == 0 && pll.cycle > 0
+       && measured > pll.cycle - pll.cycle / 8 && measured < pll.cycle + pll.cycle / 8) {
+      /* no beacon missed since the last one: take the rate from one cycle */
+      pll.rate = (uint32_t)(((uint64_t)measured << PLL_RATE_BASE) / pll.cycle);
+      pll.captures = 2;
+    } else {
+      pll.captures = 1;
+    }
+  }
+  if(pll.rate > PLL_ONE + PLL_MAX_RATE_ERROR) {
+    pll.rate = PLL_ONE + PLL_MAX_RATE_ERROR;
+  } else if(pll.rate < PLL_ONE - PLL_MAX_RATE_ERROR) {
+    pll.rate = PLL_ONE - PLL_MAX_RATE_ERROR;
+  }
+  if(pll.captures == 2 && pll.coasted == 0) {
+    rf231_slotted_config.Period = measured;
+  }
+  pll.coasted = 0;
+  pll.cycle = cycle;
+  pll.lastCapture = capture;
+  pll.nextBeacon = capture + pll_ticks(cycle);
+}
+
+/*----------------------------------------------------------------------------*/
+/**
+ * \brief  pll_coast - continue without the expected beacon
+ * \param  cycle  assumed cycle of the missed beacon, koordinator ticks
+ *
+ * The expected capture takes the place of the missed one, the rate stays.
+ */
+static void
+pll_coast(uint32_t cycle)
+{
+  ++pll.coasted;
+  ++pll.beaconsCoasted;
+  pll.cycle = cycle;
+  pll.lastCapture = pll.nextBeacon;
+  pll.nextBeacon = pll.lastCapture + pll_ticks(cycle);
+}
+#endif /* SLOTTED_KOORDINATOR */
+
+/*---------------------------------------------------------------------------*/
+/**
+ * \brief  rf231_slotted_get_pll - state of the beacon tracking
+ * \return const tdma_pll_t* - the loop state, all zero but the rate on
+ *         the koordinator
+ */
+const tdma_pll_t *
+rf231_slotted_get_pll(void)
+{
+  return &pll;
 }
 
 /*---------------------------------------------------------------------------*/
@@ -981,9 +1756,23 @@ calculate_period()
  * TX_MODE_TIMER_EVENT
  * BEACON_RECEIVED_EVENT
  * FRAME_SEND_EVENT
+ * FRAME_READ_EVENT - frame transfer from the radio complete
+ * FRAME_UPLOADED_EVENT - frame transfer to the radio complete
+ * PROCESS_EVENT_POLL - received data is waiting in the receive ring
  */
   PROCESS_THREAD(rf231_slotted_process, ev, data)
 {
+  static uint8_t frame_length;
+  hal_rx_frame_t *frame;
+  parsed_frame_t *pf;
+  int len;
+  bool beacon, deliver;
+#ifndef SLOTTED_KOORDINATOR
+  uint8_t trx_state;
+#else
+  response_t response;
+#endif /* SLOTTED_KOORDINATOR */
+
   PROCESS_BEGIN();
 
   while(1) {
@@ -992,18 +1781,60 @@ calculate_period()
       // hal_set_oc(lastBeaconTime + rf231_slotted_config.slotOffsett + 1000);
     }
     if(ev == HANDLE_PACKET_EVENT){
-      hal_frame_read(rxframe);
-      if(rxframe[0].data[0] == 0xa0) {
-	/* set the next send time */
-        hal_set_oc(lastBeaconTime + rf231_slotted_config.slotOffsett - HARDWARE_DELAY_TICKS);
+      /* read into the free entry of the receive ring, the frame is handled
+	 when the transfer is complete */
+      hal_frame_read_async(&rxframe[rxframe_tail]);
+#ifndef SLOTTED_KOORDINATOR
+      rxReading = true;
+#endif /* SLOTTED_KOORDINATOR */
+    }
+#ifndef SLOTTED_KOORDINATOR
+    if(ev == BEACON_MISSED_EVENT) {
+      trx_state = rf231_get_trx_state();
+      if(rxReading || trx_state == BUSY_RX || trx_state == BUSY_RX_AACK) {
+	/* a frame is on air or being read, it may be the beacon. Check
+	   again when the longest frame is over */
+	beaconCheck = true;
+	hal_update_Beacon_Missed_Timer((127 - BEACON_HEADER_LENGTH) * PHY_TIME_PER_BYTE_NS / TIM_RESOLUTION_NS);
+      } else {
+	beaconCheck = false;
+	beacon_missed();
+      }
+    }
+#endif /* SLOTTED_KOORDINATOR */
+    if(ev == FRAME_UPLOADED_EVENT && txframeUploading) {
+      /* the queued frame is in the frame buffer now, a client keeps it
+	 until the next beacon acknowledges it */
+      txframeUploading = false;
+#ifdef SLOTTED_KOORDINATOR
+      txqueue_remove();
+#else
+      txframeSent = true;
+#endif /* SLOTTED_KOORDINATOR */
+    }
+    if(ev == FRAME_READ_EVENT){
+      /* parse in place, the view stays with the frame in the ring */
+      frame = (hal_rx_frame_t *)data;
+      pf = &rxparsed[frame - rxframe];
+      beacon = false;
+      if(rx_frame_parse(frame, pf)) {
+	beacon = pf->fcf.frameType == BEACON_FRAME_TYPE;
+      } else {
+	frame->length = 0;
+      }
+#ifndef SLOTTED_KOORDINATOR
+      rxReading = false;
+      deliver = beacon;
+      if(beacon) {
+	frame_length = superframe_update(frame);
 	/* set the ioboard leds ti the received frame value */
-	ioboard_leds_set(rxframe[0].data[10]);
-	/* change the radio to send mode and upload the package */
-	state = RF231_STATE_SEND;
-	rf231_set_trx_state(PLL_ON);
-	rf231_upload_packet(16);
-	/* set the TX_MODE Timer to sqitch back to receive mode after the timer is expired */
-	hal_set_TX_Mode_Timer(lastBeaconTime + TDMA_PERIOD_TICKS - (2 * KOORD_PROCESSING_TIME_TICKS));
+	if(rf231_slotted_config.numClients > 0
+	   && frame->length > TDMA_BEACON_PAYLOAD_OFFSET(rf231_slotted_config.numClients) + 2) {
+	  ioboard_leds_set(frame->data[TDMA_BEACON_PAYLOAD_OFFSET(rf231_slotted_config.numClients)]);
+	}
+      }
+      if(beacon && frame_length > 0) {
+	response_send(frame_length);
 	/* toggle the green LED to indicate correct state of the Protocoll */
 	if (counter == 500) {
 	  leds_on(LEDS_GREEN);
@@ -1015,15 +1846,56 @@ calculate_period()
 	  ++counter;
 	}
       }
+      if(beaconCheck) {
+	beaconCheck = false;
+	if(!beacon) {
+	  beacon_missed();
+	}
+      }
+#else /* SLOTTED_KOORDINATOR */
+      /* response or join request of a client, a compact response is
+	 from the owner of its slot. Beacons of other koordinators are
+	 ignored */
+      deliver = false;
+      if(!beacon && frame->length > 0 && frame_response_parse(pf, &response)) {
+	if(response.addr == TDMA_NO_ADDR && response.slot < MAX_CLIENTS) {
+	  response.addr = slots[response.slot].addr;
+	}
+	deliver = slots_response(response.addr, response.flags, response.seq);
+      }
+#endif /* SLOTTED_KOORDINATOR */
+      /* keep frames with data for rf231_read() */
+      if(deliver && rx_frame_data(pf) > 0) {
+	if((rxframe_tail + 1) % RF230_CONF_RX_BUFFERS == rxframe_head) {
+	  RIMESTATS_ADD(contentiondrop);
+	} else {
+	  rxframe_tail = (rxframe_tail + 1) % RF230_CONF_RX_BUFFERS;
+	  process_poll(&rf231_slotted_process);
+	}
+      }
+    }
+    if(ev == PROCESS_EVENT_POLL) {
+      /* pass the received data to the upper layers */
+      while(rf231_pending_packet()) {
+	packetbuf_clear();
+	len = rf231_read(packetbuf_dataptr(), PACKETBUF_SIZE);
+	if(len > 0) {
+	  packetbuf_set_datalen(len);
+	  NETSTACK_RDC.input();
+	}
+      }
     }
     if(ev==TX_MODE_TIMER_EVENT){
 #ifdef SLOTTED_KOORDINATOR
       /* TX Mode Timer expired and device is a koordinator. Bring radio to send mode and upload the next
 	 beacon including the button states */
       state = RF231_STATE_SEND;
-      txBuffer[10] = ioboard_buttons_get();
+      frame_length = beacon_update();
+      if(rf231_slotted_config.numClients > 0) {
+	txBuffer[TDMA_BEACON_PAYLOAD_OFFSET(rf231_slotted_config.numClients)] = ioboard_buttons_get();
+      }
       rf231_set_trx_state(PLL_ON);
-      rf231_upload_packet(24);
+      rf231_upload_packet(frame_length);
       /* toggle the green LED to indicate correct state of the Protocoll */
       if (counter == 500) {
 	leds_on(LEDS_GREEN);
@@ -1037,8 +1909,12 @@ calculate_period()
 	++counter;
       }
 #else /* SLOTTED_KOORDINATOR */
-      /* as client set bring the radio into receive mode */
+      /* as client hop to the channel of the next beacon and bring the
+	 radio into receive mode */
       state = RF231_STATE_IDLE;
+      if(pll.captures > 0) {
+	hop_tune(hop.sequence[(hop.index + pll.coasted + 1) % TDMA_HOP_LENGTH]);
+      }
       rf231_set_trx_state(RX_AACK_ON);
 #endif /* SLOTTED_KOORDINATOR */
     }
@@ -1047,7 +1923,8 @@ calculate_period()
       /* set radio to receive mode and set the time for the next send mode switch */
       state = RF231_STATE_IDLE;
       rf231_set_trx_state(RX_AACK_ON);
-      hal_set_TX_Mode_Timer(hal_get_oc() - KOORD_PROCESSING_TIME_TICKS);
+      /* the beacon goes on air HARDWARE_DELAY after the compare match */
+      hal_set_TX_Mode_Timer(hal_get_oc() + HARDWARE_DELAY_TICKS - KOORD_PROCESSING_TIME_TICKS);
 #endif
     }
     if ((ev==sensors_event) && (data == &button_sensor)){
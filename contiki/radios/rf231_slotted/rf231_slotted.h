@@ -58,15 +58,20 @@ extern const struct radio_driver rf231_slotted_driver;
 #define RF230_SUPPORTED_INTERRUPT_MASK          ( MASK_TRX_END | MASK_RX_START )
 
 
-#define NUM_PERIODS           8               /**< The number of Periods used to
-						   calculate the average. Use 
-						   only powers of 2 */
-#define NUM_PERIODS_BASE      3               /**< log2(NUM_PERIOD) used for fast 
-						   division */
-#define PERIOD_BUFFER_LENGTH  8               /**< length of the period buffer 
-						   power of 2 */
-#define PERIOD_BUFFER_MASK    NUM_PERIODS-1   /**< Mask for fast Buffer boundary 
-						   wrapping */
+/* Beacon tracking of the client. The rate of the local timer against the
+ * koordinator is kept as a Q24 fraction (PLL_ONE = same rate), every
+ * received beacon corrects the phase completely and the rate by
+ * 1/2^PLL_FREQ_SHIFT of the measured phase error. */
+#define PLL_RATE_BASE         24              /**< fraction bits of the rate */
+#define PLL_ONE               (1UL << PLL_RATE_BASE)
+#ifdef RF231_SLOTTED_CONF_PLL_FREQ_SHIFT
+#define PLL_FREQ_SHIFT        RF231_SLOTTED_CONF_PLL_FREQ_SHIFT
+#else
+#define PLL_FREQ_SHIFT        4               /**< loop gain of the rate */
+#endif /* RF231_SLOTTED_CONF_PLL_FREQ_SHIFT */
+#define PLL_MAX_RATE_ERROR    (PLL_ONE / 2000) /**< 500 ppm, crystal limit */
+#define PLL_MAX_PHASE_ERROR_NS 10000          /**< larger errors restart the
+						   loop (missed beacon) */
 
 /*============================ STATEMACHINE STATES ===========================*/
 #define RF231_STATE_UNINIT           0 /** Uninitialised Statemachine */
@@ -87,25 +92,190 @@ extern const struct radio_driver rf231_slotted_driver;
 #define TX_MODE_TIMER_EVENT           23
 #define BEACON_RECEIVED_EVENT         24
 #define FRAME_SEND_EVENT              25
+#define FRAME_READ_EVENT              26      /**< frame read from the radio,
+						 data is the hal_rx_frame_t */
+#define FRAME_UPLOADED_EVENT          27      /**< frame written to the radio */
 
 /*============================ TDMA PARAMETER ================================*/
-/* change those parameters to modifiy the TDMA Protokoll flow */
-#define MAX_CLIENTS                   3
-#define PAYLOAD_PER_CLIENT            4
-#define MAX_RESPONSE_PAYLOAD          4
+/* The superframe (number of client slots and payload per client) is
+ * advertised by the koordinator in every beacon. Clients join through a
+ * contention slot at the end of the superframe and are granted the next
+ * free slot, slots of clients missing TDMA_MAX_MISSED responses are
+ * reclaimed. The values below are upper bounds used to size the frame
+ * buffers. */
+#ifdef RF231_SLOTTED_CONF_MAX_CLIENTS
+#define MAX_CLIENTS                   RF231_SLOTTED_CONF_MAX_CLIENTS
+#else
+#define MAX_CLIENTS                   16
+#endif /* RF231_SLOTTED_CONF_MAX_CLIENTS */
 
-#define BEACON_HEADER_LENGTH          12
+#ifdef RF231_SLOTTED_CONF_CLIENTS
+#define TDMA_CLIENTS                  RF231_SLOTTED_CONF_CLIENTS
+#else
+#define TDMA_CLIENTS                  MAX_CLIENTS /**< clients admitted by default */
+#endif /* RF231_SLOTTED_CONF_CLIENTS */
+
+#ifdef RF231_SLOTTED_CONF_MAX_MISSED
+#define TDMA_MAX_MISSED               RF231_SLOTTED_CONF_MAX_MISSED
+#else
+#define TDMA_MAX_MISSED               8       /**< missed responses until a slot
+						 is reclaimed */
+#endif /* RF231_SLOTTED_CONF_MAX_MISSED */
+
+/* A client that misses a beacon keeps sending in its slot, timed from the
+ * tracked rate, for up to TDMA_COAST_PERIODS cycles. The receive window
+ * around the expected beacon grows by TDMA_COAST_WINDOW_NS per missed
+ * beacon. Keep TDMA_COAST_PERIODS below TDMA_MAX_MISSED, the koordinator
+ * reclaims the slot otherwise. */
+#ifdef RF231_SLOTTED_CONF_COAST_PERIODS
+#define TDMA_COAST_PERIODS            RF231_SLOTTED_CONF_COAST_PERIODS
+#else
+#define TDMA_COAST_PERIODS            4       /**< cycles sent without beacon */
+#endif /* RF231_SLOTTED_CONF_COAST_PERIODS */
+
+#ifdef RF231_SLOTTED_CONF_COAST_WINDOW_NS
+#define TDMA_COAST_WINDOW_NS          RF231_SLOTTED_CONF_COAST_WINDOW_NS
+#else
+#define TDMA_COAST_WINDOW_NS          10000
+#endif /* RF231_SLOTTED_CONF_COAST_WINDOW_NS */
+#define TDMA_RX_WINDOW_TICKS(missed)  (((missed) + 1) * (TDMA_COAST_WINDOW_NS / TIM_RESOLUTION_NS))
+
+#ifdef RF231_SLOTTED_CONF_PAYLOAD_PER_CLIENT
+#define PAYLOAD_PER_CLIENT            RF231_SLOTTED_CONF_PAYLOAD_PER_CLIENT
+#else
+#define PAYLOAD_PER_CLIENT            4       /**< max. payload per client */
+#endif /* RF231_SLOTTED_CONF_PAYLOAD_PER_CLIENT */
+#define MAX_RESPONSE_PAYLOAD          PAYLOAD_PER_CLIENT
+
+/* Channel hopping: every superframe runs on the next channel of a hop
+ * sequence of TDMA_HOP_LENGTH channels, the beacon carries the sequence
+ * and the position of the superframe in it. The default sequences divide
+ * the 16 channels into TDMA_CELLS disjoint sets, koordinators of
+ * different cells (TDMA_CELL) hop on different channels and do not
+ * interfere. A client listens on the first channel of its cell until it
+ * receives a beacon. TDMA_HOP_LENGTH 1 keeps a cell on one channel. */
+#ifdef RF231_SLOTTED_CONF_HOP_LENGTH
+#define TDMA_HOP_LENGTH               RF231_SLOTTED_CONF_HOP_LENGTH
+#else
+#define TDMA_HOP_LENGTH               1       /**< channels per hop sequence */
+#endif /* RF231_SLOTTED_CONF_HOP_LENGTH */
+
+#ifdef RF231_SLOTTED_CONF_CELL
+#define TDMA_CELL                     RF231_SLOTTED_CONF_CELL
+#else
+#define TDMA_CELL                     0       /**< default hop sequence */
+#endif /* RF231_SLOTTED_CONF_CELL */
+
+#define TDMA_CHANNEL_MIN              11
+#define TDMA_CHANNEL_MAX              26
+#define TDMA_CELLS                    ((TDMA_CHANNEL_MAX - TDMA_CHANNEL_MIN + 1) / TDMA_HOP_LENGTH)
+/* hop i of the default sequence of a cell, the channels of a sequence are
+ * spread over the band */
+#define TDMA_HOP_CHANNEL(cell, i)     (TDMA_CHANNEL_MIN + ((cell) % TDMA_CELLS) + (i) * TDMA_CELLS)
+
+/* Frames of the upper layers wait in the transmit queue for the slot of
+ * the node: a client sends one frame as payload of its response, the
+ * koordinator one frame as downlink data behind the client payload of the
+ * beacon. */
+#ifdef RF231_SLOTTED_CONF_TX_QUEUE
+#define TDMA_TX_QUEUE                 RF231_SLOTTED_CONF_TX_QUEUE
+#else
+#define TDMA_TX_QUEUE                 4       /**< queued frames */
+#endif /* RF231_SLOTTED_CONF_TX_QUEUE */
+
+/* Clients answer with compact responses, the koordinator understands both
+ * formats. A data frame stays queued until the ACK bitmap of the next
+ * beacon confirms it, it is sent again up to TDMA_MAX_RETRIES times. */
+#ifdef RF231_SLOTTED_CONF_COMPACT_RESPONSE
+#define TDMA_COMPACT_RESPONSE         RF231_SLOTTED_CONF_COMPACT_RESPONSE
+#else
+#define TDMA_COMPACT_RESPONSE         1
+#endif /* RF231_SLOTTED_CONF_COMPACT_RESPONSE */
+
+#ifdef RF231_SLOTTED_CONF_MAX_RETRIES
+#define TDMA_MAX_RETRIES              RF231_SLOTTED_CONF_MAX_RETRIES
+#else
+#define TDMA_MAX_RETRIES              3
+#endif /* RF231_SLOTTED_CONF_MAX_RETRIES */
+
+#ifndef RF230_CONF_RX_BUFFERS
+#define RF230_CONF_RX_BUFFERS         3
+#endif /* RF230_CONF_RX_BUFFERS */
+
+/* Beacon: fcf(2) sqn(1) pan(2) src(2) cycle time(2) clients(1) slot time(2)
+ * payload per client(1) grant address(2) grant slot(1) hop index(1) hop
+ * sequence(TDMA_HOP_LENGTH) slot bitmap ACK bitmap payload [downlink data]
+ * fcs(2). Times are in us, little endian. The superframe of the beacon
+ * runs on channel hop sequence[hop index].
+ * The bitmaps have one bit per client slot. A slot bit is set if the slot
+ * is assigned, an ACK bit if the response in the slot was received in the
+ * last cycle. */
+#define BEACON_HEADER_LENGTH          (BEACON_BITMAP_OFFSET + 2)
+#define BEACON_CYCLE_TIME_OFFSET      7
+#define BEACON_CLIENTS_OFFSET         9
+#define BEACON_SLOT_TIME_OFFSET       10
+#define BEACON_PAYLOAD_PER_CLIENT_OFFSET 12
+#define BEACON_GRANT_ADDR_OFFSET      13
+#define BEACON_GRANT_SLOT_OFFSET      15
+#define BEACON_HOP_INDEX_OFFSET       16
+#define BEACON_HOP_SEQUENCE_OFFSET    17
+#define BEACON_BITMAP_OFFSET          (BEACON_HOP_SEQUENCE_OFFSET + TDMA_HOP_LENGTH)
+#define TDMA_BITMAP_LENGTH(clients)   (((clients) + 7) / 8)
+#define BEACON_ACK_BITMAP_OFFSET(clients)     (BEACON_BITMAP_OFFSET + TDMA_BITMAP_LENGTH(clients))
+#define TDMA_BEACON_PAYLOAD_OFFSET(clients)   (BEACON_BITMAP_OFFSET + 2 * TDMA_BITMAP_LENGTH(clients))
+/* Response: fcf(2) sqn(1) pan(2) dst(2) src(2) length(1) payload fcs(2)
+ * Compact response: fcf(2) sqn(1) slot(1) length(1) payload fcs(2), the
+ * owner of the slot is the source. Join requests are never compact. The
+ * sqn only changes with new data, the koordinator drops repeated data. */
 #define RESPONSE_HEADER_LENGTH        12
+#define RESPONSE_PAYLOAD_LENGTH_OFFSET 9
+#define RESPONSE_PAYLOAD_OFFSET       10
+#define RESPONSE_COMPACT_HEADER_LENGTH 7
+#define RESPONSE_COMPACT_SLOT_OFFSET  3
+#define RESPONSE_COMPACT_LENGTH_OFFSET 4
+#define RESPONSE_COMPACT_PAYLOAD_OFFSET 5
+/* FCF bytes, see fcf_t in slotted_frame.h. Beacons are BEACON_FRAME_TYPE
+ * with a short source address, responses RESPONSE_FRAME_TYPE with short
+ * addresses and PAN ID compression, compact responses without addresses */
+#define BEACON_FCF_0                  0xa0
+#define BEACON_FCF_1                  0x06
+#define RESPONSE_FCF_0                0xc2
+#define RESPONSE_FCF_1                0x26
+#define RESPONSE_COMPACT_FCF_0        0xc0
+#define RESPONSE_COMPACT_FCF_1        0x04
+#define RESPONSE_JOIN                 0x80    /**< length flag: join request */
+#define RESPONSE_LEAVE                0x40    /**< length flag: slot released */
+#define RESPONSE_LENGTH_MASK          0x3f
+
+#define TDMA_NO_SLOT                  0xff
+#define TDMA_NO_ADDR                  0xffff
+
+#define TDMA_BEACON_LENGTH(clients, payload)  (BEACON_HEADER_LENGTH + 2 * TDMA_BITMAP_LENGTH(clients) \
+                                               + (clients) * (payload))
+#if TDMA_COMPACT_RESPONSE
+#define TDMA_RESPONSE_LENGTH(payload)         (RESPONSE_COMPACT_HEADER_LENGTH + (payload))
+#else
+#define TDMA_RESPONSE_LENGTH(payload)         (RESPONSE_HEADER_LENGTH + (payload))
+#endif /* TDMA_COMPACT_RESPONSE */
+#define TDMA_JOIN_LENGTH                      RESPONSE_HEADER_LENGTH
 
 #define BEACON_PAYLOAD_LENGTH          (MAX_CLIENTS * PAYLOAD_PER_CLIENT)
 #define RESPONSE_PAYLOAD_LENGTH        (MAX_RESPONSE_PAYLOAD)
 
-#define BEACON_LENGTH                 (BEACON_HEADER_LENGTH + BEACON_PAYLOAD_LENGTH)
+#define BEACON_LENGTH                 TDMA_BEACON_LENGTH(MAX_CLIENTS, PAYLOAD_PER_CLIENT)
 #define RESPONSE_LENGTH               (RESPONSE_HEADER_LENGTH + RESPONSE_PAYLOAD_LENGTH)
 
-            
+#define MAX_DOWNLINK_PAYLOAD          (127 - BEACON_LENGTH)
+
+#if BEACON_LENGTH > 127
+#error RF231 SLOTTED TDMA - MAX_CLIENTS * PAYLOAD_PER_CLIENT does not fit into a beacon
+#endif
+#if MAX_RESPONSE_PAYLOAD > RESPONSE_LENGTH_MASK
+#error RF231 SLOTTED TDMA - PAYLOAD_PER_CLIENT does not fit into the response length field
+#endif
+
 #ifdef SLOTTED_KOORDINATOR
-#define RF231_MAX_TX_FRAME_LENGTH     (BEACON_HEADER_LENGTH + (MAX_CLIENTS * PAYLOAD_PER_CLIENT) + 2)
+#define RF231_MAX_TX_FRAME_LENGTH     (BEACON_LENGTH + 2)
 #else 
 #define RF231_MAX_TX_FRAME_LENGTH     (RESPONSE_HEADER_LENGTH + MAX_RESPONSE_PAYLOAD + 2)
 #endif /* SLOTTED_KOORDINATOR */
@@ -172,13 +342,19 @@ typedef enum{
  *
  */
  typedef struct{
-  uint32_t numClients;             /**< the nuber max number of connected
-				        clients */
-  uint32_t Period;                 /**< The actual calulated Period */
-  uint32_t clientSlotLength;       /**< Slot length for a Cient in us (192 +
-				        m*32 with m = length of the packet) */
+  uint32_t numClients;             /**< the number of client slots of the
+				        superframe */
+  uint32_t Period;                 /**< The measured Period in local ticks */
+  uint32_t cycleTime;              /**< Length of the superframe in ticks as
+				        advertised in the beacon */
+  uint32_t clientSlotLength;       /**< Slot length for a Cient in ticks (192 +
+				        m*32 us with m = length of the packet
+				        + guard interval) */
+  uint32_t payloadPerClient;       /**< Response payload of a client */
   uint32_t guardInterval;          /**< Guard INterval length in us */
   uint32_t clientProcessing;       /**< The client Processing Time */
+  uint32_t slotNumber;             /**< The slot of this client or
+				        TDMA_NO_SLOT */
   uint32_t slotOffsett;            /**< The actual slot offset to the received
 				        Beacon Fram */
   uint32_t beaconCount;            /**< number of consecutive received
@@ -186,17 +362,59 @@ typedef enum{
 }proto_conf_t;
 
 /**
- * A struct to store the last measuered period lengths to calculate
- * the correct send time
- *
+ * State of the beacon tracking loop of a client. Times are ticks of the
+ * local timer, the cycles advertised in the beacons are ticks of the
+ * koordinator.
+ */
+typedef struct{
+  uint32_t rate;                   /**< local ticks per koordinator tick,
+				      Q24 */
+  uint32_t lastCapture;            /**< RX_START capture of the last beacon */
+  uint32_t nextBeacon;             /**< expected capture of the next beacon */
+  uint32_t cycle;                  /**< cycle advertised in the last beacon */
+  uint8_t captures;                /**< beacons tracked, saturates at 2 */
+  uint8_t coasted;                 /**< beacons missed since the last
+				      capture */
+  int32_t phaseError;              /**< last capture - expected capture */
+  uint32_t phaseErrorMax;          /**< max. |phaseError| while locked */
+  uint32_t samples;                /**< number of phase errors taken */
+  uint32_t unlocks;                /**< beacons too far off the expected
+				      time to correct the rate */
+  uint32_t beaconsCoasted;         /**< missed beacons replaced by the
+				      expected time */
+  uint32_t syncLosses;             /**< more than TDMA_COAST_PERIODS beacons
+				      missed */
+}tdma_pll_t;
+
+/**
+ * Channel hopping state. The koordinator advances the index with every
+ * beacon, a client takes sequence and index from the last beacon received.
+ */
+typedef struct{
+  uint8_t sequence[TDMA_HOP_LENGTH]; /**< channels of the hop sequence */
+  uint8_t index;                   /**< hop of the last beacon */
+  uint8_t channel;                 /**< channel the radio is tuned to */
+  uint32_t hops;                   /**< channel changes */
+}tdma_hop_t;
+
+/**
+ * A client slot as managed by the koordinator
  */
-typedef struct ringBuffer{
-  uint32_t Buff[NUM_PERIODS];      /**< Array to store the last measured
-				      Periods */
-  uint8_t PutPos;                  /**< Position to store the next
-				      measurement */
-  uint8_t Count;                   /**< The number of stored Periods */
-}ring_buffer_t;
+typedef struct{
+  uint16_t addr;                   /**< short address of the owner or
+				      TDMA_NO_ADDR */
+  uint8_t missed;                  /**< consecutive missed responses */
+  uint8_t sqn;                     /**< sqn of the last data received */
+  bool seen;                       /**< response received in this cycle */
+}tdma_slot_t;
+
+/*============================ PROTOTYPES ====================================*/
+int rf231_slotted_set_superframe(uint8_t clients, uint8_t payload_per_client);
+void rf231_slotted_join(void);
+void rf231_slotted_leave(void);
+const tdma_pll_t *rf231_slotted_get_pll(void);
+int rf231_slotted_set_hopping(const uint8_t *sequence);
+const tdma_hop_t *rf231_slotted_get_hopping(void);
 
 
 #endif /* RF231_SLOTTED_H */
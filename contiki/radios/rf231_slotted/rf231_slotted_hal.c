@@ -20,8 +20,11 @@
 /******************************************************************************
  * SPI Makros 
  ******************************************************************************/
-/* Start the SPI transaction by pulling the Slave Select low. */
+/* Start the SPI transaction by pulling the Slave Select low. A frame
+ * transfer on the DMA streams is finished first, the DMA interrupt has a
+ * higher priority than the timer interrupt. */
 #define HAL_SPI_TRANSFER_OPEN() {		\
+  while(dma_active) {;}				\
   HAL_SS_LOW(); 
 
 #define HAL_SPI_TRANSFER_WRITE(to_write) {		\
@@ -64,6 +67,26 @@ PROCESS_NAME(rf231_slotted_process);
 
 static uint8_t dma_buffer[2+127+5+3];
 
+#if RF231_SPI_DMA
+/** One DMA transfer, SS stays low between the segments of a frame */
+typedef struct{
+  const uint8_t *tx;
+  uint8_t *rx;
+  uint8_t length;
+}dma_segment_t;
+
+static dma_segment_t dma_segments[3];
+static uint8_t dma_segment, dma_num_segments;
+static hal_rx_frame_t *dma_rx_frame;        /**< frame read, NULL for a write */
+#endif /* RF231_SPI_DMA */
+static volatile bool dma_active;
+
+/* events of the interrupt handlers, they must not use process_post() */
+PROCESS_ISR_QUEUE(timx_events, 8, PROCESS_PRIO_HIGH);
+#if RF231_SPI_DMA
+PROCESS_ISR_QUEUE(dma_events, 4, PROCESS_PRIO_HIGH);
+#endif /* RF231_SPI_DMA */
+
 void rf230_interrupt(void);
 
 extern hal_rx_frame_t rxframe[RF230_CONF_RX_BUFFERS];
@@ -75,6 +98,8 @@ extern proto_conf_t rf231_slotted_config;
 
 uint32_t slotTime;
 
+static uint32_t period = TDMA_PERIOD_TICKS;  /**< beacon period of the koordinator */
+
 void hal_set_oc(uint32_t oc_value);
 /*----------------------------------------------------------------------------*/
 /** \brief  This function reads data from one of the radio transceiver's registers.
@@ -259,6 +284,7 @@ hal_frame_write(uint8_t *write_buffer, uint8_t length)
    * since they will be overwritten.
    */
   int i = 2;
+  while(dma_active) {;}
   dma_buffer[0] = 0x60;
   dma_buffer[1] = length;
   memcpy(&dma_buffer[2],write_buffer,length);
@@ -313,6 +339,150 @@ hal_frame_write(uint8_t *write_buffer, uint8_t length)
   /* SPIx->CR2 |= SPI_CR2_RXDMAEN; */
 }
 
+/*----------------------------------------------------------------------------*/
+/** \brief  This function will download a frame from two buffers to the radio
+ *          transceiver's frame buffer, so a queued payload does not have to
+ *          be copied behind its header first.
+ *
+ *  \param  header          Pointer to the frame header.
+ *  \param  header_length   Length of the header.
+ *  \param  payload         Pointer to the payload following the header.
+ *  \param  payload_length  Length of the payload. The frame length is
+ *                          header_length + payload_length + 2 (FCS).
+ */
+void
+hal_frame_write_split(uint8_t *header, uint8_t header_length,
+		      const uint8_t *payload, uint8_t payload_length)
+{
+  /* The FCS is autogenerated, the last two bytes are not transferred */
+  HAL_SPI_TRANSFER_OPEN();
+  HAL_SPI_TRANSFER(0x60);
+  HAL_SPI_TRANSFER(header_length + payload_length + 2);
+  while(header_length-- > 0) {
+    HAL_SPI_TRANSFER(*header++);
+  }
+  while(payload_length-- > 0) {
+    HAL_SPI_TRANSFER(*payload++);
+  }
+  HAL_SPI_TRANSFER_CLOSE();
+}
+
+#if RF231_SPI_DMA
+/*----------------------------------------------------------------------------*/
+/** \brief  Start the DMA streams for one segment of a frame transfer. The RX
+ *          stream is enabled first so no received byte is lost.
+ */
+static void
+hal_dma_start(dma_segment_t *segment)
+{
+  SPI_DMAx_STREAM_TX->CR &= ~DMA_SxCR_EN;
+  SPI_DMAx_STREAM_RX->CR &= ~DMA_SxCR_EN;
+  /* Clear Transfer Complete Interrupt Flag - important for following DMA transactions */
+  SPI_DMA_IFCR_TX |= SPI_DMA_IFCR_CTCIF_TX;
+  SPI_DMA_IFCR_RX |= SPI_DMA_IFCR_CTCIF_RX;
+
+  SPI_DMAx_STREAM_TX->NDTR = segment->length;
+  SPI_DMAx_STREAM_RX->NDTR = segment->length;
+  SPI_DMAx_STREAM_TX->M0AR = (uint32_t)segment->tx;
+  SPI_DMAx_STREAM_RX->M0AR = (uint32_t)segment->rx;
+
+  SPI_DMAx_STREAM_RX->CR |= DMA_SxCR_EN;
+  SPI_DMAx_STREAM_TX->CR |= DMA_SxCR_EN;
+}
+
+/*----------------------------------------------------------------------------*/
+/** \brief  Open the SPI transaction and run the prepared segments */
+static void
+hal_dma_run(void)
+{
+  volatile uint16_t dummy;
+
+  while(dma_active) {;}
+  dma_active = true;
+  dma_segment = 0;
+
+  dummy = SPIx->DR;
+  (void)dummy;
+  HAL_SS_LOW();
+  hal_dma_start(&dma_segments[0]);
+  /* Enable Rx buffer DMA before Tx buffer DMA */
+  SPIx->CR2 |= SPI_CR2_RXDMAEN;
+  SPIx->CR2 |= SPI_CR2_TXDMAEN;
+}
+#endif /* RF231_SPI_DMA */
+
+/*----------------------------------------------------------------------------*/
+/** \brief  Start to read a frame from the radio transceiver's frame buffer.
+ *
+ *          The frame length is read first, the frame and the LQI follow in
+ *          the DMA interrupt. FRAME_READ_EVENT is posted to the slotted
+ *          process with rx_frame as data when the frame is complete.
+ *
+ *  \param  rx_frame    Pointer to the data structure where the frame is stored.
+ */
+void
+hal_frame_read_async(hal_rx_frame_t *rx_frame)
+{
+#if RF231_SPI_DMA
+  while(dma_active) {;}
+  dma_buffer[0] = 0x20;
+  dma_buffer[1] = 0;
+  dma_segments[0].tx = dma_buffer;
+  dma_segments[0].rx = dma_buffer;
+  dma_segments[0].length = 2;
+  dma_num_segments = 1;
+  dma_rx_frame = rx_frame;
+  hal_dma_run();
+#else /* RF231_SPI_DMA */
+  hal_frame_read(rx_frame);
+  /* same priority as the DMA build, so the events keep their order */
+  process_post_prio(&rf231_slotted_process, FRAME_READ_EVENT, rx_frame,
+                    PROCESS_PRIO_HIGH);
+#endif /* RF231_SPI_DMA */
+}
+
+/*----------------------------------------------------------------------------*/
+/** \brief  Start to download a frame from a header and a payload buffer to
+ *          the radio transceiver's frame buffer.
+ *
+ *          Both buffers have to stay unchanged until FRAME_UPLOADED_EVENT is
+ *          posted to the slotted process.
+ *
+ *  \param  header          Pointer to the frame header.
+ *  \param  header_length   Length of the header.
+ *  \param  payload         Pointer to the payload following the header.
+ *  \param  payload_length  Length of the payload, may be 0.
+ */
+void
+hal_frame_write_async(uint8_t *header, uint8_t header_length,
+		      const uint8_t *payload, uint8_t payload_length)
+{
+#if RF231_SPI_DMA
+  while(dma_active) {;}
+  /* the received bytes go to the end of dma_buffer and are dropped, the
+   * FCS is autogenerated and not transferred */
+  dma_buffer[0] = 0x60;
+  dma_buffer[1] = header_length + payload_length + 2;
+  dma_segments[0].tx = dma_buffer;
+  dma_segments[0].rx = dma_buffer;
+  dma_segments[0].length = 2;
+  dma_segments[1].tx = header;
+  dma_segments[1].rx = &dma_buffer[2];
+  dma_segments[1].length = header_length;
+  dma_segments[2].tx = payload;
+  dma_segments[2].rx = &dma_buffer[2];
+  dma_segments[2].length = payload_length;
+  dma_num_segments = payload_length > 0 ? 3 : 2;
+  dma_rx_frame = NULL;
+  hal_dma_run();
+#else /* RF231_SPI_DMA */
+  hal_frame_write_split(header, header_length, payload, payload_length);
+  /* same priority as the DMA build, so the events keep their order */
+  process_post_prio(&rf231_slotted_process, FRAME_UPLOADED_EVENT, NULL,
+                    PROCESS_PRIO_HIGH);
+#endif /* RF231_SPI_DMA */
+}
+
 
 /****************************************************************************
  * Interrupt Service Routines
@@ -387,14 +557,62 @@ hal_frame_write(uint8_t *write_buffer, uint8_t length)
 
 
 /**
- * Interrupthandler to stop the dma transfer
+ * Interrupthandler of the RX stream, a segment of a frame transfer is
+ * complete. Starts the next segment or ends the transfer.
  */
 void SPI_DMAx_STREAM_RX_IRQHandler(void)
 {
+#if RF231_SPI_DMA
+  uint8_t frame_length;
+
+  /* Clear Transfer Complete Interrupt Flag */
+  SPI_DMA_IFCR_RX |= SPI_DMA_IFCR_CTCIF_RX;
+
+  if(dma_rx_frame != NULL && dma_segment == 0) {
+    /* frame length read, check it before reading the frame. Bypassing this
+     * test can result in a buffer overrun! */
+    frame_length = dma_buffer[1];
+    if((frame_length >= HAL_MIN_FRAME_LENGTH) && (frame_length <= HAL_MAX_FRAME_LENGTH)) {
+      dma_rx_frame->length = frame_length;
+      dma_rx_frame->crc = true;
+      /* the frame buffer ignores the sent bytes, send the buffer itself */
+      dma_segments[1].tx = dma_rx_frame->data;
+      dma_segments[1].rx = dma_rx_frame->data;
+      dma_segments[1].length = frame_length;
+      dma_segments[2].tx = &dma_rx_frame->lqi;
+      dma_segments[2].rx = &dma_rx_frame->lqi;
+      dma_segments[2].length = 1;
+      dma_num_segments = 3;
+    } else {
+      /* Length test failed */
+      dma_rx_frame->length = 0;
+      dma_rx_frame->lqi = 0;
+      dma_rx_frame->crc = false;
+    }
+  }
+
+  if(++dma_segment < dma_num_segments) {
+    hal_dma_start(&dma_segments[dma_segment]);
+    return;
+  }
+
+  SPIx->CR2 &= ~(SPI_CR2_TXDMAEN | SPI_CR2_RXDMAEN);
+  while ((SPIx->SR & SPI_SR_BSY) == SPI_SR_BSY) {;};
+  /* Release SS */
+  HAL_SS_HIGH();
+  dma_active = false;
+
+  if(dma_rx_frame != NULL) {
+    process_post_isr(&dma_events, &rf231_slotted_process, FRAME_READ_EVENT, dma_rx_frame);
+  } else {
+    process_post_isr(&dma_events, &rf231_slotted_process, FRAME_UPLOADED_EVENT, NULL);
+  }
+#else /* RF231_SPI_DMA */
   /* Clear Transfer Complete Interrupt Flag */
   SPI_DMA_IFCR_RX |= SPI_DMA_IFCR_CTCIF_RX;
   /* Release SS */
   HAL_SS_HIGH();
+#endif /* RF231_SPI_DMA */
 }
 
 
@@ -437,9 +655,9 @@ void TIMx_IRQHandler(void)
    *  TRX END Interrupt
    ***************************************************/
   if(state == RF231_STATE_IDLE){
-  process_post(&rf231_slotted_process, HANDLE_PACKET_EVENT, NULL);
+  process_post_isr(&timx_events, &rf231_slotted_process, HANDLE_PACKET_EVENT, NULL);
 } else if(state == RF231_STATE_SEND){
-  process_post(&rf231_slotted_process, FRAME_SEND_EVENT, NULL);
+  process_post_isr(&timx_events, &rf231_slotted_process, FRAME_SEND_EVENT, NULL);
 }
 }
 }
@@ -460,10 +678,10 @@ void TIMx_IRQHandler(void)
     if(jitter == 0) {
       jitter = JITTER_TICKS;
     }
-    TIMx->CCR_OC=TIMx->CCR_OC + TDMA_PERIOD_TICKS + jitter - JITTER_TICKS;
+    TIMx->CCR_OC=TIMx->CCR_OC + period + jitter - JITTER_TICKS;
 #else /* JITTER_SIMULATION */
       /* set the next BEACON send time */
-    TIMx->CCR_OC=TIMx->CCR_OC + TDMA_PERIOD_TICKS;
+    TIMx->CCR_OC=TIMx->CCR_OC + period;
 #endif /* JITTER_SIMULATION */
     /* Generate Output Pulse by toggling the output signal polarity
      * change compare mode output signal from High level to low to end the pulse */
@@ -486,7 +704,7 @@ void TIMx_IRQHandler(void)
    *******************************************/
   /* Clear IRQ Flag*/
     TIMx->SR &= ~TIM_TX_MODE_IRQ_FLAG;
-    process_post(&rf231_slotted_process, TX_MODE_TIMER_EVENT, NULL);
+    process_post_isr(&timx_events, &rf231_slotted_process, TX_MODE_TIMER_EVENT, NULL);
 }
 
 #else
@@ -516,16 +734,16 @@ if (TIMx->SR & TIM_IC_IRQ_FLAG)	{
   capture = TIMx->CCR_IC;
   if(state == RF231_STATE_IDLE){
   rf231_slotted_IC_irqh(capture);
-  process_post(&rf231_slotted_process, INPUT_CAPTURE_EVENT, NULL);
+  process_post_isr(&timx_events, &rf231_slotted_process, INPUT_CAPTURE_EVENT, NULL);
 } 
 } else if (interrupt_source & HAL_TRX_END_MASK){
   /***************************************************
    * TRX END Interrupt
    ***************************************************/
   if(state == RF231_STATE_IDLE){
-  process_post(&rf231_slotted_process, HANDLE_PACKET_EVENT, NULL);
+  process_post_isr(&timx_events, &rf231_slotted_process, HANDLE_PACKET_EVENT, NULL);
 } else if(state == RF231_STATE_SEND){
-  process_post(&rf231_slotted_process, FRAME_SEND_EVENT, NULL);
+  process_post_isr(&timx_events, &rf231_slotted_process, FRAME_SEND_EVENT, NULL);
 }
 }
 } else if (TIMx->SR & TIM_OC_IRQ_FLAG) {
@@ -549,14 +767,14 @@ if (TIMx->SR & TIM_IC_IRQ_FLAG)	{
    *******************************************/
   /* Clear IRQ Flag*/
   TIMx->SR &= ~TIM_BEACON_MISSED_IRQ_FLAG;
-  process_post(&rf231_slotted_process, BEACON_MISSED_EVENT, NULL);
+  process_post_isr(&timx_events, &rf231_slotted_process, BEACON_MISSED_EVENT, NULL);
 } else if (TIMx->SR & TIM_TX_MODE_IRQ_FLAG) {
   /******************************************
    * TX_MODE Timer expired
    *******************************************/
   /* Clear IRQ Flag*/
   TIMx->SR &= ~TIM_TX_MODE_IRQ_FLAG;
-  process_post(&rf231_slotted_process, TX_MODE_TIMER_EVENT, NULL);
+  process_post_isr(&timx_events, &rf231_slotted_process, TX_MODE_TIMER_EVENT, NULL);
 }
 #endif
 }
@@ -581,6 +799,14 @@ uint32_t hal_get_oc()
 {
   return TIMx->CCR_OC;
 }
+
+/**
+ * set the period added to the OC value on every OC interrupt
+ */
+void hal_set_period(uint32_t ticks)
+{
+  period = ticks;
+}
 /*--------------------------------------------------------------------------*/
 /**
  * Initialise the hardware
@@ -593,6 +819,11 @@ hal_init(void)
   uint16_t tmpccer = 0;         /** Capture/Compare Enabled Register Value */
   uint32_t tmpreg;              /** temporary register */
 
+  process_isr_queue_register(&timx_events);
+#if RF231_SPI_DMA
+  process_isr_queue_register(&dma_events);
+#endif /* RF231_SPI_DMA */
+
   /****** Conifgure the Timer *************************************************/
   /* Enable the clocksource */
   RCC->APB1ENR |= RCC_APB1ENR_TIMxEN;
@@ -891,6 +1122,11 @@ hal_init(void)
 #endif
 
   IRQ_init_enable(TIMx_IRQn,1,0);
+#if RF231_SPI_DMA
+  /* frame transfers complete before the timer interrupt, see
+     HAL_SPI_TRANSFER_OPEN() */
+  IRQ_init_enable(SPI_DMAx_STREAM_RX_IRQn,0,0);
+#endif /* RF231_SPI_DMA */
 
   return 1;
 }
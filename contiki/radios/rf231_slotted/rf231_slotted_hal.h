@@ -7,17 +7,24 @@
 #include <stdbool.h>
 #include "lib/random.h"
 #include "contiki-conf.h"
+#ifndef CONTIKI_TARGET_NATIVE
 #include <stm32f4xx.h>                  /* STM32F4xx Definitions              */
+#endif /* CONTIKI_TARGET_NATIVE */
 #include "rf231_slotted.h"
 #include "sys/process.h"
+#ifndef CONTIKI_TARGET_NATIVE
 #include <nvic.h>                  /* STM32F4xx Definitions              */
 #include <clock.h>
+#else /* CONTIKI_TARGET_NATIVE */
+#include "sys/clock.h"
+#endif /* CONTIKI_TARGET_NATIVE */
 #include "rf231_slotted_registermap.h"
 #include "rf231_slotted.h"
 #include "ioboard.h"
 
 
 
+#ifndef CONTIKI_TARGET_NATIVE
 /******************************************************************************
  * AT86 RF231 PORT Definitions
  ******************************************************************************
@@ -82,6 +89,8 @@
 #define TIM_GPIO_MASk         0xFFFFFFCC                    /** PORT 0 and 3 */
 #define TIM_GPIO_MODE         0x00000022                    /** AF Mode for PORT 0 and 3 */
 #define TIM_GPIO_AF           0x00001001                    /** The Alternate Function */
+#endif /* CONTIKI_TARGET_NATIVE */
+
 /**
  * Timer 2 is connected to the APB1 clock Source and runs with a
  * frequency of 84 MHz.  We want a clock cycle length of 250 ns. This
@@ -102,28 +111,62 @@
 #define PHY_TIME_PER_BYTE_NS                 (32000)
 #define PHY_SYNCH_HEADER_NS                  (192000)
 
-#define TDMA_SLOTTIME_NS                     (714000)                                  /** the slot position in ns */
-#define TDMA_BEACON_FRAME_NS                 (PHY_SYNCH_HEADER_NS + BEACON_LENGTH * PHY_TIME_PER_BYTE_NS)
-#define TDMA_RESPONSE_FRAME_NS               (PHY_SYNCH_HEADER_NS + RESPONSE_LENGTH * PHY_TIME_PER_BYTE_NS)
+/* Frame buffer transfers run on the SPI DMA streams by default, the CPU
+ * is free while a frame is read or written and a transfer completes with
+ * FRAME_READ_EVENT or FRAME_UPLOADED_EVENT. Without DMA the transfers
+ * busy-wait and the events are posted right away. */
+#ifdef RF231_SLOTTED_CONF_SPI_DMA
+#define RF231_SPI_DMA                        RF231_SLOTTED_CONF_SPI_DMA
+#else
+#define RF231_SPI_DMA                        1
+#endif /* RF231_SLOTTED_CONF_SPI_DMA */
 
 #define CLIENT_PROCESSING_TIME_NS            (105000)      /**< the processing time needed by the client */
-#define KOORD_PROCESSING_TIME_NS             (105000)      /**< the processing time needed by the client */
-
+#if RF231_SPI_DMA
+/* the beacon upload only has to stay ahead of the PHY, it may still run
+ * while the synchronisation header is sent */
+#define KOORD_PROCESSING_TIME_NS             (50000)       /**< the processing time needed by the koordinator */
+#else
+#define KOORD_PROCESSING_TIME_NS             (105000)      /**< the processing time needed by the koordinator */
+#endif /* RF231_SPI_DMA */
+
+/* With the rate of the clients tracked (see pll_update()) the residual
+ * slot error is about one timer tick, the guard time may be reduced
+ * accordingly. */
+#ifdef RF231_SLOTTED_CONF_GUARD_TIME_NS
+#define TDMA_GUARD_TIME_NS                   RF231_SLOTTED_CONF_GUARD_TIME_NS
+#else
 #define TDMA_GUARD_TIME_NS                   (10000)
+#endif /* RF231_SLOTTED_CONF_GUARD_TIME_NS */
 
 #define HARDWARE_DELAY_NS                    (16000)
 
-#define TDMA_PERIOD_NS        (TDMA_BEACON_FRAME_NS + CLIENT_PROCESSING_TIME_NS + (MAX_CLIENTS * (TDMA_RESPONSE_FRAME_NS + TDMA_GUARD_TIME_NS)) + KOORD_PROCESSING_TIME_NS)
+/* Superframe timing for a given number of clients and payload per client.
+ * The superframe ends with the join slot. */
+#define TDMA_FRAME_NS(len)                   (PHY_SYNCH_HEADER_NS + (len) * PHY_TIME_PER_BYTE_NS)
+#define TDMA_SLOT_NS(payload)                (TDMA_FRAME_NS(TDMA_RESPONSE_LENGTH(payload)) + TDMA_GUARD_TIME_NS)
+#define TDMA_JOIN_SLOT_NS                    (TDMA_FRAME_NS(TDMA_JOIN_LENGTH) + TDMA_GUARD_TIME_NS)
+#define TDMA_CYCLE_NS(clients, payload)      (TDMA_FRAME_NS(TDMA_BEACON_LENGTH(clients, payload)) + CLIENT_PROCESSING_TIME_NS \
+                                              + (clients) * TDMA_SLOT_NS(payload) + TDMA_JOIN_SLOT_NS \
+                                              + KOORD_PROCESSING_TIME_NS)
+
+/* Timing of the empty superframe the koordinator starts with */
+#define TDMA_SLOTTIME_NS                     TDMA_SLOT_NS(PAYLOAD_PER_CLIENT)          /** the slot position in ns */
+#define TDMA_BEACON_FRAME_NS                 TDMA_FRAME_NS(TDMA_BEACON_LENGTH(0, PAYLOAD_PER_CLIENT))
+#define TDMA_RESPONSE_FRAME_NS               TDMA_FRAME_NS(RESPONSE_LENGTH)
+
+#define TDMA_PERIOD_NS        TDMA_CYCLE_NS(0, PAYLOAD_PER_CLIENT)
 #define TDMA_PERIOD_US        (TDMA_PERIOD_NS / 100);
 #define TDMA_PERIOD_TICKS     (TDMA_PERIOD_NS / TIM_RESOLUTION_NS)    /** The Period in timer ticks */
 #define CLIENT_PROCESSING_TIME_TICKS         (CLIENT_PROCESSING_TIME_NS / TIM_RESOLUTION_NS)  /**< the processing time in ticks */
-#define KOORD_PROCESSING_TIME_TICKS          (CLIENT_PROCESSING_TIME_NS / TIM_RESOLUTION_NS)  /**< the processing time in ticks */
+#define KOORD_PROCESSING_TIME_TICKS          (KOORD_PROCESSING_TIME_NS / TIM_RESOLUTION_NS)  /**< the processing time in ticks */
 #define TDMA_SLOT_TICKS       (TDMA_SLOTTIME_NS / TIM_RESOLUTION_NS)  /** The Slot Time in timer ticks */
 #define TDMA_BEACON_TICKS     (TDMA_BEACON_FRAME_NS / TIM_RESOLUTION_NS)
 #define HARDWARE_DELAY_TICKS                (HARDWARE_DELAY_NS / TIM_RESOLUTION_NS)
 
 #define FILTER_FACTOR                        (1/2)                         /** alpha value for median calculation via IIF */
 
+#ifndef CONTIKI_TARGET_NATIVE
 /******************************************************************************
  * Define the Timer Channels for Interrupt and Event generation
  ******************************************************************************
@@ -238,6 +281,32 @@
 #define hal_set_rst_low( )    ( RSTPORT->BSRRH = ((uint32_t)1 << (uint32_t)RSTPIN) ) /**< This macro pulls the RST pin low. */
 #define hal_get_rst( )        !!( RSTPORT->IDR & ((uint32_t)1 << (uint32_t)RSTPIN) ) /**< Read current state of the RST pin (High/Low). */
 
+#define hal_get_uid_byte( n ) ( *((uint8_t*)0x1FFF7A10 + (n)) ) /**< Read a byte of the STM32 96 bit unique device ID. */
+
+#else /* CONTIKI_TARGET_NATIVE */
+/****************************************************************************
+ * Native Makro definitions
+ *****************************************************************************
+ * On the native platform the pins, the SPI bus and TIMx are emulated by
+ * rf231_slotted_hal_native.c against a discrete event clock. Busy waiting
+ * makes no sense there, the simulated time does not advance while the
+ * driver runs.
+ *****************************************************************************/
+#define HAL_SS_HIGH( )
+#define HAL_SS_LOW( )
+#define delay_us( us )        ( (void)(us) )
+
+#define hal_set_slptr_high( ) ( hal_native_set_slptr(1) )  /**< This macro pulls the SLP_TR pin high. */
+#define hal_set_slptr_low( )  ( hal_native_set_slptr(0) )  /**< This macro pulls the SLP_TR pin low. */
+#define hal_get_slptr( )      ( hal_native_get_slptr() )   /**< Read current state of the SLP_TR pin (High/Low). */
+
+#define hal_set_rst_high( )   ( hal_native_set_rst(1) )    /**< This macro pulls the RST pin high. */
+#define hal_set_rst_low( )    ( hal_native_set_rst(0) )    /**< This macro pulls the RST pin low. */
+#define hal_get_rst( )        ( hal_native_get_rst() )     /**< Read current state of the RST pin (High/Low). */
+
+#define hal_get_uid_byte( n ) ( hal_native_get_uid_byte(n) ) /**< Read a byte of the simulated unique device ID. */
+#endif /* CONTIKI_TARGET_NATIVE */
+
 /****************************************************************************
  * Masks
  *****************************************************************************/
@@ -261,8 +330,7 @@
  */
 typedef struct{
     uint8_t length;                       /**< Length of frame. */
-    //    uint8_t data[RF231_MAX_TX_FRAME_LENGTH]; /**< Actual frame data. */
-    uint8_t data[32]; /**< Actual frame data. */
+    uint8_t data[HAL_MAX_FRAME_LENGTH];   /**< Actual frame data. */
     uint8_t lqi;                          /**< LQI value for received frame. */
     bool crc;                             /**< Flag - did CRC pass for received frame? */
 } hal_rx_frame_t;
@@ -306,6 +374,33 @@ void hal_clear_pll_lock_flag( void );
 
 void hal_frame_read(hal_rx_frame_t *rx_frame);
 void hal_frame_write( uint8_t *write_buffer, uint8_t length );
+void hal_frame_write_split( uint8_t *header, uint8_t header_length,
+			    const uint8_t *payload, uint8_t payload_length );
+void hal_frame_read_async( hal_rx_frame_t *rx_frame );
+void hal_frame_write_async( uint8_t *header, uint8_t header_length,
+			    const uint8_t *payload, uint8_t payload_length );
+
+void hal_set_oc( uint32_t oc_value );
+void hal_update_oc( uint32_t oc_value );
+uint32_t hal_get_oc( void );
+void hal_set_period( uint32_t period );
+int hal_start_counter( void );
+int hal_stop_counter( void );
+int hal_reset_counter( void );
+int hal_set_TX_Timer( uint32_t time );
+int hal_update_TX_Timer( uint32_t time );
+int hal_set_TX_Mode_Timer( uint32_t time );
+int hal_update_TX_Mode_Timer( uint32_t time );
+int hal_set_Beacon_Missed_Timer( uint32_t time );
+int hal_update_Beacon_Missed_Timer( uint32_t time );
+
+#ifdef CONTIKI_TARGET_NATIVE
+void hal_native_set_slptr( uint8_t level );
+uint8_t hal_native_get_slptr( void );
+void hal_native_set_rst( uint8_t level );
+uint8_t hal_native_get_rst( void );
+uint8_t hal_native_get_uid_byte( uint8_t n );
+#endif /* CONTIKI_TARGET_NATIVE */
 //void hal_sram_read( uint8_t address, uint8_t length, uint8_t *data );
 //void hal_sram_write( uint8_t address, uint8_t length, uint8_t *data );
 
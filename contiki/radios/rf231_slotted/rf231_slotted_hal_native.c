@@ -0,0 +1,1538 @@
+/*
+ * Copyright (c) 2012, TU Dortmund University.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following
+ *    disclaimer in the documentation and/or other materials provided
+ *    with the distribution.
+ * 3. The name of the author may not be used to endorse or promote
+ *    products derived from this software without specific prior
+ *    written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS
+ * OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+ * GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * This file is part of the Contiki OS
+ *
+ */
+/*---------------------------------------------------------------------------*/
+/**
+ * \file    Native (Linux) backend of the rf231 slotted HAL
+ *
+ *          Replaces rf231_slotted_hal.c and ioboard.c on the native
+ *          platform. The AT86RF231 register file, its frame buffer, the
+ *          SLP_TR/RST pins and the TIMx input capture and output compare
+ *          channels are emulated against a deterministic discrete event
+ *          clock. See rf231_slotted_sim.h for the simulated channel.
+ */
+/*---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <string.h>
+#include "contiki.h"
+#include "rf231_slotted.h"
+#include "rf231_slotted_hal.h"
+#include "rf231_slotted_registermap.h"
+#include "rf231_slotted_sim.h"
+
+/******************************************************************************
+ * Simulation definitions
+ ******************************************************************************/
+#define SIM_DUT               0                             /** node index of the device under test */
+#define SIM_NODES             (RF231_SIM_MAX_PEERS + 1)     /** DUT + peers */
+#define SIM_NO_NODE           0xff
+#ifdef SLOTTED_KOORDINATOR
+#define SIM_KOORD             SIM_DUT                       /** node sending the beacons */
+#else
+#define SIM_KOORD             1
+#endif /* SLOTTED_KOORDINATOR */
+
+#define SIM_MAX_EVENTS        (3 * SIM_NODES + 4)
+#define SIM_NS_PER_SECOND     1000000000ULL
+#define SIM_PPM               1000000LL
+/* The timer runs TIM_RESOLUTION_NS per tick, so one second has exactly this
+ * many ticks per (1e6 + drift) ppm */
+#define SIM_TICKS_PER_SECOND_PPM (SIM_NS_PER_SECOND / TIM_RESOLUTION_NS / SIM_PPM)
+
+#define SIM_FRAME_NS(len)     (PHY_SYNCH_HEADER_NS + (uint64_t)(len) * PHY_TIME_PER_BYTE_NS)
+#define SIM_GET16(p)          ((uint16_t)(p)[0] | ((uint16_t)(p)[1] << 8))
+#define SIM_SPI_BYTE_NS       1524  /** one byte at fPCLK/16 ~= 5.25 MHz */
+
+/** Compare channels of TIMx */
+#define SIM_CH_IC             0
+#define SIM_CH_OC             1
+#define SIM_CH_TX_MODE        2
+#define SIM_CH_BEACON_MISSED  3
+#define SIM_CHANNELS          4
+
+/** Discrete events */
+#define SIM_EV_COMPARE        0     /** TIMx compare match, node = channel */
+#define SIM_EV_TX_START       1     /** first symbol of a frame on air */
+#define SIM_EV_RX_START       2     /** SHR of a frame received */
+#define SIM_EV_TX_END         3     /** last symbol of a frame on air */
+#define SIM_EV_DMA_DONE       4     /** frame transfer over SPI complete */
+
+/****************************************************************************
+ * Typedefs
+ *****************************************************************************/
+typedef struct{
+  uint64_t time;                  /**< simulated time in ns */
+  uint32_t seq;                   /**< insertion order, keeps ties FIFO */
+  uint8_t  type;                  /**< SIM_EV_* */
+  uint8_t  node;                  /**< node or timer channel */
+} sim_event_t;
+
+typedef struct{
+  uint16_t addr;                  /**< short address */
+  uint16_t koordAddr;             /**< source address of the last beacon */
+  uint8_t  slot;                  /**< granted slot or TDMA_NO_SLOT */
+  bool     join;                  /**< the next response is a join request */
+  bool     tx;                    /**< frame on air */
+  bool     aborted;               /**< transmission cut off by the sender */
+  bool     underrun;              /**< frame buffer not ready when sent */
+  bool     gotBeacon;             /**< last beacon received */
+  uint8_t  rxFrom;                /**< node currently received or SIM_NO_NODE */
+  bool     rxCorrupt;             /**< current reception hit by a collision */
+  uint8_t  txLength;
+  uint8_t  txData[HAL_MAX_FRAME_LENGTH];
+  uint64_t txStart;
+  uint64_t rxStart;               /**< SHR of the last received beacon */
+  uint64_t slotStart;             /**< start of the slot or, without a slot,
+                                       of the join slot from the last beacon */
+  uint8_t  payload;               /**< response payload from the last beacon */
+  uint8_t  sqn;
+  uint8_t  channel;               /**< channel of a peer, the DUT uses the
+                                       emulated CHANNEL register */
+} sim_node_t;
+
+/******************************************************************************
+ * Extern and static Variable Definitions
+ ******************************************************************************/
+extern void rf231_slotted_IC_irqh(uint32_t capture);
+
+PROCESS_NAME(rf231_slotted_process);
+
+extern uint8_t volatile state;
+
+uint32_t slotTime;
+
+static rf231_sim_conf_t sim_conf = {
+  RF231_SIM_PEERS,   /* numPeers */
+  0,                 /* lossRate */
+  0,                 /* driftPpm */
+  0,                 /* jitterNs */
+  1,                 /* seed */
+  0                  /* dmaLatencyNs */
+};
+static rf231_sim_stats_t sim_stats;
+
+static sim_event_t events[SIM_MAX_EVENTS];   /**< sorted, next event last */
+static uint8_t nevents;
+static uint32_t event_seq;
+static uint64_t now;
+static uint32_t prng;
+
+static sim_node_t nodes[SIM_NODES];
+static uint64_t last_dut_tx;
+static uint64_t cycle_ns;         /**< cycle advertised by the last beacon */
+static uint64_t prev_cycle_ns;    /**< cycle advertised by the beacon before */
+#ifndef SLOTTED_KOORDINATOR
+static uint16_t sim_slots[MAX_CLIENTS];   /**< slot table of the simulated
+					       koordinator */
+static uint16_t sim_grant_addr;
+static uint8_t sim_grant_slot;
+static uint8_t sim_acks[TDMA_BITMAP_LENGTH(MAX_CLIENTS)]; /**< responses
+					       received since the last beacon */
+static uint8_t sim_hop_index;
+#endif /* SLOTTED_KOORDINATOR */
+static uint32_t period = TDMA_PERIOD_TICKS;
+
+/* emulated SPI DMA, the frame buffer is updated when the transfer starts,
+ * completion is signalled after the transfer time */
+static hal_rx_frame_t *dma_rx_frame;   /**< frame read, NULL for a write */
+static bool dma_writing;
+static uint64_t dma_start;             /**< first byte on SPI */
+static uint64_t dma_end;               /**< completion of the transfer */
+
+/* events of the emulated interrupt handlers, like on the target */
+PROCESS_ISR_QUEUE(timx_events, 8, PROCESS_PRIO_HIGH);
+PROCESS_ISR_QUEUE(dma_events, 4, PROCESS_PRIO_HIGH);
+
+/* emulated AT86RF231 */
+static uint8_t regs[0x40];
+static uint8_t frame_buffer[HAL_MAX_FRAME_LENGTH];
+static uint8_t frame_length;
+static uint8_t slptr, rst;
+static const uint8_t uid[12] = {RF231_SIM_NODE_ID, 0x00, 0x2e, 0x00, 0x01};
+
+/* emulated TIMx */
+static uint32_t ccr[SIM_CHANNELS];
+static uint64_t counter_base;     /**< simulated time of CNT == 0 */
+static uint32_t counter_frozen;   /**< CNT while the counter is stopped */
+static bool counter_enabled;
+#ifdef JITTER_SIMULATION
+static bool oc_output_frozen;
+#endif /* JITTER_SIMULATION */
+
+static uint8_t ioboard_leds;
+
+static void sim_dut_start_tx(uint64_t time);
+
+/*----------------------------------------------------------------------------*/
+/** \brief  Simulation PRNG (xorshift32). Independent of random_rand() so
+ *          runs are reproducible for a given seed.
+ */
+static uint32_t
+sim_rand(void)
+{
+  prng ^= prng << 13;
+  prng ^= prng >> 17;
+  prng ^= prng << 5;
+  return prng;
+}
+
+/*----------------------------------------------------------------------------*/
+static bool
+sim_frame_lost(void)
+{
+  return sim_conf.lossRate && (sim_rand() & 0xffff) < sim_conf.lossRate;
+}
+
+/*****************************************************************************
+ * Event queue
+ *****************************************************************************/
+/*----------------------------------------------------------------------------*/
+static void
+sim_schedule(uint64_t time, uint8_t type, uint8_t node)
+{
+  uint8_t i;
+
+  if(nevents == SIM_MAX_EVENTS) {
+    PRINTF("rf231 sim: event queue full\n");
+    return;
+  }
+  /* the queue is sorted descending, most events go close to the end */
+  for(i = nevents; i > 0; --i) {
+    if(events[i - 1].time > time) {
+      break;
+    }
+    events[i] = events[i - 1];
+  }
+  events[i].time = time;
+  events[i].seq = event_seq++;
+  events[i].type = type;
+  events[i].node = node;
+  ++nevents;
+}
+
+/*----------------------------------------------------------------------------*/
+static void
+sim_unschedule(uint8_t type, uint8_t node)
+{
+  uint8_t i;
+
+  for(i = 0; i < nevents; ++i) {
+    if(events[i].type == type && events[i].node == node) {
+      memmove(&events[i], &events[i + 1], (nevents - i - 1) * sizeof(sim_event_t));
+      --nevents;
+      return;
+    }
+  }
+}
+
+/*****************************************************************************
+ * Emulated TIMx
+ *****************************************************************************/
+/*----------------------------------------------------------------------------*/
+/** \brief  Timer ticks of the (drifting) DUT crystal after dt ns */
+static uint64_t
+sim_ticks(uint64_t dt)
+{
+  uint64_t rate = SIM_PPM + sim_conf.driftPpm;
+
+  return (dt / SIM_NS_PER_SECOND) * SIM_TICKS_PER_SECOND_PPM * rate
+    + (dt % SIM_NS_PER_SECOND) * rate / (TIM_RESOLUTION_NS * SIM_PPM);
+}
+
+/*----------------------------------------------------------------------------*/
+/** \brief  First point in time (ns after CNT == 0) the counter reaches ticks */
+static uint64_t
+sim_ticks_to_ns(uint64_t ticks)
+{
+  uint64_t rate = SIM_PPM + sim_conf.driftPpm;
+  uint64_t per_second = SIM_TICKS_PER_SECOND_PPM * rate;
+  uint64_t rem = ticks % per_second;
+
+  return (ticks / per_second) * SIM_NS_PER_SECOND
+    + (rem * TIM_RESOLUTION_NS * SIM_PPM + rate - 1) / rate;
+}
+
+/*----------------------------------------------------------------------------*/
+static uint32_t
+sim_counter(void)
+{
+  if(!counter_enabled) {
+    return counter_frozen;
+  }
+  return (uint32_t)sim_ticks(now - counter_base);
+}
+
+/*----------------------------------------------------------------------------*/
+/** \brief  (Re)schedule the compare match of a channel. Like the hardware the
+ *          match happens when CNT reaches CCR, a value that just passed
+ *          matches after the next overflow.
+ */
+static void
+sim_schedule_compare(uint8_t channel)
+{
+  uint64_t elapsed, target;
+  uint32_t delta;
+
+  sim_unschedule(SIM_EV_COMPARE, channel);
+  if(!counter_enabled || channel == SIM_CH_IC) {
+    return;
+  }
+#ifdef SLOTTED_KOORDINATOR
+  if(channel == SIM_CH_BEACON_MISSED) {
+    return;
+  }
+#endif /* SLOTTED_KOORDINATOR */
+  elapsed = sim_ticks(now - counter_base);
+  delta = ccr[channel] - (uint32_t)elapsed;
+  target = elapsed + (delta ? delta : 0x100000000ULL);
+  sim_schedule(counter_base + sim_ticks_to_ns(target), SIM_EV_COMPARE, channel);
+}
+
+/*----------------------------------------------------------------------------*/
+static void
+sim_schedule_compares(void)
+{
+  uint8_t i;
+
+  for(i = SIM_CH_OC; i < SIM_CHANNELS; ++i) {
+    sim_schedule_compare(i);
+  }
+}
+
+/*----------------------------------------------------------------------------*/
+/**
+ * Counterpart of TIMx_IRQHandler in rf231_slotted_hal.c
+ */
+static void
+sim_timx_irq(uint8_t channel)
+{
+  volatile uint32_t capture;
+  uint8_t interrupt_source;
+#ifdef SLOTTED_KOORDINATOR
+#ifdef JITTER_SIMULATION
+  uint16_t jitter = 0;
+#endif /* JITTER_SIMULATION */
+  if(channel == SIM_CH_IC) {
+    /******************************************
+     * Input Capture Interrupt detected - New Packet received
+     *******************************************/
+    interrupt_source = hal_register_read(RG_IRQ_STATUS);
+    if((interrupt_source & HAL_RX_START_MASK)) {
+      /***************************************************
+       * RX START Interrupt
+       ***************************************************/
+      capture = ccr[SIM_CH_IC];
+      (void)capture;
+    } else if(interrupt_source & HAL_TRX_END_MASK) {
+      /***************************************************
+       *  TRX END Interrupt
+       ***************************************************/
+      if(state == RF231_STATE_IDLE) {
+        process_post_isr(&timx_events, &rf231_slotted_process, HANDLE_PACKET_EVENT, NULL);
+      } else if(state == RF231_STATE_SEND) {
+        process_post_isr(&timx_events, &rf231_slotted_process, FRAME_SEND_EVENT, NULL);
+      }
+    }
+  } else if(channel == SIM_CH_OC) {
+    /******************************************
+     * Output Compare IRQ - Time to send Frame
+     *******************************************/
+#ifdef JITTER_SIMULATION
+#define JITTER_TICKS         32
+#define JITTER_MASK          (JITTER_TICKS * 2 - 1)
+    jitter = random_rand();
+    jitter = (jitter & JITTER_MASK);
+    if(jitter == 0) {
+      jitter = JITTER_TICKS;
+    }
+    ccr[SIM_CH_OC] = ccr[SIM_CH_OC] + period + jitter - JITTER_TICKS;
+#else /* JITTER_SIMULATION */
+    /* set the next BEACON send time */
+    ccr[SIM_CH_OC] = ccr[SIM_CH_OC] + period;
+#endif /* JITTER_SIMULATION */
+    sim_schedule_compare(SIM_CH_OC);
+#ifdef JITTER_SIMULATION
+    if((random_rand() & (0x7 << 8)) == 0) {
+      oc_output_frozen = true;
+    }
+#endif /* JITTER_SIMULATION */
+  } else if(channel == SIM_CH_TX_MODE) {
+    /******************************************
+     * TX_MODE Timer expired
+     *******************************************/
+    process_post_isr(&timx_events, &rf231_slotted_process, TX_MODE_TIMER_EVENT, NULL);
+  }
+#else /* SLOTTED_KOORDINATOR */
+  if(channel == SIM_CH_IC) {
+    /******************************************
+     * Input Capture Interrupt detected - New Packet received
+     *******************************************/
+    interrupt_source = hal_register_read(RG_IRQ_STATUS);
+    if((interrupt_source & HAL_RX_START_MASK)) {
+      /***************************************************
+       * RX START Interrupt
+       ***************************************************/
+      capture = ccr[SIM_CH_IC];
+      if(state == RF231_STATE_IDLE) {
+        rf231_slotted_IC_irqh(capture);
+        process_post_isr(&timx_events, &rf231_slotted_process, INPUT_CAPTURE_EVENT, NULL);
+      }
+    } else if(interrupt_source & HAL_TRX_END_MASK) {
+      /***************************************************
+       * TRX END Interrupt
+       ***************************************************/
+      if(state == RF231_STATE_IDLE) {
+        process_post_isr(&timx_events, &rf231_slotted_process, HANDLE_PACKET_EVENT, NULL);
+      } else if(state == RF231_STATE_SEND) {
+        process_post_isr(&timx_events, &rf231_slotted_process, FRAME_SEND_EVENT, NULL);
+      }
+    }
+  } else if(channel == SIM_CH_BEACON_MISSED) {
+    /******************************************
+     * Beacon Missed Timer expired
+     *******************************************/
+    process_post_isr(&timx_events, &rf231_slotted_process, BEACON_MISSED_EVENT, NULL);
+  } else if(channel == SIM_CH_TX_MODE) {
+    /******************************************
+     * TX_MODE Timer expired
+     *******************************************/
+    process_post_isr(&timx_events, &rf231_slotted_process, TX_MODE_TIMER_EVENT, NULL);
+  }
+#endif /* SLOTTED_KOORDINATOR */
+}
+
+/*----------------------------------------------------------------------------*/
+/** \brief  Compare match of a channel. The OC channel drives SLP_TR, its
+ *          pulse starts the transmission of the frame buffer.
+ */
+static void
+sim_compare_match(uint8_t channel)
+{
+  if(channel == SIM_CH_OC) {
+#ifdef JITTER_SIMULATION
+    if(oc_output_frozen) {
+      oc_output_frozen = false;
+    } else
+#endif /* JITTER_SIMULATION */
+    {
+      sim_dut_start_tx(now + HARDWARE_DELAY_NS);
+    }
+  }
+  sim_timx_irq(channel);
+  /* the channel fires again after the next overflow unless it was moved */
+  if(channel != SIM_CH_OC) {
+    sim_schedule_compare(channel);
+  }
+}
+
+/*****************************************************************************
+ * Emulated AT86RF231
+ *****************************************************************************/
+/*----------------------------------------------------------------------------*/
+static uint8_t
+sim_trx_status(void)
+{
+  return regs[RG_TRX_STATUS] & 0x1f;
+}
+
+/*----------------------------------------------------------------------------*/
+static void
+sim_set_trx_status(uint8_t status)
+{
+  regs[RG_TRX_STATUS] = (regs[RG_TRX_STATUS] & ~0x1f) | status;
+}
+
+/*----------------------------------------------------------------------------*/
+/** \brief  Raise a radio interrupt. The IRQ line is routed to the input
+ *          capture channel, which latches CNT and enters the timer ISR.
+ */
+static void
+sim_radio_irq(uint8_t mask)
+{
+  regs[RG_IRQ_STATUS] |= mask;
+  if(regs[RG_IRQ_MASK] & mask) {
+    ccr[SIM_CH_IC] = sim_counter();
+    sim_timx_irq(SIM_CH_IC);
+  }
+}
+
+/*----------------------------------------------------------------------------*/
+static void
+sim_radio_command(uint8_t cmd)
+{
+  uint8_t status = sim_trx_status();
+
+  if(!rst) {
+    return;
+  }
+  if(status == BUSY_TX || status == BUSY_TX_ARET) {
+    /* only FORCE_TRX_OFF interrupts a transmission */
+    if(cmd == CMD_FORCE_TRX_OFF) {
+      nodes[SIM_DUT].aborted = true;
+      sim_set_trx_status(TRX_OFF);
+    }
+    return;
+  }
+  switch(cmd) {
+  case CMD_FORCE_TRX_OFF:
+  case CMD_TRX_OFF:
+    nodes[SIM_DUT].rxFrom = SIM_NO_NODE;
+    sim_set_trx_status(TRX_OFF);
+    break;
+  case CMD_PLL_ON:
+  case CMD_TX_ARET_ON:
+    nodes[SIM_DUT].rxFrom = SIM_NO_NODE;
+    sim_set_trx_status(cmd == CMD_PLL_ON ? PLL_ON : TX_ARET_ON);
+    break;
+  case CMD_RX_ON:
+  case CMD_RX_AACK_ON:
+    if(status != BUSY_RX && status != BUSY_RX_AACK) {
+      sim_set_trx_status(cmd);
+    }
+    break;
+  case CMD_TX_START:
+    if(status == PLL_ON || status == TX_ARET_ON) {
+      sim_dut_start_tx(now);
+    }
+    break;
+  default:
+    break;
+  }
+}
+
+/*----------------------------------------------------------------------------*/
+/** \brief  SLP_TR pulse or TX_START command: send the frame buffer */
+static void
+sim_dut_start_tx(uint64_t time)
+{
+  uint8_t status = sim_trx_status();
+
+  if(slptr || frame_length == 0 || (status != PLL_ON && status != TX_ARET_ON)) {
+    return;
+  }
+  sim_set_trx_status(status == PLL_ON ? BUSY_TX : BUSY_TX_ARET);
+  /* an upload may still run while the SHR is sent, the frame is lost if the
+   * PHR is not in the frame buffer in time */
+  nodes[SIM_DUT].underrun = dma_writing
+    && dma_start + 2 * SIM_SPI_BYTE_NS > time + PHY_SYNCH_HEADER_NS - PHY_TIME_PER_BYTE_NS;
+  if(nodes[SIM_DUT].underrun) {
+    ++sim_stats.underruns;
+  }
+  nodes[SIM_DUT].txLength = frame_length;
+  memcpy(nodes[SIM_DUT].txData, frame_buffer, frame_length);
+  sim_schedule(time, SIM_EV_TX_START, SIM_DUT);
+}
+
+/*****************************************************************************
+ * Simulated channel
+ *****************************************************************************/
+/*----------------------------------------------------------------------------*/
+/** \brief  Place the peers. All clients start without a slot and join
+ *          through the join slot, peer i has the short address i.
+ */
+static void
+sim_setup_peers(void)
+{
+  uint8_t i;
+
+  for(i = 0; i <= sim_conf.numPeers && i < SIM_NODES; ++i) {
+    nodes[i].rxFrom = SIM_NO_NODE;
+    nodes[i].addr = i;
+    nodes[i].koordAddr = TDMA_NO_ADDR;
+    nodes[i].slot = TDMA_NO_SLOT;
+    nodes[i].channel = TDMA_HOP_CHANNEL(TDMA_CELL, 0);
+  }
+  /* same address as rf231_init() */
+  nodes[SIM_DUT].addr = ((uint16_t)uid[2] << 8) | uid[0];
+#ifndef SLOTTED_KOORDINATOR
+  for(i = 0; i < MAX_CLIENTS; ++i) {
+    sim_slots[i] = TDMA_NO_ADDR;
+  }
+  sim_grant_addr = TDMA_NO_ADDR;
+  memset(sim_acks, 0, sizeof(sim_acks));
+  sim_hop_index = TDMA_HOP_LENGTH - 1;
+#endif /* SLOTTED_KOORDINATOR */
+}
+
+/*----------------------------------------------------------------------------*/
+/** \brief  The channel a node is tuned to, only nodes on the same channel
+ *          hear and disturb each other.
+ */
+static uint8_t
+sim_channel(uint8_t node)
+{
+  if(node == SIM_DUT) {
+    return regs[RG_PHY_CC_CCA] & 0x1f;
+  }
+  return nodes[node].channel;
+}
+
+/*----------------------------------------------------------------------------*/
+/** \brief  The length field of a response of either format */
+static uint8_t
+sim_response_flags(const uint8_t *data)
+{
+  if(data[0] == RESPONSE_COMPACT_FCF_0) {
+    return data[RESPONSE_COMPACT_LENGTH_OFFSET];
+  }
+  return data[RESPONSE_PAYLOAD_LENGTH_OFFSET];
+}
+
+#ifndef SLOTTED_KOORDINATOR
+/*----------------------------------------------------------------------------*/
+/** \brief  Response received by the simulated koordinator. Join requests
+ *          get the first free slot, one grant at a time. The grant is
+ *          repeated until the client answers in its slot. A compact
+ *          response is from the owner of its slot, every response in a
+ *          slot is acknowledged in the next beacon.
+ */
+static void
+sim_koord_response(const uint8_t *data)
+{
+  uint16_t addr = ((uint16_t)data[7] << 8) | data[8];
+  uint8_t flags = sim_response_flags(data);
+  uint8_t i, slot = TDMA_NO_SLOT, free = TDMA_NO_SLOT;
+
+  if(data[0] == RESPONSE_COMPACT_FCF_0) {
+    if(data[RESPONSE_COMPACT_SLOT_OFFSET] >= MAX_CLIENTS) {
+      return;
+    }
+    addr = sim_slots[data[RESPONSE_COMPACT_SLOT_OFFSET]];
+  }
+
+  for(i = 0; i < MAX_CLIENTS; ++i) {
+    if(sim_slots[i] == addr) {
+      slot = i;
+    } else if(sim_slots[i] == TDMA_NO_ADDR && free == TDMA_NO_SLOT) {
+      free = i;
+    }
+  }
+  if(flags & RESPONSE_JOIN) {
+    if(sim_grant_addr != TDMA_NO_ADDR && sim_grant_addr != addr) {
+      return;
+    }
+    if(slot == TDMA_NO_SLOT) {
+      slot = free;
+    }
+    if(slot != TDMA_NO_SLOT) {
+      sim_slots[slot] = addr;
+      sim_grant_addr = addr;
+      sim_grant_slot = slot;
+    }
+  } else if(slot != TDMA_NO_SLOT) {
+    if(flags & RESPONSE_LEAVE) {
+      sim_slots[slot] = TDMA_NO_ADDR;
+      return;
+    }
+    sim_acks[slot / 8] |= 1 << (slot % 8);
+    if(sim_grant_addr == addr) {
+      sim_grant_addr = TDMA_NO_ADDR;
+    }
+  }
+}
+#endif /* SLOTTED_KOORDINATOR */
+
+/*----------------------------------------------------------------------------*/
+/** \brief  Frame of a peer, laid out like the frames of rf231_slotted.c */
+static void
+sim_peer_frame(uint8_t node)
+{
+  sim_node_t *n = &nodes[node];
+#ifndef SLOTTED_KOORDINATOR
+  uint8_t i, clients = 0;
+  uint16_t cycle_us, slot_us = TDMA_SLOT_NS(PAYLOAD_PER_CLIENT) / 1000;
+#endif /* SLOTTED_KOORDINATOR */
+
+  memset(n->txData, 0, sizeof(n->txData));
+#ifndef SLOTTED_KOORDINATOR
+  if(node == SIM_KOORD) {
+    for(i = 0; i < MAX_CLIENTS; ++i) {
+      if(sim_slots[i] != TDMA_NO_ADDR) {
+        clients = i + 1;
+        n->txData[BEACON_BITMAP_OFFSET + i / 8] |= 1 << (i % 8);
+      }
+    }
+    cycle_us = TDMA_CYCLE_NS(clients, PAYLOAD_PER_CLIENT) / 1000;
+    n->txLength = TDMA_BEACON_LENGTH(clients, PAYLOAD_PER_CLIENT);
+    n->txData[0] = BEACON_FCF_0;         /* fcf */
+    n->txData[1] = BEACON_FCF_1;
+    n->txData[5] = n->addr >> 8;         /* src address */
+    n->txData[6] = n->addr & 0xff;
+    n->txData[BEACON_CYCLE_TIME_OFFSET] = cycle_us & 0xff;
+    n->txData[BEACON_CYCLE_TIME_OFFSET + 1] = cycle_us >> 8;
+    n->txData[BEACON_CLIENTS_OFFSET] = clients;
+    n->txData[BEACON_SLOT_TIME_OFFSET] = slot_us & 0xff;
+    n->txData[BEACON_SLOT_TIME_OFFSET + 1] = slot_us >> 8;
+    n->txData[BEACON_PAYLOAD_PER_CLIENT_OFFSET] = PAYLOAD_PER_CLIENT;
+    n->txData[BEACON_GRANT_ADDR_OFFSET] = sim_grant_addr >> 8;
+    n->txData[BEACON_GRANT_ADDR_OFFSET + 1] = sim_grant_addr & 0xff;
+    n->txData[BEACON_GRANT_SLOT_OFFSET] =
+      sim_grant_addr == TDMA_NO_ADDR ? TDMA_NO_SLOT : sim_grant_slot;
+    /* hop on the default sequence of the cell */
+    sim_hop_index = (sim_hop_index + 1) % TDMA_HOP_LENGTH;
+    n->txData[BEACON_HOP_INDEX_OFFSET] = sim_hop_index;
+    for(i = 0; i < TDMA_HOP_LENGTH; ++i) {
+      n->txData[BEACON_HOP_SEQUENCE_OFFSET + i] = TDMA_HOP_CHANNEL(TDMA_CELL, i);
+    }
+    n->channel = TDMA_HOP_CHANNEL(TDMA_CELL, sim_hop_index);
+    memcpy(&n->txData[BEACON_ACK_BITMAP_OFFSET(clients)], sim_acks, TDMA_BITMAP_LENGTH(clients));
+    memset(sim_acks, 0, sizeof(sim_acks));
+  } else
+#endif /* SLOTTED_KOORDINATOR */
+  if(TDMA_COMPACT_RESPONSE && !n->join) {
+    n->txLength = TDMA_RESPONSE_LENGTH(n->payload);
+    n->txData[0] = RESPONSE_COMPACT_FCF_0; /* fcf */
+    n->txData[1] = RESPONSE_COMPACT_FCF_1;
+    n->txData[2] = n->sqn++;
+    n->txData[RESPONSE_COMPACT_SLOT_OFFSET] = n->slot;
+    n->txData[RESPONSE_COMPACT_LENGTH_OFFSET] = n->payload;
+    return;
+  } else {
+    n->txLength = n->join ? TDMA_JOIN_LENGTH : TDMA_RESPONSE_LENGTH(n->payload);
+    n->txData[0] = RESPONSE_FCF_0;       /* fcf */
+    n->txData[1] = RESPONSE_FCF_1;
+    n->txData[5] = n->koordAddr >> 8;    /* dst address */
+    n->txData[6] = n->koordAddr & 0xff;
+    n->txData[7] = n->addr >> 8;         /* src address */
+    n->txData[8] = n->addr & 0xff;
+    n->txData[RESPONSE_PAYLOAD_LENGTH_OFFSET] = n->join ? RESPONSE_JOIN : n->payload;
+  }
+  n->txData[2] = n->sqn++;
+  n->txData[3] = TDMA_PAN_ID_1;
+  n->txData[4] = TDMA_PAN_ID_0;
+}
+
+/*----------------------------------------------------------------------------*/
+/** \brief  Beacon received by a client, applies the grant and the slot
+ *          bitmap the same way as superframe_update() in rf231_slotted.c.
+ */
+static void
+sim_client_beacon(uint8_t receiver, const sim_node_t *f)
+{
+  sim_node_t *r = &nodes[receiver];
+  const uint8_t *data = f->txData;
+  uint8_t clients = data[BEACON_CLIENTS_OFFSET];
+  uint16_t grant_addr = ((uint16_t)data[BEACON_GRANT_ADDR_OFFSET] << 8)
+    | data[BEACON_GRANT_ADDR_OFFSET + 1];
+  uint8_t slot = r->slot;
+
+  if(grant_addr == r->addr) {
+    slot = data[BEACON_GRANT_SLOT_OFFSET];
+  } else if(grant_addr != TDMA_NO_ADDR && data[BEACON_GRANT_SLOT_OFFSET] == slot) {
+    slot = TDMA_NO_SLOT;
+  }
+  if(slot != TDMA_NO_SLOT && (slot >= clients
+     || !(data[BEACON_BITMAP_OFFSET + slot / 8] & (1 << (slot % 8))))) {
+    slot = TDMA_NO_SLOT;
+  }
+  if(slot != TDMA_NO_SLOT && r->slot == TDMA_NO_SLOT) {
+    ++sim_stats.joins;
+  }
+  r->slot = slot;
+  r->join = slot == TDMA_NO_SLOT;
+  r->koordAddr = ((uint16_t)data[5] << 8) | data[6];
+  r->payload = data[BEACON_PAYLOAD_PER_CLIENT_OFFSET];
+
+  /* the slot starts after the beacon, the client processing time and the
+   * slots before, the join slot follows the last client slot */
+  r->slotStart = r->rxStart + (uint64_t)f->txLength * PHY_TIME_PER_BYTE_NS
+    + CLIENT_PROCESSING_TIME_NS
+    + (uint64_t)(r->join ? clients : slot) * SIM_GET16(&data[BEACON_SLOT_TIME_OFFSET]) * 1000;
+
+  if(receiver != SIM_DUT && (!r->join || (sim_rand() & 1))) {
+    /* ideal client: answer at the start of its slot */
+    sim_peer_frame(receiver);
+    sim_schedule(r->slotStart, SIM_EV_TX_START, receiver);
+  }
+}
+
+/*----------------------------------------------------------------------------*/
+/** \brief  A frame transfer is complete, post the completion event like the
+ *          DMA interrupt.
+ */
+static void
+sim_dma_done(void)
+{
+  if(dma_rx_frame != NULL) {
+    process_post_isr(&dma_events, &rf231_slotted_process, FRAME_READ_EVENT, dma_rx_frame);
+    dma_rx_frame = NULL;
+  } else {
+    dma_writing = false;
+    process_post_isr(&dma_events, &rf231_slotted_process, FRAME_UPLOADED_EVENT, NULL);
+  }
+}
+
+/*----------------------------------------------------------------------------*/
+/** \brief  Start a frame transfer of length bytes after the command */
+static void
+sim_dma_start(uint8_t length)
+{
+  dma_start = now + sim_conf.dmaLatencyNs;
+  dma_end = dma_start + (2 + (uint64_t)length) * SIM_SPI_BYTE_NS;
+  sim_schedule(dma_end, SIM_EV_DMA_DONE, 0);
+}
+
+/*----------------------------------------------------------------------------*/
+/** \brief  The HAL waits for a running transfer before it starts the next one,
+ *          finish it immediately.
+ */
+static void
+sim_dma_wait(void)
+{
+  if(dma_end > now) {
+    sim_unschedule(SIM_EV_DMA_DONE, 0);
+    dma_end = now;
+    sim_dma_done();
+  }
+}
+
+/*----------------------------------------------------------------------------*/
+static void
+sim_rx_start(uint8_t receiver, uint8_t from)
+{
+  sim_node_t *r = &nodes[receiver];
+  uint8_t status = 0;
+
+  if(sim_channel(receiver) != sim_channel(from)) {
+    return;
+  }
+  if(r->rxFrom != SIM_NO_NODE) {
+    /* a second frame on air destroys the current reception */
+    if(!r->rxCorrupt) {
+      ++sim_stats.collisions;
+    }
+    r->rxCorrupt = true;
+    return;
+  }
+  if(receiver == SIM_DUT) {
+    status = sim_trx_status();
+    if(slptr || (status != RX_ON && status != RX_AACK_ON)) {
+      return;
+    }
+  } else if(r->tx) {
+    return;
+  }
+  if(sim_frame_lost()) {
+    return;
+  }
+  r->rxFrom = from;
+  r->rxCorrupt = false;
+  if(from == SIM_KOORD) {
+    r->rxStart = now;
+  }
+  if(receiver == SIM_DUT) {
+    sim_set_trx_status(status == RX_ON ? BUSY_RX : BUSY_RX_AACK);
+    sim_radio_irq(HAL_RX_START_MASK);
+  }
+}
+
+/*----------------------------------------------------------------------------*/
+static void
+sim_rx_end(uint8_t receiver, uint8_t from)
+{
+  sim_node_t *r = &nodes[receiver];
+  sim_node_t *f = &nodes[from];
+  bool ok;
+
+  if(r->rxFrom != from) {
+    return;
+  }
+  r->rxFrom = SIM_NO_NODE;
+  ok = !r->rxCorrupt && !f->aborted && !f->underrun;
+
+  if(receiver == SIM_DUT) {
+    if(sim_trx_status() == BUSY_RX || sim_trx_status() == BUSY_RX_AACK) {
+      sim_set_trx_status(sim_trx_status() == BUSY_RX ? RX_ON : RX_AACK_ON);
+    } else {
+      /* the driver changed the state while receiving */
+      ok = false;
+    }
+    if(ok) {
+      memcpy(frame_buffer, f->txData, f->txLength);
+      frame_length = f->txLength;
+      sim_radio_irq(HAL_TRX_END_MASK);
+    }
+  }
+  if(!ok) {
+    return;
+  }
+  if(from == SIM_KOORD) {
+    r->gotBeacon = true;
+    sim_client_beacon(receiver, f);
+  } else if(receiver == SIM_KOORD) {
+    if(!(sim_response_flags(f->txData) & RESPONSE_JOIN)) {
+      ++sim_stats.slotsUsed;
+    }
+#ifndef SLOTTED_KOORDINATOR
+    sim_koord_response(f->txData);
+#endif /* SLOTTED_KOORDINATOR */
+  }
+}
+
+/*----------------------------------------------------------------------------*/
+static void
+sim_measure_dut_tx(void)
+{
+  uint64_t err;
+
+#ifndef SLOTTED_KOORDINATOR
+  if(sim_response_flags(nodes[SIM_DUT].txData) & RESPONSE_JOIN) {
+    /* join requests are sent at random, there is no period to measure */
+    last_dut_tx = 0;
+    return;
+  }
+#endif /* SLOTTED_KOORDINATOR */
+  if(last_dut_tx) {
+    err = now - last_dut_tx;
+    err = err > prev_cycle_ns ? err - prev_cycle_ns : prev_cycle_ns - err;
+    ++sim_stats.periodSamples;
+    sim_stats.periodErrSum += err;
+    if(err > sim_stats.periodErrMax) {
+      sim_stats.periodErrMax = err;
+    }
+  }
+  last_dut_tx = now;
+#ifndef SLOTTED_KOORDINATOR
+  if(nodes[SIM_DUT].slotStart) {
+    err = nodes[SIM_DUT].slotStart;
+    err = now > err ? now - err : err - now;
+    ++sim_stats.slotSamples;
+    sim_stats.slotErrSum += err;
+    if(err > sim_stats.slotErrMax) {
+      sim_stats.slotErrMax = err;
+    }
+  }
+#endif /* SLOTTED_KOORDINATOR */
+}
+
+/*----------------------------------------------------------------------------*/
+static void
+sim_tx_start(uint8_t node)
+{
+  sim_node_t *n = &nodes[node];
+  uint64_t next;
+  int32_t jitter;
+  uint8_t i;
+
+#ifndef SLOTTED_KOORDINATOR
+  if(node == SIM_KOORD) {
+    /* the beacon carries the slots granted up to now */
+    sim_peer_frame(SIM_KOORD);
+  }
+#endif /* SLOTTED_KOORDINATOR */
+  n->tx = true;
+  n->aborted = false;
+  n->txStart = now;
+  if(node == SIM_KOORD) {
+    prev_cycle_ns = cycle_ns;
+    cycle_ns = SIM_GET16(&n->txData[BEACON_CYCLE_TIME_OFFSET]) * 1000ULL;
+    /* ideal peers know the hop sequence once they received a beacon */
+    for(i = 0; i <= sim_conf.numPeers && i < SIM_NODES; ++i) {
+      if(i != SIM_DUT && i != SIM_KOORD && nodes[i].koordAddr != TDMA_NO_ADDR) {
+        nodes[i].channel = sim_channel(SIM_KOORD);
+      }
+    }
+#ifndef SLOTTED_KOORDINATOR
+    /* the slot of the DUT follows this beacon, also if the DUT misses it */
+    if(!nodes[SIM_DUT].join && nodes[SIM_DUT].slot != TDMA_NO_SLOT) {
+      nodes[SIM_DUT].slotStart = now + SIM_FRAME_NS(n->txLength) + CLIENT_PROCESSING_TIME_NS
+	+ (uint64_t)nodes[SIM_DUT].slot * SIM_GET16(&n->txData[BEACON_SLOT_TIME_OFFSET]) * 1000;
+    }
+#endif /* SLOTTED_KOORDINATOR */
+  }
+  sim_schedule(now + PHY_SYNCH_HEADER_NS, SIM_EV_RX_START, node);
+  sim_schedule(now + SIM_FRAME_NS(n->txLength), SIM_EV_TX_END, node);
+
+  if(node == SIM_DUT) {
+    sim_measure_dut_tx();
+  }
+#ifndef SLOTTED_KOORDINATOR
+  if(node == SIM_KOORD) {
+    /* the simulated coordinator keeps its own, jittered period */
+    next = now + cycle_ns;
+    if(sim_conf.jitterNs) {
+      jitter = sim_rand() % (2 * sim_conf.jitterNs + 1);
+      next += jitter - (int32_t)sim_conf.jitterNs;
+    }
+    sim_schedule(next, SIM_EV_TX_START, SIM_KOORD);
+  }
+#else
+  (void)next;
+  (void)jitter;
+#endif /* SLOTTED_KOORDINATOR */
+}
+
+/*----------------------------------------------------------------------------*/
+static void
+sim_tx_end(uint8_t node)
+{
+  uint8_t i;
+
+  nodes[node].tx = false;
+  if(node == SIM_DUT && !nodes[SIM_DUT].aborted) {
+    sim_set_trx_status(sim_trx_status() == BUSY_TX ? PLL_ON : TX_ARET_ON);
+    sim_radio_irq(HAL_TRX_END_MASK);
+  }
+  for(i = 0; i <= sim_conf.numPeers && i < SIM_NODES; ++i) {
+    if(i != node) {
+      sim_rx_end(i, node);
+    }
+  }
+  if(node == SIM_KOORD) {
+    ++sim_stats.cycles;
+    sim_stats.slotsTotal += nodes[SIM_KOORD].txData[BEACON_CLIENTS_OFFSET];
+    for(i = 0; i <= sim_conf.numPeers && i < SIM_NODES; ++i) {
+      if(i != SIM_KOORD) {
+        if(!nodes[i].gotBeacon) {
+          ++sim_stats.beaconsMissed;
+        }
+        nodes[i].gotBeacon = false;
+      }
+    }
+  }
+}
+
+/*----------------------------------------------------------------------------*/
+static void
+sim_rx_start_all(uint8_t from)
+{
+  uint8_t i;
+
+  for(i = 0; i <= sim_conf.numPeers && i < SIM_NODES; ++i) {
+    if(i == from) {
+      continue;
+    }
+    /* peer clients only listen to the coordinator */
+    if(i != SIM_DUT && i != SIM_KOORD && from != SIM_KOORD) {
+      continue;
+    }
+    sim_rx_start(i, from);
+  }
+}
+
+/*----------------------------------------------------------------------------*/
+static bool
+sim_dispatch(void)
+{
+  sim_event_t ev;
+
+  if(nevents == 0) {
+    return false;
+  }
+  ev = events[--nevents];
+  now = ev.time;
+  ++sim_stats.events;
+
+  switch(ev.type) {
+  case SIM_EV_COMPARE:
+    sim_compare_match(ev.node);
+    break;
+  case SIM_EV_TX_START:
+    sim_tx_start(ev.node);
+    break;
+  case SIM_EV_RX_START:
+    sim_rx_start_all(ev.node);
+    break;
+  case SIM_EV_TX_END:
+    sim_tx_end(ev.node);
+    break;
+  case SIM_EV_DMA_DONE:
+    sim_dma_done();
+    break;
+  }
+  return true;
+}
+
+/*****************************************************************************
+ * Simulation control
+ *****************************************************************************/
+/*----------------------------------------------------------------------------*/
+/**
+ * \brief  Change the simulation parameters. May be called at any time, the
+ *         node id of the DUT is fixed at compile time (RF231_SIM_CONF_NODE_ID)
+ *         since rf231_init() derives the client address from it.
+ */
+void
+rf231_sim_configure(const rf231_sim_conf_t *conf)
+{
+  sim_conf = *conf;
+  if(sim_conf.numPeers > RF231_SIM_MAX_PEERS) {
+    sim_conf.numPeers = RF231_SIM_MAX_PEERS;
+  }
+  prng = sim_conf.seed ? sim_conf.seed : 1;
+  sim_setup_peers();
+  sim_schedule_compares();
+}
+
+/*----------------------------------------------------------------------------*/
+/**
+ * \brief  Run the simulation for a number of beacon cycles.
+ *
+ *         Events are dispatched in time order. After each one the Contiki
+ *         processes run until no event is pending, so the driver takes no
+ *         simulated time. Must be called from a process; processes other
+ *         than the radio process should not keep themselves polled.
+ *
+ * \return The number of cycles simulated
+ */
+uint32_t
+rf231_sim_run(uint32_t cycles)
+{
+  struct process *caller = process_current;
+  uint32_t start = sim_stats.cycles;
+
+  while(process_run() > 0);
+  while(sim_stats.cycles - start < cycles && sim_dispatch()) {
+    while(process_run() > 0);
+  }
+  process_current = caller;
+  return sim_stats.cycles - start;
+}
+
+/*----------------------------------------------------------------------------*/
+uint64_t
+rf231_sim_now(void)
+{
+  return now;
+}
+
+/*----------------------------------------------------------------------------*/
+const rf231_sim_stats_t *
+rf231_sim_get_stats(void)
+{
+  return &sim_stats;
+}
+
+/*----------------------------------------------------------------------------*/
+void
+rf231_sim_clear_stats(void)
+{
+  memset(&sim_stats, 0, sizeof(sim_stats));
+  last_dut_tx = 0;
+}
+
+/*****************************************************************************
+ * HAL API
+ *****************************************************************************/
+/*----------------------------------------------------------------------------*/
+/** \brief  This function reads data from one of the radio transceiver's
+ *          registers. Reading IRQ_STATUS clears it.
+ */
+uint8_t
+hal_register_read(uint8_t address)
+{
+  uint8_t register_value;
+
+  address &= 0x3f;
+  register_value = regs[address];
+  if(address == RG_IRQ_STATUS) {
+    regs[RG_IRQ_STATUS] = 0;
+  }
+  return register_value;
+}
+
+/*----------------------------------------------------------------------------*/
+/** \brief  This function writes a new value to one of the radio transceiver's
+ *          registers. Writes to TRX_STATE execute the state command.
+ */
+void
+hal_register_write(uint8_t address, uint8_t value)
+{
+  address &= 0x3f;
+  if(address == RG_TRX_STATUS || address == RG_IRQ_STATUS
+     || address == RG_VERSION_NUM || address == RG_MAN_ID_0) {
+    return;
+  }
+  regs[address] = value;
+  if(address == RG_TRX_STATE) {
+    sim_radio_command(value & 0x1f);
+  }
+}
+
+/*----------------------------------------------------------------------------*/
+uint8_t
+hal_subregister_read(uint8_t address, uint8_t mask, uint8_t position)
+{
+  return (hal_register_read(address) & mask) >> position;
+}
+
+/*----------------------------------------------------------------------------*/
+void
+hal_subregister_write(uint8_t address, uint8_t mask, uint8_t position,
+		      uint8_t value)
+{
+  uint8_t register_value = regs[address & 0x3f] & ~mask;
+
+  value <<= position;
+  value &= mask;
+  hal_register_write(address, value | register_value);
+}
+
+/*----------------------------------------------------------------------------*/
+/** \brief  Transfer a frame from the emulated frame buffer to a RAM buffer
+ *
+ *  If the frame length is out of the defined bounds, the length, lqi and crc
+ *  are set to zero.
+ */
+void
+hal_frame_read(hal_rx_frame_t *rx_frame)
+{
+  if(frame_length >= HAL_MIN_FRAME_LENGTH && frame_length <= HAL_MAX_FRAME_LENGTH
+     && frame_length <= sizeof(rx_frame->data)) {
+    memcpy(rx_frame->data, frame_buffer, frame_length);
+    rx_frame->length = frame_length;
+    rx_frame->lqi = 0xff;
+    rx_frame->crc = true;
+  } else {
+    rx_frame->length = 0;
+    rx_frame->lqi = 0;
+    rx_frame->crc = false;
+  }
+}
+
+/*----------------------------------------------------------------------------*/
+/** \brief  This function will download a frame to the emulated frame buffer.
+ */
+void
+hal_frame_write(uint8_t *write_buffer, uint8_t length)
+{
+#if RF231_SPI_DMA
+  sim_dma_wait();
+#endif /* RF231_SPI_DMA */
+  if(length > HAL_MAX_FRAME_LENGTH) {
+    length = HAL_MAX_FRAME_LENGTH;
+  }
+  memcpy(frame_buffer, write_buffer, length);
+  frame_length = length;
+}
+
+/*----------------------------------------------------------------------------*/
+/** \brief  Download a frame from a header and a payload buffer, the FCS is
+ *          left zero.
+ */
+void
+hal_frame_write_split(uint8_t *header, uint8_t header_length,
+		      const uint8_t *payload, uint8_t payload_length)
+{
+  if(header_length + payload_length + 2 > HAL_MAX_FRAME_LENGTH) {
+    payload_length = HAL_MAX_FRAME_LENGTH - 2 - header_length;
+  }
+  memcpy(frame_buffer, header, header_length);
+  memcpy(&frame_buffer[header_length], payload, payload_length);
+  frame_length = header_length + payload_length + 2;
+  frame_buffer[frame_length - 2] = 0;
+  frame_buffer[frame_length - 1] = 0;
+}
+
+/*----------------------------------------------------------------------------*/
+/** \brief  Read the frame buffer, FRAME_READ_EVENT follows after the modelled
+ *          transfer time.
+ */
+void
+hal_frame_read_async(hal_rx_frame_t *rx_frame)
+{
+#if RF231_SPI_DMA
+  sim_dma_wait();
+#endif /* RF231_SPI_DMA */
+  hal_frame_read(rx_frame);
+#if RF231_SPI_DMA
+  dma_rx_frame = rx_frame;
+  dma_writing = false;
+  sim_dma_start(rx_frame->length + 1);
+#else /* RF231_SPI_DMA */
+  process_post(&rf231_slotted_process, FRAME_READ_EVENT, rx_frame);
+#endif /* RF231_SPI_DMA */
+}
+
+/*----------------------------------------------------------------------------*/
+/** \brief  Write the frame buffer, FRAME_UPLOADED_EVENT follows after the
+ *          modelled transfer time.
+ */
+void
+hal_frame_write_async(uint8_t *header, uint8_t header_length,
+		      const uint8_t *payload, uint8_t payload_length)
+{
+#if RF231_SPI_DMA
+  sim_dma_wait();
+#endif /* RF231_SPI_DMA */
+  hal_frame_write_split(header, header_length, payload, payload_length);
+#if RF231_SPI_DMA
+  dma_rx_frame = NULL;
+  dma_writing = true;
+  sim_dma_start(header_length + payload_length);
+#else /* RF231_SPI_DMA */
+  process_post(&rf231_slotted_process, FRAME_UPLOADED_EVENT, NULL);
+#endif /* RF231_SPI_DMA */
+}
+
+/*----------------------------------------------------------------------------*/
+void
+hal_native_set_slptr(uint8_t level)
+{
+  slptr = level;
+}
+
+/*----------------------------------------------------------------------------*/
+uint8_t
+hal_native_get_slptr(void)
+{
+  return slptr;
+}
+
+/*----------------------------------------------------------------------------*/
+void
+hal_native_set_rst(uint8_t level)
+{
+  if(!rst && level) {
+    /* leaving reset: P_ON */
+    sim_set_trx_status(P_ON);
+  }
+  rst = level;
+}
+
+/*----------------------------------------------------------------------------*/
+uint8_t
+hal_native_get_rst(void)
+{
+  return rst;
+}
+
+/*----------------------------------------------------------------------------*/
+uint8_t
+hal_native_get_uid_byte(uint8_t n)
+{
+  return n < sizeof(uid) ? uid[n] : 0;
+}
+
+/*----------------------------------------------------------------------------*/
+void
+hal_set_oc(uint32_t oc_value)
+{
+  ccr[SIM_CH_OC] = oc_value;
+  sim_schedule_compare(SIM_CH_OC);
+}
+
+/*----------------------------------------------------------------------------*/
+void
+hal_update_oc(uint32_t oc_value)
+{
+  hal_set_oc(ccr[SIM_CH_OC] + oc_value);
+}
+
+/*----------------------------------------------------------------------------*/
+void
+hal_set_period(uint32_t ticks)
+{
+  period = ticks;
+}
+
+/*----------------------------------------------------------------------------*/
+uint32_t
+hal_get_oc(void)
+{
+  return ccr[SIM_CH_OC];
+}
+
+/*--------------------------------------------------------------------------*/
+/**
+ * Initialise the emulated hardware and the simulated channel
+ */
+int
+hal_init(void)
+{
+  process_isr_queue_register(&timx_events);
+  process_isr_queue_register(&dma_events);
+  memset(regs, 0, sizeof(regs));
+  memset(ccr, 0, sizeof(ccr));
+  memset(nodes, 0, sizeof(nodes));
+  nevents = 0;
+  now = 0;
+  frame_length = 0;
+  slptr = 0;
+  rst = 0;
+  counter_enabled = false;
+  counter_frozen = 0;
+  counter_base = 0;
+  period = TDMA_PERIOD_TICKS;
+  cycle_ns = 0;
+  prev_cycle_ns = 0;
+  dma_rx_frame = NULL;
+  dma_writing = false;
+  dma_end = 0;
+  nodes[SIM_DUT].rxFrom = SIM_NO_NODE;
+
+  regs[RG_VERSION_NUM] = RF230_REVB;
+  regs[RG_MAN_ID_0] = SUPPORTED_MANUFACTURER_ID;
+  regs[RG_PHY_CC_CCA] = 0x20 | TDMA_CHANNEL_MIN;   /* reset value */
+
+  rf231_sim_clear_stats();
+  rf231_sim_configure(&sim_conf);
+
+#ifndef SLOTTED_KOORDINATOR
+  /* the simulated coordinator starts beaconing after one period */
+  sim_schedule(TDMA_PERIOD_NS, SIM_EV_TX_START, SIM_KOORD);
+#endif /* SLOTTED_KOORDINATOR */
+
+  ioboard_init();
+  ioboard_leds_off(0xff);
+
+  return 1;
+}
+
+/*---------------------------------------------------------------*/
+int
+hal_start_counter()
+{
+  if(!counter_enabled) {
+    counter_base = now - sim_ticks_to_ns(counter_frozen);
+    counter_enabled = true;
+    sim_schedule_compares();
+  }
+  return 1;
+}
+
+/*---------------------------------------------------------------*/
+int
+hal_stop_counter()
+{
+  counter_frozen = sim_counter();
+  counter_enabled = false;
+  sim_schedule_compares();
+  return 1;
+}
+
+/*---------------------------------------------------------------*/
+int
+hal_reset_counter()
+{
+  hal_stop_counter();
+  counter_frozen = 0;
+  hal_start_counter();
+  return 1;
+}
+
+/*---------------------------------------------------------------*/
+int
+hal_set_TX_Timer(uint32_t time)
+{
+  hal_set_oc(time);
+  return 1;
+}
+
+/*---------------------------------------------------------------*/
+int
+hal_update_TX_Timer(uint32_t time)
+{
+  hal_update_oc(time);
+  return 1;
+}
+
+/*---------------------------------------------------------------*/
+int
+hal_set_TX_Mode_Timer(uint32_t time)
+{
+  ccr[SIM_CH_TX_MODE] = time;
+  sim_schedule_compare(SIM_CH_TX_MODE);
+  return 1;
+}
+
+/*---------------------------------------------------------------*/
+int
+hal_update_TX_Mode_Timer(uint32_t time)
+{
+  return hal_set_TX_Mode_Timer(ccr[SIM_CH_TX_MODE] + time);
+}
+
+/*---------------------------------------------------------------*/
+int
+hal_set_Beacon_Missed_Timer(uint32_t time)
+{
+  ccr[SIM_CH_BEACON_MISSED] = time;
+  sim_schedule_compare(SIM_CH_BEACON_MISSED);
+  return 1;
+}
+
+/*---------------------------------------------------------------*/
+int
+hal_update_Beacon_Missed_Timer(uint32_t time)
+{
+  return hal_set_Beacon_Missed_Timer(ccr[SIM_CH_BEACON_MISSED] + time);
+}
+
+/*****************************************************************************
+ * IO-Board
+ *****************************************************************************/
+/*---------------------------------------------------------------------------*/
+void
+ioboard_init(void)
+{
+  ioboard_leds = 0xff;
+}
+
+unsigned char
+ioboard_leds_get(void)
+{
+  return ioboard_leds;
+}
+
+void
+ioboard_leds_set(unsigned char leds)
+{
+  ioboard_leds_on(leds);
+  ioboard_leds_off(~leds);
+}
+
+/* LEDs are low active like on the IO-Board */
+void
+ioboard_leds_on(unsigned char leds)
+{
+  ioboard_leds &= ~leds;
+}
+
+void
+ioboard_leds_off(unsigned char leds)
+{
+  ioboard_leds |= leds;
+}
+
+void
+ioboard_leds_toggle(unsigned char leds)
+{
+  ioboard_leds ^= leds;
+}
+
+unsigned char
+ioboard_buttons_get(void)
+{
+  return 0;
+}
@@ -0,0 +1,133 @@
+/*
+ * Copyright (c) 2012, TU Dortmund University.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following
+ *    disclaimer in the documentation and/or other materials provided
+ *    with the distribution.
+ * 3. The name of the author may not be used to endorse or promote
+ *    products derived from this software without specific prior
+ *    written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS
+ * OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+ * GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * This file is part of the Contiki OS
+ *
+ */
+/*---------------------------------------------------------------------------*/
+/**
+ * \file    Control interface of the native discrete event backend of the
+ *          rf231 slotted HAL
+ *
+ *          On the native platform rf231_slotted_hal_native.c replaces the
+ *          STM32 HAL. The radio, its SPI register file and frame buffer and
+ *          the TIMx capture/compare channels are emulated against a
+ *          simulated clock, so rf231_slotted_process runs unmodified. The
+ *          node under test (DUT) shares a simulated channel with a number of
+ *          scripted peers:
+ *
+ *          - SLOTTED_KOORDINATOR build: the DUT sends the beacons and the
+ *            peers are clients answering in their slots.
+ *          - client build: the first peer is the coordinator sending beacons, the
+ *            remaining peers are clients like the DUT.
+ *
+ *          All clients start without a slot and join through the join slot,
+ *          a client granted a slot keeps it for the rest of the run.
+ */
+/*---------------------------------------------------------------------------*/
+#ifndef RF231_SLOTTED_SIM_H
+#define RF231_SLOTTED_SIM_H
+
+/*============================ INCLUDE =======================================*/
+#include <stdint.h>
+
+/*============================ MACROS ========================================*/
+#ifdef RF231_SIM_CONF_PEERS
+#define RF231_SIM_PEERS               RF231_SIM_CONF_PEERS
+#else
+#define RF231_SIM_PEERS               3
+#endif /* RF231_SIM_CONF_PEERS */
+
+#ifdef RF231_SIM_CONF_MAX_PEERS
+#define RF231_SIM_MAX_PEERS           RF231_SIM_CONF_MAX_PEERS
+#else
+#define RF231_SIM_MAX_PEERS           32
+#endif /* RF231_SIM_CONF_MAX_PEERS */
+
+#ifdef RF231_SIM_CONF_NODE_ID
+#define RF231_SIM_NODE_ID             RF231_SIM_CONF_NODE_ID
+#else
+#define RF231_SIM_NODE_ID             0x3c  /**< byte 0 of the DUT unique id,
+					       low byte of the client address */
+#endif /* RF231_SIM_CONF_NODE_ID */
+
+/*============================ TYPE DEFS =====================================*/
+/**
+ * Parameters of a simulation run. All times are in ns of the simulated
+ * (true) time, rates are fractions of 65536.
+ */
+typedef struct{
+  uint8_t  numPeers;               /**< number of scripted nodes sharing the
+				        channel with the DUT */
+  uint16_t lossRate;               /**< probability that a receiver misses
+				        a frame (x/65536) */
+  int32_t  driftPpm;               /**< drift of the DUT crystal in ppm */
+  uint32_t jitterNs;               /**< max. jitter of the simulated
+				        coordinator beacons (client build) */
+  uint32_t seed;                   /**< seed of the simulation PRNG */
+  uint32_t dmaLatencyNs;           /**< delay until a SPI DMA frame transfer
+				        starts, the transfer itself takes
+				        1.5 us per byte */
+}rf231_sim_conf_t;
+
+/**
+ * Statistics collected while the simulation runs. A cycle is one beacon
+ * on the channel.
+ */
+typedef struct{
+  uint32_t cycles;                 /**< beacons sent */
+  uint32_t beaconsMissed;          /**< beacons not received by a listening
+				        client (DUT and peers) */
+  uint32_t slotsTotal;             /**< response slots offered */
+  uint32_t slotsUsed;              /**< responses received by the
+				        coordinator, join requests excluded */
+  uint32_t joins;                  /**< slots granted to clients */
+  uint32_t collisions;             /**< frames destroyed by overlapping
+				        transmissions */
+  uint32_t periodSamples;          /**< number of measured DUT periods */
+  uint64_t periodErrSum;           /**< sum of |period - TDMA_PERIOD| in ns */
+  uint32_t periodErrMax;           /**< max. |period - TDMA_PERIOD| in ns */
+  uint32_t slotSamples;            /**< number of measured DUT responses */
+  uint64_t slotErrSum;             /**< sum of |response start - slot start|
+				        in ns */
+  uint32_t slotErrMax;             /**< max. |response start - slot start|
+				        in ns */
+  uint32_t underruns;              /**< DUT frames sent before the upload
+				        was far enough */
+  uint32_t events;                 /**< discrete events dispatched */
+}rf231_sim_stats_t;
+
+/*============================ PROTOTYPES ====================================*/
+void rf231_sim_configure(const rf231_sim_conf_t *conf);
+uint32_t rf231_sim_run(uint32_t cycles);
+uint64_t rf231_sim_now(void);
+const rf231_sim_stats_t *rf231_sim_get_stats(void);
+void rf231_sim_clear_stats(void);
+
+#endif /* RF231_SLOTTED_SIM_H */
@@ -171,22 +171,23 @@ frame_tx_create(frame_create_params_t *p,frame_result_t *frame_result)
 
     /* OK, now we have field lengths.  Time to actually construct */
     /* the outgoing frame, and store it in tx_frame_buffer */
-    *(uint16_t *)tx_frame_buffer  = p->fcf.word_val; /* FCF */
+    tx_frame_buffer[0] = p->fcf.word_val & 0xff; /* FCF, see FRAME_GET_FCF() */
+    tx_frame_buffer[1] = p->fcf.word_val >> 8;
     index = 2;
     tx_frame_buffer[index++] = p->seq;           /* sequence number */
     /* Destination PAN ID */
     if (flen.dest_pid_len == 2){
-      *(uint16_t *)&tx_frame_buffer[index] = p->dest_pid;
+      memcpy(&tx_frame_buffer[index], &p->dest_pid, 2);
       index += 2;
     }
     /* Destination address */
     switch (flen.dest_addr_len){
     case 2:    /* two-byte address */
-      *(uint16_t *)&tx_frame_buffer[index] = p->dest_addr.addr16;
+      memcpy(&tx_frame_buffer[index], &p->dest_addr.addr16, 2);
       index += 2;
       break;
     case 8:    /* 8-byte address */
-      *(uint64_t *)&tx_frame_buffer[index] = p->dest_addr.addr64;
+      memcpy(&tx_frame_buffer[index], &p->dest_addr.addr64, 8);
       index += 8;
       break;
     case 0:
@@ -195,17 +196,17 @@ frame_tx_create(frame_create_params_t *p,frame_result_t *frame_result)
     }
     /* Source PAN ID */
     if (flen.src_pid_len == 2){
-      *(uint16_t *)&tx_frame_buffer[index] = p->src_pid;
+      memcpy(&tx_frame_buffer[index], &p->src_pid, 2);
       index += 2;
     }
     /* Source address */
     switch (flen.src_addr_len){
     case 2:    /* two-byte address */
-      *(uint16_t *)&tx_frame_buffer[index] = p->src_addr.addr16;
+      memcpy(&tx_frame_buffer[index], &p->src_addr.addr16, 2);
       index += 2;
       break;
     case 8:    /* 8-byte address */
-      *(uint64_t *)&tx_frame_buffer[index] = p->src_addr.addr64;
+      memcpy(&tx_frame_buffer[index], &p->src_addr.addr64, 8);
       index += 8;
       break;
     case 0:
@@ -230,6 +231,14 @@ frame_tx_create(frame_create_params_t *p,frame_result_t *frame_result)
     (char *)&p->bhdr.maxClients,
     1);
     index += 1;
+    memcpy((char *)&tx_frame_buffer[index],
+    (char *)&p->bhdr.slotTime,
+    2);
+    index += 2;
+    memcpy((char *)&tx_frame_buffer[index],
+    (char *)&p->bhdr.payloadPerClient,
+    1);
+    index += 1;
 #else
     /* /\* client append the response header *\/ */
     /* memcpy((char *)&tx_frame_buffer[index], */
@@ -249,19 +258,136 @@ frame_tx_create(frame_create_params_t *p,frame_result_t *frame_result)
     return;
 }
 
+/*----------------------------------------------------------------------------*/
+/**
+ *   \brief Writes the header of a compact response. The slot replaces the
+ *   PAN ID and the addresses of a response.
+ *
+ *   \param buffer The header, RESPONSE_COMPACT_PAYLOAD_OFFSET bytes.
+ *   \param seq The sequence number, changed for new data only.
+ *   \param slot The slot the response is sent in.
+ *   \param flags The payload length and the RESPONSE_LEAVE flag.
+ *
+ *   \return The header length.
+*/
+uint8_t
+frame_compact_response_create(uint8_t *buffer, uint8_t seq, uint8_t slot,
+			      uint8_t flags)
+{
+    buffer[0] = RESPONSE_COMPACT_FCF_0;        /* fcf */
+    buffer[1] = RESPONSE_COMPACT_FCF_1;
+    buffer[2] = seq;
+    buffer[RESPONSE_COMPACT_SLOT_OFFSET] = slot;
+    buffer[RESPONSE_COMPACT_LENGTH_OFFSET] = flags;
+    return RESPONSE_COMPACT_PAYLOAD_OFFSET;
+}
+
+/*----------------------------------------------------------------------------*/
+/**
+ *   \brief Parses a client response of either format. The addressed
+ *   response carries the length field first, the compact response the
+ *   slot and the length field.
+ *
+ *   \param pf The frame parsed by rx_frame_parse().
+ *   \param r The response, the payload points into the received frame.
+ *
+ *   \return true if the frame is a complete response.
+*/
+bool
+frame_response_parse(parsed_frame_t *pf, response_t *r)
+{
+    uint8_t header;
+
+    if (pf->fcf.frameType != RESPONSE_FRAME_TYPE || pf->payload_length < 1){
+      return false;
+    }
+    if (pf->fcf.srcAddrMode == SHORTADDRMODE){
+      r->addr = FRAME_GET16(pf->src_addr);
+      r->slot = TDMA_NO_SLOT;
+      r->flags = pf->payload[0];
+      header = 1;
+    } else if (pf->fcf.srcAddrMode == NOADDRMODE && pf->payload_length >= 2){
+      r->addr = TDMA_NO_ADDR;
+      r->slot = pf->payload[0];
+      r->flags = pf->payload[1];
+      header = 2;
+    } else {
+      return false;
+    }
+    r->seq = *pf->seqNum;
+    r->payload = pf->payload + header;
+    r->payload_length = (r->flags & RESPONSE_JOIN) ? 0 : r->flags & RESPONSE_LENGTH_MASK;
+    return pf->payload_length >= header + r->payload_length;
+}
+
 /*----------------------------------------------------------------------------*/
 /**
  *   \brief Parses an input frame.  Scans the input frame to find each
  *   section, and stores the resulting addresses of each section in a
- *   parsed_frame_t structure.
+ *   parsed_frame_t structure.  Only the FCF is copied, the pointers are
+ *   only valid as long as rx_frame is not reused.  The data of rx_frame
+ *   is not aligned, the fields are read byte by byte.
  *
  *   \param rx_frame The input data from the radio chip.
  *   \param pf The parsed_frame_t struct that stores a pointer to each
  *   section of the frame payload.
+ *
+ *   \return true if the frame holds all fields its FCF announces and the
+ *   fcs.  Frames with security enabled are not supported.
  */
-void rx_frame_parse(hal_rx_frame_t *rx_frame, parsed_frame_t *pf)
+bool
+rx_frame_parse(hal_rx_frame_t *rx_frame, parsed_frame_t *pf)
 {
-  /* TODO */
+    /* Pointer to start of AT86RF2xx frame */
+    uint8_t *p = rx_frame->data;
+    fcf_t *fcf = &pf->fcf;
+
+    if (rx_frame->length < FIXEDFRAMEOVERHEAD){
+      return false;
+    }
+    fcf->word_val = FRAME_GET_FCF(p);
+    if (fcf->securityEnabled){
+      return false;
+    }
+    pf->seqNum = p + 2;
+    p += 3;                             /* Skip first three bytes */
+
+    /* Destination PAN ID and address */
+    pf->dest_pid = NULL;
+    pf->dest_addr = NULL;
+    if (fcf->destAddrMode == SHORTADDRMODE || fcf->destAddrMode == LONGADDRMODE){
+      pf->dest_pid = p;
+      p += 2;
+      pf->dest_addr = p;
+      p += (fcf->destAddrMode == SHORTADDRMODE) ? 2 : 8;
+    }
+    /* Source PAN ID and address */
+    pf->src_pid = NULL;
+    pf->src_addr = NULL;
+    if (fcf->srcAddrMode == SHORTADDRMODE || fcf->srcAddrMode == LONGADDRMODE){
+      if (fcf->panIdCompression){
+	pf->src_pid = pf->dest_pid;
+      } else {
+	pf->src_pid = p;
+	p += 2;
+      }
+      pf->src_addr = p;
+      p += (fcf->srcAddrMode == SHORTADDRMODE) ? 2 : 8;
+    }
+    /* aux security header, not supported */
+    pf->aux_sec_hdr = NULL;
+
+    /* payload up to the fcs */
+    if (p + 2 > rx_frame->data + rx_frame->length){
+      return false;
+    }
+    pf->payload = p;
+    pf->payload_length = rx_frame->length - (p - rx_frame->data) - 2;
+
+    pf->lqi = rx_frame->lqi;
+    pf->fcs = rx_frame->crc;
+    pf->in_use = true;
+    return true;
 }
 
 /** \}   */
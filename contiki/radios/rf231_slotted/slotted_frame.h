@@ -66,28 +66,44 @@
 #define BEACON_FRAME_TYPE             (5)
 #define RESPONSE_FRAME_TYPE           (6)
 #define TDMA_FRAME_VERSION            (1)
+#define NOADDRMODE                    (0)
 #define SHORTADDRMODE                 (2)
+#define LONGADDRMODE                  (3)
 
 
 /**
  * \brief Defines the bitfields of the frame control field (FCF).
+ *
+ * The TDMA frames write each FCF byte with the first field of 802.15.4
+ * in the most significant bits, e.g. 0xa0 0x06 for a beacon. The
+ * bitfields are declared in this order, so word_val holds the FCF bytes
+ * as a little endian word (bitfields allocated from the least significant
+ * bit like gcc does on ARM and x86), see FRAME_GET_FCF().
  */
 typedef union{
     /** \brief Structure of bitfields for the FCF */
     struct{
-        uint8_t frameType : 3;          /**< Frame type field, see 802.15.4 */
-        bool    securityEnabled : 1;    /**< True if security is used in this frame */
-        bool    framePending : 1;       /**< True if sender has more data to send */
-        bool    ackRequired : 1;        /**< Is an ack frame required? */
+        uint8_t reserved0 : 1;          /**< Unused bit */
         bool    panIdCompression : 1;   /**< Is this a compressed header? */
-        uint8_t reserved : 3;           /**< Unused bits */
-        uint8_t destAddrMode : 2;       /**< Destination address mode, see 802.15.4 */
-        uint8_t frameVersion : 2;       /**< 802.15.4 frame version */
+        bool    ackRequired : 1;        /**< Is an ack frame required? */
+        bool    framePending : 1;       /**< True if sender has more data to send */
+        bool    securityEnabled : 1;    /**< True if security is used in this frame */
+        uint8_t frameType : 3;          /**< Frame type field, see 802.15.4 */
         uint8_t srcAddrMode : 2;        /**< Source address mode, see 802.15.4 */
+        uint8_t frameVersion : 2;       /**< 802.15.4 frame version */
+        uint8_t destAddrMode : 2;       /**< Destination address mode, see 802.15.4 */
+        uint8_t reserved : 2;           /**< Unused bits */
     };
     uint16_t word_val; /**< A word-wide value for the entire FCF */
 }fcf_t;
 
+/** \brief Reads a short address or PAN ID of a TDMA frame, the TDMA
+ *  frames carry them most significant byte first. */
+#define FRAME_GET16(p)  (((uint16_t)((const uint8_t *)(p))[0] << 8) | ((const uint8_t *)(p))[1])
+
+/** \brief Reads the FCF bytes of a frame into a fcf_t word_val. */
+#define FRAME_GET_FCF(p) (((uint16_t)((const uint8_t *)(p))[1] << 8) | ((const uint8_t *)(p))[0])
+
 /**
  *  \brief Structure that contains the lengths of the various addressing and security fields
  *  in the 802.15.4 header.  This structure is used in \ref frame_tx_create()
@@ -163,8 +179,10 @@ typedef struct{
 } frame_result_t;
 
 typedef struct{
-  uint16_t cycleTime;
-  uint8_t maxClients;
+  uint16_t cycleTime;           /**< length of the superframe in us */
+  uint8_t maxClients;           /**< number of client slots */
+  uint16_t slotTime;            /**< length of a client slot in us */
+  uint8_t payloadPerClient;     /**< response payload of a client */
 } beacon_header_t;
 
 
@@ -172,6 +190,18 @@ typedef struct{
   uint8_t payloadLength;
 } response_header_t;
 
+/** \brief A client response of either format, see rf231_slotted.h. The
+ *  payload points into the received frame. */
+typedef struct{
+  uint16_t addr;          /**< source address, TDMA_NO_ADDR if compact */
+  uint8_t slot;           /**< slot of a compact response, TDMA_NO_SLOT
+			       otherwise */
+  uint8_t seq;            /**< sequence number */
+  uint8_t flags;          /**< the length field with the JOIN/LEAVE flags */
+  uint8_t *payload;       /**< response payload */
+  uint8_t payload_length; /**< length of the payload */
+} response_t;
+
 
 
 /** \brief Parameters used by the frame_tx_create() function.  These
@@ -195,12 +225,13 @@ typedef struct{
 
 
 typedef struct{
-    fcf_t      * fcf;               /**< The FCF of the frame. */
+    fcf_t        fcf;               /**< The FCF of the frame. */
     uint8_t    * seqNum;            /**< The sequence number of the frame. */
-    uint16_t   * dest_pid;          /**< Destination PAN ID. */
-    addr_t     * dest_addr;         /**< Destination address. */
-    uint16_t   * src_pid;           /**< PAN ID */
-    addr_t     * src_addr;          /**< Source address */
+    uint8_t    * dest_pid;          /**< Destination PAN ID, read with
+                                         FRAME_GET16(). */
+    uint8_t    * dest_addr;         /**< Destination address. */
+    uint8_t    * src_pid;           /**< PAN ID */
+    uint8_t    * src_addr;          /**< Source address */
     uint8_t    * aux_sec_hdr;       /**< 802.15.4 Aux security header */
     uint8_t    * payload;           /**< Frame payload */
     uint8_t      payload_length;    /**< Length of payload section of frame */
@@ -219,7 +250,10 @@ typedef struct{
 
 void frame_tx_create(frame_create_params_t *p,frame_result_t *frame_result);
 void frame_rx_callback(uint16_t data);
-void rx_frame_parse(hal_rx_frame_t *rx_frame, parsed_frame_t *pf);
+bool rx_frame_parse(hal_rx_frame_t *rx_frame, parsed_frame_t *pf);
+uint8_t frame_compact_response_create(uint8_t *buffer, uint8_t seq,
+				      uint8_t slot, uint8_t flags);
+bool frame_response_parse(parsed_frame_t *pf, response_t *r);
 
 /** @} */
 #endif /* FRAME_UTILS_H */
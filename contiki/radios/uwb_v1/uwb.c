@@ -3,11 +3,6 @@
 
 #include "contiki.h"
 
-#include <stm32f4xx.h> /* STM32F4xx Definitions */
-#include <clock.h>
-
-#define delay_us( us )   ( clock_delay_usec( us ) )
-
 #include "dev/leds.h"
 #include "dev/spi.h"
 #include "uwb.h"
@@ -17,11 +12,16 @@
 #include "net/netstack.h"
 
 #include "sys/timetable.h"
+#include "sys/ctimer.h"
 
 #include "lib/random.h"
 
 /* RS232 delays will cause 6lowpan fragment overruns! Use DEBUGFLOW instead. */
+#ifdef UWB_CONF_DEBUG
+#define DEBUG UWB_CONF_DEBUG
+#else
 #define DEBUG 1
+#endif
 #if DEBUG
 #define PRINTF(...) printf(__VA_ARGS__)
 //#define PRINTF(FORMAT,args...) printf_P(PSTR(FORMAT),##args)
@@ -42,6 +42,24 @@
 uint8_t ram_tx_buffer[1024];
 uint8_t ram_rx_buffer[1024];
 
+/* RX descriptor ring - the dma-int downloads frames to rx_ring[rx_head] and
+ * re-arms rx right away, uwbprocess drains the ring from rx_tail. head and
+ * tail are free-running, only the dma-int writes rx_head and only
+ * uwbprocess writes rx_tail. A descriptor holds the bytes clocked in during
+ * the download: two dummies, the length and the frame. */
+#if (UWB_RX_BUFFERS & (UWB_RX_BUFFERS - 1)) != 0
+#error "UWB_RX_BUFFERS must be a power of two"
+#endif
+#define UWB_RX_DESCRIPTOR(n) (rx_ring[(uint8_t)(n) & (UWB_RX_BUFFERS - 1)])
+
+static uint8_t rx_ring[UWB_RX_BUFFERS][UWB_MAX_FRAME_LENGTH + 3];
+static volatile uint8_t rx_head, rx_tail;
+
+/* capture of the rx-int edge per descriptor, written by the rx-int */
+static uint32_t rx_timestamp[UWB_RX_BUFFERS];
+#define UWB_RX_TIMESTAMP(n) (rx_timestamp[(uint8_t)(n) & (UWB_RX_BUFFERS - 1)])
+static uint32_t rx_last_timestamp;  /* of the frame in packetbuf */
+
 /* finite state machine */
 #define UWB_STATE_OFF                  0 /* in reset */
 #define UWB_STATE_ON                   1 /* after reset, without RX init */
@@ -49,8 +67,7 @@ uint8_t ram_rx_buffer[1024];
 
 #define UWB_STATE_LISTEN              11 /* after RX init or frame reception or transmission */
 #define UWB_STATE_RX_LEN_DOWNLOAD     12 /* after RX interrupt - set in rx-int, dma started for length-download */
-#define UWB_STATE_RX_FRAME_DOWNLOAD   13 /* after DMA interrupt in RXD-state - set in dma-int, dma started for frame download */
-#define UWB_STATE_RX_PROCESS_POLLED   14 /* after DMA interrupt in DOWNLOAD-state - set in dma-int, uwbprocess polled, gets reset to LISTEN by uwbprocess */
+#define UWB_STATE_RX_FRAME_DOWNLOAD   13 /* after DMA interrupt in RXD-state - set in dma-int, dma started for frame download, reset to LISTEN by dma-int */
 
 #define USB_STATE_TX_FRAME_UPLOAD     21 /* set when the TX RAM gets loaded by DMA, gets reset to LISTEN (e.g. by dma-int) or can lead to CONFIG_UPLOAD */
 #define USB_STATE_TX_CONFIG_UPLOAD    22 /* set when the CONFIG gets loaded by DMA, gets promoted to TX_ACTIVE by dma-int */
@@ -58,6 +75,19 @@ uint8_t ram_rx_buffer[1024];
 
 uint8_t volatile uwb_fsm;
 
+/* guard time for the tx-int of an asynchronous transmission */
+#ifdef UWB_CONF_TX_TIMEOUT
+#define UWB_TX_TIMEOUT UWB_CONF_TX_TIMEOUT
+#else
+#define UWB_TX_TIMEOUT (CLOCK_SECOND / 50)
+#endif
+
+static volatile uint8_t tx_chained;  /* config upload follows the frame upload (set by transmit, taken by dma-int) */
+static volatile uint8_t tx_done;     /* tx-int seen, uwbprocess reports the result */
+static uwb_tx_callback_t tx_callback;
+static void *tx_callback_ptr;
+static struct ctimer tx_timer;
+
 /*---------------------------------------------------------------------------*/
 PROCESS(uwb_process, "UWB driver");
 /*---------------------------------------------------------------------------*/
@@ -71,7 +101,8 @@ static int init(void);
 static int
 enable_rx_mode(void)
 {
-  uint8_t cmd_buffer[16];
+  /* static - the dma may still be underway when this returns */
+  static uint8_t cmd_buffer[16];
 
   /* keep silence here, as this is called in int-context */
 
@@ -127,19 +158,12 @@ prepare(const void *payload, unsigned short payload_len)
   return 1;
 }
 /*---------------------------------------------------------------------------*/
-static int
-transmit(unsigned short transmit_len)
+static void
+tx_config_upload(void)
 {
-  uint8_t cmd_buffer[16];
-  uint16_t i;
+  static uint8_t cmd_buffer[16];
 
-  if ((uwb_fsm != UWB_STATE_ON) && (uwb_fsm != UWB_STATE_LISTEN) && (uwb_fsm != USB_STATE_TX_FRAME_UPLOAD))
-  {
-    PRINTF("uwb: transmit - WRONG STATE: %u\r\n", uwb_fsm);	
-    return RADIO_TX_ERR;
-  }
-
-  PRINTF("uwb: transmitting ... ");
+  /* called by transmit or chained by the dma-int - no dma is underway */
   cmd_buffer[0] = CMD_CONFIG_MODE;
   cmd_buffer[1] = 0x0A;
   cmd_buffer[2] = 0xE3;
@@ -151,16 +175,85 @@ transmit(unsigned short transmit_len)
   cmd_buffer[8] = 0x00;
   cmd_buffer[9] = 0x00;
   cmd_buffer[10] = 0x00;
-  /* wait for previous dma to finish (e.g. "prepare") */
-  while (hal_spi_dma_busy()) {;}
   hal_spi_dma_transfer(cmd_buffer, NULL, 11);
 
   uwb_fsm = USB_STATE_TX_CONFIG_UPLOAD;
+}
+/*---------------------------------------------------------------------------*/
+static int
+tx_start(void)
+{
+  tx_done = 0;
+
+  /* the dma-int must not run between the state check and the chaining */
+  HAL_DISABLE_DMA_IRQ();
+  if (uwb_fsm == USB_STATE_TX_FRAME_UPLOAD)
+  {
+    /* frame upload still underway - the dma-int starts the config upload */
+    tx_chained = 1;
+    HAL_ENABLE_DMA_IRQ();
+    return RADIO_TX_OK;
+  }
+  HAL_ENABLE_DMA_IRQ();
 
-  /* right here we could defer and wait for interrupt */
+  /* no rx-int from here on - the PHY gets switched to tx */
+  HAL_DISABLE_IRQ0();
+  if ((uwb_fsm == UWB_STATE_ON) || (uwb_fsm == UWB_STATE_LISTEN))
+  {
+    /* frame already in the TX RAM (e.g. "prepare") - wait for a previous
+     * dma (e.g. rx config) to finish and release SS */
+    while (hal_spi_dma_busy()) {;}
+    tx_config_upload();
+    return RADIO_TX_OK;
+  }
+
+  PRINTF("uwb: transmit - WRONG STATE: %u\r\n", uwb_fsm);
+  return RADIO_TX_ERR;
+}
+/*---------------------------------------------------------------------------*/
+static void
+tx_abort(void)
+{
+  /* no tx-int - give up and switch back to listen-state */
+  HAL_DISABLE_IRQ1();
+  tx_chained = 0;
+  enable_rx_mode();
+}
+/*---------------------------------------------------------------------------*/
+static void
+tx_finish(int status)
+{
+  uwb_tx_callback_t callback = tx_callback;
+
+  ctimer_stop(&tx_timer);
+  tx_callback = NULL;
+  if (callback != NULL)
+    callback(tx_callback_ptr, status);
+}
+/*---------------------------------------------------------------------------*/
+static void
+tx_timeout(void *ptr)
+{
+  if (uwb_tx_busy())
+  {
+    PRINTF("uwb: no tx-interrupt - FAILED\r\n");
+    tx_abort();
+    tx_finish(RADIO_TX_ERR);
+  }
+}
+/*---------------------------------------------------------------------------*/
+static int
+transmit(unsigned short transmit_len)
+{
+  uint16_t i;
+
+  PRINTF("uwb: transmitting ... ");
+  if (tx_start() != RADIO_TX_OK)
+    return RADIO_TX_ERR;
 
   /* wait for state TX_ACTIVE (which is set by dma-int) */
-  while (uwb_fsm == USB_STATE_TX_CONFIG_UPLOAD) {;}
+  while ((uwb_fsm == USB_STATE_TX_FRAME_UPLOAD) || (uwb_fsm == USB_STATE_TX_CONFIG_UPLOAD))
+    while (hal_spi_dma_busy()) {;}
 
   /* wait for state LISTEN */
   /* encoding time depends on frame length - so make it length-dependend */
@@ -181,11 +274,76 @@ transmit(unsigned short transmit_len)
   }
   else
   {
-    PRINTF("no tx-interrupt - FAILED\r\n");	
+    PRINTF("no tx-interrupt - FAILED\r\n");
+    tx_abort();
     return RADIO_TX_ERR;
   }
 }
 /*---------------------------------------------------------------------------*/
+/*
+ * Non-blocking transmission: starts the frame upload and returns. The
+ * dma-int chains the config upload, the tx-int switches back to
+ * listen-state and uwbprocess then calls the callback with RADIO_TX_OK -
+ * or with RADIO_TX_ERR if the tx-int did not show up within
+ * UWB_TX_TIMEOUT.
+ */
+int
+uwb_transmit_async(const void *payload, unsigned short payload_len,
+                   uwb_tx_callback_t callback, void *ptr)
+{
+  uint8_t state;
+
+  /* prepare resets the PHY and overwrites ram_tx_buffer - no rx-int until
+   * the tx-int re-enables rx. The state is checked with the rx-int off, so
+   * it cannot start a frame download behind the check, and with the dma-int
+   * held off, which re-enables the rx-int when a download completes */
+  HAL_DISABLE_DMA_IRQ();
+  HAL_DISABLE_IRQ0();
+  state = uwb_fsm;
+  HAL_ENABLE_DMA_IRQ();
+  if ((state > UWB_STATE_LISTEN) && (state < USB_STATE_TX_FRAME_UPLOAD))
+  {
+    /* frame download underway - the dma-int re-enables the rx-int once it
+     * is done */
+    return RADIO_TX_COLLISION;
+  }
+  if ((state != UWB_STATE_ON) && (state != UWB_STATE_LISTEN))
+  {
+    /* off, in test or transmitting - the rx-int was not enabled */
+    return RADIO_TX_ERR;
+  }
+
+  if (prepare(payload, payload_len) != 1)
+  {
+    HAL_ENABLE_IRQ0();
+    return RADIO_TX_ERR;
+  }
+
+  tx_callback = callback;
+  tx_callback_ptr = ptr;
+  if (tx_start() != RADIO_TX_OK)
+  {
+    tx_callback = NULL;
+    return RADIO_TX_ERR;
+  }
+  ctimer_set(&tx_timer, UWB_TX_TIMEOUT, tx_timeout, NULL);
+
+  return RADIO_TX_OK;
+}
+/*---------------------------------------------------------------------------*/
+uint8_t
+uwb_tx_busy(void)
+{
+  return ((uwb_fsm == USB_STATE_TX_FRAME_UPLOAD) && tx_chained) ||
+         (uwb_fsm == USB_STATE_TX_CONFIG_UPLOAD) || (uwb_fsm == USB_STATE_TX_ACTIVE);
+}
+/*---------------------------------------------------------------------------*/
+uint32_t
+uwb_rx_timestamp(void)
+{
+  return rx_last_timestamp;
+}
+/*---------------------------------------------------------------------------*/
 static int
 send(const void *payload, unsigned short payload_len)
 {
@@ -214,7 +372,7 @@ receiving_packet(void)
 static int
 pending_packet(void)
 {
-  return (uwb_fsm > UWB_STATE_LISTEN);
+  return (rx_head != rx_tail) || (uwb_fsm == UWB_STATE_RX_LEN_DOWNLOAD) || (uwb_fsm == UWB_STATE_RX_FRAME_DOWNLOAD);
 }
 /*---------------------------------------------------------------------------*/
 static int
@@ -584,6 +742,7 @@ int init(void)
   /* Do uwb-phy Reset */
   HAL_ASSERT_RST();
   uwb_fsm = UWB_STATE_OFF;
+  rx_head = rx_tail = 0;
   PRINTF("uwb: Reset\r\n");
 
   if (run_tests() == 0)
@@ -592,7 +751,8 @@ int init(void)
     PRINTF("uwb: AT LEAST ONE TEST FAILED *****************\r\n");
 
 
- /* Start the packet receive process */
+ /* Start the packet receive process, the ISRs poll it */
+  process_set_prio(&uwb_process, PROCESS_PRIO_HIGH);
   process_start(&uwb_process, NULL);
 
  /* Leave radio in on state (?)*/
@@ -606,33 +766,47 @@ void uwb_dma_interrupt(void)
   /* DMA transaction finished */
   if (uwb_fsm == UWB_STATE_RX_LEN_DOWNLOAD)
   {
-    /* we downloaded the frame length - now download the frame! */
-    if (ram_rx_buffer[2] > 0)
+    /* we downloaded the frame length - now download the frame to the same descriptor! */
+    uint8_t *rx = UWB_RX_DESCRIPTOR(rx_head);
+    if (rx[2] > UWB_MAX_FRAME_LENGTH)
+    {
+      RIMESTATS_ADD(toolong);
+      enable_rx_mode();
+    }
+    else if (rx[2] > 0)
     {
       ram_tx_buffer[0] = CMD_READ_RAM_RX;
-      hal_spi_dma_transfer(ram_tx_buffer, ram_rx_buffer, ram_rx_buffer[2]+3);
+      hal_spi_dma_transfer(ram_tx_buffer, rx, rx[2]+3);
       uwb_fsm = UWB_STATE_RX_FRAME_DOWNLOAD;
     }
     else
     {
-      /* directly poll process to handle zero-length frame */
-      process_poll(&uwb_process);
-      RIMESTATS_ADD(llrx);
-      uwb_fsm = UWB_STATE_RX_PROCESS_POLLED;
+      /* nothing to pass up for a zero-length frame */
+      RIMESTATS_ADD(tooshort);
+      enable_rx_mode();
     }
   }
   else if (uwb_fsm == UWB_STATE_RX_FRAME_DOWNLOAD)
   {
-    /* download complete, poll process */
-    process_poll(&uwb_process);
+    /* download complete - hand the descriptor to uwbprocess and listen again */
+    rx_head++;
     RIMESTATS_ADD(llrx);
-    uwb_fsm = UWB_STATE_RX_PROCESS_POLLED;
+    process_poll(&uwb_process);
+    enable_rx_mode();
   }
   else if (uwb_fsm == USB_STATE_TX_FRAME_UPLOAD)
   {
-    /* tx frame uploaded, move back to listen state */
-    /* here we could also implement a mechanism that starts the tx by sending config right away */
-    uwb_fsm = UWB_STATE_LISTEN;
+    if (tx_chained)
+    {
+      /* tx frame uploaded and transmit requested - send config right away */
+      tx_chained = 0;
+      tx_config_upload();
+    }
+    else
+    {
+      /* tx frame uploaded, move back to listen state */
+      uwb_fsm = UWB_STATE_LISTEN;
+    }
 //    PRINTF("d1");
   }
   else if (uwb_fsm == USB_STATE_TX_CONFIG_UPLOAD)
@@ -645,7 +819,7 @@ void uwb_dma_interrupt(void)
   }
 }
 
-void uwb_rx_interrupt(void)
+void uwb_rx_interrupt(uint32_t capture)
 {
   /* frame received */
 
@@ -653,9 +827,20 @@ void uwb_rx_interrupt(void)
   /* Disable rx-int */
   HAL_DISABLE_IRQ0( );
 
+  if ((uint8_t)(rx_head - rx_tail) >= UWB_RX_BUFFERS)
+  {
+    /* no free descriptor - drop the frame and listen again */
+    RIMESTATS_ADD(overrun);
+    enable_rx_mode();
+    return;
+  }
+
+  /* the capture is taken by the edge, the int latency does not matter */
+  UWB_RX_TIMESTAMP(rx_head) = capture;
+
   /* start DMA download of length field */
   ram_tx_buffer[0] = CMD_READ_RAM_RX;
-  hal_spi_dma_transfer(ram_tx_buffer, ram_rx_buffer, 3);
+  hal_spi_dma_transfer(ram_tx_buffer, UWB_RX_DESCRIPTOR(rx_head), 3);
   uwb_fsm = UWB_STATE_RX_LEN_DOWNLOAD;
 }
 
@@ -670,13 +855,17 @@ void uwb_tx_interrupt(void)
   /* switch back to listen-state */
   enable_rx_mode();
 
+  /* let uwbprocess report the transmission */
+  tx_done = 1;
+  process_poll(&uwb_process);
+
 //  PRINTF("d3");
 }
 
 /*---------------------------------------------------------------------------*/
 /* Process to handle input packets
- * Receive interrupts cause this process to be polled
- * It calls the core MAC layer which calls uwb_read to get the packet
+ * The dma-int polls this process when a frame is in the RX ring
+ * It passes all frames in the ring to the core MAC layer
  * uwbprocessflag can be printed in the main idle loop for debugging
  */
 #if 0
@@ -696,25 +885,40 @@ PROCESS_THREAD(uwb_process, ev, data)
     PROCESS_YIELD_UNTIL(ev == PROCESS_EVENT_POLL);
     UWBPROCESSFLAG(02);
 
-    if (uwb_fsm != UWB_STATE_RX_PROCESS_POLLED)
-      PRINTF("uwb: wrong state in process: %u\n",uwb_fsm);			
-
-    packetbuf_clear();
-
-    len = ram_rx_buffer[2];
-    if ((len > 0) && (len < PACKETBUF_SIZE))
+    /* polled by the rx path (frames downloaded) and/or by the tx-int */
+    /* drain the RX ring - frames arriving meanwhile are handled in the same batch */
+    while (rx_tail != rx_head)
     {
-      memcpy(packetbuf_dataptr(),&ram_rx_buffer[3],len); 
-      packetbuf_set_datalen(len);
-      UWBPROCESSFLAG(03);
-      NETSTACK_RDC.input();
+      uint8_t *rx = UWB_RX_DESCRIPTOR(rx_tail);
+
+      packetbuf_clear();
+      rx_last_timestamp = UWB_RX_TIMESTAMP(rx_tail);
+      packetbuf_set_attr(PACKETBUF_ATTR_TIMESTAMP, (uint16_t)rx_last_timestamp);
+
+      len = rx[2];
+      if (len < PACKETBUF_SIZE)
+      {
+        memcpy(packetbuf_dataptr(),&rx[3],len);
+        packetbuf_set_datalen(len);
+      }
+      /* the descriptor is free once copied */
+      rx_tail++;
+
+      if ((len > 0) && (len < PACKETBUF_SIZE))
+      {
+        UWBPROCESSFLAG(03);
+        NETSTACK_RDC.input();
+      }
+
+      PRINTF("uwb: read: %u bytes\n",len);
     }
 
-    /* switch back to listen-state */
-    PRINTF("uwb: enabling rx-mode\r\n");
-    enable_rx_mode();
-
-    PRINTF("uwb: read: %u bytes\n",len);
+    /* the frames are handled, a callback may start the next transmission */
+    if (tx_done)
+    {
+      tx_done = 0;
+      tx_finish(RADIO_TX_OK);
+    }
 
     UWBPROCESSFLAG(04);
   }
@@ -19,6 +19,29 @@
 #define MODULE_RX						0x08
 #define MODULE_LOOPBACK			0x80
 
+/* number of descriptors in the RX ring, a power of two */
+#ifdef UWB_CONF_RX_BUFFERS
+#define UWB_RX_BUFFERS UWB_CONF_RX_BUFFERS
+#else
+#define UWB_RX_BUFFERS 4
+#endif
+
+#define UWB_MAX_FRAME_LENGTH 127
+
 extern const struct radio_driver uwb_driver;
 
+/* called from uwb_process when an asynchronous transmission is done,
+ * status is RADIO_TX_OK or RADIO_TX_ERR */
+typedef void (* uwb_tx_callback_t)(void *ptr, int status);
+
+int uwb_transmit_async(const void *payload, unsigned short payload_len,
+                       uwb_tx_callback_t callback, void *ptr);
+uint8_t uwb_tx_busy(void);
+
+/* HAL_GET_TIME() when the PHY signalled the end of the frame being passed
+ * up (captured by TIMx at the rx-int edge, HAL_TIME_SECOND ticks per
+ * second). Valid while NETSTACK_RDC.input() runs - PACKETBUF_ATTR_TIMESTAMP
+ * only holds the lower 16 bits. */
+uint32_t uwb_rx_timestamp(void);
+
 #endif
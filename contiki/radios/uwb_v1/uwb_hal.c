@@ -27,7 +27,7 @@ void hal_time_isr_func(void)
 }
 
 extern void uwb_tx_interrupt(void);
-extern void uwb_rx_interrupt(void);
+extern void uwb_rx_interrupt(uint32_t capture);
 extern void uwb_dma_interrupt(void);
 
 void TIMx_IRQHandler(void)
@@ -36,7 +36,7 @@ void TIMx_IRQHandler(void)
   if (TIMx->SR & TIM_SR_CCxIF_IRQ0)	/* IRQ0 */
   {
     capture = TIMx->CCRx_IRQ0;
-    uwb_rx_interrupt();
+    uwb_rx_interrupt(capture);
   }
   if (TIMx->SR & TIM_SR_CCxIF_IRQ1)	/* IRQ1 */
   {
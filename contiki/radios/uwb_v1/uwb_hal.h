@@ -4,7 +4,9 @@
 #include <stdint.h>
 #include <stdbool.h>
 #include "contiki-conf.h"
+#ifndef CONTIKI_TARGET_NATIVE
 #include <stm32f4xx.h>                  /* STM32F4xx Definitions              */
+#include <clock.h>
 
 #define STM3240G_EVAL      7
 #define STM32F4_Discovery  8
@@ -183,6 +185,9 @@
 #define HAL_ENABLE_OVERFLOW_INTERRUPT( ) ( TIMx->DIER |= TIM_DIER_UIE )
 #define HAL_DISABLE_OVERFLOW_INTERRUPT( ) ( TIMx->DIER &= ~TIM_DIER_UIE )
 
+/* TIMx counts unprescaled at 2 * fPCLK1 = 84 MHz and wraps after 2^32 */
+#define HAL_GET_TIME( )       ( TIMx->CNT )
+
 #define HAL_SPI_TRANSFER_OPEN() { \
   HAL_SS_LOW(); /* Start the SPI transaction by pulling the Slave Select low. */
 #define HAL_SPI_TRANSFER_WRITE(to_write) { volatile uint16_t dummy = SPIx->DR; while ((SPIx->SR & SPI_SR_TXE) != SPI_SR_TXE) {;}; SPIx->DR = (to_write); }
@@ -201,6 +206,68 @@ __INLINE uint8_t spiWrite(uint8_t byte)
 	return HAL_SPI_TRANSFER_READ();
 }
 
+/* mask the DMA-int while the driver decides whether to chain a transfer */
+#define HAL_DISABLE_DMA_IRQ( ) ( NVIC_DisableIRQ(SPI_DMAx_STREAM_RX_IRQn) )
+#define HAL_ENABLE_DMA_IRQ( )  ( NVIC_EnableIRQ(SPI_DMAx_STREAM_RX_IRQn) )
+
+#define delay_us( us )   ( clock_delay_usec( us ) )
+
+#else /* CONTIKI_TARGET_NATIVE */
+/*
+ * On the native platform the pins, the SPI bus with its DMA streams, the
+ * IRQ lines and the PHY are emulated by uwb_hal_native.c against a
+ * simulated clock (see uwb_sim.h). Busy waiting advances that clock.
+ */
+#include "sys/clock.h"
+
+#define HAL_SS_HIGH( )        ( hal_native_set_ss(1) )
+#define HAL_SS_LOW( )         ( hal_native_set_ss(0) )
+
+#define HAL_DEASSERT_RST( )   ( hal_native_set_rst(1) )
+#define HAL_ASSERT_RST( )     ( hal_native_set_rst(0) )
+#define HAL_GET_RST( )        ( hal_native_get_rst() )
+
+#define HAL_ENABLE_IRQ0( )    ( hal_native_enable_irq(0, 1) )
+#define HAL_DISABLE_IRQ0( )   ( hal_native_enable_irq(0, 0) )
+#define HAL_ENABLE_IRQ1( )    ( hal_native_enable_irq(1, 1) )
+#define HAL_DISABLE_IRQ1( )   ( hal_native_enable_irq(1, 0) )
+
+#define HAL_CHECK_IRQ0( )     ( hal_native_check_irq(0) )
+#define HAL_CHECK_IRQ1( )     ( hal_native_check_irq(1) )
+
+#define HAL_ENABLE_OVERFLOW_INTERRUPT( )
+#define HAL_DISABLE_OVERFLOW_INTERRUPT( )
+
+#define HAL_GET_TIME( )       ( hal_native_get_time() )
+
+#define HAL_SPI_TRANSFER_OPEN() { \
+  HAL_SS_LOW();
+#define HAL_SPI_TRANSFER_CLOSE() \
+  HAL_SS_HIGH(); \
+}
+#define HAL_SPI_TRANSFER(to_write) ( hal_native_spi_transfer(to_write) )
+
+#define HAL_DISABLE_DMA_IRQ( ) ( hal_native_enable_dma_irq(0) )
+#define HAL_ENABLE_DMA_IRQ( )  ( hal_native_enable_dma_irq(1) )
+
+#define delay_us( us )        ( hal_native_delay_us(us) )
+
+void hal_native_set_ss(uint8_t level);
+void hal_native_set_rst(uint8_t level);
+uint8_t hal_native_get_rst(void);
+void hal_native_enable_irq(uint8_t irq, uint8_t enable);
+uint8_t hal_native_check_irq(uint8_t irq);
+uint8_t hal_native_spi_transfer(uint8_t byte);
+void hal_native_enable_dma_irq(uint8_t enable);
+void hal_native_delay_us(uint32_t us);
+uint32_t hal_native_get_time(void);
+
+#endif /* CONTIKI_TARGET_NATIVE */
+
+/* ticks per second of HAL_GET_TIME() and of the IRQ captures, the native
+ * backend simulates the same timer */
+#define HAL_TIME_SECOND       84000000UL
+
 void hal_init(void);
 uint8_t hal_spi_dma_busy(void);
 void hal_spi_dma_transfer(uint8_t *tx_buffer, uint8_t *rx_buffer, uint8_t length);
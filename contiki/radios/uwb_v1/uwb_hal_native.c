@@ -0,0 +1,564 @@
+/*
+ * Copyright (c) 2012, TU Dortmund University.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following
+ *    disclaimer in the documentation and/or other materials provided
+ *    with the distribution.
+ * 3. The name of the author may not be used to endorse or promote
+ *    products derived from this software without specific prior
+ *    written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS
+ * OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+ * GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * This file is part of the Contiki OS
+ *
+ */
+/*---------------------------------------------------------------------------*/
+/**
+ * \file    Native (Linux) backend of the UWB HAL
+ *
+ *          Replaces uwb_hal.c on the native platform. The PHY with its TX
+ *          and RX RAM and config mode, the SPI bus, the SPI DMA streams,
+ *          the SS/RST pins and the IRQ lines are emulated against a
+ *          deterministic simulated clock. See uwb_sim.h.
+ *
+ *          The DMA-int may preempt the TIMx-int (IRQ0/IRQ1) as on the
+ *          STM32, where the DMA stream has the higher NVIC priority.
+ */
+/*---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <string.h>
+#include "contiki.h"
+#include "uwb.h"
+#include "uwb_hal.h"
+#include "uwb_sim.h"
+
+/******************************************************************************
+ * Simulation definitions
+ ******************************************************************************/
+#define SIM_EV_DMA_DONE       0     /** SPI DMA transfer complete */
+#define SIM_EV_TX_END         1     /** last symbol of a frame on air */
+#define SIM_EV_IRQ0           2     /** edge on IRQ0 (frame received) */
+#define SIM_EV_IRQ1           3     /** edge on IRQ1 (frame sent) */
+#define SIM_EV_RX_START       4     /** SHR of a frame of the peer */
+#define SIM_EV_RX_END         5     /** last symbol of a frame of the peer */
+#define SIM_EVENTS            6
+#define SIM_NEVER             0xffffffffffffffffULL
+
+#define SIM_RAM_SIZE          258   /** length byte, frame and trailing zero */
+#define SIM_FRAME_NS(len)     (UWB_SIM_PREAMBLE_NS + (uint64_t)(len) * UWB_SIM_BYTE_NS)
+#define SIM_CONFIG_SIZE       16
+
+/** interrupt context of the simulated CPU */
+#define SIM_LEVEL_THREAD      0
+#define SIM_LEVEL_TIMX        1
+#define SIM_LEVEL_DMA         2
+
+/******************************************************************************
+ * Extern and static Variable Definitions
+ ******************************************************************************/
+extern void uwb_tx_interrupt(void);
+extern void uwb_rx_interrupt(uint32_t capture);
+extern void uwb_dma_interrupt(void);
+
+static uwb_sim_conf_t sim_conf = {
+  0,                 /* dmaLatencyNs */
+  1000               /* irqLatencyNs */
+};
+static uwb_sim_stats_t sim_stats;
+
+static uint64_t sim_now;
+static uint64_t sim_events[SIM_EVENTS] = { SIM_NEVER, SIM_NEVER, SIM_NEVER,
+                                           SIM_NEVER, SIM_NEVER, SIM_NEVER };
+static uint8_t sim_level;                 /**< SIM_LEVEL_* of the running code */
+static uint8_t sim_wait_depth;            /**< nested busy waits */
+
+/* PHY */
+static uint8_t phy_ram_tx[SIM_RAM_SIZE];  /**< [0] is the frame length */
+static uint8_t phy_ram_rx[SIM_RAM_SIZE];
+static uint8_t phy_config[SIM_CONFIG_SIZE];
+static uint8_t phy_rst;                   /**< RST pin level, low = reset */
+static uint8_t phy_echo;                  /**< the frame on air is looped back */
+static uint64_t phy_tx_start;
+static uint8_t phy_listening;             /**< rx configured, no frame received yet */
+static uint8_t phy_receiving;             /**< frame of the peer being received */
+static uint8_t phy_rx_irq;                /**< IRQ0 pending for a frame of the peer */
+
+/* peer injecting frames */
+static uint32_t peer_frames;              /**< frames left to send */
+static uint8_t peer_length;
+static uint32_t peer_gap;
+static uint16_t peer_seq;
+
+/* SPI */
+static uint8_t spi_ss = 1;
+static uint16_t spi_index;                /**< bytes since SS went low */
+static uint8_t spi_cmd;
+static uint8_t spi_last;                  /**< loopback register */
+
+/* IRQ lines captured by TIMx */
+static uint8_t irq_flag[2];
+static uint8_t irq_enabled[2];
+static uint32_t irq_capture[2];           /**< TIMx count latched by the edge */
+
+/* SPI DMA */
+static uint8_t dma_dummy;
+static uint8_t dma_busy;
+static uint8_t dma_pending;               /**< transfer complete, int not served */
+static uint8_t dma_irq_enabled = 1;
+static uint8_t *dma_tx;
+static uint8_t *dma_rx;
+static uint8_t dma_length;
+
+/******************************************************************************
+ * Simulated PHY
+ ******************************************************************************/
+/* TIMx count at a simulated time */
+static uint32_t
+sim_ticks(uint64_t ns)
+{
+  return (uint32_t)(ns * (HAL_TIME_SECOND / 1000000) / 1000);
+}
+/*---------------------------------------------------------------------------*/
+static void
+phy_configure(void)
+{
+  uint8_t modules = phy_config[3];
+
+  if(!(modules & MODULE_TX)) {
+    phy_listening = !!(modules & MODULE_RX);
+    return;
+  }
+  phy_listening = 0;
+  /* transmit the TX RAM, with loopback or rx-antenna on the PHY hears itself */
+  phy_tx_start = sim_now;
+  phy_echo = (modules & MODULE_RX) &&
+    ((modules & MODULE_LOOPBACK) || (phy_config[2] & 0x10));
+  sim_events[SIM_EV_TX_END] = sim_now + UWB_SIM_PREAMBLE_NS +
+    (uint64_t)phy_ram_tx[0] * UWB_SIM_BYTE_NS;
+}
+/*---------------------------------------------------------------------------*/
+static void
+phy_reset(void)
+{
+  if(sim_events[SIM_EV_TX_END] != SIM_NEVER) {
+    sim_stats.framesAborted++;
+  }
+  if(phy_receiving || phy_rx_irq) {
+    sim_stats.rxMissed++;
+  }
+  phy_listening = 0;
+  phy_receiving = 0;
+  phy_rx_irq = 0;
+  sim_events[SIM_EV_TX_END] = SIM_NEVER;
+  sim_events[SIM_EV_IRQ0] = SIM_NEVER;
+  sim_events[SIM_EV_IRQ1] = SIM_NEVER;
+  memset(phy_config, 0, sizeof(phy_config));
+  spi_cmd = 0;
+}
+/*---------------------------------------------------------------------------*/
+static void
+phy_tx_end(void)
+{
+  sim_stats.framesSent++;
+  sim_stats.airtimeNs += sim_now - phy_tx_start;
+  sim_events[SIM_EV_IRQ1] = sim_now + sim_conf.irqLatencyNs;
+  if(phy_echo) {
+    memcpy(phy_ram_rx, phy_ram_tx, phy_ram_tx[0] + 1);
+    sim_events[SIM_EV_IRQ0] = sim_now + sim_conf.irqLatencyNs;
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+phy_rx_start(void)
+{
+  sim_stats.rxInjected++;
+  if(phy_listening) {
+    phy_receiving = 1;
+  } else {
+    sim_stats.rxMissed++;
+  }
+  sim_events[SIM_EV_RX_END] = sim_now + SIM_FRAME_NS(peer_length);
+  if(--peer_frames > 0) {
+    sim_events[SIM_EV_RX_START] = sim_events[SIM_EV_RX_END] + peer_gap;
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+phy_rx_end(void)
+{
+  uint8_t i;
+
+  if(phy_receiving) {
+    /* the PHY keeps the frame until it gets configured again */
+    phy_receiving = 0;
+    phy_listening = 0;
+    phy_ram_rx[0] = peer_length;
+    for(i = 0; i < peer_length; i++) {
+      phy_ram_rx[1 + i] = i == 0 ? peer_seq & 0xff : i == 1 ? peer_seq >> 8 :
+        (uint8_t)(peer_seq + i);
+    }
+    phy_rx_irq = 1;
+    sim_events[SIM_EV_IRQ0] = sim_now + sim_conf.irqLatencyNs;
+  }
+  peer_seq++;
+}
+/*---------------------------------------------------------------------------*/
+static uint8_t
+phy_spi_byte(uint8_t out)
+{
+  uint8_t in = 0;
+  uint16_t k = spi_index - 1;
+
+  if(!phy_rst) {
+    return 0;
+  }
+  if(spi_index == 0) {
+    spi_cmd = out;
+    spi_last = 0;
+  } else {
+    switch(spi_cmd) {
+    case CMD_WRITE_RAM_TX:
+      if(k < SIM_RAM_SIZE) {
+        phy_ram_tx[k] = out;
+      }
+      break;
+    case CMD_READ_RAM_TX:
+      /* the RAM follows one dummy byte after the command */
+      if(k >= 1 && k - 1 < SIM_RAM_SIZE) {
+        in = phy_ram_tx[k - 1];
+      }
+      break;
+    case CMD_WRITE_RAM_RX:
+      if(k < SIM_RAM_SIZE) {
+        phy_ram_rx[k] = out;
+      }
+      break;
+    case CMD_READ_RAM_RX:
+      if(k >= 1 && k - 1 < SIM_RAM_SIZE) {
+        in = phy_ram_rx[k - 1];
+      }
+      break;
+    case CMD_CONFIG_MODE:
+      if(k < SIM_CONFIG_SIZE) {
+        phy_config[k] = out;
+      }
+      break;
+    case CMD_SPI_LOOPBACK:
+      in = spi_last;
+      spi_last = out;
+      break;
+    }
+  }
+  if(spi_index < 0xffff) {
+    spi_index++;
+  }
+  return in;
+}
+/******************************************************************************
+ * Event handling
+ ******************************************************************************/
+static void
+sim_deliver(void)
+{
+  uint8_t level;
+
+  for(;;) {
+    if(dma_pending && dma_irq_enabled && sim_level < SIM_LEVEL_DMA) {
+      /* SPI_DMAx_STREAM_RX_IRQHandler */
+      dma_pending = 0;
+      level = sim_level;
+      sim_level = SIM_LEVEL_DMA;
+      HAL_SS_HIGH();
+      uwb_dma_interrupt();
+      sim_level = level;
+      continue;
+    }
+    if(sim_level < SIM_LEVEL_TIMX &&
+       ((irq_flag[0] && irq_enabled[0]) || (irq_flag[1] && irq_enabled[1]))) {
+      /* TIMx_IRQHandler */
+      level = sim_level;
+      sim_level = SIM_LEVEL_TIMX;
+      if(irq_flag[0] && irq_enabled[0]) {
+        irq_flag[0] = 0;
+        uwb_rx_interrupt(irq_capture[0]);
+      }
+      if(irq_flag[1] && irq_enabled[1]) {
+        irq_flag[1] = 0;
+        uwb_tx_interrupt();
+      }
+      sim_level = level;
+      continue;
+    }
+    break;
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+sim_dma_done(void)
+{
+  uint8_t i, in;
+
+  for(i = 0; i < dma_length; i++) {
+    in = phy_spi_byte(dma_tx != NULL ? dma_tx[i] : dma_dummy);
+    if(dma_rx != NULL) {
+      dma_rx[i] = in;
+    }
+  }
+  dma_busy = 0;
+  dma_pending = 1;
+}
+/*---------------------------------------------------------------------------*/
+static int
+sim_step(uint64_t until)
+{
+  uint8_t i, next = SIM_EVENTS;
+
+  for(i = 0; i < SIM_EVENTS; i++) {
+    if(sim_events[i] != SIM_NEVER &&
+       (next == SIM_EVENTS || sim_events[i] < sim_events[next])) {
+      next = i;
+    }
+  }
+  if(next == SIM_EVENTS || sim_events[next] > until) {
+    return 0;
+  }
+  if(sim_events[next] > sim_now) {
+    sim_now = sim_events[next];
+  }
+  sim_events[next] = SIM_NEVER;
+  sim_stats.events++;
+
+  switch(next) {
+  case SIM_EV_DMA_DONE:
+    sim_dma_done();
+    break;
+  case SIM_EV_TX_END:
+    phy_tx_end();
+    break;
+  case SIM_EV_IRQ0:
+    if(phy_rx_irq) {
+      phy_rx_irq = 0;
+      sim_stats.rxReceived++;
+    }
+    /* the input capture latches the edge, whenever the int gets served */
+    irq_capture[0] = sim_ticks(sim_now);
+    irq_flag[0] = 1;
+    break;
+  case SIM_EV_IRQ1:
+    irq_capture[1] = sim_ticks(sim_now);
+    irq_flag[1] = 1;
+    break;
+  case SIM_EV_RX_START:
+    phy_rx_start();
+    break;
+  case SIM_EV_RX_END:
+    phy_rx_end();
+    break;
+  }
+  sim_deliver();
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+static void
+sim_wait(uint64_t until, uint8_t *busy)
+{
+  uint64_t start = sim_now;
+
+  /* busy waiting - only the outermost wait counts as CPU time */
+  sim_wait_depth++;
+  if(busy != NULL) {
+    while(*busy && sim_step(SIM_NEVER));
+  } else {
+    while(sim_step(until));
+    if(sim_now < until) {
+      sim_now = until;
+    }
+  }
+  if(--sim_wait_depth == 0) {
+    sim_stats.cpuBusyNs += sim_now - start;
+  }
+}
+/******************************************************************************
+ * Simulation control
+ ******************************************************************************/
+void
+uwb_sim_configure(const uwb_sim_conf_t *conf)
+{
+  sim_conf = *conf;
+}
+/*---------------------------------------------------------------------------*/
+void
+uwb_sim_run(uint64_t ns)
+{
+  uint64_t until = sim_now + ns;
+
+  /* dispatch the hardware events, let the processes react in between */
+  while(process_run() > 0);
+  while(sim_step(until)) {
+    while(process_run() > 0);
+  }
+}
+/*---------------------------------------------------------------------------*/
+void
+uwb_sim_inject(uint32_t frames, uint8_t length, uint32_t gapNs)
+{
+  peer_frames = frames;
+  peer_length = length;
+  peer_gap = gapNs;
+  peer_seq = 0;
+  sim_events[SIM_EV_RX_START] = frames > 0 ? sim_now : SIM_NEVER;
+}
+/*---------------------------------------------------------------------------*/
+void
+uwb_sim_busy(uint32_t ns)
+{
+  sim_wait(sim_now + ns, NULL);
+}
+/*---------------------------------------------------------------------------*/
+uint64_t
+uwb_sim_now(void)
+{
+  return sim_now;
+}
+/*---------------------------------------------------------------------------*/
+const uwb_sim_stats_t *
+uwb_sim_get_stats(void)
+{
+  return &sim_stats;
+}
+/*---------------------------------------------------------------------------*/
+void
+uwb_sim_clear_stats(void)
+{
+  memset(&sim_stats, 0, sizeof(sim_stats));
+}
+/******************************************************************************
+ * HAL
+ ******************************************************************************/
+void
+hal_native_set_ss(uint8_t level)
+{
+  if(level && !spi_ss && spi_cmd == CMD_CONFIG_MODE && phy_rst) {
+    /* the config gets applied when the transaction ends */
+    phy_configure();
+  }
+  if(!level && spi_ss) {
+    spi_index = 0;
+  }
+  spi_ss = level;
+}
+/*---------------------------------------------------------------------------*/
+void
+hal_native_set_rst(uint8_t level)
+{
+  if(!level) {
+    phy_reset();
+  }
+  phy_rst = level;
+}
+/*---------------------------------------------------------------------------*/
+uint8_t
+hal_native_get_rst(void)
+{
+  return phy_rst;
+}
+/*---------------------------------------------------------------------------*/
+void
+hal_native_enable_irq(uint8_t irq, uint8_t enable)
+{
+  if(enable) {
+    irq_flag[irq] = 0;
+  }
+  irq_enabled[irq] = enable;
+}
+/*---------------------------------------------------------------------------*/
+uint8_t
+hal_native_check_irq(uint8_t irq)
+{
+  return irq_flag[irq];
+}
+/*---------------------------------------------------------------------------*/
+uint8_t
+hal_native_spi_transfer(uint8_t byte)
+{
+  sim_wait(sim_now + UWB_SIM_SPI_BYTE_NS, NULL);
+  return phy_spi_byte(byte);
+}
+/*---------------------------------------------------------------------------*/
+void
+hal_native_enable_dma_irq(uint8_t enable)
+{
+  dma_irq_enabled = enable;
+  if(enable) {
+    sim_deliver();
+  }
+}
+/*---------------------------------------------------------------------------*/
+void
+hal_native_delay_us(uint32_t us)
+{
+  sim_wait(sim_now + (uint64_t)us * 1000, NULL);
+}
+/*---------------------------------------------------------------------------*/
+uint32_t
+hal_native_get_time(void)
+{
+  return sim_ticks(sim_now);
+}
+/*---------------------------------------------------------------------------*/
+void
+hal_init(void)
+{
+  phy_reset();
+  memset(irq_flag, 0, sizeof(irq_flag));
+  memset(irq_enabled, 0, sizeof(irq_enabled));
+  dma_busy = 0;
+  dma_pending = 0;
+  dma_irq_enabled = 1;
+  spi_ss = 1;
+}
+/*---------------------------------------------------------------------------*/
+uint8_t
+hal_spi_dma_busy(void)
+{
+  if(dma_busy) {
+    sim_wait(SIM_NEVER, &dma_busy);
+  }
+  return dma_busy;
+}
+/*---------------------------------------------------------------------------*/
+void
+hal_spi_dma_transfer(uint8_t *tx_buffer, uint8_t *rx_buffer, uint8_t length)
+{
+  /* Assert SS, a served transfer complete gets cleared as on the STM32 */
+  HAL_SS_LOW();
+  dma_tx = tx_buffer;
+  dma_rx = rx_buffer;
+  dma_length = length;
+  dma_busy = 1;
+  dma_pending = 0;
+  sim_events[SIM_EV_DMA_DONE] = sim_now + sim_conf.dmaLatencyNs +
+    (uint64_t)length * UWB_SIM_SPI_BYTE_NS;
+  sim_stats.dmaTransfers++;
+  sim_stats.dmaBytes += length;
+}
+/*---------------------------------------------------------------------------*/
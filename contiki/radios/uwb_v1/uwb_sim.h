@@ -0,0 +1,117 @@
+/*
+ * Copyright (c) 2012, TU Dortmund University.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following
+ *    disclaimer in the documentation and/or other materials provided
+ *    with the distribution.
+ * 3. The name of the author may not be used to endorse or promote
+ *    products derived from this software without specific prior
+ *    written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS
+ * OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+ * GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * This file is part of the Contiki OS
+ *
+ */
+/*---------------------------------------------------------------------------*/
+/**
+ * \file    Control interface of the native backend of the UWB HAL
+ *
+ *          On the native platform uwb_hal_native.c replaces the STM32 HAL.
+ *          The SPI bus with its DMA streams, the RST/SS pins, the two IRQ
+ *          lines captured by TIMx and the PHY itself (TX/RX RAM, config
+ *          mode, transmission) are emulated against a simulated clock, so
+ *          uwb.c runs unmodified. Time only advances while the driver
+ *          waits (delay_us, hal_spi_dma_busy) or while uwb_sim_run()
+ *          dispatches the pending hardware events.
+ *
+ *          A scripted peer can inject frames with a given gap between
+ *          them. Like the PHY, the simulation receives one frame after each
+ *          rx config and misses frames starting before the driver re-armed
+ *          rx. Byte 0/1 of an injected frame is a sequence number (little
+ *          endian), byte i >= 2 is (uint8_t)(sequence number + i).
+ */
+/*---------------------------------------------------------------------------*/
+#ifndef UWB_SIM_H
+#define UWB_SIM_H
+
+/*============================ INCLUDE =======================================*/
+#include <stdint.h>
+
+/*============================ MACROS ========================================*/
+#ifdef UWB_SIM_CONF_SPI_BYTE_NS
+#define UWB_SIM_SPI_BYTE_NS           UWB_SIM_CONF_SPI_BYTE_NS
+#else
+#define UWB_SIM_SPI_BYTE_NS           762   /**< one byte at fPCLK/8 = 10.5 MHz */
+#endif /* UWB_SIM_CONF_SPI_BYTE_NS */
+
+#ifdef UWB_SIM_CONF_PREAMBLE_NS
+#define UWB_SIM_PREAMBLE_NS           UWB_SIM_CONF_PREAMBLE_NS
+#else
+#define UWB_SIM_PREAMBLE_NS           64000 /**< preamble and SFD on air */
+#endif /* UWB_SIM_CONF_PREAMBLE_NS */
+
+#ifdef UWB_SIM_CONF_BYTE_NS
+#define UWB_SIM_BYTE_NS               UWB_SIM_CONF_BYTE_NS
+#else
+#define UWB_SIM_BYTE_NS               8000  /**< one encoded byte on air */
+#endif /* UWB_SIM_CONF_BYTE_NS */
+
+/*============================ TYPE DEFS =====================================*/
+/**
+ * Parameters of the simulation. All times are in ns of the simulated time.
+ */
+typedef struct{
+  uint32_t dmaLatencyNs;           /**< delay until a SPI DMA transfer starts,
+                                        the transfer itself takes
+                                        UWB_SIM_SPI_BYTE_NS per byte */
+  uint32_t irqLatencyNs;           /**< delay from the end of a transmission
+                                        to the edge on the IRQ line */
+}uwb_sim_conf_t;
+
+/**
+ * Statistics collected while the simulation runs.
+ */
+typedef struct{
+  uint32_t framesSent;             /**< transmissions completed by the PHY */
+  uint32_t framesAborted;          /**< transmissions cut off by a reset */
+  uint32_t dmaTransfers;           /**< SPI DMA transfers started */
+  uint32_t dmaBytes;               /**< bytes moved by SPI DMA */
+  uint64_t airtimeNs;              /**< time the PHY was transmitting */
+  uint64_t cpuBusyNs;              /**< simulated time the CPU spent busy
+                                        waiting in delay_us() and
+                                        hal_spi_dma_busy() */
+  uint32_t rxInjected;             /**< frames sent by the peer */
+  uint32_t rxReceived;             /**< frames received by the PHY */
+  uint32_t rxMissed;               /**< frames starting while the PHY was not
+                                        listening or cut off by a reset */
+  uint32_t events;                 /**< hardware events dispatched */
+}uwb_sim_stats_t;
+
+/*============================ PROTOTYPES ====================================*/
+void uwb_sim_configure(const uwb_sim_conf_t *conf);
+void uwb_sim_run(uint64_t ns);
+void uwb_sim_inject(uint32_t frames, uint8_t length, uint32_t gapNs);
+void uwb_sim_busy(uint32_t ns);
+uint64_t uwb_sim_now(void);
+const uwb_sim_stats_t *uwb_sim_get_stats(void);
+void uwb_sim_clear_stats(void);
+
+#endif /* UWB_SIM_H */